@@ -147,8 +147,14 @@ public:
     /// Page number of this nodes parent. Unused in root node.
     uint32_t parentPageNum;
 
+    /// Page number of the previous leaf in key order, 0 if none.
+    uint32_t prevPageNum;
+
+    /// Page number of the next leaf in key order, 0 if none.
+    uint32_t nextPageNum;
+
     /// Number of keys in this node.
-    uint8_t  numKeys;
+    uint16_t numKeys;
 
     /// 1 if this node is a leaf node, 0 otherwise.
     uint8_t  isLeaf;
@@ -157,7 +163,7 @@ public:
     uint8_t  pad0;
 
     /// must be zero.
-    uint8_t  pad1;
+    uint32_t pad1;
 };
 
 /**
@@ -215,6 +221,14 @@ public:
      * to by b. Undefined if a or b is invalid.
      */
     virtual int compare(const uint8_t *a, const uint8_t *b) = 0;
+
+    /**
+     * Return true if keys are 16 byte UUIDs ordered as by memcmp.
+     *
+     * findKeyPosition then uses KeySearch::findUUIDPosition instead
+     * of calling compare for every probe.
+     */
+    virtual bool isUUID() { return false; };
 };
 
 /**
@@ -226,6 +240,9 @@ public:
     /// Implement the required compare routine.
     int compare(const uint8_t *a, const uint8_t *b);
 
+    /// Use the UUID key search.
+    bool isUUID() { return true; };
+
     /**
      * Convenience routine to init btree size params.
      *
@@ -484,6 +501,10 @@ public:
      * associated values greater than or equal to key will be copied
      * to empty.
      *
+     * empty takes over the next link of full. The links between full
+     * and empty, and the prev link of the leaf after empty, need page
+     * numbers and must be set by the caller.
+     *
      * If false is returned full and empty are unchanged.
      *
      * @note Locking is the callers responsibility.
@@ -557,6 +578,8 @@ public:
      * If src or dst is null false is returned. If there are too many
      * keys false is returned.
      *
+     * dst takes over the sibling link of src that points away from
+     * dst. The caller must point that neighbour back at dst.
      *
      * @note Locking is the callers responsibility.
      *
@@ -19,6 +19,8 @@ public:
 	ERR_UNDERFLOW,
 	ERR_DUPLICATE_INSERT,
 	ERR_KEY_NOT_FOUND,
+	ERR_NO_SPACE,
+	ERR_IO,
 	ERR_UNKNOWN
     };
 
@@ -0,0 +1,128 @@
+#ifndef _HASHINDEX_H_
+#define _HASHINDEX_H_
+
+namespace dback {
+
+/**
+ * In memory hash table of fixed size keys and values.
+ *
+ * Used by R2BTree as a front index for exact match lookups, see the
+ * hash index section of the R2BTree overview. A find is one hash and
+ * usually one or two key compares, where the tree takes a compare
+ * search on every level.
+ *
+ * The table is open addressing with linear probing and Robin Hood
+ * placement: an entry being inserted takes the slot of any entry that
+ * is closer to its home slot, so every entry stays close to its home
+ * and a find can stop at the first entry closer to home than the key
+ * would be. Deletion shifts the entries after the slot back by one
+ * instead of leaving tombstones. The table doubles when it is 3/4
+ * full, past that the runs of slots an insert has to walk get long.
+ * A slot holds the probe distance, key and value together, so a find
+ * is usually a single cache miss.
+ *
+ * Keys are hashed and compared as bytes, so keys that compare equal
+ * must have the same bytes, as UUIDs do.
+ *
+ * @note Locking is the callers responsibility.
+ */
+class HashIndex {
+private:
+    uint32_t keySize;
+    uint32_t valSize;
+
+    /// 1 + keySize + valSize.
+    size_t slotSize;
+
+    /**
+     * The slots, each the probe distance of its entry plus 1, 0 if
+     * empty, then the key and the value.
+     */
+    std::vector<uint8_t> slots;
+
+    /// Number of slots - 1, the number of slots is a power of 2.
+    size_t mask;
+
+    /// Number of entries.
+    size_t count;
+
+    /// Slot being moved by insert.
+    std::vector<uint8_t> carry;
+
+public:
+    /// Number of slots of a new or cleared table.
+    static const size_t MIN_SLOTS = 16;
+
+    /// Distance from its home slot at which the table is grown.
+    static const uint8_t MAX_DIST = 255;
+
+    HashIndex(uint32_t keySize, uint32_t valSize);
+
+    /**
+     * Look up a key.
+     *
+     * @param [in]  key The key.
+     * @param [out] val Set to the value, may be NULL.
+     *
+     * @result true if found, false otherwise.
+     */
+    bool find(const uint8_t *key, uint8_t *val);
+
+    /**
+     * Add a key, or replace its value if it is there already.
+     *
+     * @result true if the key was added, false if it was replaced.
+     */
+    bool insert(const uint8_t *key, const uint8_t *val);
+
+    /**
+     * Remove a key.
+     *
+     * @result true if found, false otherwise.
+     */
+    bool remove(const uint8_t *key);
+
+    /// Remove every key and shrink to MIN_SLOTS.
+    void clear();
+
+    /**
+     * Grow so that n keys fit without growing again.
+     *
+     * Each time the table grows every entry is put in again, which
+     * for a large table takes longer than the inserts that led to it.
+     */
+    void reserve(size_t n);
+
+    /// Number of keys held.
+    size_t size() { return this->count; };
+
+    /// Bytes of memory used by the slots.
+    size_t memoryBytes() {
+	return (this->mask + 1) * this->slotSize;
+    };
+
+    uint32_t getKeySize() { return this->keySize; };
+    uint32_t getValSize() { return this->valSize; };
+
+    /**
+     * Exchange the entries with those of other, which must have the
+     * same key and value sizes.
+     */
+    void swap(HashIndex *other);
+
+private:
+    /// Home slot of a key.
+    size_t home(const uint8_t *key);
+
+    /// Set the number of slots and put every entry back.
+    void resize(size_t nSlots);
+
+    // disallow copy constructor
+    HashIndex(const HashIndex &);
+    // disallow assignment operator
+    void operator=(const HashIndex &);
+};
+
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef _KEYSEARCH_H_
+#define _KEYSEARCH_H_
+
+namespace dback {
+
+/**
+ * Key search routines for fixed key layouts.
+ *
+ * The btree findKeyPosition routines call a virtual compare for every
+ * probe of the binary search. When the key is known to be a 16 byte
+ * UUID ordered by memcmp the routines here are used instead. Each key
+ * is loaded as two 64 bit big endian words, so a probe is two integer
+ * compares. The binary search stops when a few keys remain and the
+ * last keys are handled with a branchless linear scan, which is
+ * cheaper than mispredicted branches over such a short range.
+ *
+ * Random UUIDs are spread evenly over the key space, so the position
+ * of a key can also be guessed from its value. The interpolation
+ * search does that from the first 8 bytes and scans from the guess,
+ * which usually takes two or three compares where the binary search
+ * takes log2 of the number of keys. Keys that are not spread evenly
+ * make the guess miss, and the search then falls back to a binary
+ * search of what is left.
+ */
+class KeySearch {
+public:
+    /// Number of keys left when the binary search switches to a scan.
+    static const uint32_t LINEAR_SCAN_KEYS = 8;
+
+    /**
+     * Search a sorted array of 16 byte UUID keys.
+     *
+     * @param [in]  keys Pointer to the first key.
+     * @param [in]  n    Number of keys.
+     * @param [in]  key  The key to look for.
+     * @param [out] idx  Position of the key, or where it should go.
+     *
+     * Keys are ordered as by memcmp. Has the same result as
+     * findKeyPosition: true if the key is found with its position in
+     * *idx, else false with the position it would be inserted at.
+     *
+     * @result true if found, false otherwise.
+     */
+    static bool findUUIDPosition(const uint8_t *keys, uint32_t n,
+				 const uint8_t *key, uint32_t *idx);
+
+    /// Keys scanned from the interpolated guess before falling back.
+    static const uint32_t INTERPOLATION_WINDOW = 8;
+
+    /**
+     * Search a sorted array of 16 byte UUID keys by interpolation.
+     *
+     * @param [in]  keys     Pointer to the first key.
+     * @param [in]  n        Number of keys.
+     * @param [in]  key      The key to look for.
+     * @param [out] idx      Position of the key, or where it should go.
+     * @param [out] probes   Number of keys compared with key.
+     * @param [out] fellBack true if the key was not within
+     *                       INTERPOLATION_WINDOW keys of the guess and
+     *                       a binary search was needed.
+     *
+     * Same result as findUUIDPosition.
+     *
+     * @result true if found, false otherwise.
+     */
+    static bool interpolateUUIDPosition(const uint8_t *keys, uint32_t n,
+					const uint8_t *key, uint32_t *idx,
+					uint32_t *probes, bool *fellBack);
+};
+
+}
+
+#endif
@@ -0,0 +1,538 @@
+#ifndef _PAGESTORE_H_
+#define _PAGESTORE_H_
+
+namespace dback {
+
+class WriteAheadLog;
+
+/**
+ * @page pagestore Page stores.
+ *
+ * The btree routines refer to pages by 32 bit page number - the
+ * values stored in non-leaf nodes are page numbers. A page store is
+ * what turns a page number into memory. All pages in a store have
+ * the same size. A page store only deals in raw pages, so the same
+ * store can be used for BTree and R2BTree pages.
+ *
+ * Page 0 is never handed out by a page store - it is reserved for
+ * the index header, and a page number of 0 is used to mean "no page".
+ *
+ * A page returned by getPage or allocPage is pinned - the page
+ * buffer will stay at the same address until releasePage is called.
+ * Each getPage and allocPage must be matched by one releasePage. The
+ * PagePin class can be used to make sure this happens.
+ */
+
+/**
+ * Used to abstract page storage.
+ *
+ * This is a pure virtual base class. Any class that wants to
+ * provide pages to a btree should inherit from this class.
+ */
+class PageStore {
+public:
+    virtual ~PageStore() {;};
+
+    /**
+     * Pin a page and return the page buffer.
+     *
+     * @param [in]  pageNum The page to look up.
+     * @param [out] err     Error info output.
+     *
+     * @result Pointer to the page buffer or NULL if the page could
+     * not be pinned. If NULL is returned err is set.
+     */
+    virtual uint8_t *getPage(uint32_t pageNum, ErrorInfo *err) = 0;
+
+    /**
+     * Unpin a page.
+     *
+     * @param [in] pageNum The page to unpin.
+     * @param [in] dirty   true if the page buffer was modified.
+     *
+     * After the last pin on a page is released the page buffer must
+     * not be used.
+     */
+    virtual void releasePage(uint32_t pageNum, bool dirty) = 0;
+
+    /**
+     * Allocate a new page.
+     *
+     * @param [out] pageNum Page number of the new page.
+     * @param [out] err     Error info output.
+     *
+     * The new page is returned pinned. The contents of the new page
+     * are undefined, the caller is expected to use one of the btree
+     * page init routines.
+     *
+     * @result Pointer to the new page buffer, or NULL if no page
+     * could be allocated. If NULL is returned err is set.
+     */
+    virtual uint8_t *allocPage(uint32_t *pageNum, ErrorInfo *err) = 0;
+
+    /**
+     * Return a page to the store.
+     *
+     * @param [in] pageNum The page to release, must not be pinned.
+     *
+     * After this call the page number may be handed out again by
+     * allocPage.
+     */
+    virtual void freePage(uint32_t pageNum) = 0;
+};
+
+/**
+ * Holds a pin on a single page.
+ *
+ * The pin is released when the PagePin is destroyed, or when a
+ * different page is pinned.
+ */
+class PagePin {
+private:
+    PageStore *ps;
+    uint32_t pageNum;
+    uint8_t *buf;
+    bool dirty;
+
+public:
+    PagePin() : ps(NULL), pageNum(0), buf(NULL), dirty(false) {;};
+    ~PagePin() { this->release(); };
+
+    /**
+     * Pin page pageNum from store s.
+     *
+     * Any page currently held is released first.
+     *
+     * @result The page buffer, or NULL if the page could not be pinned.
+     */
+    uint8_t *pin(PageStore *s, uint32_t pageNum, ErrorInfo *err);
+
+    /**
+     * Allocate a new page from store s and hold the pin on it.
+     *
+     * Any page currently held is released first. The new page is
+     * marked dirty.
+     *
+     * @result The page buffer, or NULL if no page could be allocated.
+     */
+    uint8_t *alloc(PageStore *s, uint32_t *pageNum, ErrorInfo *err);
+
+    /// Release the pin, if any.
+    void release();
+
+    /**
+     * Take over the pin held by other.
+     *
+     * Any page currently held is released first, other is left empty.
+     */
+    void moveFrom(PagePin *other);
+
+    /// Mark the page as modified, it is written back when released.
+    void setDirty() { this->dirty = true; };
+
+    /// Page buffer, NULL if no page is pinned.
+    uint8_t *getBuf() { return this->buf; };
+
+    /// Page number, 0 if no page is pinned.
+    uint32_t getPageNum() { return this->pageNum; };
+
+private:
+    // disallow copy constructor
+    PagePin(const PagePin &);
+    // disallow assignment operator
+    void operator=(const PagePin &);
+};
+
+/**
+ * Page store that keeps all pages in heap memory.
+ *
+ * Pages never move, so pinning is a no-op.
+ */
+class MemPageStore : public PageStore {
+private:
+    /// Size of each page in bytes.
+    uint32_t pageSize;
+
+    /// Indexed by page number, entry 0 is always NULL.
+    std::vector<uint8_t *> pages;
+
+    /// Page numbers that have been freed and can be reused.
+    std::vector<uint32_t> freeList;
+
+public:
+    /**
+     * @param [in] sz Size of each page in bytes.
+     */
+    MemPageStore(uint32_t sz);
+    ~MemPageStore();
+
+    uint8_t *getPage(uint32_t pageNum, ErrorInfo *err);
+    void releasePage(uint32_t pageNum, bool dirty);
+    uint8_t *allocPage(uint32_t *pageNum, ErrorInfo *err);
+    void freePage(uint32_t pageNum);
+
+    /// Number of pages currently allocated.
+    size_t numPages();
+
+private:
+    // disallow copy constructor
+    MemPageStore(const MemPageStore &);
+    // disallow assignment operator
+    void operator=(const MemPageStore &);
+};
+
+/**
+ * Page cache in front of a single index file.
+ *
+ * Page n of the file is at byte offset n * page size. The pool holds
+ * at most a fixed number of pages in memory, set by the memory budget
+ * given to the constructor. Pages that are not pinned are evicted
+ * using the CLOCK algorithm: each frame has a reference bit that is
+ * set on every hit and cleared as the clock hand passes. A frame is
+ * reused when the hand finds it unpinned with the reference bit
+ * clear. Dirty pages are written back when evicted and by flush.
+ *
+ * Hit and miss counts are kept so the memory budget can be sized
+ * against the hot set of a real index.
+ *
+ * After setLog the pool follows the write-ahead rule: the log is
+ * committed up to a page's LSN before the page is written, and pages
+ * holding WAL_LSN_PENDING are neither evicted nor flushed.
+ *
+ * The pool does not know about the index header in page 0, and never
+ * caches it. The list of freed pages is only kept in memory.
+ *
+ * All routines are thread safe.
+ */
+class BufferPool : public PageStore {
+private:
+    /// Book keeping for one cached page.
+    class Frame {
+    public:
+	/// Page held in this frame, 0 if the frame is empty.
+	uint32_t pageNum;
+	/// Number of outstanding pins.
+	uint32_t pinCount;
+	/// true if the page buffer differs from the file.
+	bool dirty;
+	/// CLOCK reference bit.
+	bool ref;
+    };
+
+    /// Size of each page in bytes.
+    uint32_t pageSize;
+
+    /// Number of frames, fixed by the memory budget.
+    size_t numFrames;
+
+    /// Page buffers for all frames, numFrames * pageSize bytes.
+    uint8_t *mem;
+
+    /// Frame info, indexed the same as mem.
+    std::vector<Frame> frames;
+
+    /// Maps page number to frame index for cached pages.
+    std::unordered_map<uint32_t, size_t> pageTable;
+
+    /// Next frame the CLOCK hand will look at.
+    size_t clockHand;
+
+    /// The index file, -1 if not open.
+    int fd;
+
+    /// Number of pages in the file, including page 0.
+    uint32_t numFilePages;
+
+    /// Page numbers that have been freed and can be reused.
+    std::vector<uint32_t> freeList;
+
+    /// Log committed before pages are written, NULL if none.
+    WriteAheadLog *wal;
+
+    /// Byte offset of the 64 bit LSN in each page.
+    uint32_t lsnOffset;
+
+    /// Protects everything above and the stats.
+    boost::mutex lock;
+
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nEvictions;
+    uint64_t nWrites;
+
+public:
+    /**
+     * @param [in] sz       Size of each page in bytes.
+     * @param [in] maxBytes Memory budget for cached pages. Atleast 8
+     *                      frames are always used.
+     */
+    BufferPool(uint32_t sz, size_t maxBytes);
+
+    /// Any dirty pages are written and the file closed.
+    ~BufferPool();
+
+    /**
+     * Open or create the index file.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool open(const char *path, ErrorInfo *err);
+
+    /**
+     * Write all dirty pages and sync the file.
+     *
+     * Pinned pages are written too, but stay pinned. Pages not yet
+     * logged are skipped, see setLog.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool flush(ErrorInfo *err);
+
+    /**
+     * Flush and close the file.
+     *
+     * No pages may be pinned. All cached pages are dropped.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool close(ErrorInfo *err);
+
+    uint8_t *getPage(uint32_t pageNum, ErrorInfo *err);
+    void releasePage(uint32_t pageNum, bool dirty);
+    uint8_t *allocPage(uint32_t *pageNum, ErrorInfo *err);
+    void freePage(uint32_t pageNum);
+
+    /**
+     * Follow the write-ahead rule for log.
+     *
+     * @param [in] log       The log, NULL to stop.
+     * @param [in] lsnOffset Offset of the page LSN, for R2BTree pages
+     *                       offsetof(R2PageHeader, lsn).
+     *
+     * log must stay open until the pool is closed.
+     */
+    void setLog(WriteAheadLog *log, uint32_t lsnOffset);
+
+    /// Number of page frames.
+    size_t getNumFrames() { return this->numFrames; };
+
+    /// Number of getPage calls that found the page cached.
+    uint64_t getNumHits();
+
+    /// Number of getPage calls that had to read the page.
+    uint64_t getNumMisses();
+
+    /// Number of pages evicted to make room.
+    uint64_t getNumEvictions();
+
+    /// Number of page writes to the file.
+    uint64_t getNumWrites();
+
+    /// Hits divided by total lookups, 0 if there were no lookups.
+    double getHitRatio();
+
+    /// Set all counters to 0.
+    void resetStats();
+
+private:
+    /**
+     * Find a frame to hold a new page.
+     *
+     * Lock must be held. Writes back the victim if dirty.
+     */
+    bool findVictim(size_t *idx, ErrorInfo *err);
+
+    /// Write frame idx to the file. Lock must be held.
+    bool writeFrame(size_t idx, ErrorInfo *err);
+
+    /// false if frame idx holds a page not yet logged. Lock must be held.
+    bool canWrite(size_t idx);
+
+    /// Write all dirty frames. Lock must be held.
+    bool writeAll(ErrorInfo *err);
+
+    // disallow copy constructor
+    BufferPool(const BufferPool &);
+    // disallow assignment operator
+    void operator=(const BufferPool &);
+};
+
+/**
+ * Layout of the start of page 0 in a MMapPageStore file.
+ *
+ * The index header (an IndexHeader or R2IndexHeader) is stored right
+ * after this, see MMapPageStore::getIndexHeader.
+ */
+class MMapFileHeader {
+public:
+    /// Always MMapPageStore::MAGIC.
+    uint32_t magic;
+
+    /// File format version, currently 1.
+    uint32_t version;
+
+    /// Size of each page in bytes.
+    uint32_t pageSize;
+
+    /// Number of pages in use, including page 0 and free pages.
+    uint32_t numPages;
+
+    /// First page on the free list, 0 if the list is empty.
+    uint32_t freeListHead;
+
+    /// Number of pages on the free list.
+    uint32_t numFree;
+};
+
+/**
+ * Page store that maps a single index file into memory.
+ *
+ * Page n is at byte offset n * page size, and getPage simply returns
+ * the address of the page in the mapping. Pinning is a no-op since
+ * pages never move - the whole address range the file can grow
+ * into is reserved when the file is opened. The file grows as pages
+ * are allocated.
+ *
+ * Page 0 holds a MMapFileHeader followed by the btree index header,
+ * so after open the index header can be used in place and the tree is
+ * immediately ready for lookups. Changes to the header, such as a new
+ * root page number, are written back with the pages. Freed pages are
+ * kept on a list chained through the first 4 bytes of each free page.
+ *
+ * Data is only guaranteed to be on disk after flush.
+ */
+class MMapPageStore : public PageStore {
+public:
+    /// Value of MMapFileHeader::magic.
+    static const uint32_t MAGIC = 0x64627831;
+
+    /// Expected access pattern, passed to madvise.
+    enum AccessHint {
+	AccessNormal,
+	AccessRandom,
+	AccessSequential,
+	AccessWillNeed
+    };
+
+private:
+    /// Size of address range reserved for the mapping.
+    size_t maxBytes;
+
+    /// Start of the mapping, NULL if not open.
+    uint8_t *base;
+
+    /// Bytes of the file currently mapped, same as the file size.
+    size_t mappedBytes;
+
+    /// The index file, -1 if not open.
+    int fd;
+
+    /// Header at the start of page 0.
+    MMapFileHeader *fileHeader;
+
+public:
+    /**
+     * @param [in] maxBytes Largest size the file will be allowed to
+     *                      grow to. This much address space is
+     *                      reserved, but no memory is used for it.
+     */
+    MMapPageStore(size_t maxBytes);
+
+    /// The file is closed, without a flush.
+    ~MMapPageStore();
+
+    /**
+     * Create a new index file.
+     *
+     * Any existing file is truncated. The index header area in page
+     * 0 is zero filled.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool create(const char *path, uint32_t pageSize, ErrorInfo *err);
+
+    /**
+     * Open an existing index file.
+     *
+     * The page size is read from the file.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool open(const char *path, ErrorInfo *err);
+
+    /**
+     * Write modified pages to disk.
+     *
+     * @param [in]  wait If true block until the data is on disk, if
+     *                   false only start the writes.
+     * @param [out] err  Error info output.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool flush(bool wait, ErrorInfo *err);
+
+    /**
+     * Flush and close the file.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool close(ErrorInfo *err);
+
+    /**
+     * Tell the kernel how the index will be accessed.
+     *
+     * AccessRandom is best for point lookups, AccessSequential for
+     * full scans or rebuilds, AccessWillNeed starts reading the whole
+     * file in.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool setAccessHint(AccessHint h, ErrorInfo *err);
+
+    /**
+     * Space in page 0 for the btree index header.
+     *
+     * The address is fixed while the file is open.
+     */
+    uint8_t *getIndexHeader();
+
+    /// Size in bytes of the index header space.
+    size_t getIndexHeaderSize();
+
+    /// Page size of the open file.
+    uint32_t getPageSize();
+
+    uint8_t *getPage(uint32_t pageNum, ErrorInfo *err);
+    void releasePage(uint32_t pageNum, bool dirty);
+    uint8_t *allocPage(uint32_t *pageNum, ErrorInfo *err);
+    void freePage(uint32_t pageNum);
+
+    /// Number of pages in use, not counting page 0 or free pages.
+    size_t numPages();
+
+private:
+    /// Map the file, which is mappedBytes long, into a new reservation.
+    bool mapFile(ErrorInfo *err);
+
+    /// Grow the file and mapping to atleast need bytes.
+    bool grow(size_t need, ErrorInfo *err);
+
+    /// Unmap and close without writing anything.
+    void unmap();
+
+    // disallow copy constructor
+    MMapPageStore(const MMapPageStore &);
+    // disallow assignment operator
+    void operator=(const MMapPageStore &);
+};
+
+}
+
+/*
+Local Variables:
+mode: c++
+c-basic-offset: 4
+End:
+*/
+
+#endif
@@ -103,6 +103,371 @@ namespace dback {
  * non-leaf nodes is fixed and the offset of the key and value arrays
  * for leaf and non-leaf nodes is also fixed.
  *
+ * @section r2tree Tree level operations
+ *
+ * The block* routines, splitNode, concatNodes and redistributeNodes
+ * all work on a single page (or a pair of pages). The tree level
+ * routines insert, find and erase work on the whole tree - they start
+ * at the root page named in the R2IndexHeader and use a PageStore to
+ * turn child page numbers into page buffers.
+ *
+ * The tree level routines use non-leaf nodes with exactly one child
+ * per key. Key i of a non-leaf node is a lower bound for all keys
+ * stored under child i, so child i holds the keys k where
+ * key[i] <= k < key[i+1]. Keys smaller than key 0 are also found
+ * under child 0, and insert lowers key 0 when a smaller key goes
+ * under child 0 so the keys of a node are always sorted. This is
+ * the same key/value pairing that splitNode, concatNodes and
+ * redistributeNodes use, so those routines work unchanged on
+ * non-leaf nodes. The extra value slot is not used.
+ *
+ * insert splits full nodes on the way down, so a split never has to
+ * propagate back up the tree. When the root is full a new root is
+ * allocated above it. erase removes the key from the leaf and then
+ * walks back up the path it came down, fixing underflowing nodes by
+ * concatenating with or borrowing keys from a sibling. When the root
+ * is a non-leaf node with a single child the child becomes the root.
+ *
+ * The tree level routines remember the path taken from the root, no
+ * page holds the number of its parent. Pages are pinned in the page
+ * store only while they are being used, at most three at a time, so
+ * a BufferPool smaller than the index can be used.
+ *
+ * The pages of each level are linked to their neighbours in key
+ * order through prevPageNum and nextPageNum, so an R2Cursor can walk
+ * the leaves without going back to the root. splitNode and
+ * concatNodes carry over the links that point outside the pair of
+ * nodes, the tree level routines fill in the rest since they know
+ * the page numbers. Each page also holds its level, 0 for leaves.
+ *
+ * bulkLoad builds a whole tree from keys that are already sorted. It
+ * fills pages left to right, so it is much faster than inserting the
+ * keys one at a time and can leave every page full.
+ *
+ * @section r2olc Concurrent find and insert
+ *
+ * findConcurrent and insertConcurrent can be called from any number
+ * of threads at once. They use the R2Latch in each page header and
+ * the sibling links, as in the B-link tree of Lehman and Yao.
+ *
+ * A page covers the keys from its first key up to, but not
+ * including, the first key of the next page at its level, which
+ * serves as its high key. A page that is split keeps the lower half
+ * of its keys and links to the new page holding the upper half
+ * before anything else can see either page. Until the new page is
+ * added to the parent the parent still sends its keys to the old
+ * page, and the search follows the link to the right. A key is only
+ * compared with the first key of the next page when it is larger
+ * than the last key of the page, so this is rarely needed.
+ *
+ * findConcurrent takes no latches. It notes the version of a page,
+ * reads it and checks the version again, reading the page again if
+ * it changed. A page that was split under the reader is left by the
+ * link to the right, so the search never starts over at the root.
+ *
+ * insertConcurrent finds the leaf the same way, then latches it,
+ * moving right if needed. If the leaf is full it is split, the latch
+ * is let go, and the new page is added to the page one level up,
+ * which is found and latched the same way and may be split in turn.
+ * So only one page on the path is latched at a time, plus the new
+ * root when the root is split and the next page while its prev link
+ * is set. Latches are only waited on to the right, so writers cannot
+ * deadlock. The root page number only changes while the old root is
+ * latched.
+ *
+ * erase, bulkLoad, R2Cursor and the non concurrent insert and find
+ * must not run at the same time as any other operation on the tree.
+ * Pages are never freed by insertConcurrent, which is what lets a
+ * reader safely look at a page it is not sure is still in the tree.
+ * Allocation from ps is serialized by the tree, but ps must allow
+ * getPage while another thread allocates. BufferPool and
+ * MMapPageStore do, MemPageStore does not.
+ *
+ * @section r2wal Logging
+ *
+ * If wal is set, initTree, insert and erase append one group to the
+ * WriteAheadLog for each call, so a crash never leaves half of a
+ * split or a merge in the index file. A call that only changes one
+ * leaf, which is most of them, logs a physiological insert or remove
+ * record naming the slot. A call that changes more pages logs the
+ * after-image of every page it changed. A change to the root page
+ * number is logged too. Each page changed is stamped with the LSN of
+ * the group.
+ *
+ * While a call runs the pages it changed hold WAL_LSN_PENDING. The
+ * page store must not write such pages back, and must commit the log
+ * up to a page's LSN before writing it back. BufferPool does both
+ * after BufferPool::setLog. MMapPageStore cannot, since the kernel
+ * writes pages back when it likes.
+ *
+ * The tree routines only append, the caller commits. Writers that
+ * serialize their inserts with a lock can commit after letting go
+ * of it, so the commits of many writers share one log write. After
+ * a crash recover replays the log. bulkLoad and insertConcurrent are
+ * not logged and fail if wal is set.
+ *
+ * @section r2prefix Key prefixes
+ *
+ * Composite keys, such as a machine id followed by a timestamp, put
+ * many keys with the same leading bytes in each leaf. If prefixKeys
+ * is set the bytes every key of a leaf must share are stored once, in
+ * front of the key array, and each key slot only holds the rest. The
+ * page then has room for more keys. The prefix length is kept in the
+ * page header and the layout of a page with no prefix is unchanged,
+ * so pages of both kinds can be read by every routine.
+ *
+ * A leaf holds the keys from the separator for it in its parent up to
+ * the next separator. Keys are ordered as by memcmp, so every key that
+ * can ever be stored in the leaf starts with the bytes those two
+ * separators have in common, and that is the prefix. It is worked
+ * out when a leaf is split, concatenated or given keys by a sibling,
+ * and a later insert cannot break it. The first and last child of a
+ * parent have only one separator at hand, and keep the prefix they
+ * had, or none. The leftmost and rightmost leaves of the tree never
+ * have a prefix.
+ *
+ * When a leaf is split the separator put in the parent is the
+ * shortest prefix of the first key of the new page that is larger
+ * than the last key left behind, padded with zero bytes. Non-leaf
+ * pages keep fixed size key slots, so this does not add separators
+ * to them, but it gives the leaves below longer common prefixes.
+ *
+ * The prefix length, and so the number of keys, differs from leaf to
+ * leaf. maxKeys gives the limit of a page, minNumKeys is unchanged.
+ * prefixKeys needs keys for which R2KeyInterface::isBytewise is true,
+ * and is not supported by insertConcurrent and findConcurrent, which
+ * fail. bulkLoad builds leaves with no prefix, they get one when they
+ * are next split or merged.
+ *
+ * @section r2cow Snapshots
+ *
+ * If copyOnWrite is set, takeSnapshot gives a point in time view of
+ * the tree that can be searched and scanned by other threads, with
+ * no locks, while insert and erase carry on.
+ *
+ * The tree has a generation, and every page holds the generation it
+ * was written in. takeSnapshot notes the root page number and the
+ * generation and then moves the tree to the next generation. A page
+ * can only be reached from the snapshots taken after it was written,
+ * so insert and erase change a page in place if no snapshot that
+ * new is still held. Any other page on the way down is first copied
+ * to a new page, and the parent, which is already safe to change, is
+ * pointed at the copy. A copied root becomes the new root. So each
+ * snapshot costs one copy of each page changed while it is held, not
+ * a copy of the index, and with no snapshot held nothing is copied.
+ *
+ * The pages that were copied are retired with the generation they
+ * were replaced in, and returned to ps once every snapshot older
+ * than that has been released.
+ *
+ * insert and erase hold a lock while they run, which takeSnapshot
+ * also takes, so a snapshot is only ever taken between two calls and
+ * the root swap it sees is atomic. The lock is not held while a
+ * snapshot is read.
+ *
+ * Sibling links would have to be changed in pages that are not on
+ * the path, so they are not kept up to date in copy-on-write mode.
+ * R2Cursor moves between leaves through the parent pages instead,
+ * and findConcurrent and insertConcurrent, which need the links,
+ * fail. Snapshots read pages while the writer allocates, so ps must
+ * allow that, as for insertConcurrent.
+ *
+ * @section r2layout Non-leaf page layout
+ *
+ * Binary search of the key array of a non-leaf page touches a new
+ * cache line on almost every probe, around 8 of them in a 4K page of
+ * 16 byte keys, and every find makes that search once per level.
+ *
+ * A tree whose R2BTreeParams::nonLeafLayout is R2LayoutIndexed keeps
+ * a small search index in each non-leaf page, a static B+tree whose
+ * nodes are one cache line of keys each. The key array is cut into
+ * blocks of as many keys as fill a cache line, and the first key of
+ * each block but the first goes into the level above, which is cut
+ * up the same way until one block is left. A search reads one block
+ * per level, the top one first, and ends in a single block of the
+ * key array, so it touches 3 or 4 cache lines per page. The key
+ * array starts on a cache line boundary.
+ *
+ * The index copies about one key in every block, so non-leaf pages
+ * hold fewer keys, a quarter fewer for 16 byte keys. It is rebuilt
+ * whenever the keys of a page are changed, which is once per split,
+ * except for key 0, which is never indexed. Leaves are unchanged, and
+ * the sorted key array stays as it was, so every other routine works
+ * on it as before. R2BTreeT only handles R2LayoutSorted.
+ *
+ * @section r2slotted Slotted leaves
+ *
+ * Inserting into or removing from a leaf shifts the keys and values
+ * after the slot, so with large values most of the cost of an insert
+ * is moving values that did not change.
+ *
+ * A tree whose R2BTreeParams::leafLayout is R2LeafSlotted keeps the
+ * values of each leaf in a heap of fixed size cells, in the order
+ * they were added, and a sorted array of 16 bit cell numbers in its
+ * place. An insert puts the value in the next unused cell and shifts
+ * two bytes per later key instead of the value. A remove leaves its
+ * cell behind. When every cell has been used and a key is added, the
+ * heap is compacted, which writes the values back in key order. This
+ * happens at most once every maxKeys - numKeys inserts. Routines that
+ * move runs of values between pages, splits, merges and bulk loads,
+ * compact the pages first and then work as on sorted leaves.
+ *
+ * The keys stay in their sorted array, which searches need, so an
+ * insert still moves the later keys. The slot array costs each leaf
+ * two bytes per key of room. R2BTreeT only handles R2LeafSorted.
+ *
+ * @section r2var Variable length values
+ *
+ * Leaf values have one size, valSize, so values that vary in length
+ * would have to be padded to the longest. If R2BTreeParams::varValues
+ * is set valSize is instead the size of a slot, chosen to fit the
+ * common values, and insertVar and findVar store and read values of
+ * any length. A value that fits the slot, with its 4 byte length, is
+ * kept in the leaf. A longer one is written to a chain of overflow
+ * pages, linked through nextPageNum, and the slot holds the length and
+ * the first page number.
+ *
+ * Overflow pages are written once and never changed. erase frees the
+ * chain of the value it removes, or in copy-on-write mode retires it
+ * like a copied page if a snapshot can still reach it. The pages are
+ * logged with the leaf when wal is set.
+ *
+ * Everything else, find, insert, the cursor, insertBatch, bulkLoad,
+ * the concurrent routines and R2BTreeT, sees the slots as plain
+ * valSize values. readValue turns a slot into its value.
+ *
+ * @section r2varkey Variable length keys
+ *
+ * Keys are fixed size slots, so strings such as paths are kept in
+ * slots of keySize bytes by R2VarKey, which holds strings of up to
+ * keySize - 2 bytes. The string is padded with zero bytes and its
+ * length is put in the last two bytes, big endian. memcmp on such
+ * slots gives the order of the strings, with a string before any
+ * longer string it starts, so isBytewise is true.
+ *
+ * R2VarKey::compare loads the first R2_NORMALIZED_KEY_SIZE bytes of
+ * each slot as a big endian integer, the normalized key, and only
+ * compares the rest of the slots if the integers are equal. Keys that
+ * differ in their first 8 bytes, which is most keys near the root,
+ * take one integer compare.
+ *
+ * Slots padded to the longest string would waste most of the leaves.
+ * With prefixKeys set, which R2VarKey allows, the leading bytes the
+ * keys of a leaf share, such as a directory or a machine id, are kept
+ * once per leaf, and each key only holds the rest of its slot.
+ *
+ * @section r2max Largest values
+ *
+ * Finding the largest blocks of a tree keyed by UUID would take a
+ * scan of every leaf. If R2BTreeParams::subtreeMax is set each leaf
+ * value holds an unsigned 64 bit field, such as a block size, at
+ * maxOffset, and each non-leaf value holds, after the child page
+ * number, the largest field in the subtree of that child.
+ * findLargest then walks the tree best first, always opening the
+ * page or taking the entry with the largest field not yet looked at,
+ * and returns the k largest entries having read little more than the
+ * k paths to them.
+ *
+ * insert raises the maxima on the path to its leaf, stopping at the
+ * first one that is large enough already. erase, splits, merges and
+ * moves between siblings recompute the maxima of the pages they
+ * change from the pages below, and bulkLoad computes them all once
+ * the tree is built. Each non-leaf key takes 8 more bytes, so
+ * non-leaf pages hold somewhat fewer keys. The field is kept in host
+ * byte order. subtreeMax cannot be used with varValues, and
+ * insertConcurrent and R2BTreeT do not handle it.
+ *
+ * @section r2count Counts and sums
+ *
+ * Questions such as how many blocks a machine has, or how many bytes
+ * they take, would take a scan of every leaf in the key range. If
+ * R2BTreeParams::subtreeCounts is set each non-leaf value also holds
+ * the number of leaf entries in the subtree of that child, and with
+ * subtreeSums the sum of an unsigned 64 bit field, such as a block
+ * size, at sumOffset in their values. rank then adds up the counts
+ * and sums of the children left of the path to a key, select follows
+ * the counts down to the entry at a position, and count gives the
+ * entries and the sum between two keys as the difference of two
+ * ranks, each reading one page per level.
+ *
+ * Every insert and erase changes the count on each level of its
+ * path, so the whole path is walked up rather than stopping early as
+ * for the maxima. When nothing else changes, each count change is
+ * logged as a small R2LogCount record rather than a page image.
+ * Splits, merges and moves between siblings recompute the counts of
+ * the pages they change, and bulkLoad computes them all once the tree
+ * is built. Each non-leaf key takes 8 more bytes for the count and 8
+ * for the sum. Sums wrap around at 2^64, and the field is kept in
+ * host byte order. subtreeSums cannot be used with varValues;
+ * insertConcurrent and R2BTreeT do not handle either.
+ *
+ * @section r2append Appending keys
+ *
+ * Keys such as timestamps or sequence numbers mostly arrive in
+ * increasing order, and each goes to the end of the rightmost leaf.
+ * insert remembers that leaf, and a key larger than the last key in
+ * it is added there without going down from the root or searching
+ * the leaf, until the leaf is full. The leaf is checked on every use,
+ * so a leaf that was split, merged or freed since is just forgotten.
+ * This is not done in copy-on-write mode or with subtreeMax or
+ * subtreeCounts, where the path from the root has to be walked
+ * anyway.
+ *
+ * An even split of the rightmost leaf leaves a half empty page behind
+ * that no later key goes to, so an index built by appending ends up
+ * about half full. If appendSplit is set, a full page on the right
+ * edge of the tree that is split for a key past all its keys keeps
+ * its keys: a leaf moves none of them to the new page, and a non-leaf
+ * moves only its last two. Pages built by appending are then full.
+ * The new pages start out below minNumKeys, which erase copes with
+ * like any other underflow; a non-leaf keeps two children so that the
+ * one that underflows has a sibling to merge with.
+ *
+ * @section r2hash Hash index
+ *
+ * Most lookups ask whether a block is there by its UUID and need no
+ * order. If hashIndex is set find and findBatch look the key up in
+ * that HashIndex, which holds every key of the tree with its leaf
+ * value, and never read a page. A key missing from the hash index is
+ * not in the tree. insert, insertBatch, erase and bulkLoad keep the
+ * hash index in step with the leaves, and initTree empties it.
+ *
+ * The hash index holds values rather than leaf page numbers, so splits,
+ * merges and moves between siblings, which move entries from page to
+ * page, do not touch it. It lives in memory only: loadHashIndex fills
+ * it from the tree, which recover does after the log is replayed. It
+ * takes between 4/3 and 8/3 times keySize + valSize + 1 bytes per
+ * key. Keys that compare equal must have the same bytes. The hash index
+ * describes the tree as it is now, findSnapshot does not use it, and
+ * insertConcurrent does not keep it.
+ *
+ * @section r2bloom Bloom filter
+ *
+ * Most dedup lookups ask about blocks the pool does not hold, and
+ * each such find goes down every level only to miss in the leaf. If
+ * bloomFilter is set find and findBatch first test the key against
+ * that BloomFilter, and a key it rules out is reported missing
+ * without reading a page or, with a hash index, probing it. A key the
+ * filter passes is looked up as usual, so a false positive costs one
+ * test more than without the filter.
+ *
+ * insert, insertBatch and bulkLoad add keys to the filter, initTree
+ * empties it. Keys cannot be taken out of a Bloom filter, so erase
+ * leaves the key in and it goes on costing a full lookup; after many
+ * erases loadBloomFilter rebuilds the filter from the tree. The filter
+ * is not logged: recover rebuilds it after the log is replayed. A
+ * tree opened without recovery can instead load the filter with
+ * BloomFilter::load from a file written by BloomFilter::save when the
+ * header was last saved, which avoids reading every leaf. Such a file
+ * is only good for the tree as it was when saved.
+ *
+ * There is one filter for the whole tree rather than one per leaf. A
+ * filter per leaf would only be reached after the descent it is meant
+ * to save, and its bits would have to move with the keys on every
+ * split and merge. Like the hash index, the filter hashes key bytes,
+ * findSnapshot does not use it, and insertConcurrent does not keep
+ * it.
+ *
  */
 
 /**
@@ -113,7 +478,48 @@ namespace dback {
  */
 enum PageType {
     PageTypeNonLeaf,
-    PageTypeLeaf
+    PageTypeLeaf,
+    /// Part of a value too long for its leaf, see R2IndexHeader::varValues.
+    PageTypeOverflow
+};
+
+/**
+ * Layout of the keys in non-leaf pages, see the overview.
+ */
+enum R2NonLeafLayout {
+    /// One sorted key array, searched by binary search.
+    R2LayoutSorted,
+    /// Sorted key array and a cache line sized search index.
+    R2LayoutIndexed
+};
+
+/**
+ * Layout of the values in leaf pages, see the overview.
+ */
+enum R2LeafLayout {
+    /// Values in an array kept in key order.
+    R2LeafSorted,
+    /// Values in a heap, reached through an array of cell numbers.
+    R2LeafSlotted
+};
+
+/**
+ * Types of the log records written by R2BTree.
+ */
+enum R2LogType {
+    /// After-image of a whole page.
+    R2LogPage = 1,
+    /// Key inserted into a leaf: uint32_t slot, key, value.
+    R2LogInsert,
+    /// Key removed from a leaf: uint32_t slot.
+    R2LogRemove,
+    /// New root, the page number of the record is the root.
+    R2LogRoot,
+    /**
+     * Subtree count of a non-leaf entry changed: uint32_t slot, then
+     * int64_t changes to the count and to the sum.
+     */
+    R2LogCount
 };
 
 /**
@@ -150,39 +556,246 @@ public:
      * of keys to preserve the btree property.
      */
     uint32_t minNumKeys[2];
+
+    /// Page number of the root node, 0 if no tree has been created.
+    uint32_t rootPageNum;
+
+    /// Page format, R2_FORMAT_VERSION when made by initIndexHeader.
+    uint32_t formatVersion;
+
+    /// R2NonLeafLayout of the non-leaf pages.
+    uint32_t nonLeafLayout;
+
+    /// R2LeafLayout of the leaf pages.
+    uint32_t leafLayout;
+
+    /**
+     * Non-zero if leaf values are variable length.
+     *
+     * Each leaf value is then a slot of valSize bytes, made by
+     * R2BTree::insertVar. Its first 4 bytes hold the length of the
+     * value. A value of up to valSize - 4 bytes follows in the slot,
+     * a longer one is kept in a chain of overflow pages and the slot
+     * holds the page number of the first.
+     */
+    uint32_t varValues;
+
+    /**
+     * Non-zero if non-leaf values hold a subtree maximum.
+     *
+     * Each non-leaf value is then the child page number followed by
+     * the largest uint64_t found at maxOffset in the leaf values under
+     * that child, see R2BTree::findLargest.
+     */
+    uint32_t subtreeMax;
+
+    /// Offset in each leaf value of the field subtreeMax keeps.
+    uint32_t maxOffset;
+
+    /**
+     * Non-zero if non-leaf values hold a subtree count.
+     *
+     * Each non-leaf value then holds, after the page number and the
+     * maximum if any, the number of leaf entries under that child,
+     * see R2BTree::rank.
+     */
+    uint32_t subtreeCounts;
+
+    /**
+     * Non-zero if non-leaf values also hold a subtree sum.
+     *
+     * Needs subtreeCounts. The sum of the uint64_t found at sumOffset
+     * in the leaf values under each child follows its count.
+     */
+    uint32_t subtreeSums;
+
+    /// Offset in each leaf value of the field subtreeSums adds up.
+    uint32_t sumOffset;
 };
 
+/**
+ * Page format written by this code.
+ *
+ * Version 1 pages had 8 bit key counts, so no page could hold more
+ * than 255 keys. Version 2 pages have 16 bit key counts and leaf
+ * sibling links. Version 3 pages drop the unused value count and
+ * have a latch version in the page header. Version 4 pages are linked
+ * to their neighbours at every level and hold their level. Version 5
+ * pages hold the log sequence number of their last logged change.
+ * Version 6 pages replace the unused parent page number with the
+ * length of a key prefix shared by the keys of a leaf. Version 7
+ * index headers hold the layout of non-leaf pages. Version 8 replaces
+ * the unused spare page header field with the number of heap cells of
+ * a slotted leaf, and index headers hold the layout of leaves.
+ * Version 9 adds overflow pages and variable length values. Version
+ * 10 non-leaf pages can hold the largest value field of each subtree.
+ * Version 11 non-leaf pages can hold the number of entries of each
+ * subtree and the sum of a value field.
+ */
+static const uint32_t R2_FORMAT_VERSION = 11;
+
+/// Bytes in a cache line, the block size of R2LayoutIndexed.
+static const uint32_t R2_CACHE_LINE = 64;
+
+/// Largest number of keys a page can hold, limited by numKeys.
+static const uint32_t R2_MAX_KEYS_PER_PAGE = 0xffff;
+
+/// Number of keys findBatch descends with at once.
+static const uint32_t R2_FIND_GROUP = 16;
+
+/// Leading key bytes R2VarKey compares as one integer.
+static const uint32_t R2_NORMALIZED_KEY_SIZE = 8;
+
 /**
  * Initial bytes of a btree page - leaf and non-leaf.
  *
  * Describes the kind of page - leaf or non-leaf. Also has
- * links to parent.
+ * links to siblings.
  */
 class R2PageHeader {
 public:
-    /// Page number of this nodes parent. Unused in root node.
-    uint32_t parentPageNum;
+    /**
+     * Number of leading key bytes stored once for the whole page.
+     *
+     * Only leaves have a prefix, see R2BTree::prefixKeys. 0 if none.
+     */
+    uint16_t prefixLen;
 
-    /// Number of keys in this node.
-    uint8_t  numKeys;
+    /**
+     * Number of value cells used in the heap of a slotted leaf.
+     *
+     * Some of them may be free, see R2LeafSlotted. 0 in other pages.
+     */
+    uint16_t numCells;
+
+    /// Page number of the previous leaf in key order, 0 if none.
+    uint32_t prevPageNum;
 
-    /// Number of values - non-leaf nodes have one more value than n keys.
-    uint8_t  numVals;
+    /// Page number of the next leaf in key order, 0 if none.
+    uint32_t nextPageNum;
+
+    /// Number of keys in this node.
+    uint16_t numKeys;
 
     /**
      * Type of this page.
      *
      * 0 = non-leaf
      * 1 = leaf
+     * 2 = overflow
      *
-     * The page type can be used to index into the valSize and maxNumKeys
-     * arrays in the R2IndexHeader.
+     * The page type of a non-leaf or leaf page can be used to index
+     * into the valSize and maxNumKeys arrays in the R2IndexHeader.
      *
      */
     uint8_t  pageType;
 
-    /// Padding to make header be 32 bit aligned, must be 0.
-    uint8_t pad;
+    /// Height of the page above the leaves, 0 for leaf pages.
+    uint8_t level;
+
+    /**
+     * Latch version, see R2Latch.
+     *
+     * Even when the page is not latched. Only changed through R2Latch.
+     */
+    uint32_t version;
+
+    /**
+     * Tree generation the page was written in, see R2BTree::copyOnWrite.
+     *
+     * 0 for trees that never took a snapshot.
+     */
+    uint32_t generation;
+
+    /**
+     * LSN of the last logged change to this page, see WriteAheadLog.
+     *
+     * 0 if the page was never changed under a log, WAL_LSN_PENDING
+     * while an operation that changed it has not been logged yet.
+     */
+    uint64_t lsn;
+};
+
+/**
+ * Optimistic latch on a page, kept in R2PageHeader::version.
+ *
+ * A writer sets the low bit of the version while it holds the latch,
+ * and when it lets go the version moves on to the next even number if
+ * the page was changed, or goes back to what it was if not.
+ *
+ * A reader does not take the latch. It notes the version with
+ * readLock, reads what it needs from the page and then calls
+ * validate. If the version moved the page changed under the reader,
+ * what it read may be torn and it must start over. Readers never
+ * write to the page, so unlike a shared lock, many readers of the
+ * same page on different cores do not fight over its cache line.
+ *
+ * A page must stay pinned while it is being read or latched.
+ */
+class R2Latch {
+public:
+    /**
+     * Wait until no writer holds the latch and return the version.
+     */
+    static uint32_t readLock(R2PageHeader *h);
+
+    /**
+     * Return true if the version is still v.
+     *
+     * Reads of the page done before the call can be trusted if true
+     * is returned.
+     */
+    static bool validate(R2PageHeader *h, uint32_t v);
+
+    /// Take the latch for writing, waiting for any other writer.
+    static void lock(R2PageHeader *h);
+
+    /**
+     * Let go of a latch taken by lock.
+     *
+     * @param [in] h       The page header.
+     * @param [in] changed True if the page was changed while latched.
+     */
+    static void unlock(R2PageHeader *h, bool changed);
+};
+
+/**
+ * Holds the write latch on a single page.
+ *
+ * The latch is released when the R2WriteLatch is destroyed, or when
+ * a different page is latched. Declare it after the PagePin of the
+ * same page so the latch is let go before the pin.
+ */
+class R2WriteLatch {
+private:
+    R2PageHeader *header;
+    bool changed;
+
+public:
+    R2WriteLatch() : header(NULL), changed(false) {;};
+    ~R2WriteLatch() { this->release(); };
+
+    /// Latch h, any page currently held is released first.
+    void lock(R2PageHeader *h);
+
+    /// Release the latch, if any.
+    void release();
+
+    /**
+     * Take over the latch held by other.
+     *
+     * Any page currently held is released first, other is left empty.
+     */
+    void moveFrom(R2WriteLatch *other);
+
+    /// Note the page was changed, readers of it will start over.
+    void setChanged() { this->changed = true; };
+
+private:
+    // disallow copy constructor
+    R2WriteLatch(const R2WriteLatch &);
+    // disallow assignment operator
+    void operator=(const R2WriteLatch &);
 };
 
 /**
@@ -196,8 +809,10 @@ public:
     /**
      * Pointer to array of keys.
      *
-     * Key size is fixed at the time of btree creation.
-     *
+     * Key size is fixed at the time of btree creation. In a page with
+     * a key prefix the prefixLen bytes just before the array hold the
+     * prefix, and each key holds only the keySize - prefixLen bytes
+     * after it.
      */
     uint8_t *keys;
 
@@ -210,8 +825,16 @@ public:
      * @note In the case of a non-leaf node there will also be an
      * extra value. The extra pointer is stored at the end of the
      * array.
+     *
+     * In a slotted leaf this is the value heap, and the value of key i
+     * is in cell slots[i].
      */
     uint8_t *vals;
+
+    /// Cell numbers of the values of a slotted leaf, NULL otherwise.
+    uint16_t *slots;
+
+    R2PageAccess() : header(NULL), keys(NULL), vals(NULL), slots(NULL) {;};
 };
 
 /**
@@ -227,6 +850,40 @@ public:
     uint32_t keySize;
     /// Size of user value in bytes.
     uint32_t valSize;
+    /// R2NonLeafLayout, R2LayoutSorted by default.
+    uint32_t nonLeafLayout;
+    /// R2LeafLayout, R2LeafSorted by default.
+    uint32_t leafLayout;
+    /**
+     * Values are variable length, valSize is then the size of the
+     * slot holding each one, at least 8. false by default.
+     */
+    bool varValues;
+    /**
+     * Keep the largest of a uint64_t field of the values in each
+     * non-leaf value, see the overview. false by default.
+     */
+    bool subtreeMax;
+    /// Offset of that field in each value, at most valSize - 8.
+    uint32_t maxOffset;
+    /**
+     * Keep the number of entries under each non-leaf value, see the
+     * overview. false by default.
+     */
+    bool subtreeCounts;
+    /**
+     * With subtreeCounts, also keep the sum of a uint64_t field of
+     * the values. false by default.
+     */
+    bool subtreeSums;
+    /// Offset of that field in each value, at most valSize - 8.
+    uint32_t sumOffset;
+
+    R2BTreeParams()
+	: pageSize(0), keySize(0), valSize(0), nonLeafLayout(R2LayoutSorted),
+	  leafLayout(R2LeafSorted), varValues(false), subtreeMax(false),
+	  maxOffset(0), subtreeCounts(false), subtreeSums(false), sumOffset(0)
+	{;};
 };
 
 
@@ -247,6 +904,21 @@ public:
      * to by b. Undefined if a or b is invalid.
      */
     virtual int compare(const uint8_t *a, const uint8_t *b) = 0;
+
+    /**
+     * Return true if keys are 16 byte UUIDs ordered as by memcmp.
+     *
+     * findKeyPosition then uses KeySearch::findUUIDPosition instead
+     * of calling compare for every probe.
+     */
+    virtual bool isUUID() { return false; };
+
+    /**
+     * Return true if compare orders keys as memcmp does.
+     *
+     * Needed for R2BTree::prefixKeys.
+     */
+    virtual bool isBytewise() { return this->isUUID(); };
 };
 
 /**
@@ -258,236 +930,1676 @@ public:
     /// Implement the required compare routine.
     int compare(const uint8_t *a, const uint8_t *b);
 
+    /// Use the UUID key search.
+    bool isUUID() { return true; };
+
 };
 
-class R2BTree {
+/**
+ * Variable length byte string keys, see the overview.
+ *
+ * Each key is a keySize slot holding up to keySize - 2 bytes of
+ * string, padded with zero bytes, and the string length in the last
+ * two bytes, big endian.
+ */
+class R2VarKey : public R2KeyInterface {
 private:
+    uint32_t keySize;
 
 public:
-    R2IndexHeader *header;
-    R2PageAccess *root;
-    R2KeyInterface *ki;
-    
-
+    /// Keys in slots of size bytes, at least R2_NORMALIZED_KEY_SIZE + 2.
+    R2VarKey(uint32_t size) : keySize(size) {;};
 
     /**
-     * Blocking insert, add a key and value into a node.
-     *
-     * @param [in] l shared lock
-     * @param [in] ac Pointer to info about the particular leaf
-     *                page to insert into.
-     * @param [in] key Pointer to the key to be inserted.
-     * @param [in] val Pointer to the value to be inserted.
-     * @param [out] err If an error occurs this will contain error info.
-     *
-     * Blocking insert. This routine will block until it acquires an
-     * exclusive lock on l. After the lock is acquired, this routine will
-     * check if there is enough space to insert the key without
-     * needing to overflow the page. If there is not enough space then
-     * false is returned and the page is not modified.  If there is
-     * enough space the key is copied into the page at the proper
-     * location, the page values are modified, the user data val is
-     * copied, and true is returned.  In all cases the lock is
-     * released before returning.
+     * Compare the normalized keys, then the rest of the slots.
      *
-     * If they key already exists in the node false is returned and the
-     * node is unmodified.
-     *
-     * @return Return true if insert took place, false if insert could
-     * not be done. If false is returned the page is not modified.
+     * The same order as memcmp on the slots, which is the order of
+     * the strings, a string being before any longer string it starts.
      */
+    int compare(const uint8_t *a, const uint8_t *b);
 
-    bool blockInsert(boost::shared_mutex *l,
-		     R2PageAccess *ac,
-		     uint8_t *key,
-		     uint8_t *val,
-		     ErrorInfo *err);
+    /// Slots compare as by memcmp, so key prefixes can be used.
+    bool isBytewise() { return true; };
+
+    /// Longest string a key can hold.
+    uint32_t getMaxLength() { return this->keySize - 2; };
 
     /**
-     * Blocking delete, remove a key from a node.
-     *
-     * @param [in] l shared lock
-     * @param [in] ac Pointer to info about the particular leaf
-     *                page to delete from.
-     * @param [in] key Pointer to a the key to be deleted.
-     * @param [out] err If an error occurs this will contain error info.
-     *
-     * Blocking delete. Routine will block until it acquires an
-     * exclusive lock on l. Lock is released at end of routine. This
-     * routine will only delete the key if it does not result in an
-     * underflow condition (key count below the required minimum).
+     * Make the slot for a string.
      *
-     * If the key is found, and deleting this key will not result
-     * in an underflow then the key is deleted and true is returned.
-     * Otherwise false is returned and the node is not modified.
+     * @param [in]  str String bytes, may hold zero bytes.
+     * @param [in]  len Length of the string.
+     * @param [out] key keySize bytes.
      *
-     * @return Return true if a key was deleted, or return false if
-     * the delete could not be done. If false is returned the node
-     * is not modified.
+     * @result false if the string is too long, true otherwise.
      */
-    bool blockDelete(boost::shared_mutex *l,
-		     R2PageAccess *ac,
-		     uint8_t *key,
-		     ErrorInfo *err);
+    bool makeKey(const uint8_t *str, uint32_t len, uint8_t *key);
+
+    /// Length of the string held by a slot. The string is at key.
+    uint32_t getLength(const uint8_t *key);
+};
 
+/**
+ * Source of key/value pairs for R2BTree::bulkLoad.
+ *
+ * This is a pure virtual base class. The pairs must be returned
+ * in strictly increasing key order.
+ */
+class R2BulkSource {
+public:
     /**
-     * Blocking find, search for a key in a node.
+     * Get the next pair.
      *
-     * @param [in]  l     Shared lock
-     * @param [in]  ac    Pointer to info about the particular leaf
-     *                    page to insert into.
+     * Copy the next key and value into key and val, which are large
+     * enough for one key and one user value. Return false when there
+     * are no more pairs.
+     */
+    virtual bool next(uint8_t *key, uint8_t *val) = 0;
+};
+
+/**
+ * Per level state used by R2BTree::bulkLoad.
+ *
+ * This is not a public API class.
+ */
+class R2BulkLevel {
+public:
+    /// Page currently being filled at this level.
+    uint32_t pageNum;
+
+    /// Previous page at this level, 0 if pageNum is the first.
+    uint32_t prevPageNum;
+};
+
+/**
+ * Point in time view of a tree, see R2BTree::takeSnapshot.
+ */
+class R2Snapshot {
+public:
+    /// Root of the tree when the snapshot was taken, 0 if not taken.
+    uint32_t rootPageNum;
+
+    /// Generation of the tree when the snapshot was taken.
+    uint32_t generation;
+
+    R2Snapshot() : rootPageNum(0), generation(0) {;};
+};
+
+/**
+ * Page replaced by a copy, waiting for the snapshots that may still
+ * read it to be released.
+ *
+ * This is not a public API class.
+ */
+class R2RetiredPage {
+public:
+    uint32_t pageNum;
+
+    /// Generation of the tree when the page was replaced.
+    uint32_t generation;
+};
+
+class R2BTree {
+private:
+    /// Serializes allocPage calls made by insertConcurrent.
+    boost::mutex allocLock;
+
+    /// Pages changed by the call being logged.
+    std::vector<uint32_t> logPages;
+
+    /// Records of the call being logged.
+    WALGroup logGroup;
+
+    /// true if the call being logged changed the root page number.
+    bool logRoot;
+
+    /**
+     * true if the call being logged changed a page in a way no
+     * record describes, so that page images are logged.
+     */
+    bool logImages;
+
+    /**
+     * Held by insert and erase in copy-on-write mode and while
+     * snapshots are taken and released. Protects everything below.
+     */
+    boost::mutex snapLock;
+
+    /// Generation pages written now are stamped with.
+    uint32_t generation;
+
+    /// Generations of the snapshots not yet released, sorted.
+    std::vector<uint32_t> snapshots;
+
+    /// Pages replaced by copies, oldest first.
+    std::vector<R2RetiredPage> retired;
+
+    /// Number of pages copied.
+    uint64_t nCopies;
+
+    /// Searches, keys compared and fallbacks of interpolation search.
+    uint64_t nSearches;
+    uint64_t nProbes;
+    uint64_t nFallbacks;
+
+    /// Rightmost leaf of the tree of appendHeader, 0 if not known.
+    uint32_t appendPageNum;
+    R2IndexHeader *appendHeader;
+
+    /// Number of inserts made straight into appendPageNum.
+    uint64_t nAppends;
+
+public:
+    R2IndexHeader *header;
+    R2PageAccess *root;
+    R2KeyInterface *ki;
+
+    /// Used by the tree level routines to find pages by page number.
+    PageStore *ps;
+
+    /// Log for changes made by the tree level routines, may be NULL.
+    WriteAheadLog *wal;
+
+    /**
+     * Exact match front index, may be NULL, see the hash index
+     * section of the overview. Its key and value sizes must be those
+     * of the tree leaves. Set before initTree, bulkLoad or
+     * loadHashIndex.
+     */
+    HashIndex *hashIndex;
+
+    /**
+     * Filter for finds of missing keys, may be NULL, see the Bloom
+     * filter section of the overview. Its key size must be that of
+     * the tree. Set before initTree, bulkLoad or loadBloomFilter.
+     */
+    BloomFilter *bloomFilter;
+
+    /**
+     * Copy pages shared with a snapshot instead of changing them, see
+     * the snapshot section of the overview. Set before initTree or
+     * bulkLoad, and do not change while the tree is in use.
+     */
+    bool copyOnWrite;
+
+    /**
+     * Store the key bytes a leaf shares once, see the key prefix
+     * section of the overview. Set before initTree or bulkLoad, and
+     * keep set for as long as the index is used.
+     */
+    bool prefixKeys;
+
+    /**
+     * Search pages of 16 byte UUID keys by interpolation.
+     *
+     * Pays off for keys spread evenly over the key space, such as
+     * random UUIDs, see KeySearch::interpolateUUIDPosition. The
+     * number of keys compared is counted, see getNumProbes. Can be
+     * changed at any time.
+     */
+    bool interpolationSearch;
+
+    /**
+     * Split pages on the right edge of the tree so that they stay
+     * full when keys arrive in increasing order, see the append
+     * section of the overview. Random keys then leave pages on the
+     * right edge below minNumKeys. Can be changed at any time.
+     */
+    bool appendSplit;
+
+    R2BTree()
+	: logRoot(false), logImages(false), generation(0), nCopies(0), nSearches(0),
+	  nProbes(0), nFallbacks(0), appendPageNum(0), appendHeader(NULL),
+	  nAppends(0), header(NULL), root(NULL), ki(NULL), ps(NULL),
+	  wal(NULL), hashIndex(NULL), bloomFilter(NULL), copyOnWrite(false),
+	  prefixKeys(false), interpolationSearch(false), appendSplit(false)
+	  {;};
+
+    /**
+     * Create an empty tree.
+     *
+     * @param [out] err Error info output.
+     *
+     * header, ki and ps must already be set. A single empty leaf page
+     * is allocated from ps and becomes the root. The header
+     * rootPageNum is updated. If wal is set the new root is logged.
+     *
+     * The tree level routines need non-leaf nodes that can hold
+     * atleast 4 keys and leaf nodes that can hold atleast 2 keys, if
+     * the page size is too small false is returned. false is also
+     * returned if the header formatVersion is not R2_FORMAT_VERSION.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool initTree(ErrorInfo *err);
+
+    /**
+     * Insert a key and value into the tree.
+     *
+     * @param [in]  key Pointer to the key to be inserted.
+     * @param [in]  val Pointer to the value to be inserted.
+     * @param [out] err Error info output.
+     *
+     * Descend from the root to the leaf that should hold key. Any
+     * full node met on the way down is split before it is entered,
+     * so the leaf will always have room. If the root is full a new
+     * root is created. Pages needed for the split are allocated from
+     * ps.
+     *
+     * If the key already exists false is returned, err is set to
+     * ERR_DUPLICATE_INSERT and the value is not changed. Note that
+     * full nodes along the path may have been split.
+     *
+     * If wal is set the changes are appended to it, see the logging
+     * section of the overview.
+     *
+     * @note Locking is the callers responsibility.
+     *
+     * @result true if the key was inserted, false otherwise.
+     */
+    bool insert(uint8_t *key, uint8_t *val, ErrorInfo *err);
+
+    /**
+     * Insert many keys and values into the tree.
+     *
+     * @param [in]  keys      n keys, one after the other, in any order.
+     * @param [in]  vals      n values, in the same order as keys.
+     * @param [in]  n         Number of keys.
+     * @param [out] nInserted Number of keys inserted, may be NULL.
+     * @param [out] err       Error info output.
+     *
+     * The batch is sorted and each run of keys that belongs to the
+     * same leaf is merged into it in one pass, instead of shifting
+     * the keys of the leaf once for every key. The descent to each
+     * leaf splits full nodes as insert does, and a run is cut short
+     * when the leaf is full, the rest going to the next descent.
+     *
+     * A key that is already in the tree, or comes more than once in
+     * the batch, is not inserted, its first value in the batch is
+     * used. All other keys are inserted, and then false is returned
+     * with err set to ERR_DUPLICATE_INSERT.
+     *
+     * If wal is set the whole batch is one group of log records.
+     *
+     * @note Locking is the callers responsibility.
+     *
+     * @result true if every key was inserted, false otherwise.
+     */
+    bool insertBatch(uint8_t *keys, uint8_t *vals, uint32_t n,
+		     uint32_t *nInserted, ErrorInfo *err);
+
+    /**
+     * Find a key in the tree.
+     *
+     * @param [in]  key Pointer to the key to look for.
+     * @param [out] val Pointer to store associated value, may be NULL.
+     * @param [out] err Error info output.
+     *
+     * If the key is found true is returned and, if val is not NULL,
+     * the value is copied to the memory pointed to by val. Otherwise
+     * false is returned and val is not modified.
+     *
+     * @note Locking is the callers responsibility.
+     *
+     * @result true if found, false otherwise.
+     */
+    bool find(uint8_t *key, uint8_t *val, ErrorInfo *err);
+
+    /**
+     * Find many keys at once.
+     *
+     * @param [in]  keys  n keys to look for, in any order.
+     * @param [out] vals  Room for n values, may be NULL.
+     * @param [out] found n flags, set to whether each key was found.
+     * @param [in]  n     Number of keys.
+     * @param [out] err   Error info output.
+     *
+     * The keys are looked up R2_FIND_GROUP at a time, descending the
+     * tree one level at a time for the whole group. The child page
+     * each key goes to next is prefetched before the compares for the
+     * other keys of the group are done, so the cache misses of the
+     * lookups overlap rather than follow each other.
+     *
+     * The value of each key found is copied to its place in vals, the
+     * places of keys not found are left unchanged. Keys bloomFilter
+     * rules out are left out of the groups.
+     *
+     * @note Locking is the callers responsibility.
+     *
+     * @result true if every key was looked up, false if a page could
+     * not be read.
+     */
+    bool findBatch(uint8_t *keys, uint8_t *vals, bool *found, uint32_t n,
+		   ErrorInfo *err);
+
+    /**
+     * Remove a key from the tree.
+     *
+     * @param [in]  key Pointer to the key to remove.
+     * @param [out] err Error info output.
+     *
+     * The key is removed from its leaf. Nodes left with fewer than
+     * the minimum number of keys are concatenated with, or borrow
+     * keys from, a sibling. This may continue up to the root. Pages
+     * emptied by concatenation are returned to ps.
+     *
+     * If wal is set the changes are appended to it.
+     *
+     * @note Locking is the callers responsibility.
+     *
+     * @result true if the key was removed, false if not found.
+     */
+    bool erase(uint8_t *key, ErrorInfo *err);
+
+    /**
+     * Insert a key with a variable length value.
+     *
+     * @param [in]  key Pointer to the key to insert.
+     * @param [in]  val The value, may be NULL if len is 0.
+     * @param [in]  len Length of the value in bytes.
+     * @param [out] err Error info output.
+     *
+     * Needs header->varValues. The value is kept in its slot if it
+     * fits, otherwise in new overflow pages. Otherwise as insert.
+     *
+     * @note Locking is the callers responsibility.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool insertVar(uint8_t *key, const uint8_t *val, uint32_t len,
+		   ErrorInfo *err);
+
+    /**
+     * Find a key with a variable length value.
+     *
+     * @param [in]  key Pointer to the key to look for.
+     * @param [out] val Set to the value, may be NULL.
+     * @param [out] err Error info output.
+     *
+     * Needs header->varValues. Otherwise as find.
+     *
+     * @note Locking is the callers responsibility.
+     *
+     * @result true if found, false otherwise.
+     */
+    bool findVar(uint8_t *key, std::vector<uint8_t> *val, ErrorInfo *err);
+
+    /**
+     * Read the value a slot made by insertVar stands for.
+     *
+     * @param [in]  slot valSize bytes, as returned by find or a cursor.
+     * @param [out] val  Set to the value.
+     * @param [out] err  Error info output.
+     *
+     * The overflow pages of the value must not have been freed.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool readValue(const uint8_t *slot, std::vector<uint8_t> *val,
+		   ErrorInfo *err);
+
+    /**
+     * Find the entries with the largest value field.
+     *
+     * @param [in]  k    Most entries to return.
+     * @param [out] keys Set to the keys found, keySize bytes each.
+     * @param [out] vals Set to their values, valSize bytes each.
+     * @param [out] err  Error info output.
+     *
+     * Needs header->subtreeMax, see the overview. The k entries whose
+     * field at maxOffset is largest, or every entry if there are
+     * fewer, are returned largest first. Entries with the same field
+     * come in no particular order.
+     *
+     * @note Locking is the callers responsibility.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool findLargest(uint32_t k, std::vector<uint8_t> *keys,
+		     std::vector<uint8_t> *vals, ErrorInfo *err);
+
+    /**
+     * Count the entries whose key is below a key.
+     *
+     * @param [in]  key The key, which need not be in the tree.
+     * @param [out] n   Set to the number of entries with a smaller key.
+     * @param [out] sum Set to the sum of their subtreeSums field, may
+     *                  be NULL.
+     * @param [out] err Error info output.
+     *
+     * Needs header->subtreeCounts, and header->subtreeSums if sum is
+     * not NULL, see the overview. The position select takes for a key
+     * in the tree is its rank.
+     *
+     * @note Locking is the callers responsibility.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool rank(uint8_t *key, uint64_t *n, uint64_t *sum, ErrorInfo *err);
+
+    /**
+     * Find the entry at a position in key order.
+     *
+     * @param [in]  i   The position, 0 for the smallest key.
+     * @param [out] key Set to the key.
+     * @param [out] val Set to the value, may be NULL.
+     * @param [out] err Error info output.
+     *
+     * Needs header->subtreeCounts. If the tree has no more than i
+     * entries false is returned and err is set to ERR_KEY_NOT_FOUND.
+     *
+     * @note Locking is the callers responsibility.
+     *
+     * @result true if found, false otherwise.
+     */
+    bool select(uint64_t i, uint8_t *key, uint8_t *val, ErrorInfo *err);
+
+    /**
+     * Count the entries with keys in a range.
+     *
+     * @param [in]  lo  Smallest key of the range, NULL for no bound.
+     * @param [in]  hi  Key just past the range, NULL for no bound.
+     * @param [out] n   Set to the number of entries with lo <= key < hi.
+     * @param [out] sum Set to the sum of their subtreeSums field, may
+     *                  be NULL.
+     * @param [out] err Error info output.
+     *
+     * Needs header->subtreeCounts, and header->subtreeSums if sum is
+     * not NULL. A range with hi <= lo is empty.
+     *
+     * @note Locking is the callers responsibility.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool count(uint8_t *lo, uint8_t *hi, uint64_t *n, uint64_t *sum,
+	       ErrorInfo *err);
+
+    /**
+     * Build a tree from a sorted stream of keys and values.
+     *
+     * @param [in]  src        Source of pairs, in strictly increasing order.
+     * @param [in]  fillFactor Fraction of each page to fill, (0, 1].
+     * @param [out] err        Error info output.
+     *
+     * header, ki and ps must already be set. Leaves are filled left
+     * to right and the first key of each new page is appended to the
+     * page being filled one level up, so no searching, shifting or
+     * splitting is done. Each page gets fillFactor * max keys, but
+     * never fewer than the minimum. The last page of a level is
+     * topped up from its left neighbour if it would underflow. Use a
+     * fillFactor of 1 for an index that will only be read, and less
+     * for one that will take random inserts later.
+     *
+     * When the build finishes the header rootPageNum names the new
+     * tree. Any tree the header named before is not freed. If src is
+     * out of order false is returned and err is set to ERR_BAD_ARG,
+     * or ERR_DUPLICATE_INSERT for a repeated key. On failure the
+     * header, hashIndex and bloomFilter are unchanged and the pages
+     * already built are not freed. The subtree maxima, counts and sums
+     * of the new tree are filled in before the header names it. The
+     * new hash index and filter are filled aside and swapped in at the
+     * end, so for a while both copies take memory.
+     *
+     * bulkLoad is not logged, false is returned with err set to
+     * ERR_BAD_ARG if wal is set.
+     *
+     * @note Locking is the callers responsibility.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool bulkLoad(R2BulkSource *src, double fillFactor, ErrorInfo *err);
+
+    /**
+     * Find a key, safe to call while other threads insert.
+     *
+     * @param [in]  key Pointer to the key to look for.
+     * @param [out] val Pointer to store associated value, may be NULL.
+     * @param [out] err Error info output.
+     *
+     * Same as find, but pages are read optimistically and the search
+     * starts over if a page changed while it was read. See the
+     * concurrency section of the overview.
+     *
+     * If the search has to start over val may be written to even if
+     * false is returned in the end.
+     *
+     * @result true if found, false otherwise.
+     */
+    bool findConcurrent(uint8_t *key, uint8_t *val, ErrorInfo *err);
+
+    /**
+     * Insert a key and value, safe to call from many threads at once.
+     *
+     * @param [in]  key Pointer to the key to be inserted.
+     * @param [in]  val Pointer to the value to be inserted.
+     * @param [out] err Error info output.
+     *
+     * Same as insert, but splits go from the leaf up and only one
+     * page on the path is latched at a time. See the concurrency
+     * section of the overview.
+     *
+     * If a page cannot be allocated part way up, the pages already
+     * split stay reachable through the sibling links but the tree
+     * is left with a missing parent entry, so the error should be
+     * treated as fatal for the index.
+     *
+     * insertConcurrent is not logged and does not keep subtree
+     * maxima or counts, the hash index or the Bloom filter, false is
+     * returned with err set to ERR_BAD_ARG if wal,
+     * header->subtreeMax, header->subtreeCounts, hashIndex or
+     * bloomFilter is set.
+     *
+     * @result true if the key was inserted, false otherwise.
+     */
+    bool insertConcurrent(uint8_t *key, uint8_t *val, ErrorInfo *err);
+
+    /**
+     * Replay the log after a crash.
+     *
+     * @param [out] err Error info output.
+     *
+     * header, ki, ps and wal must be set, and wal opened with nothing
+     * appended yet. Every group in the log is applied to the pages it
+     * names whose LSN is older than the group. Pages past the end of
+     * ps are allocated. The header rootPageNum is set to the last root
+     * logged. If hashIndex or bloomFilter is set it is then filled
+     * from the tree.
+     *
+     * Once the pages have been flushed and the header saved the log
+     * can be checkpointed.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool recover(ErrorInfo *err);
+
+    /**
+     * Fill hashIndex with every key of the tree.
+     *
+     * @param [out] err Error info output.
+     *
+     * Anything in hashIndex is removed first. Used to build the hash
+     * index of a tree that already exists.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool loadHashIndex(ErrorInfo *err);
+
+    /**
+     * Fill bloomFilter with every key of the tree.
+     *
+     * @param [out] err Error info output.
+     *
+     * Anything in bloomFilter is removed first. Used to build the
+     * filter of a tree that already exists, or to drop erased keys
+     * from it.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool loadBloomFilter(ErrorInfo *err);
+
+    /**
+     * Take a point in time view of the tree.
+     *
+     * @param [out] snap The snapshot.
+     * @param [out] err  Error info output.
+     *
+     * Safe to call from any thread while another thread inserts and
+     * erases. Waits for the insert or erase in progress, if any, to
+     * finish. The snapshot can then be read with findSnapshot and an
+     * R2Cursor until it is passed to releaseSnapshot. Pages it can
+     * reach are kept until then, so a snapshot held for long keeps
+     * every page changed since it was taken.
+     *
+     * If copyOnWrite is not set false is returned and err is set to
+     * ERR_BAD_ARG.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool takeSnapshot(R2Snapshot *snap, ErrorInfo *err);
+
+    /**
+     * Let go of a snapshot taken by takeSnapshot.
+     *
+     * Nothing may be reading the snapshot any more. Pages no other
+     * snapshot needs are returned to ps.
+     */
+    void releaseSnapshot(R2Snapshot *snap);
+
+    /**
+     * Same as find, on a snapshot.
+     *
+     * Needs no lock, and may run at the same time as anything else
+     * on the tree.
+     *
+     * @result true if found, false otherwise.
+     */
+    bool findSnapshot(R2Snapshot *snap, uint8_t *key, uint8_t *val,
+		      ErrorInfo *err);
+
+    /// Number of pages copied in copy-on-write mode.
+    uint64_t getNumCopies() { return this->nCopies; };
+
+    /// Number of page searches made by interpolation.
+    uint64_t getNumSearches() {
+	return __atomic_load_n(&this->nSearches, __ATOMIC_RELAXED);
+    };
+
+    /// Number of keys compared by those searches.
+    uint64_t getNumProbes() {
+	return __atomic_load_n(&this->nProbes, __ATOMIC_RELAXED);
+    };
+
+    /// Number of those searches that fell back to binary search.
+    uint64_t getNumFallbacks() {
+	return __atomic_load_n(&this->nFallbacks, __ATOMIC_RELAXED);
+    };
+
+    /// Set the interpolation search counters to 0.
+    void resetSearchStats();
+
+    /// Number of inserts that went straight to the rightmost leaf.
+    uint64_t getNumAppends() { return this->nAppends; };
+
+
+
+    /**
+     * Blocking insert, add a key and value into a node.
+     *
+     * @param [in] l shared lock
+     * @param [in] ac Pointer to info about the particular leaf
+     *                page to insert into.
+     * @param [in] key Pointer to the key to be inserted.
+     * @param [in] val Pointer to the value to be inserted.
+     * @param [out] err If an error occurs this will contain error info.
+     *
+     * Blocking insert. This routine will block until it acquires an
+     * exclusive lock on l. After the lock is acquired, this routine will
+     * check if there is enough space to insert the key without
+     * needing to overflow the page. If there is not enough space then
+     * false is returned and the page is not modified.  If there is
+     * enough space the key is copied into the page at the proper
+     * location, the page values are modified, the user data val is
+     * copied, and true is returned.  In all cases the lock is
+     * released before returning.
+     *
+     * If they key already exists in the node false is returned and the
+     * node is unmodified.
+     *
+     * @return Return true if insert took place, false if insert could
+     * not be done. If false is returned the page is not modified.
+     */
+
+    bool blockInsert(boost::shared_mutex *l,
+		     R2PageAccess *ac,
+		     uint8_t *key,
+		     uint8_t *val,
+		     ErrorInfo *err);
+
+    /**
+     * Blocking delete, remove a key from a node.
+     *
+     * @param [in] l shared lock
+     * @param [in] ac Pointer to info about the particular leaf
+     *                page to delete from.
+     * @param [in] key Pointer to a the key to be deleted.
+     * @param [out] err If an error occurs this will contain error info.
+     *
+     * Blocking delete. Routine will block until it acquires an
+     * exclusive lock on l. Lock is released at end of routine. This
+     * routine will only delete the key if it does not result in an
+     * underflow condition (key count below the required minimum).
+     *
+     * If the key is found, and deleting this key will not result
+     * in an underflow then the key is deleted and true is returned.
+     * Otherwise false is returned and the node is not modified.
+     *
+     * @return Return true if a key was deleted, or return false if
+     * the delete could not be done. If false is returned the node
+     * is not modified.
+     */
+    bool blockDelete(boost::shared_mutex *l,
+		     R2PageAccess *ac,
+		     uint8_t *key,
+		     ErrorInfo *err);
+
+    /**
+     * Blocking find, search for a key in a node.
+     *
+     * @param [in]  l     Shared lock
+     * @param [in]  ac    Pointer to info about the particular leaf
+     *                    page to insert into.
      * @param [in]  key   Pointer to a the key to be inserted.
      * @param [out] val   Pointer to store associated value.
      * @param [out] err   If an error occurs this will contain error info.
      *
-     * Blocking find. This routine will block until it acquires a
-     * shared lock on l. After the lock is acquired, this routine will
-     * search for the key. If the key is not found false is returned
-     * and nothing is written to memory pointed to by val. If the key
-     * is found true will be returned, in addition if val is not null
-     * the associated value will be written to the memory pointed to
-     * by child, val must point to a buffer large enough to accomodate
-     * the value.
+     * Blocking find. This routine will block until it acquires a
+     * shared lock on l. After the lock is acquired, this routine will
+     * search for the key. If the key is not found false is returned
+     * and nothing is written to memory pointed to by val. If the key
+     * is found true will be returned, in addition if val is not null
+     * the associated value will be written to the memory pointed to
+     * by child, val must point to a buffer large enough to accomodate
+     * the value.
+     *
+     * @return Return true if found. False otherwise.
+     */
+
+    bool blockFind(boost::shared_mutex *l,
+		   R2PageAccess *ac,
+		   uint8_t *key,
+		   uint8_t *val,
+		   ErrorInfo *err);
+
+    /**
+     * Latched insert, add a key and value into a node.
+     *
+     * Same as blockInsert, but the page's own R2Latch is held while
+     * the node is changed instead of a separate lock.
+     *
+     * @return Return true if insert took place, false if insert could
+     * not be done. If false is returned the page is not modified.
+     */
+    bool latchInsert(R2PageAccess *ac,
+		     uint8_t *key,
+		     uint8_t *val,
+		     ErrorInfo *err);
+
+    /**
+     * Latched delete, remove a key from a node.
+     *
+     * Same as blockDelete, but the page's own R2Latch is held while
+     * the node is changed instead of a separate lock.
+     *
+     * @return Return true if a key was deleted, or return false if
+     * the delete could not be done. If false is returned the node
+     * is not modified.
+     */
+    bool latchDelete(R2PageAccess *ac,
+		     uint8_t *key,
+		     ErrorInfo *err);
+
+    /**
+     * Optimistic find, search for a key in a node.
+     *
+     * Same as blockFind, but no lock is taken. The search is done
+     * again if the page's R2Latch shows the node changed while it
+     * was being read. val may be written to even if false is
+     * returned in the end.
+     *
+     * @return Return true if found. False otherwise.
+     */
+    bool latchFind(R2PageAccess *ac,
+		   uint8_t *key,
+		   uint8_t *val,
+		   ErrorInfo *err);
+
+
+
+
+
+
+    /********************************************************/
+
+    /**
+     * Split a node.
+     *
+     * @param [in,out] full   The full node to split.
+     * @param [in,out] empty  The empty node to use.
+     * @param [out] key       The key to promote to higher node.
+     * @param [out] err       Error info output.
+     *
+     * Split a node into two nodes, return true if successful.  The
+     * node full must have the maximum number of keys, else false is
+     * returned. The empty node must have zero keys else false is
+     * returned. key must be non-null, else false is returned, and it
+     * must point to a buffer large enough to store a key. The two nodes
+     * must be of the same page type, else false is returned.
+     *
+     * The full node will be split into two, with keys (and associated
+     * data) moved into the empty page. A suitable 'middle' key from
+     * full will be chosen, and copied into the buffer pointed to by
+     * key. All keys and associated values greater than or equal to
+     * key will be copied to empty.
+     *
+     * empty takes over the next link of full. The links between full
+     * and empty, and the prev link of the node after empty, need page
+     * numbers and must be set by the caller.
+     *
+     * If false is returned full and empty are unchanged.
+     *
+     * @note Locking is the callers responsibility.
+     *
+     * @result true if node successfully split, false otherwise.
+     */
+    bool splitNode(R2PageAccess *full, R2PageAccess *empty, uint8_t *key,
+		   ErrorInfo *err);
+
+    /**
+     * Concatenate two nodes.
+     *
+     * @param [in,out] dst The destination.
+     * @param [in]     src The source node.
+     * @param [in]     dstIsFirst Indicates node ordering.
+     * @param [out]    err Error info output.
+     *
+     * Concatenate two nodes into one. The final result will be
+     * stored in node dst. src and dst are expected to be two adjascent
+     * nodes - that is they both have the same parent and the child node
+     * pointers that refer to them are next to each other. dstIsFirst
+     * indicates which keys are "smaller" than the other. If dstIsFirst
+     * is true then the keys in dst are all less than the keys in src,
+     * if false the keys in dst are all larger than src.
+     *
+     * The total number of keys in src and dst must be less than or
+     * equal to the max number of keys.
+     *
+     * true will be returned only if the two nodes are properly merged.
+     * Otherwise false is returned, the error condition will be set,
+     * and input nodes are not not modified. If the concat succeeds src
+     * will have no keys and dst will have all keys.
+     * 
+     * If src or dst is null false is returned. If there are too many
+     * keys false is returned.
+     *
+     * dst takes over the sibling link of src that points away from
+     * dst. The caller must point that neighbour back at dst.
+     *
+     * @note Locking is the callers responsibility.
+     *
+     * @result true if success, false otherwise.
+     * 
+     */
+    bool concatNodes(R2PageAccess *dst, R2PageAccess *src, bool dstIsFirst,
+		     ErrorInfo *err);
+
+
+    /**
+     * Redistribute keys between two nodes.
+     *
+     * @param [in,out] n1  Node.
+     * @param [in,out] n2  Node.
+     *
+     * Redistribute the keys, so that each node has atleast the
+     * minimum required number of keys. Returns true if redistribution
+     * takes place successfully. Otherwise false is returned and n1
+     * and n2 are unmodified. Nodes must be of the same type, and
+     * neither n1 nor n2 can be null. All of the keys in n1 must be
+     * less than all of the keys in n2 - this condition is not
+     * checked.
+     *
+     * The keys will be redistributed so that n1 and n2 have
+     * approximately the same number of keys. The ordering of the keys
+     * will be preserved (all n1 keys are before all n2 keys). The
+     * sibling links do not change.
+     *
+     * This routine is really only intended to be used when exactly one
+     * node has less than the minimum number of keys - so it will reject
+     * any other kind of input.
+     * 
+     * @note Locking is the callers resposibility.
+     *
+     * @result true if success, false otherwise.
+     *
+     */
+    bool redistributeNodes(R2PageAccess *n1, R2PageAccess *n2, ErrorInfo *err);
+
+    /********************************************************/
+
+    /**
+     * Return key index, where it should be store or where it is stored.
+     *
+     * @param [in] ac Pointer to info about a leaf page.
+     * @param [in] key The key to be inserted.
+     * @param [out] idx Key number where key is stored or should be stored.
+     *
+     * This is not a public API routine.
+     *
+     * The node can be a leaf or non-leaf node.
+     *
+     * Search the key array fo the key. Return true if the key is
+     * found, and store the position of the key in *idx. If the key is
+     * not found, return false, and store the position where the key
+     * should be inserted at *idx.
+     *
+     * Locking and thread safety are the responsibility of the caller.
+     *
+     * @note The return value is not the offset into the key array, rather
+     * it is the key index - it needs to be multiplied by the key size to
+     * find the actual byte offset.
+     *
+     * @result Return true if found, false otherwise.
+     */
+    bool findKeyPosition(R2PageAccess *ac, uint8_t *key, uint32_t *idx);
+
+    /**
+     * Return the index of the child to descend into.
+     *
+     * @param [in] ac  A non-leaf node.
+     * @param [in] key The key being searched for.
+     *
+     * This is not a public API routine.
+     *
+     * @result Index of the child that would hold key.
+     */
+    uint32_t findChildIndex(R2PageAccess *ac, uint8_t *key);
+
+    /**
+     * findChildIndex for R2LayoutIndexed, using the search index.
+     *
+     * This is not a public API routine.
+     */
+    uint32_t searchIndex(R2PageAccess *ac, uint8_t *key);
+
+    /**
+     * Rebuild the search index of a non-leaf page.
+     *
+     * This is not a public API routine. Does nothing for leaves and
+     * for trees with R2LayoutSorted. Must be called after the keys of
+     * a non-leaf page, other than key 0, are changed.
+     */
+    void indexNode(R2PageAccess *ac);
+
+    /**
+     * Return the child page number stored at idx in a non-leaf node.
+     *
+     * This is not a public API routine.
+     */
+    uint32_t getChildPageNum(R2PageAccess *ac, uint32_t idx);
+
+    /**
+     * Return the subtree maximum stored at idx in a non-leaf node.
+     *
+     * This is not a public API routine. Needs header->subtreeMax.
+     */
+    uint64_t getChildMax(R2PageAccess *ac, uint32_t idx);
+
+    /**
+     * Store the subtree maximum at idx in a non-leaf node.
+     *
+     * This is not a public API routine. Needs header->subtreeMax.
+     */
+    void setChildMax(R2PageAccess *ac, uint32_t idx, uint64_t m);
+
+    /**
+     * Largest value field under a page, 0 for an empty page.
+     *
+     * This is not a public API routine. Read from the values of a
+     * leaf or the maxima of a non-leaf node.
+     */
+    uint64_t pageMax(R2PageAccess *ac);
+
+    /// The field subtreeMax keeps, of a leaf value.
+    uint64_t valueField(const uint8_t *val);
+
+    /**
+     * Return the subtree count stored at idx in a non-leaf node.
+     *
+     * This is not a public API routine. Needs header->subtreeCounts.
+     */
+    uint64_t getChildCount(R2PageAccess *ac, uint32_t idx);
+
+    /**
+     * Store the subtree count at idx in a non-leaf node.
+     *
+     * This is not a public API routine. Needs header->subtreeCounts.
+     */
+    void setChildCount(R2PageAccess *ac, uint32_t idx, uint64_t n);
+
+    /**
+     * Return the subtree sum stored at idx in a non-leaf node.
+     *
+     * This is not a public API routine. Needs header->subtreeSums.
+     */
+    uint64_t getChildSum(R2PageAccess *ac, uint32_t idx);
+
+    /**
+     * Store the subtree sum at idx in a non-leaf node.
+     *
+     * This is not a public API routine. Needs header->subtreeSums.
+     */
+    void setChildSum(R2PageAccess *ac, uint32_t idx, uint64_t sum);
+
+    /// The field subtreeSums adds up, of a leaf value.
+    uint64_t sumField(const uint8_t *val);
+
+    /**
+     * Number of entries under a page.
+     *
+     * @param [in]  ac  The page.
+     * @param [out] sum Set to the sum of the field subtreeSums adds
+     *                  up under the page, 0 without subtreeSums.
+     *
+     * This is not a public API routine. Read from the values of a
+     * leaf or the counts of a non-leaf node, which needs
+     * header->subtreeCounts.
+     */
+    uint64_t pageCount(R2PageAccess *ac, uint64_t *sum);
+
+    /**
+     * Set the maximum, count and sum at idx in parent, those the tree
+     * keeps, from the child page at idx.
+     *
+     * This is not a public API routine.
+     */
+    void setChildStats(R2PageAccess *parent, uint32_t idx,
+		       R2PageAccess *child);
+
+    /**
+     * Make the non-leaf value for a child page.
+     *
+     * This is not a public API routine. The subtree maximum, if any,
+     * is 0 until set by setChildMax.
+     */
+    void childEntry(uint32_t pageNum, std::vector<uint8_t> *entry);
+
+    /**
+     * Account for entries added under the last page of a path.
+     *
+     * @param [in]  pathPn  Non-leaf pages from the root down.
+     * @param [in]  pathIdx Index of the next page down in each.
+     * @param [in]  m       Largest field added under the last page.
+     * @param [in]  n       Number of entries added.
+     * @param [in]  sum     Sum of their subtreeSums field.
+     * @param [out] err     Error info output.
+     *
+     * This is not a public API routine. Walks up from the bottom
+     * raising the subtree maxima to at least m, and adding n and sum
+     * to the subtree counts and sums. Without counts it stops at the
+     * first maximum that is already large enough, since those above
+     * are no smaller. The pages must already be safe to change in
+     * copy-on-write mode.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool raiseStats(std::vector<uint32_t> *pathPn,
+		    std::vector<uint32_t> *pathIdx, uint64_t m, uint64_t n,
+		    uint64_t sum, ErrorInfo *err);
+
+    /**
+     * Set every subtree maximum, count and sum of a tree built by
+     * bulkLoad.
+     *
+     * @param [in]  pageNum Root of the subtree.
+     * @param [out] m       Largest field in the subtree.
+     * @param [out] n       Number of entries in the subtree.
+     * @param [out] sum     Sum of the subtreeSums field in it.
+     * @param [out] err     Error info output.
+     *
+     * This is not a public API routine.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool computeStats(uint32_t pageNum, uint64_t *m, uint64_t *n,
+		      uint64_t *sum, ErrorInfo *err);
+
+    /**
+     * Store key and value at position idx.
+     *
+     * @param [in,out] ac  The node to change.
+     * @param [in]     idx Key index where the key will be stored.
+     * @param [in]     key The key.
+     * @param [in]     val The value, a page number for non-leaf nodes.
+     *
+     * This is not a public API routine. Keys at idx and above are
+     * shifted up by one. No checks are made, the node must have room.
+     */
+    void insertAt(R2PageAccess *ac, uint32_t idx, uint8_t *key, uint8_t *val);
+
+    /**
+     * Remove the key and value at position idx.
+     *
+     * This is not a public API routine. Keys above idx are shifted
+     * down by one. No underflow checks are made.
+     */
+    void removeAt(R2PageAccess *ac, uint32_t idx);
+
+    /**
+     * Copy the whole key at position idx, prefix included.
+     *
+     * This is not a public API routine.
+     */
+    void copyKey(R2PageAccess *ac, uint32_t idx, uint8_t *key);
+
+    /**
+     * Max number of keys the page can hold.
+     *
+     * maxNumKeys from the header for pages with no key prefix, more
+     * for leaves with one.
+     */
+    uint32_t maxKeys(R2PageAccess *ac);
+
+    /**
+     * Pointer to the value at position idx of a page.
+     *
+     * This is not a public API routine.
+     */
+    uint8_t *valAt(R2PageAccess *ac, uint32_t idx);
+
+    /**
+     * Write the values of a slotted leaf back to the heap in key order.
+     *
+     * This is not a public API routine. Afterwards the value of key i
+     * is in cell i and numCells is numKeys. Does nothing to other
+     * pages.
+     */
+    void compactLeaf(R2PageAccess *ac);
+
+    /**
+     * Point key i of a slotted leaf at cell i, for i < numKeys.
+     *
+     * This is not a public API routine. Used after the values of a
+     * compacted leaf were moved as in a sorted leaf.
+     */
+    void resetSlots(R2PageAccess *ac);
+
+    /**
+     * Max number of keys in a leaf with a prefix of prefixLen bytes.
+     *
+     * This is not a public API routine.
+     */
+    uint32_t leafCapacity(uint32_t prefixLen);
+
+    /**
+     * Number of leading bytes two keys share, 0 if either is NULL.
+     *
+     * This is not a public API routine. At most keySize - 1.
+     */
+    uint32_t commonPrefix(const uint8_t *a, const uint8_t *b);
+
+    /**
+     * Shortest separator between two keys.
+     *
+     * @param [in]  lo  The smaller key.
+     * @param [in]  hi  The larger key.
+     * @param [out] sep The bytes of hi up to and including the first
+     *                  one that differs from lo, then zero bytes.
+     *
+     * This is not a public API routine. lo < sep <= hi.
+     */
+    void shortSeparator(const uint8_t *lo, const uint8_t *hi, uint8_t *sep);
+
+    /**
+     * Append the whole keys and the values of a leaf to keys and vals.
+     *
+     * This is not a public API routine.
+     */
+    void getEntries(R2PageAccess *ac, std::vector<uint8_t> *keys,
+		    std::vector<uint8_t> *vals);
+
+    /**
+     * Replace the contents of a leaf.
+     *
+     * @param [in,out] ac        The leaf.
+     * @param [in]     keys      n whole keys, sorted.
+     * @param [in]     vals      n values.
+     * @param [in]     n         Number of entries, at least 1.
+     * @param [in]     prefixLen Prefix length to give the page, every
+     *                           key must share its first prefixLen bytes.
+     *
+     * This is not a public API routine. No checks are made, the n
+     * entries must fit with that prefix.
+     */
+    void fillLeaf(R2PageAccess *ac, const uint8_t *keys, const uint8_t *vals,
+		  uint32_t n, uint32_t prefixLen);
+
+    /**
+     * splitNode for leaves when prefixKeys is set.
+     *
+     * @param [in]     parent The non-leaf node holding full.
+     * @param [in]     idx    Index of full in parent.
+     * @param [in,out] full   The full leaf.
+     * @param [in,out] empty  New empty leaf.
+     * @param [out]    key    The separator for empty.
+     * @param [out]    err    Error info output.
+     *
+     * This is not a public API routine. The separator is shortened
+     * and both leaves get the longest prefix the separators around
+     * them allow.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool splitLeaf(R2PageAccess *parent, uint32_t idx, R2PageAccess *full,
+		   R2PageAccess *empty, uint8_t *key, ErrorInfo *err);
+
+    /**
+     * Fix an underflowing leaf when prefixKeys is set.
+     *
+     * @param [in,out] parent  The non-leaf node holding both leaves.
+     * @param [in]     leftIdx Index of left in parent.
+     * @param [in,out] left    Left leaf.
+     * @param [in,out] right   Right leaf, child leftIdx + 1.
+     * @param [out]    merged  true if every key was moved to left.
+     *
+     * This is not a public API routine. If the keys of both leaves
+     * fit in one with the prefix the separators around the pair allow
+     * they are all moved to left, and the caller removes right.
+     * Otherwise just enough keys are moved to the underflowing leaf
+     * to bring it to minNumKeys, and its separator in parent is
+     * replaced.
+     */
+    void mergeLeaves(R2PageAccess *parent, uint32_t leftIdx,
+		     R2PageAccess *left, R2PageAccess *right, bool *merged);
+
+    /**
+     * Split child idx of a non-leaf node.
+     *
+     * @param [in,out] parent    The non-leaf node, must not be full.
+     * @param [in]     idx       Index of the full child.
+     * @param [in,out] child     The full child.
+     * @param [in]     appendKey NULL for an even split, else the key
+     *                           being inserted, which is past every
+     *                           key of child.
+     * @param [out]    err       Error info output.
+     *
+     * This is not a public API routine. A new page of the same type
+     * as child is allocated, half of the keys of child are moved into
+     * it and the new page is added to parent just after child. If
+     * appendKey is given a leaf moves no keys and appendKey becomes
+     * the separator, and a non-leaf moves only its last two keys.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool splitChild(R2PageAccess *parent, uint32_t idx, R2PageAccess *child,
+		    uint8_t *appendKey, ErrorInfo *err);
+
+    /**
+     * Check the index header can be used by the tree level routines.
+     *
+     * @param [out] err Error info output.
+     *
+     * This is not a public API routine. The header must have the
+     * current formatVersion and key counts that the tree level
+     * routines and the 16 bit numKeys can handle.
+     *
+     * @result true if the header is usable, false otherwise.
+     */
+    bool checkHeader(ErrorInfo *err);
+
+    /**
+     * Pin a page and init a R2PageAccess for it.
+     *
+     * @param [in,out] pin     Holds the pin, any previous pin is released.
+     * @param [out]    ac      Set up to access the page.
+     * @param [in]     pageNum The page to pin.
+     * @param [out]    err     Error info output.
+     *
+     * This is not a public API routine. ac is only valid while pin
+     * holds the page.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool pinPage(PagePin *pin, R2PageAccess *ac, uint32_t pageNum,
+		 ErrorInfo *err);
+
+    /**
+     * Allocate a page from ps and hold the pin on it.
+     *
+     * This is not a public API routine. Calls to ps->allocPage are
+     * serialized so insertConcurrent can split nodes from many
+     * threads.
+     *
+     * @result The page buffer, or NULL if no page could be allocated.
+     */
+    uint8_t *allocPage(PagePin *pin, uint32_t *pageNum, ErrorInfo *err);
+
+    /**
+     * Return a page to ps.
+     *
+     * This is not a public API routine. The page is dropped from the
+     * pages to log.
+     */
+    void freePage(uint32_t pageNum);
+
+    /**
+     * The tree level insert, without the logging.
+     *
+     * This is not a public API routine.
+     */
+    bool insertPages(uint8_t *key, uint8_t *val, ErrorInfo *err);
+
+    /**
+     * Add key to the end of the rightmost leaf, if it goes there.
+     *
+     * This is not a public API routine. false is returned, and nothing
+     * changed, if appendPageNum is not known, no longer the rightmost
+     * leaf or full, or key is not past its last key.
+     */
+    bool appendLeaf(uint8_t *key, uint8_t *val);
+
+    /**
+     * Key to pass to splitChild for a split of ac, NULL for an even
+     * split.
+     *
+     * This is not a public API routine. edge tells if ac is the last
+     * page of its level.
+     */
+    uint8_t *appendSplitKey(R2PageAccess *ac, uint8_t *key, bool edge);
+
+    /**
+     * Add a key to hashIndex and bloomFilter, those that are set.
      *
-     * @return Return true if found. False otherwise.
+     * This is not a public API routine.
      */
+    void indexKey(const uint8_t *key, const uint8_t *val);
 
-    bool blockFind(boost::shared_mutex *l,
-		   R2PageAccess *ac,
-		   uint8_t *key,
-		   uint8_t *val,
-		   ErrorInfo *err);
+    /**
+     * Add the keys of a subtree to hash and bloom, either may be NULL.
+     *
+     * This is not a public API routine.
+     */
+    bool indexSubtree(uint32_t pageNum, HashIndex *hash, BloomFilter *bloom,
+		      ErrorInfo *err);
+
+    /**
+     * Descend to the leaf that should hold key, splitting full nodes.
+     *
+     * @param [in]  key     The key to be inserted.
+     * @param [out] pin     Pin of the leaf.
+     * @param [out] ac      The leaf, which has room for a key.
+     * @param [out] hi      The smallest separator above the leaf, may
+     *                      be NULL.
+     * @param [out] hasHi   false if no separator is above the leaf.
+     * @param [out] pathPn  Set to the non-leaf pages passed, for
+     *                      raiseStats, may be NULL.
+     * @param [out] pathIdx Set to the index taken in each, may be NULL.
+     * @param [out] err     Error info output.
+     *
+     * This is not a public API routine.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool descendInsert(uint8_t *key, PagePin *pin, R2PageAccess *ac,
+		       uint8_t *hi, bool *hasHi, std::vector<uint32_t> *pathPn,
+		       std::vector<uint32_t> *pathIdx, ErrorInfo *err);
 
+    /**
+     * insertBatch without the logging.
+     *
+     * This is not a public API routine.
+     */
+    bool insertBatchPages(uint8_t *keys, uint8_t *vals, uint32_t n,
+			  uint32_t *nInserted, ErrorInfo *err);
 
+    /**
+     * Merge a sorted run of keys into a leaf.
+     *
+     * @param [in,out] ac    The leaf, with room for n keys.
+     * @param [in]     keys  n keys, sorted, none repeated.
+     * @param [in]     vals  n values.
+     * @param [in]     n     Number of keys.
+     * @param [out]    pos   Room for n positions, used while merging.
+     *
+     * This is not a public API routine. Keys already in the leaf are
+     * skipped. Each key is placed by a binary search of the leaf keys
+     * past the previous one, then blocks of leaf keys are moved at
+     * most once each, from the end down.
+     *
+     * @result Number of keys merged.
+     */
+    uint32_t mergeRun(R2PageAccess *ac, const uint8_t *keys,
+		      const uint8_t *vals, uint32_t n, uint32_t *pos);
 
+    /**
+     * Compare a key with the key at position idx of a page.
+     *
+     * This is not a public API routine. key must share the page key
+     * prefix, if any.
+     */
+    int compareAt(R2PageAccess *ac, uint32_t idx, const uint8_t *key);
 
+    /**
+     * The tree level erase, without the logging.
+     *
+     * This is not a public API routine.
+     */
+    bool erasePages(uint8_t *key, ErrorInfo *err);
 
+    /**
+     * Make a page safe to change in copy-on-write mode.
+     *
+     * @param [in,out] pin       Pin of the page, moved to the copy.
+     * @param [in,out] ac        Access to the page, moved to the copy.
+     * @param [in]     parentPin Pin of the parent, NULL for the root.
+     * @param [in]     parent    The parent, already safe to change.
+     * @param [in]     idx       Index of the page in the parent.
+     * @param [out]    err       Error info output.
+     *
+     * This is not a public API routine. Does nothing unless
+     * copyOnWrite is set and a snapshot held can reach the page.
+     * Otherwise the page is copied to a new page, the
+     * parent or the root is pointed at the copy and the old page is
+     * retired. snapLock must be held.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool copyPage(PagePin *pin, R2PageAccess *ac, PagePin *parentPin,
+		  R2PageAccess *parent, uint32_t idx, ErrorInfo *err);
 
-    /********************************************************/
+    /**
+     * Return retired pages no snapshot can reach to ps.
+     *
+     * This is not a public API routine. snapLock must be held.
+     */
+    void freeRetired();
 
     /**
-     * Split a node.
+     * Write a value to a new chain of overflow pages.
      *
-     * @param [in,out] full   The full node to split.
-     * @param [in,out] empty  The empty node to use.
-     * @param [out] key       The key to promote to higher node.
+     * @param [in]  val       The value.
+     * @param [in]  len       Length of the value, > 0.
+     * @param [out] firstPage Page number of the first page.
      * @param [out] err       Error info output.
      *
-     * Split a node into two nodes, return true if successful.  The
-     * node full must have the maximum number of keys, else false is
-     * returned. The empty node must have zero keys else false is
-     * returned. key must be non-null, else false is returned, and it
-     * must point to a buffer large enough to store a key. The two nodes
-     * must be of the same page type, else false is returned.
+     * This is not a public API routine. On failure any pages written
+     * are freed.
      *
-     * The full node will be split into two, with keys (and associated
-     * data) moved into the empty page. A suitable 'middle' key from
-     * full will be chosen, and copied into the buffer pointed to by
-     * key. All keys and associated values greater than or equal to
-     * key will be copied to empty.
+     * @result true if success, false otherwise.
+     */
+    bool writeOverflow(const uint8_t *val, uint32_t len, uint32_t *firstPage,
+		       ErrorInfo *err);
+
+    /**
+     * Let go of the overflow pages of a slot, if it has any.
      *
-     * If false is returned full and empty are unchanged.
+     * This is not a public API routine. The pages are freed, or
+     * retired if a snapshot can reach them, snapLock must then be held.
+     */
+    void freeOverflow(const uint8_t *slot);
+
+    /**
+     * find, starting from the given root.
      *
-     * @note Locking is the callers responsibility.
+     * This is not a public API routine.
+     */
+    bool findFrom(uint32_t rootPageNum, uint8_t *key, uint8_t *val,
+		  ErrorInfo *err);
+
+    /**
+     * Prefetch the lines of a page the first probes of a search read.
      *
-     * @result true if node successfully split, false otherwise.
+     * @param [in] buf      The page.
+     * @param [in] pageType Type of the page, known from the parent.
+     *
+     * This is not a public API routine. The page header is not read,
+     * so nothing waits for the page. The header line is asked for,
+     * along with the lines of the first two binary search probes or
+     * the first line of each level of the search index.
      */
-    bool splitNode(R2PageAccess *full, R2PageAccess *empty, uint8_t *key,
-		   ErrorInfo *err);
+    void prefetchPage(uint8_t *buf, uint32_t pageType);
 
     /**
-     * Concatenate two nodes.
+     * Mark a page changed by the call being logged.
      *
-     * @param [in,out] dst The destination.
-     * @param [in]     src The source node.
-     * @param [in]     dstIsFirst Indicates node ordering.
-     * @param [out]    err Error info output.
+     * This is not a public API routine. The pin is set dirty. If wal
+     * is set the page LSN is set to WAL_LSN_PENDING until logEnd.
+     */
+    void setDirty(PagePin *pin, R2PageAccess *ac);
+
+    /**
+     * Mark a non-leaf page whose entry at idx had its subtree count
+     * changed by n and its sum by sum.
      *
-     * Concatenate two nodes into one. The final result will be
-     * stored in node dst. src and dst are expected to be two adjascent
-     * nodes - that is they both have the same parent and the child node
-     * pointers that refer to them are next to each other. dstIsFirst
-     * indicates which keys are "smaller" than the other. If dstIsFirst
-     * is true then the keys in dst are all less than the keys in src,
-     * if false the keys in dst are all larger than src.
+     * This is not a public API routine. Same as setDirty, but the
+     * change is logged as a R2LogCount record as long as every other
+     * page the call changes is also described by a record.
+     */
+    void setDirtyCount(PagePin *pin, R2PageAccess *ac, uint32_t idx,
+		       int64_t n, int64_t sum);
+
+    /**
+     * Mark a page changed, without choosing how it is logged.
      *
-     * Each node must have exactly the minimum number of keys and sum
-     * of the two must be exactly equal to the max number of keys.
+     * This is not a public API routine. Used by the setDirty
+     * routines.
+     */
+    void markDirty(PagePin *pin, R2PageAccess *ac);
+
+    /**
+     * Mark a leaf changed by insertAt or removeAt.
      *
-     * true will be returned only if the two nodes are properly merged.
-     * Otherwise false is returned, the error condition will be set,
-     * and input nodes are not not modified. If the concat succeeds src
-     * will have no keys and dst will have all keys.
-     * 
-     * If src or dst is null false is returned. If there are too many
-     * keys false is returned.
+     * @param [in] pin  Holds the pin on the leaf.
+     * @param [in] ac   The leaf.
+     * @param [in] type R2LogInsert or R2LogRemove.
+     * @param [in] idx  The slot.
+     * @param [in] key  Key inserted, NULL for a remove.
+     * @param [in] val  Value inserted, NULL for a remove.
      *
+     * This is not a public API routine. Same as setDirty, and the
+     * physiological record is kept in case every page the call
+     * changes is described by a record.
+     */
+    void setDirtyLeaf(PagePin *pin, R2PageAccess *ac, uint32_t type,
+		      uint32_t idx, uint8_t *key, uint8_t *val);
+
+    /// Set the header rootPageNum. This is not a public API routine.
+    void setRoot(uint32_t pageNum);
+
+    /// Start logging a call. This is not a public API routine.
+    void logBegin();
+
+    /**
+     * Append the changes of the call to wal.
      *
-     * @note Locking is the callers responsibility.
+     * This is not a public API routine. Called even if the call
+     * failed, since pages may have been split before the failure.
+     * The pages changed get the LSN of the group.
      *
      * @result true if success, false otherwise.
-     * 
      */
-    bool concatNodes(R2PageAccess *dst, R2PageAccess *src, bool dstIsFirst,
-		     ErrorInfo *err);
+    bool logEnd(ErrorInfo *err);
 
+    /**
+     * Apply one log record, see WALReplayer::redo.
+     *
+     * This is not a public API routine. Used by recover.
+     */
+    bool redo(uint64_t lsn, uint32_t type, uint32_t pageNum,
+	      const uint8_t *data, uint32_t len, ErrorInfo *err);
 
     /**
-     * Redistribute keys between two nodes.
+     * Pin a page named by a log record, allocating it if needed.
      *
-     * @param [in,out] n1  Node.
-     * @param [in,out] n2  Node.
+     * This is not a public API routine. Pages allocated on the way
+     * to pageNum are zeroed and left unused.
      *
-     * Redistribute the keys, so that each node has atleast the
-     * minimum required number of keys. Returns true if redistribution
-     * takes place successfully. Otherwise false is returned and n1
-     * and n2 are unmodified. Nodes must be of the same type, and
-     * neither n1 nor n2 can be null. All of the keys in n1 must be
-     * less than all of the keys in n2 - this condition is not
-     * checked.
+     * @result true if success, false otherwise.
+     */
+    bool redoPin(PagePin *pin, R2PageAccess *ac, uint32_t pageNum,
+		 ErrorInfo *err);
+
+    /**
+     * Check if key belongs to a page right of the current one.
      *
-     * The keys will be redistributed so that n1 and n2 have
-     * approximately the same number of keys. The ordering of the keys
-     * will be preserved (all n1 keys are before all n2 keys).
+     * @param [in]  nextPageNum The next page at the same level.
+     * @param [in]  key         The key being searched for.
+     * @param [out] right       Set true if key is at least the first
+     *                          key of the next page.
+     * @param [out] err         Error info output.
      *
-     * This routine is really only intended to be used when exactly one
-     * node has less than the minimum number of keys - so it will reject
-     * any other kind of input.
-     * 
-     * @note Locking is the callers resposibility.
+     * This is not a public API routine. The next page is read
+     * optimistically.
      *
      * @result true if success, false otherwise.
-     *
      */
-    bool redistributeNodes(R2PageAccess *n1, R2PageAccess *n2, ErrorInfo *err);
+    bool keyInNext(uint32_t nextPageNum, uint8_t *key, bool *right,
+		   ErrorInfo *err);
 
-    /********************************************************/
+    /**
+     * Find and write latch the page at a level that covers key.
+     *
+     * @param [in]     key   The key.
+     * @param [in]     level The level wanted, 0 for a leaf.
+     * @param [in,out] pin   Holds the pin on the page found.
+     * @param [in,out] latch Holds the latch on the page found.
+     * @param [out]    ac    Set up to access the page found.
+     * @param [out]    err   Error info output.
+     *
+     * This is not a public API routine. Used by insertConcurrent.
+     * Pages above level are read optimistically, except that key 0
+     * of a non-leaf page is lowered under its latch when key is
+     * smaller.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool latchCovering(uint8_t *key, uint8_t level, PagePin *pin,
+		       R2WriteLatch *latch, R2PageAccess *ac, ErrorInfo *err);
 
     /**
-     * Return key index, where it should be store or where it is stored.
+     * Split a full, latched page and add a key to it, B-link style.
      *
-     * @param [in] ac Pointer to info about a leaf page.
-     * @param [in] key The key to be inserted.
-     * @param [out] idx Key number where key is stored or should be stored.
+     * @param [in,out] pin   Holds the pin on the page.
+     * @param [in,out] ac    The full page, write latched by the caller.
+     * @param [in]     key   Key to add after the split.
+     * @param [in]     val   Value to add after the split.
+     * @param [out]    sep   The first key of the new page.
+     * @param [out]    newPageNum The new page, that must be added to
+     *                            the level above. Set to 0 if the page
+     *                            was the root, a new root has then
+     *                            already been made.
+     * @param [out]    err   Error info output.
      *
-     * This is not a public API routine.
+     * This is not a public API routine. The new page is filled and
+     * linked in to the right of ac before the caller lets go of the
+     * latch on ac.
      *
-     * The node can be a leaf or non-leaf node.
+     * @result true if success, false otherwise.
+     */
+    bool splitRight(PagePin *pin, R2PageAccess *ac, uint8_t *key,
+		    uint8_t *val, uint8_t *sep, uint32_t *newPageNum,
+		    ErrorInfo *err);
+
+    /**
+     * Append a key and value to the page being filled at a level.
      *
-     * Search the key array fo the key. Return true if the key is
-     * found, and store the position of the key in *idx. If the key is
-     * not found, return false, and store the position where the key
-     * should be inserted at *idx.
+     * @param [in,out] levels Build state, one entry per level.
+     * @param [in]     level  Level to append to, 0 is the leaves.
+     * @param [in]     key    The key, larger than any key at this level.
+     * @param [in]     val    User value or child page number.
+     * @param [in]     target Keys per page, indexed by page type.
+     * @param [out]    err    Error info output.
      *
-     * Locking and thread safety are the responsibility of the caller.
+     * This is not a public API routine. If the page being filled has
+     * target keys a new page is started and its first key is appended
+     * to the level above, creating that level if needed.
      *
-     * @note The return value is not the offset into the key array, rather
-     * it is the key index - it needs to be multiplied by the key size to
-     * find the actual byte offset.
+     * @result true if success, false otherwise.
+     */
+    bool bulkAppend(std::vector<R2BulkLevel> *levels, uint32_t level,
+		    uint8_t *key, uint8_t *val, uint32_t *target,
+		    ErrorInfo *err);
+
+    /**
+     * Finish a bulk load.
      *
-     * @result Return true if found, false otherwise.
+     * This is not a public API routine. Fix the last page of each
+     * level if it underflows, then set rootPageNum to the root of the
+     * new tree, dropping a non-leaf root that has a single child. The
+     * header is left for the caller to set.
+     *
+     * @result true if success, false otherwise.
      */
-    bool findKeyPosition(R2PageAccess *ac, uint8_t *key, uint32_t *idx);
+    bool bulkFinish(std::vector<R2BulkLevel> *levels, uint32_t *rootPageNum,
+		    ErrorInfo *err);
 
     /********************************************************/
 
@@ -550,10 +2662,168 @@ public:
      *
      * The index header will be updated using the param information.
      *
+     * false is returned if the key size is 0, if the page is too
+     * small to hold 2 keys in both leaf and non-leaf nodes, or if it
+     * would hold more than R2_MAX_KEYS_PER_PAGE keys. The header must
+     * not be used if false is returned.
+     *
+     * @result true if the params are usable, false otherwise.
      */
     static bool initIndexHeader(R2IndexHeader *h, R2BTreeParams *p);
 };
 
+/**
+ * Ordered scan over the keys of a R2BTree.
+ *
+ * A cursor is positioned on one key of a leaf, or is not valid. Once
+ * positioned it moves between leaves using the sibling links, so a
+ * scan only descends from the root once. The current leaf stays
+ * pinned in the page store until the cursor moves off it, is closed
+ * or is destroyed.
+ *
+ * @note The tree must not be changed while a cursor is open on it.
+ * Locking is the callers responsibility.
+ */
+class R2Cursor {
+private:
+    R2BTree *tree;
+    PagePin pin;
+    R2PageAccess ac;
+    uint32_t idx;
+    bool valid;
+
+    /// Snapshot being read, NULL for the tree itself.
+    R2Snapshot *snap;
+
+    /// Non-leaf pages above the current leaf, root first.
+    std::vector<uint32_t> pathPages;
+
+    /// Index of the child taken in each of pathPages.
+    std::vector<uint32_t> pathIdx;
+
+public:
+    R2Cursor(R2BTree *t) : tree(t), idx(0), valid(false), snap(NULL) {;};
+
+    /**
+     * Cursor on a snapshot taken by R2BTree::takeSnapshot.
+     *
+     * Needs no lock, and may run at the same time as anything else on
+     * the tree. Must be closed before the snapshot is released.
+     */
+    R2Cursor(R2BTree *t, R2Snapshot *s)
+	: tree(t), idx(0), valid(false), snap(s) {;};
+
+    /**
+     * Position on the first key greater than or equal to key.
+     *
+     * @param [in]  key The key to look for.
+     * @param [out] err Error info output.
+     *
+     * If every key in the tree is smaller than key false is returned,
+     * err is set to ERR_KEY_NOT_FOUND and the cursor is not valid.
+     *
+     * @result true if the cursor is on a key, false otherwise.
+     */
+    bool seek(uint8_t *key, ErrorInfo *err);
+
+    /**
+     * Position on the smallest key in the tree.
+     *
+     * @result true if the cursor is on a key, false if the tree is empty.
+     */
+    bool seekFirst(ErrorInfo *err);
+
+    /**
+     * Position on the largest key in the tree.
+     *
+     * @result true if the cursor is on a key, false if the tree is empty.
+     */
+    bool seekLast(ErrorInfo *err);
+
+    /**
+     * Move to the next key.
+     *
+     * @result true if the cursor is on a key, false at the end of the tree.
+     */
+    bool next(ErrorInfo *err);
+
+    /**
+     * Move to the previous key.
+     *
+     * @result true if the cursor is on a key, false at the start of the tree.
+     */
+    bool prev(ErrorInfo *err);
+
+    /**
+     * Copy up to n keys and values, moving forward.
+     *
+     * @param [in]  n    Max number of entries to copy.
+     * @param [out] keys Buffer for n keys, may be NULL.
+     * @param [out] vals Buffer for n values, may be NULL.
+     * @param [out] err  Error info output.
+     *
+     * Starting at the current key, copy keys and values into the
+     * buffers, a run of keys at a time from each leaf, and leave the
+     * cursor on the key after the last one copied. Stops early at the
+     * end of the tree, in which case the cursor is no longer valid.
+     *
+     * @result Number of entries copied.
+     */
+    uint32_t fetch(uint32_t n, uint8_t *keys, uint8_t *vals, ErrorInfo *err);
+
+    /// true if the cursor is on a key.
+    bool isValid() { return this->valid; };
+
+    /**
+     * Copy the current key.
+     *
+     * @result false if the cursor is not valid.
+     */
+    bool getKey(uint8_t *key);
+
+    /**
+     * Copy the current value.
+     *
+     * @result false if the cursor is not valid.
+     */
+    bool getVal(uint8_t *val);
+
+    /// Release the current leaf, the cursor is no longer valid.
+    void close();
+
+private:
+    /**
+     * Position on the first key, or on the last key if last is true.
+     */
+    bool descend(bool last, ErrorInfo *err);
+
+    /**
+     * Move to the leaf pageNum, 0 ends the scan.
+     *
+     * Empty leaves are skipped in the direction forward indicates.
+     */
+    bool moveToLeaf(uint32_t pageNum, bool forward, ErrorInfo *err);
+
+    /**
+     * Move to the next leaf, or the previous one if forward is false.
+     *
+     * Follows the sibling links, or in copy-on-write mode goes back up
+     * pathPages to the nearest parent with a child on that side.
+     */
+    bool nextLeaf(bool forward, ErrorInfo *err);
+
+    /**
+     * Descend from pageNum to its first leaf, or its last if last is
+     * true, adding the non-leaf pages to pathPages.
+     */
+    bool edgeLeaf(uint32_t pageNum, bool last, ErrorInfo *err);
+
+    // disallow copy constructor
+    R2Cursor(const R2Cursor &);
+    // disallow assignment operator
+    void operator=(const R2Cursor &);
+};
+
 }
 
 #endif
@@ -0,0 +1,315 @@
+#ifndef _R2BTREET_H_
+#define _R2BTREET_H_
+
+namespace dback {
+
+/**
+ * @page r2btreet Compile time R2BTree.
+ *
+ * R2BTree takes its key size, value size and page size from a
+ * R2IndexHeader at run time and compares keys through the virtual
+ * R2KeyInterface::compare. Both happen on every probe of every
+ * search, which keeps the compiler from inlining the compare or
+ * folding the page offsets.
+ *
+ * R2BTreeT is the same tree with the key handling and the sizes
+ * fixed at compile time by a key policy class and a page size. The
+ * page layout is the one initIndexHeader computes, so R2BTreeT and
+ * R2BTree can be used on the same pages. A key policy looks like:
+ *
+ * @verbatim
+ *
+ * class MyPolicy {
+ * public:
+ *     static const uint32_t KEY_SIZE = 16;
+ *     static const uint32_t VAL_SIZE = 8;
+ *     static const bool IS_UUID = true;
+ *     static int compare(const uint8_t *a, const uint8_t *b);
+ * };
+ *
+ * @endverbatim
+ *
+ * IS_UUID has the same meaning as R2KeyInterface::isUUID.
+ *
+ * find and insert, the hot paths, are done by R2BTreeT itself.
+ * Everything else, and any insert that meets a full node on the way
+ * down, is passed to a runtime R2BTree that R2BTreeT holds. Splits
+ * only happen about once every maxNumKeys / 2 inserts so this costs
+ * little. If the runtime tree has a log, is in copy-on-write mode or
+ * stores key prefixes every find and insert goes to it, so that the
+ * insert is logged, pages held by snapshots are copied and leaf keys
+ * are read past their prefix. The same goes for a runtime tree with a
+ * hash index, which then serves the finds and is kept by the inserts.
+ */
+
+/**
+ * Key policy for 16 byte UUID keys and 8 byte values.
+ */
+class R2UUIDKeyPolicy {
+public:
+    static const uint32_t KEY_SIZE = 16;
+    static const uint32_t VAL_SIZE = 8;
+    static const bool IS_UUID = true;
+
+    static int compare(const uint8_t *a, const uint8_t *b) {
+	return memcmp(a, b, 16);
+    };
+};
+
+/**
+ * R2KeyInterface that calls a key policy.
+ *
+ * Used by R2BTreeT for the runtime R2BTree it holds.
+ */
+template <class KeyPolicy>
+class R2PolicyKey : public R2KeyInterface {
+public:
+    int compare(const uint8_t *a, const uint8_t *b) {
+	return KeyPolicy::compare(a, b);
+    };
+
+    bool isUUID() { return KeyPolicy::IS_UUID; };
+};
+
+template <class KeyPolicy, uint32_t PageSize>
+class R2BTreeT {
+public:
+    static const uint32_t KEY_SIZE = KeyPolicy::KEY_SIZE;
+    static const uint32_t VAL_SIZE = KeyPolicy::VAL_SIZE;
+    static const uint32_t PAGE_SIZE = PageSize;
+
+    /// Same as initIndexHeader, non-leaf values are page numbers.
+    static const uint32_t MAX_NON_LEAF_KEYS =
+	((PageSize - sizeof(R2PageHeader) - sizeof(uint32_t))
+	 / (KEY_SIZE + sizeof(uint32_t))) & ~(uint32_t)0x01;
+
+    static const uint32_t MAX_LEAF_KEYS =
+	((PageSize - sizeof(R2PageHeader)) / (KEY_SIZE + VAL_SIZE))
+	& ~(uint32_t)0x01;
+
+    /// Offset of the key array in a non-leaf page.
+    static const uint32_t NON_LEAF_KEYS_OFFSET =
+	sizeof(R2PageHeader) + MAX_NON_LEAF_KEYS * sizeof(uint32_t);
+
+    /// Offset of the key array in a leaf page.
+    static const uint32_t LEAF_KEYS_OFFSET =
+	sizeof(R2PageHeader) + MAX_LEAF_KEYS * VAL_SIZE;
+
+private:
+    R2PolicyKey<KeyPolicy> key;
+    R2BTree tree;
+
+public:
+    R2BTreeT() {
+	this->tree.ki = &this->key;
+    };
+
+    /**
+     * Fill in a R2IndexHeader for this layout.
+     */
+    static void initIndexHeader(R2IndexHeader *h) {
+	R2BTreeParams p;
+	p.pageSize = PageSize;
+	p.keySize = KEY_SIZE;
+	p.valSize = VAL_SIZE;
+	R2BTree::initIndexHeader(h, &p);
+    };
+
+    /**
+     * Attach to an index.
+     *
+     * @param [in]  h   The index header.
+     * @param [in]  ps  Page store holding the tree pages.
+     * @param [out] err Error info output.
+     *
+     * If h does not describe the compile time layout false is
+     * returned and err is set to ERR_BAD_ARG.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool open(R2IndexHeader *h, PageStore *ps, ErrorInfo *err) {
+	if (h->formatVersion != R2_FORMAT_VERSION
+	    || h->keySize != KEY_SIZE
+	    || h->pageSize != PageSize
+	    || h->valSize[PageTypeLeaf] != VAL_SIZE
+	    || h->maxNumKeys[PageTypeLeaf] != MAX_LEAF_KEYS
+	    || h->maxNumKeys[PageTypeNonLeaf] != MAX_NON_LEAF_KEYS
+	    || h->nonLeafLayout != R2LayoutSorted
+	    || h->leafLayout != R2LeafSorted
+	    || h->varValues
+	    || h->subtreeMax
+	    || h->subtreeCounts) {
+	    err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	    err->message.assign("index header does not match tree layout");
+	    return false;
+	}
+	this->tree.header = h;
+	this->tree.ps = ps;
+	return true;
+    };
+
+    /// The runtime tree used for everything but find and insert.
+    R2BTree *getTree() { return &this->tree; };
+
+    /// Same as R2BTree::initTree.
+    bool initTree(ErrorInfo *err) { return this->tree.initTree(err); };
+
+    /// Same as R2BTree::erase.
+    bool erase(uint8_t *key, ErrorInfo *err) {
+	return this->tree.erase(key, err);
+    };
+
+    /// Same as R2BTree::bulkLoad.
+    bool bulkLoad(R2BulkSource *src, double fillFactor, ErrorInfo *err) {
+	return this->tree.bulkLoad(src, fillFactor, err);
+    };
+
+    /**
+     * Same as R2BTree::findKeyPosition, on a key array.
+     */
+    static bool findKeyPosition(const uint8_t *keys, uint32_t n,
+				const uint8_t *key, uint32_t *idx) {
+	if (KeyPolicy::IS_UUID && KEY_SIZE == 16)
+	    return KeySearch::findUUIDPosition(keys, n, key, idx);
+
+	uint32_t lo = 0;
+	uint32_t hi = n;
+	while (lo < hi) {
+	    uint32_t m = lo + (hi - lo) / 2;
+	    if (KeyPolicy::compare(keys + m * KEY_SIZE, key) < 0)
+		lo = m + 1;
+	    else
+		hi = m;
+	}
+	*idx = lo;
+	return lo < n && KeyPolicy::compare(keys + lo * KEY_SIZE, key) == 0;
+    };
+
+    /// Same as R2BTree::find.
+    bool find(uint8_t *key, uint8_t *val, ErrorInfo *err) {
+	if (this->tree.prefixKeys || this->tree.hashIndex != NULL
+	    || this->tree.bloomFilter != NULL)
+	    return this->tree.find(key, val, err);
+
+	PagePin pin;
+	uint32_t idx;
+	uint8_t *buf = pin.pin(this->tree.ps, this->tree.header->rootPageNum,
+			       err);
+	if (buf == NULL)
+	    return false;
+
+	R2PageHeader *h = reinterpret_cast<R2PageHeader *>(buf);
+	while (h->pageType == PageTypeNonLeaf) {
+	    uint32_t pn = this->childFor(buf, key);
+	    buf = pin.pin(this->tree.ps, pn, err);
+	    if (buf == NULL)
+		return false;
+	    h = reinterpret_cast<R2PageHeader *>(buf);
+	}
+
+	if ( ! findKeyPosition(buf + LEAF_KEYS_OFFSET, h->numKeys, key, &idx)) {
+	    err->setErrNum(ErrorInfo::ERR_KEY_NOT_FOUND);
+	    err->message.assign("key not found");
+	    return false;
+	}
+
+	if (val != NULL)
+	    memcpy(val, buf + sizeof(R2PageHeader) + idx * VAL_SIZE, VAL_SIZE);
+
+	return true;
+    };
+
+    /**
+     * Same as R2BTree::insert.
+     *
+     * If a full node is met on the way down nothing has been changed
+     * that matters, and the insert is redone by the runtime tree,
+     * which does the splits.
+     */
+    bool insert(uint8_t *key, uint8_t *val, ErrorInfo *err) {
+	if (this->tree.wal != NULL || this->tree.copyOnWrite
+	    || this->tree.prefixKeys || this->tree.hashIndex != NULL
+	    || this->tree.bloomFilter != NULL)
+	    return this->tree.insert(key, val, err);
+
+	PagePin pin;
+	uint32_t idx;
+	uint8_t *buf = pin.pin(this->tree.ps, this->tree.header->rootPageNum,
+			       err);
+	if (buf == NULL)
+	    return false;
+
+	R2PageHeader *h = reinterpret_cast<R2PageHeader *>(buf);
+	while (h->pageType == PageTypeNonLeaf) {
+	    if (h->numKeys == MAX_NON_LEAF_KEYS)
+		goto full;
+
+	    uint8_t *keys = buf + NON_LEAF_KEYS_OFFSET;
+	    if (KeyPolicy::compare(key, keys) < 0) {
+		memcpy(keys, key, KEY_SIZE);
+		pin.setDirty();
+	    }
+
+	    uint32_t pn = this->childFor(buf, key);
+	    buf = pin.pin(this->tree.ps, pn, err);
+	    if (buf == NULL)
+		return false;
+	    h = reinterpret_cast<R2PageHeader *>(buf);
+	}
+
+	if (h->numKeys == MAX_LEAF_KEYS)
+	    goto full;
+
+	{
+	    uint8_t *keys = buf + LEAF_KEYS_OFFSET;
+	    uint8_t *vals = buf + sizeof(R2PageHeader);
+	    if (findKeyPosition(keys, h->numKeys, key, &idx)) {
+		err->setErrNum(ErrorInfo::ERR_DUPLICATE_INSERT);
+		err->message.assign("attempt to insert duplicate key");
+		return false;
+	    }
+
+	    uint32_t n_to_move = h->numKeys - idx;
+	    memmove(keys + (idx + 1) * KEY_SIZE, keys + idx * KEY_SIZE,
+		    n_to_move * KEY_SIZE);
+	    memmove(vals + (idx + 1) * VAL_SIZE, vals + idx * VAL_SIZE,
+		    n_to_move * VAL_SIZE);
+	    memcpy(keys + idx * KEY_SIZE, key, KEY_SIZE);
+	    memcpy(vals + idx * VAL_SIZE, val, VAL_SIZE);
+	    h->numKeys++;
+	    pin.setDirty();
+	}
+
+	return true;
+
+    full:
+	pin.release();
+	return this->tree.insert(key, val, err);
+    };
+
+private:
+    /**
+     * Return the page number of the child of a non-leaf page to descend
+     * into, same as R2BTree::findChildIndex.
+     */
+    uint32_t childFor(uint8_t *buf, uint8_t *key) {
+	R2PageHeader *h = reinterpret_cast<R2PageHeader *>(buf);
+	uint32_t idx, pn;
+	if ( ! findKeyPosition(buf + NON_LEAF_KEYS_OFFSET, h->numKeys, key,
+			       &idx)
+	     && idx > 0)
+	    idx--;
+	memcpy(&pn, buf + sizeof(R2PageHeader) + idx * sizeof(uint32_t),
+	       sizeof(uint32_t));
+	return pn;
+    };
+
+    // disallow copy constructor
+    R2BTreeT(const R2BTreeT &);
+    // disallow assignment operator
+    void operator=(const R2BTreeT &);
+};
+
+}
+
+#endif
@@ -0,0 +1,346 @@
+#ifndef _WAL_H_
+#define _WAL_H_
+
+namespace dback {
+
+/**
+ * @page wal Write-ahead log.
+ *
+ * A page store only writes a page back when it is evicted or
+ * flushed, so after a crash the index file holds some mix of old and
+ * new pages. A split that changed three pages may have reached the
+ * file for one of them only. The write-ahead log makes every change
+ * recoverable: each operation appends a group of redo records
+ * describing what it changed, and a page is only written back after
+ * the log records for it are on disk.
+ *
+ * Records are physiological - they name a page, and say what was done
+ * to it. What the record means is up to the caller, the log itself
+ * only stores the type, page number and data of each record. A group
+ * of records is either replayed as a whole or not at all, so an
+ * operation that changes several pages is atomic.
+ *
+ * Every record has a log sequence number (LSN), the position in the
+ * log just past the end of the record. LSNs only grow, also across a
+ * checkpoint. A page holds the LSN of the last group that changed it,
+ * and on replay a record is only applied to a page with a smaller
+ * LSN, which makes replay idempotent.
+ *
+ * append only copies a group to memory. commit waits until the log
+ * is on disk up to a given LSN. Commits from many threads are served
+ * by one write and one fdatasync: the first thread to find no write
+ * in progress writes everything appended so far, and the threads
+ * that come while it waits for the disk are all covered by the next
+ * write. A background flusher can also be started, which writes the
+ * log every few milliseconds for callers that do not need to wait.
+ *
+ * The log file starts with a WALFileHeader. Groups follow, each a
+ * WALGroupHeader followed by its records, each a WALRecordHeader
+ * followed by its data. A group that was torn by a crash fails its
+ * checksum, and it and anything after it are dropped when the log is
+ * opened. Pages are assumed to reach the index file whole, a torn
+ * page write is not repaired.
+ */
+
+/// Value of R2PageHeader::lsn for a page changed but not yet logged.
+static const uint64_t WAL_LSN_PENDING = UINT64_MAX;
+
+/**
+ * Layout of the start of the log file.
+ */
+class WALFileHeader {
+public:
+    /// Always WriteAheadLog::MAGIC.
+    uint32_t magic;
+
+    /// File format version, currently 1.
+    uint32_t version;
+
+    /// LSN of the first byte after this header.
+    uint64_t baseLsn;
+};
+
+/**
+ * Layout of the start of each group in the log file.
+ */
+class WALGroupHeader {
+public:
+    /// Always WriteAheadLog::GROUP_MAGIC.
+    uint32_t magic;
+
+    /// Number of bytes of records following this header.
+    uint32_t length;
+
+    /// Number of records in the group.
+    uint32_t numRecords;
+
+    /// CRC-32 of this header, with crc 0, and the records.
+    uint32_t crc;
+};
+
+/**
+ * Layout of the start of each record in the log file.
+ */
+class WALRecordHeader {
+public:
+    /// Record type, chosen by the caller.
+    uint32_t type;
+
+    /// Page the record applies to, 0 if none.
+    uint32_t pageNum;
+
+    /// Number of bytes of data following this header.
+    uint32_t length;
+};
+
+/**
+ * Records of one operation, built up before being appended.
+ */
+class WALGroup {
+private:
+    /// The records, laid out as in the log file.
+    std::vector<uint8_t> buf;
+
+    uint32_t numRecords;
+
+public:
+    WALGroup() : numRecords(0) {;};
+
+    /**
+     * Add a record.
+     *
+     * @param [in] type    Record type.
+     * @param [in] pageNum Page the record applies to.
+     * @param [in] data    Record data, may be NULL if len is 0.
+     * @param [in] len     Number of bytes of data.
+     */
+    void add(uint32_t type, uint32_t pageNum, const uint8_t *data,
+	     uint32_t len);
+
+    /// Remove all records.
+    void clear();
+
+    /// Number of records added.
+    uint32_t getNumRecords() { return this->numRecords; };
+
+    /// The records, getLength bytes.
+    const uint8_t *getBuf() { return this->buf.empty() ? NULL : &this->buf[0]; };
+
+    /// Number of bytes of records.
+    size_t getLength() { return this->buf.size(); };
+
+private:
+    // disallow copy constructor
+    WALGroup(const WALGroup &);
+    // disallow assignment operator
+    void operator=(const WALGroup &);
+};
+
+/**
+ * Applies the records read back from a log.
+ *
+ * This is a pure virtual base class, see WriteAheadLog::replay.
+ */
+class WALReplayer {
+public:
+    virtual ~WALReplayer() {;};
+
+    /**
+     * Apply one record.
+     *
+     * @param [in]  lsn     LSN of the record.
+     * @param [in]  type    Record type.
+     * @param [in]  pageNum Page the record applies to.
+     * @param [in]  data    Record data.
+     * @param [in]  len     Number of bytes of data.
+     * @param [out] err     Error info output.
+     *
+     * @result true if success, false to stop the replay.
+     */
+    virtual bool redo(uint64_t lsn, uint32_t type, uint32_t pageNum,
+		      const uint8_t *data, uint32_t len, ErrorInfo *err) = 0;
+};
+
+/**
+ * Redo log kept in a single file.
+ *
+ * All routines are thread safe.
+ */
+class WriteAheadLog {
+public:
+    /// Value of WALFileHeader::magic.
+    static const uint32_t MAGIC = 0x64627731;
+
+    /// Value of WALGroupHeader::magic.
+    static const uint32_t GROUP_MAGIC = 0x67727031;
+
+private:
+    /// Path of the log file.
+    std::string path;
+
+    /// The log file, -1 if not open.
+    int fd;
+
+    /// LSN of the first byte after the file header.
+    uint64_t baseLsn;
+
+    /// LSN of the end of the last group appended.
+    uint64_t appendLsn;
+
+    /// The log is on disk up to this LSN.
+    uint64_t durableLsn;
+
+    /// Groups appended but not yet written.
+    std::vector<uint8_t> pending;
+
+    /// true while a thread is writing and syncing the log.
+    bool flushing;
+
+    /// true after a write failed, every commit fails from then on.
+    bool failed;
+
+    /// Protects everything above, the flusher state and the stats.
+    boost::mutex lock;
+
+    /// Signalled when a write finishes.
+    boost::condition_variable flushDone;
+
+    /// Background flusher thread, NULL if not running.
+    boost::thread *flusher;
+
+    /// Signalled to stop the flusher.
+    boost::condition_variable flusherWake;
+
+    /// true while the flusher should keep running.
+    bool flusherRun;
+
+    /// Milliseconds between flusher writes.
+    uint32_t flushInterval;
+
+    uint64_t nCommits;
+    uint64_t nSyncs;
+    uint64_t nGroups;
+
+public:
+    WriteAheadLog();
+
+    /// Anything appended is written and the file closed.
+    ~WriteAheadLog();
+
+    /**
+     * Open or create the log file.
+     *
+     * A new file gets a header. In an existing file the groups are
+     * checked and the log is cut at the first torn group.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool open(const char *path, ErrorInfo *err);
+
+    /**
+     * Stop the flusher, write anything appended and close the file.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool close(ErrorInfo *err);
+
+    /**
+     * Add a group to the end of the log.
+     *
+     * @param [in]  g   The group, left unchanged.
+     * @param [out] lsn LSN of the end of the group.
+     * @param [out] err Error info output.
+     *
+     * The group is only copied to memory, use commit to wait until it
+     * is on disk. An empty group is not added, lsn is then the LSN of
+     * the end of the log.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool append(WALGroup *g, uint64_t *lsn, ErrorInfo *err);
+
+    /**
+     * Wait until the log is on disk up to lsn.
+     *
+     * @param [in]  lsn An LSN returned by append.
+     * @param [out] err Error info output.
+     *
+     * If no write is in progress the calling thread writes and syncs
+     * every group appended so far, otherwise it waits for the write in
+     * progress and checks again.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool commit(uint64_t lsn, ErrorInfo *err);
+
+    /**
+     * Start a thread that writes the log every intervalMs.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool startFlusher(uint32_t intervalMs, ErrorInfo *err);
+
+    /// Stop the flusher thread, if running.
+    void stopFlusher();
+
+    /**
+     * Pass every record in the log to r, oldest first.
+     *
+     * Call after open and before anything is appended.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool replay(WALReplayer *r, ErrorInfo *err);
+
+    /**
+     * Empty the log.
+     *
+     * Anything appended is written first. The caller must have
+     * flushed every page changed by the logged groups, and saved the
+     * index header, since the log can no longer be replayed. LSNs
+     * carry on from where they were. Nothing may be appended while the
+     * checkpoint runs.
+     *
+     * @result true if success, false otherwise.
+     */
+    bool checkpoint(ErrorInfo *err);
+
+    /// LSN of the end of the last group appended.
+    uint64_t getAppendLsn();
+
+    /// The log is on disk up to this LSN.
+    uint64_t getDurableLsn();
+
+    /// Number of commit calls.
+    uint64_t getNumCommits();
+
+    /// Number of times the log was written and synced.
+    uint64_t getNumSyncs();
+
+    /// Number of groups appended.
+    uint64_t getNumGroups();
+
+    /// Set all counters to 0.
+    void resetStats();
+
+private:
+    /**
+     * Write and sync all pending groups.
+     *
+     * Lock must be held and no write in progress. The lock is let go
+     * during the write.
+     */
+    bool writePending(boost::mutex::scoped_lock *guard, ErrorInfo *err);
+
+    /// Body of the flusher thread.
+    void flusherMain();
+
+    // disallow copy constructor
+    WriteAheadLog(const WriteAheadLog &);
+    // disallow assignment operator
+    void operator=(const WriteAheadLog &);
+};
+
+}
+
+#endif
@@ -0,0 +1,293 @@
+#include <inttypes.h>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <new>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+
+#include "dback.h"
+#include "bloomfilter.h"
+
+namespace dback {
+
+/****************************************************/
+/****************************************************/
+/* Bloom filter                                     */
+/****************************************************/
+/****************************************************/
+
+/**
+ * Mix the bits of a word, the finalizer of MurmurHash3.
+ */
+static inline uint64_t
+mix64(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/// Number of 64 bit words in a block.
+static const uint32_t BLOCK_WORDS = BloomFilter::BLOCK_SIZE / 8;
+
+/// Number of bits in a block.
+static const uint32_t BLOCK_BITS = BloomFilter::BLOCK_SIZE * 8;
+
+/**
+ * Checksum of n blocks, stored in BloomFileHeader::sum.
+ */
+static uint64_t
+block_sum(const uint64_t *words, uint64_t n)
+{
+    uint64_t sum = n;
+    for (uint64_t i = 0; i < n * BLOCK_WORDS; i++)
+	sum = mix64(sum ^ words[i]);
+    return sum;
+}
+
+/**
+ * Read all of len bytes, false on a short read.
+ */
+static bool
+read_all(int fd, uint8_t *buf, size_t len)
+{
+    while (len > 0) {
+	ssize_t n = ::read(fd, buf, len);
+	if (n <= 0)
+	    return false;
+	buf += n;
+	len -= n;
+    }
+    return true;
+}
+
+/**
+ * Write all of len bytes.
+ */
+static bool
+write_all(int fd, const uint8_t *buf, size_t len)
+{
+    while (len > 0) {
+	ssize_t n = ::write(fd, buf, len);
+	if (n <= 0)
+	    return false;
+	buf += n;
+	len -= n;
+    }
+    return true;
+}
+
+BloomFilter::BloomFilter(uint32_t keySize, uint64_t maxKeys,
+			 uint32_t bitsPerKey)
+    : keySize(keySize), numKeys(0)
+{
+    // k = bits per key * ln 2 gives the fewest false positives
+    this->numHashes = (bitsPerKey * 69 + 50) / 100;
+    if (this->numHashes < 1)
+	this->numHashes = 1;
+    if (this->numHashes > MAX_HASHES)
+	this->numHashes = MAX_HASHES;
+
+    this->numBlocks = (maxKeys * bitsPerKey + BLOCK_BITS - 1) / BLOCK_BITS;
+    if (this->numBlocks < 1)
+	this->numBlocks = 1;
+
+    this->allocBlocks();
+}
+
+BloomFilter::BloomFilter(const BloomFilter *shape)
+    : keySize(shape->keySize), numHashes(shape->numHashes),
+      numBlocks(shape->numBlocks), numKeys(0)
+{
+    this->allocBlocks();
+}
+
+BloomFilter::~BloomFilter()
+{
+    free(this->bits);
+}
+
+void
+BloomFilter::allocBlocks()
+{
+    void *p = NULL;
+    if (posix_memalign(&p, BLOCK_SIZE, this->numBlocks * BLOCK_SIZE) != 0)
+	throw std::bad_alloc();
+    this->bits = static_cast<uint64_t *>(p);
+    memset(this->bits, 0, this->numBlocks * BLOCK_SIZE);
+}
+
+uint64_t *
+BloomFilter::probe(const uint8_t *key, uint64_t *mask)
+{
+    uint64_t h = 0;
+    uint64_t w;
+    uint32_t i;
+
+    for (i = 0; i + sizeof(w) <= this->keySize; i += sizeof(w)) {
+	memcpy(&w, key + i, sizeof(w));
+	h = mix64(h ^ w);
+    }
+    if (i < this->keySize) {
+	w = 0;
+	memcpy(&w, key + i, this->keySize - i);
+	h = mix64(h ^ w);
+    }
+
+    // the block from the high bits of h, the bits in it from a second
+    // hash: a + i * b with b odd gives numHashes different bits
+    uint64_t block = (uint64_t)(((unsigned __int128)h * this->numBlocks)
+				>> 64);
+    uint64_t g = mix64(h ^ 0x9e3779b97f4a7c15ULL);
+    uint32_t a = (uint32_t)g;
+    uint32_t b = (uint32_t)(g >> 32) | 1;
+
+    memset(mask, 0, BLOCK_SIZE);
+    for (i = 0; i < this->numHashes; i++) {
+	uint32_t bit = (a + i * b) % BLOCK_BITS;
+	mask[bit / 64] |= (uint64_t)1 << (bit % 64);
+    }
+
+    return this->bits + block * BLOCK_WORDS;
+}
+
+void
+BloomFilter::add(const uint8_t *key)
+{
+    uint64_t mask[BLOCK_WORDS];
+    uint64_t *block = this->probe(key, mask);
+
+    for (uint32_t i = 0; i < BLOCK_WORDS; i++)
+	block[i] |= mask[i];
+    this->numKeys++;
+}
+
+bool
+BloomFilter::mayContain(const uint8_t *key)
+{
+    uint64_t mask[BLOCK_WORDS];
+    uint64_t *block = this->probe(key, mask);
+    uint64_t missing = 0;
+
+    for (uint32_t i = 0; i < BLOCK_WORDS; i++)
+	missing |= mask[i] & ~block[i];
+
+    return missing == 0;
+}
+
+void
+BloomFilter::clear()
+{
+    memset(this->bits, 0, this->numBlocks * BLOCK_SIZE);
+    this->numKeys = 0;
+}
+
+void
+BloomFilter::swap(BloomFilter *other)
+{
+    std::swap(this->bits, other->bits);
+    std::swap(this->numKeys, other->numKeys);
+}
+
+bool
+BloomFilter::save(const char *path, ErrorInfo *err)
+{
+    std::string tmp(path);
+    tmp += ".tmp";
+
+    BloomFileHeader fh;
+    memset(&fh, 0, sizeof(fh));
+    fh.magic = MAGIC;
+    fh.version = 1;
+    fh.keySize = this->keySize;
+    fh.numHashes = this->numHashes;
+    fh.numBlocks = this->numBlocks;
+    fh.numKeys = this->numKeys;
+    fh.sum = block_sum(this->bits, this->numBlocks);
+
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("cannot create bloom filter file");
+	return false;
+    }
+
+    bool ok = write_all(fd, reinterpret_cast<uint8_t *>(&fh), sizeof(fh))
+	&& write_all(fd, reinterpret_cast<uint8_t *>(this->bits),
+		     this->numBlocks * BLOCK_SIZE)
+	&& fdatasync(fd) == 0;
+    ok = ::close(fd) == 0 && ok;
+    if ( ! ok || rename(tmp.c_str(), path) != 0) {
+	unlink(tmp.c_str());
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("cannot write bloom filter file");
+	return false;
+    }
+
+    return true;
+}
+
+bool
+BloomFilter::load(const char *path, ErrorInfo *err)
+{
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("cannot open bloom filter file");
+	return false;
+    }
+
+    BloomFileHeader fh;
+    if ( ! read_all(fd, reinterpret_cast<uint8_t *>(&fh), sizeof(fh))) {
+	::close(fd);
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("cannot read bloom filter file");
+	return false;
+    }
+
+    if (fh.magic != MAGIC || fh.version != 1
+	|| fh.keySize != this->keySize
+	|| fh.numHashes != this->numHashes
+	|| fh.numBlocks != this->numBlocks) {
+	::close(fd);
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("bloom filter file does not match filter");
+	return false;
+    }
+
+    // read aside so a bad file leaves the filter as it was
+    std::vector<uint64_t> data(this->numBlocks * BLOCK_WORDS);
+    bool ok = read_all(fd, reinterpret_cast<uint8_t *>(&data[0]),
+		       this->numBlocks * BLOCK_SIZE);
+    ::close(fd);
+    if ( ! ok || block_sum(&data[0], this->numBlocks) != fh.sum) {
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("bloom filter file is damaged");
+	return false;
+    }
+
+    memcpy(this->bits, &data[0], this->numBlocks * BLOCK_SIZE);
+    this->numKeys = fh.numKeys;
+
+    return true;
+}
+
+}
+
+/*
+  Local Variables:
+  mode: c++
+  c-basic-offset: 4
+  End:
+*/
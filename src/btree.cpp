@@ -1,12 +1,14 @@
 #include <inttypes.h>
 #include <cstddef>
 #include <string>
+#include <cstring>
 
 #include <boost/thread.hpp>
 
 #include <arpa/inet.h>
 
 #include "dback.h"
+#include "keysearch.h"
 #include "btree.h"
 
 namespace dback {
@@ -319,6 +321,10 @@ BTree::findKeyPosition(PageAccess *ac, uint8_t *key, uint32_t *idx)
 {
     size_t n1, n2, n, ks;
 
+    if (this->header->nKeyBytes == 16 && this->ki->isUUID())
+	return KeySearch::findUUIDPosition(ac->keys, ac->header->numKeys,
+					   key, idx);
+
     if (ac->header->numKeys == 0) {
 	*idx = 0;
 	return false;
@@ -437,6 +443,7 @@ BTree::splitLeaf(PageAccess *full, PageAccess *empty, uint8_t *key,
     empty->header->numKeys = n_to_move;
     full->header->numKeys = move_start_idx;
 
+    empty->header->nextPageNum = full->header->nextPageNum;
 
     return true;
 }
@@ -539,6 +546,11 @@ BTree::concatLeaf(PageAccess *dst, PageAccess *src, bool dstIsFirst,
     dst->header->numKeys += src->header->numKeys;
     src->header->numKeys = 0;
 
+    if (dstIsFirst)
+	dst->header->nextPageNum = src->header->nextPageNum;
+    else
+	dst->header->prevPageNum = src->header->prevPageNum;
+
     return true;
 }
 
@@ -593,7 +605,7 @@ BTree::initNonLeafPage(uint8_t *buf)
 int
 UUIDKey::compare(const uint8_t *a, const uint8_t *b)
 {
-    return 0;
+    return memcmp(a, b, 16);
 }
 
 void
@@ -619,6 +631,14 @@ UUIDKey::initIndexHeader(IndexHeader *h, uint32_t pageSizeInBytes)
     per_key = h->nKeyBytes + sz_user_data;
     h->maxNumLeafKeys = (pageSizeInBytes - sizeof(PageHeader)) / per_key;
 
+    // numKeys is 16 bits
+    if (h->maxNumNLeafKeys > 0xfffe) {
+	h->maxNumNLeafKeys = 0xfffe;
+	h->minNumNLeafKeys = h->maxNumNLeafKeys / 2;
+    }
+    if (h->maxNumLeafKeys > 0xffff)
+	h->maxNumLeafKeys = 0xffff;
+
     return;
 }
 
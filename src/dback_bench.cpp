@@ -0,0 +1,2200 @@
+#include "config.h"
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <iostream>
+
+#include <inttypes.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <boost/thread.hpp>
+
+#include "dback.h"
+#include "wal.h"
+#include "pagestore.h"
+#include "keysearch.h"
+#include "hashindex.h"
+#include "bloomfilter.h"
+#include "r2btree.h"
+#include "r2btreet.h"
+
+using namespace std;
+
+using namespace dback;
+
+/****************************************************/
+/* helpers                                          */
+/****************************************************/
+
+static double
+now_secs()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static uint64_t
+mix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * Make the i'th benchmark key.
+ *
+ * Keys are random looking 16 byte UUIDs, but key i is always the
+ * same so keys do not need to be stored.
+ */
+static void
+make_key(uint64_t i, uint8_t *key)
+{
+    uint64_t a = mix64(2 * i);
+    uint64_t b = mix64(2 * i + 1);
+    memcpy(key, &a, sizeof(a));
+    memcpy(key + 8, &b, sizeof(b));
+}
+
+/**
+ * Bulk load source returning n keys in increasing order.
+ *
+ * The first 8 bytes of key i hold i in big endian order so memcmp
+ * order matches i, the rest is random looking.
+ */
+class SortedKeySource : public R2BulkSource {
+public:
+    uint64_t i;
+    uint64_t n;
+
+    SortedKeySource(uint64_t count) : i(0), n(count) {;};
+
+    bool next(uint8_t *key, uint8_t *val);
+};
+
+bool
+SortedKeySource::next(uint8_t *key, uint8_t *val)
+{
+    if (this->i >= this->n)
+	return false;
+    for (int b = 0; b < 8; b++)
+	key[b] = (uint8_t)(this->i >> (56 - 8 * b));
+    uint64_t r = mix64(this->i);
+    memcpy(key + 8, &r, sizeof(r));
+    memcpy(val, &this->i, sizeof(this->i));
+    this->i++;
+    return true;
+}
+
+/**
+ * UUID ordered key that only provides compare.
+ *
+ * Used to time the generic search, which calls compare for every probe.
+ */
+class MemcmpKey : public R2KeyInterface {
+public:
+    int compare(const uint8_t *a, const uint8_t *b) { return memcmp(a, b, 16); };
+};
+
+static void
+report(const char *name, size_t n, double secs)
+{
+    cout << name
+	 << " n=" << n
+	 << " secs=" << secs
+	 << " ops/sec=" << (secs > 0 ? (size_t)(n / secs) : 0)
+	 << "\n";
+}
+
+/****************************************************/
+/* r2btree tree level ops                           */
+/****************************************************/
+
+static bool
+bench_r2btree_tree(size_t n)
+{
+    R2BTreeParams params;
+    params.pageSize = 4096;
+    params.keySize = 16;
+    params.valSize = 8;
+
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, &params);
+
+    R2UUIDKey k;
+    MemPageStore ps(params.pageSize);
+
+    R2BTree b;
+    b.header = &ih;
+    b.ki = &k;
+    b.ps = &ps;
+
+    ErrorInfo err;
+    err.clear();
+    if ( ! b.initTree(&err)) {
+	cout << "initTree failed: " << err.message << "\n";
+	return false;
+    }
+
+    uint8_t key[16];
+    uint64_t val;
+    double t0;
+
+    t0 = now_secs();
+    for (size_t i = 0; i < n; i++) {
+	make_key(i, key);
+	val = i;
+	if ( ! b.insert(key, reinterpret_cast<uint8_t *>(&val), &err)) {
+	    cout << "insert failed: " << err.message << "\n";
+	    return false;
+	}
+    }
+    report("r2btree insert", n, now_secs() - t0);
+    cout << "    pages=" << ps.numPages() << "\n";
+
+    t0 = now_secs();
+    for (size_t i = 0; i < n; i++) {
+	make_key(i, key);
+	if ( ! b.find(key, reinterpret_cast<uint8_t *>(&val), &err)
+	     || val != i) {
+	    cout << "find failed\n";
+	    return false;
+	}
+    }
+    report("r2btree find", n, now_secs() - t0);
+
+    t0 = now_secs();
+    for (size_t i = 0; i < n; i++) {
+	make_key(i + n, key);
+	if (b.find(key, NULL, &err)) {
+	    cout << "find of missing key succeeded\n";
+	    return false;
+	}
+    }
+    report("r2btree find missing", n, now_secs() - t0);
+
+    t0 = now_secs();
+    for (size_t i = 0; i < n; i++) {
+	make_key(i, key);
+	if ( ! b.erase(key, &err)) {
+	    cout << "erase failed: " << err.message << "\n";
+	    return false;
+	}
+    }
+    report("r2btree erase", n, now_secs() - t0);
+
+    return true;
+}
+
+/****************************************************/
+/* compile time r2btree                             */
+/****************************************************/
+
+static bool
+bench_r2btree_template(size_t n)
+{
+    typedef R2BTreeT<R2UUIDKeyPolicy, 4096> Tree;
+
+    R2IndexHeader ih;
+    Tree::initIndexHeader(&ih);
+
+    MemPageStore ps(4096);
+    Tree t;
+
+    ErrorInfo err;
+    err.clear();
+    if ( ! t.open(&ih, &ps, &err) || ! t.initTree(&err)) {
+	cout << "initTree failed: " << err.message << "\n";
+	return false;
+    }
+
+    uint8_t key[16];
+    uint64_t val;
+    double t0;
+
+    t0 = now_secs();
+    for (size_t i = 0; i < n; i++) {
+	make_key(i, key);
+	val = i;
+	if ( ! t.insert(key, reinterpret_cast<uint8_t *>(&val), &err)) {
+	    cout << "insert failed: " << err.message << "\n";
+	    return false;
+	}
+    }
+    report("r2btreet insert", n, now_secs() - t0);
+
+    t0 = now_secs();
+    for (size_t i = 0; i < n; i++) {
+	make_key(i, key);
+	if ( ! t.find(key, reinterpret_cast<uint8_t *>(&val), &err)
+	     || val != i) {
+	    cout << "find failed\n";
+	    return false;
+	}
+    }
+    report("r2btreet find", n, now_secs() - t0);
+
+    return true;
+}
+
+/****************************************************/
+/* key search in a page                             */
+/****************************************************/
+
+static bool
+bench_key_search(size_t n)
+{
+    R2BTreeParams params;
+    params.pageSize = 4096;
+    params.keySize = 16;
+    params.valSize = 8;
+
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, &params);
+
+    MemcmpKey mk;
+    R2UUIDKey uk;
+    R2BTree b;
+    b.header = &ih;
+    b.ki = &mk;
+
+    // one full leaf of sorted keys
+    vector<uint8_t> buf(params.pageSize);
+    R2PageAccess ac;
+    b.initLeafPage(&buf[0]);
+    b.initPageAccess(&ac, &buf[0]);
+
+    uint32_t nkeys = ih.maxNumKeys[PageTypeLeaf];
+    SortedKeySource src(nkeys);
+    uint8_t key[16];
+    uint64_t val;
+    while (src.next(key, reinterpret_cast<uint8_t *>(&val)))
+	b.insertAt(&ac, ac.header->numKeys, key, reinterpret_cast<uint8_t *>(&val));
+
+    const char *names[2] = { "page search compare", "page search uuid" };
+    R2KeyInterface *kis[2] = { &mk, &uk };
+    size_t sum[2] = { 0, 0 };
+
+    for (int t = 0; t < 2; t++) {
+	b.ki = kis[t];
+	double t0 = now_secs();
+	for (size_t i = 0; i < n; i++) {
+	    uint32_t idx;
+	    uint8_t *k = ac.keys + (mix64(i) % nkeys) * 16;
+	    b.findKeyPosition(&ac, k, &idx);
+	    sum[t] += idx;
+	}
+	report(names[t], n, now_secs() - t0);
+    }
+
+    if (sum[0] != sum[1]) {
+	cout << "page search results differ\n";
+	return false;
+    }
+
+    return true;
+}
+
+/****************************************************/
+/* r2btree bulk load                                */
+/****************************************************/
+
+static bool
+bench_r2btree_bulk(size_t n)
+{
+    R2BTreeParams params;
+    params.pageSize = 4096;
+    params.keySize = 16;
+    params.valSize = 8;
+
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, &params);
+
+    R2UUIDKey k;
+    MemPageStore ps(params.pageSize);
+
+    R2BTree b;
+    b.header = &ih;
+    b.ki = &k;
+    b.ps = &ps;
+
+    ErrorInfo err;
+    err.clear();
+
+    SortedKeySource src(n);
+    double t0 = now_secs();
+    if ( ! b.bulkLoad(&src, 1.0, &err)) {
+	cout << "bulkLoad failed: " << err.message << "\n";
+	return false;
+    }
+    report("r2btree bulk load", n, now_secs() - t0);
+    cout << "    pages=" << ps.numPages() << "\n";
+
+    uint8_t key[16];
+    uint64_t val;
+    SortedKeySource check(n);
+    t0 = now_secs();
+    for (size_t i = 0; i < n; i++) {
+	check.next(key, reinterpret_cast<uint8_t *>(&val));
+	if ( ! b.find(key, reinterpret_cast<uint8_t *>(&val), &err)
+	     || val != i) {
+	    cout << "find failed\n";
+	    return false;
+	}
+    }
+    report("r2btree bulk find", n, now_secs() - t0);
+
+    const uint32_t batch = 1024;
+    vector<uint8_t> keys(batch * 16);
+    vector<uint64_t> vals(batch);
+    size_t total = 0;
+    R2Cursor c(&b);
+    t0 = now_secs();
+    if (c.seekFirst(&err)) {
+	uint32_t got;
+	while ((got = c.fetch(batch, &keys[0],
+			      reinterpret_cast<uint8_t *>(&vals[0]), &err)) > 0)
+	    total += got;
+    }
+    if (total != n) {
+	cout << "cursor scan failed\n";
+	return false;
+    }
+    report("r2btree cursor scan", n, now_secs() - t0);
+
+    return true;
+}
+
+/****************************************************/
+/* r2btree on a buffer pool                         */
+/****************************************************/
+
+static bool
+bench_r2btree_pool(size_t n, size_t poolBytes)
+{
+    R2BTreeParams params;
+    params.pageSize = 4096;
+    params.keySize = 16;
+    params.valSize = 8;
+
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, &params);
+
+    char path[] = "/tmp/dback_bench.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+	cout << "unable to create temp file\n";
+	return false;
+    }
+    close(fd);
+
+    ErrorInfo err;
+    err.clear();
+
+    R2UUIDKey k;
+    BufferPool bp(params.pageSize, poolBytes);
+    if ( ! bp.open(path, &err)) {
+	cout << "open failed: " << err.message << "\n";
+	unlink(path);
+	return false;
+    }
+
+    R2BTree b;
+    b.header = &ih;
+    b.ki = &k;
+    b.ps = &bp;
+
+    if ( ! b.initTree(&err)) {
+	cout << "initTree failed: " << err.message << "\n";
+	unlink(path);
+	return false;
+    }
+
+    uint8_t key[16];
+    uint64_t val;
+    double t0;
+
+    t0 = now_secs();
+    for (size_t i = 0; i < n; i++) {
+	make_key(i, key);
+	val = i;
+	if ( ! b.insert(key, reinterpret_cast<uint8_t *>(&val), &err)) {
+	    cout << "insert failed: " << err.message << "\n";
+	    unlink(path);
+	    return false;
+	}
+    }
+    report("pool insert", n, now_secs() - t0);
+    cout << "    frames=" << bp.getNumFrames()
+	 << " hit ratio=" << bp.getHitRatio()
+	 << " evictions=" << bp.getNumEvictions()
+	 << "\n";
+
+    bp.resetStats();
+    t0 = now_secs();
+    for (size_t i = 0; i < n; i++) {
+	make_key(i, key);
+	if ( ! b.find(key, reinterpret_cast<uint8_t *>(&val), &err)
+	     || val != i) {
+	    cout << "find failed\n";
+	    unlink(path);
+	    return false;
+	}
+    }
+    report("pool find", n, now_secs() - t0);
+    cout << "    frames=" << bp.getNumFrames()
+	 << " hit ratio=" << bp.getHitRatio()
+	 << " evictions=" << bp.getNumEvictions()
+	 << "\n";
+
+    unlink(path);
+    return true;
+}
+
+/****************************************************/
+/* r2btree page size sweep                          */
+/****************************************************/
+
+/**
+ * Return the number of levels in a tree, following child 0 down.
+ */
+static uint32_t
+tree_depth(R2BTree *b)
+{
+    ErrorInfo err;
+    PagePin pin;
+    uint32_t depth = 1;
+    uint8_t *buf = pin.pin(b->ps, b->header->rootPageNum, &err);
+    while (buf != NULL
+	   && reinterpret_cast<R2PageHeader *>(buf)->pageType
+	   == PageTypeNonLeaf) {
+	uint32_t pn;
+	memcpy(&pn, buf + sizeof(R2PageHeader), sizeof(uint32_t));
+	buf = pin.pin(b->ps, pn, &err);
+	depth++;
+    }
+    return depth;
+}
+
+static bool
+bench_r2btree_page_sizes(size_t n)
+{
+    for (uint32_t psize = 4096; psize <= 65536; psize *= 2) {
+	R2BTreeParams params;
+	params.pageSize = psize;
+	params.keySize = 16;
+	params.valSize = 8;
+
+	R2IndexHeader ih;
+	if ( ! R2BTree::initIndexHeader(&ih, &params)) {
+	    cout << "initIndexHeader failed for page size " << psize << "\n";
+	    return false;
+	}
+
+	R2UUIDKey k;
+	MemPageStore ps(params.pageSize);
+
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &ps;
+
+	ErrorInfo err;
+	err.clear();
+	if ( ! b.initTree(&err)) {
+	    cout << "initTree failed: " << err.message << "\n";
+	    return false;
+	}
+
+	uint8_t key[16];
+	uint64_t val;
+	double t0;
+
+	cout << "  page size " << psize
+	     << " leaf keys=" << ih.maxNumKeys[PageTypeLeaf]
+	     << " non-leaf keys=" << ih.maxNumKeys[PageTypeNonLeaf] << "\n";
+
+	t0 = now_secs();
+	for (size_t i = 0; i < n; i++) {
+	    make_key(i, key);
+	    val = i;
+	    if ( ! b.insert(key, reinterpret_cast<uint8_t *>(&val), &err)) {
+		cout << "insert failed: " << err.message << "\n";
+		return false;
+	    }
+	}
+	report("sweep insert", n, now_secs() - t0);
+
+	t0 = now_secs();
+	for (size_t i = 0; i < n; i++) {
+	    make_key(i, key);
+	    if ( ! b.find(key, reinterpret_cast<uint8_t *>(&val), &err)
+		 || val != i) {
+		cout << "find failed\n";
+		return false;
+	    }
+	}
+	report("sweep find", n, now_secs() - t0);
+	cout << "    pages=" << ps.numPages()
+	     << " depth=" << tree_depth(&b) << "\n";
+    }
+
+    return true;
+}
+
+/****************************************************/
+/* r2btree concurrent readers                       */
+/****************************************************/
+
+static void
+find_shared_lock(R2BTree *b, boost::shared_mutex *l, size_t first, size_t n,
+		 size_t *nBad)
+{
+    ErrorInfo err;
+    uint8_t key[16];
+    uint64_t val;
+
+    for (size_t i = first; i < first + n; i++) {
+	make_key(i, key);
+	l->lock_shared();
+	bool ok = b->find(key, reinterpret_cast<uint8_t *>(&val), &err);
+	l->unlock_shared();
+	if ( ! ok || val != i)
+	    (*nBad)++;
+    }
+}
+
+static void
+find_optimistic(R2BTree *b, size_t first, size_t n, size_t *nBad)
+{
+    ErrorInfo err;
+    uint8_t key[16];
+    uint64_t val;
+
+    for (size_t i = first; i < first + n; i++) {
+	make_key(i, key);
+	if ( ! b->findConcurrent(key, reinterpret_cast<uint8_t *>(&val), &err)
+	     || val != i)
+	    (*nBad)++;
+    }
+}
+
+static bool
+bench_r2btree_threads(size_t n, size_t nThreads)
+{
+    R2BTreeParams params;
+    params.pageSize = 4096;
+    params.keySize = 16;
+    params.valSize = 8;
+
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, &params);
+
+    R2UUIDKey k;
+    MemPageStore ps(params.pageSize);
+
+    R2BTree b;
+    b.header = &ih;
+    b.ki = &k;
+    b.ps = &ps;
+
+    ErrorInfo err;
+    err.clear();
+    if ( ! b.initTree(&err)) {
+	cout << "initTree failed: " << err.message << "\n";
+	return false;
+    }
+
+    uint8_t key[16];
+    uint64_t val;
+    for (size_t i = 0; i < n; i++) {
+	make_key(i, key);
+	val = i;
+	if ( ! b.insert(key, reinterpret_cast<uint8_t *>(&val), &err)) {
+	    cout << "insert failed: " << err.message << "\n";
+	    return false;
+	}
+    }
+
+    size_t per = n / nThreads;
+    vector<size_t> nBad(nThreads, 0);
+    boost::shared_mutex l;
+    double t0;
+
+    for (int pass = 0; pass < 2; pass++) {
+	boost::thread_group g;
+	t0 = now_secs();
+	for (size_t t = 0; t < nThreads; t++) {
+	    if (pass == 0)
+		g.create_thread(boost::bind(find_shared_lock, &b, &l, t * per,
+					    per, &nBad[t]));
+	    else
+		g.create_thread(boost::bind(find_optimistic, &b, t * per,
+					    per, &nBad[t]));
+	}
+	g.join_all();
+	report(pass == 0 ? "threads shared_mutex find" : "threads optimistic find",
+	       per * nThreads, now_secs() - t0);
+    }
+
+    for (size_t t = 0; t < nThreads; t++) {
+	if (nBad[t] != 0) {
+	    cout << "find failed\n";
+	    return false;
+	}
+    }
+    cout << "    threads=" << nThreads << "\n";
+
+    return true;
+}
+
+/****************************************************/
+/* r2btree logged inserts                           */
+/****************************************************/
+
+static void
+insert_commit(R2BTree *b, WriteAheadLog *wal, boost::mutex *l, size_t first,
+	      size_t n, size_t *nBad)
+{
+    ErrorInfo err;
+    uint8_t key[16];
+    uint64_t val, lsn;
+    bool ok;
+
+    for (size_t i = first; i < first + n; i++) {
+	make_key(i, key);
+	val = i;
+	{
+	    boost::mutex::scoped_lock guard(*l);
+	    ok = b->insert(key, reinterpret_cast<uint8_t *>(&val), &err);
+	    lsn = wal->getAppendLsn();
+	}
+	// the commit waits outside the lock so other writers can join it
+	if ( ! ok || ! wal->commit(lsn, &err))
+	    (*nBad)++;
+    }
+}
+
+static bool
+bench_r2btree_wal(size_t n, size_t nThreads)
+{
+    // every insert waits for the disk, keep the run short
+    if (n > 200000)
+	n = 200000;
+
+    size_t threads[2] = { 1, nThreads };
+    for (int pass = 0; pass < 2; pass++) {
+	char path[] = "/tmp/dback_bench_wal.XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0) {
+	    cout << "unable to create log file\n";
+	    return false;
+	}
+	close(fd);
+
+	R2BTreeParams params;
+	params.pageSize = 4096;
+	params.keySize = 16;
+	params.valSize = 8;
+
+	R2IndexHeader ih;
+	R2BTree::initIndexHeader(&ih, &params);
+
+	R2UUIDKey k;
+	MemPageStore ps(params.pageSize);
+	WriteAheadLog wal;
+
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &ps;
+	b.wal = &wal;
+
+	ErrorInfo err;
+	err.clear();
+	if ( ! wal.open(path, &err) || ! b.initTree(&err)) {
+	    cout << "log setup failed: " << err.message << "\n";
+	    unlink(path);
+	    return false;
+	}
+	wal.resetStats();
+
+	size_t nt = threads[pass];
+	size_t per = n / nt;
+	vector<size_t> nBad(nt, 0);
+	boost::mutex l;
+	boost::thread_group g;
+	double t0 = now_secs();
+	for (size_t t = 0; t < nt; t++)
+	    g.create_thread(boost::bind(insert_commit, &b, &wal, &l, t * per,
+					per, &nBad[t]));
+	g.join_all();
+	report(pass == 0 ? "wal 1 thread insert+commit" : "wal threads insert+commit",
+	       per * nt, now_secs() - t0);
+
+	uint64_t syncs = wal.getNumSyncs();
+	cout << "    threads=" << nt << " commits=" << wal.getNumCommits()
+	     << " syncs=" << syncs << " commits/sync="
+	     << (syncs > 0 ? (double)wal.getNumCommits() / syncs : 0.0) << "\n";
+
+	wal.close(&err);
+	unlink(path);
+
+	for (size_t t = 0; t < nt; t++) {
+	    if (nBad[t] != 0) {
+		cout << "insert failed\n";
+		return false;
+	    }
+	}
+    }
+
+    return true;
+}
+
+/****************************************************/
+/* r2btree snapshot scans during ingest             */
+/****************************************************/
+
+static void
+scan_snapshots(R2BTree *b, bool *stop, size_t *nScans,
+	       size_t *nKeys, size_t *nBad)
+{
+    ErrorInfo err;
+
+    while ( ! __atomic_load_n(stop, __ATOMIC_ACQUIRE)) {
+	R2Snapshot snap;
+	if ( ! b->takeSnapshot(&snap, &err)) {
+	    (*nBad)++;
+	    return;
+	}
+
+	R2Cursor c(b, &snap);
+	for (bool ok = c.seekFirst(&err); ok; ok = c.next(&err))
+	    (*nKeys)++;
+	c.close();
+
+	b->releaseSnapshot(&snap);
+	(*nScans)++;
+    }
+}
+
+static bool
+bench_r2btree_cow(size_t n)
+{
+    for (int pass = 0; pass < 2; pass++) {
+	char path[] = "/tmp/dback_bench_cow.XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0) {
+	    cout << "unable to create page file\n";
+	    return false;
+	}
+	close(fd);
+
+	R2BTreeParams params;
+	params.pageSize = 4096;
+	params.keySize = 16;
+	params.valSize = 8;
+
+	R2IndexHeader ih;
+	R2BTree::initIndexHeader(&ih, &params);
+
+	R2UUIDKey k;
+	// snapshot readers need a store that allows reads during
+	// allocation, leave room for the pages copied for them
+	MMapPageStore ps((size_t)n * 256 + ((size_t)256 << 20));
+
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &ps;
+	b.copyOnWrite = true;
+
+	ErrorInfo err;
+	err.clear();
+	if ( ! ps.create(path, params.pageSize, &err) || ! b.initTree(&err)) {
+	    cout << "copy-on-write setup failed: " << err.message << "\n";
+	    unlink(path);
+	    return false;
+	}
+
+	bool stop = false;
+	size_t nScans = 0, nScanned = 0, nBad = 0;
+	boost::thread_group g;
+	if (pass == 1)
+	    g.create_thread(boost::bind(scan_snapshots, &b, &stop, &nScans,
+					&nScanned, &nBad));
+
+	uint8_t key[16];
+	uint64_t val;
+	double t0 = now_secs();
+	for (size_t i = 0; i < n; i++) {
+	    make_key(i, key);
+	    val = i;
+	    if ( ! b.insert(key, reinterpret_cast<uint8_t *>(&val), &err))
+		nBad++;
+	}
+	report(pass == 0 ? "cow insert" : "cow insert, snapshot scans",
+	       n, now_secs() - t0);
+	__atomic_store_n(&stop, true, __ATOMIC_RELEASE);
+	g.join_all();
+
+	cout << "    copies=" << b.getNumCopies() << " scans=" << nScans
+	     << " keys scanned=" << nScanned << "\n";
+
+	unlink(path);
+
+	if (nBad != 0) {
+	    cout << "insert or snapshot failed\n";
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+/****************************************************/
+/* r2btree key prefixes                             */
+/****************************************************/
+
+/**
+ * Make the i'th composite key.
+ *
+ * A machine id followed by a per machine sequence number, both big
+ * endian. Machines take turns, so consecutive keys land far apart.
+ */
+static void
+make_composite_key(uint64_t i, uint8_t *key)
+{
+    static const uint64_t N_MACHINES = 1024;
+    uint64_t machine = mix64(i % N_MACHINES) & 0xffffffffULL;
+    uint64_t seq = i / N_MACHINES;
+    for (int b = 0; b < 8; b++) {
+	key[b] = (uint8_t)(machine >> (56 - 8 * b));
+	key[8 + b] = (uint8_t)(seq >> (56 - 8 * b));
+    }
+}
+
+static bool
+bench_r2btree_prefix(size_t n)
+{
+    for (int pass = 0; pass < 2; pass++) {
+	R2BTreeParams params;
+	params.pageSize = 4096;
+	params.keySize = 16;
+	params.valSize = 8;
+
+	R2IndexHeader ih;
+	R2BTree::initIndexHeader(&ih, &params);
+
+	R2UUIDKey k;
+	MemPageStore ps(params.pageSize);
+
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &ps;
+	b.prefixKeys = pass == 1;
+
+	ErrorInfo err;
+	err.clear();
+	if ( ! b.initTree(&err)) {
+	    cout << "initTree failed: " << err.message << "\n";
+	    return false;
+	}
+
+	uint8_t key[16];
+	uint64_t val;
+	size_t nBad = 0;
+	double t0 = now_secs();
+	for (size_t i = 0; i < n; i++) {
+	    make_composite_key(i, key);
+	    val = i;
+	    if ( ! b.insert(key, reinterpret_cast<uint8_t *>(&val), &err))
+		nBad++;
+	}
+	report(pass == 0 ? "composite insert" : "composite insert, prefixes",
+	       n, now_secs() - t0);
+
+	t0 = now_secs();
+	for (size_t i = 0; i < n; i++) {
+	    make_composite_key(mix64(i) % n, key);
+	    if ( ! b.find(key, reinterpret_cast<uint8_t *>(&val), &err))
+		nBad++;
+	}
+	report(pass == 0 ? "composite find" : "composite find, prefixes",
+	       n, now_secs() - t0);
+
+	cout << "    pages=" << ps.numPages() << " depth=" << tree_depth(&b)
+	     << "\n";
+
+	if (nBad != 0) {
+	    cout << "insert or find failed\n";
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+/****************************************************/
+/* r2btree non-leaf layouts                         */
+/****************************************************/
+
+static bool
+bench_r2btree_layout(size_t n)
+{
+    static const uint32_t pageSizes[] = { 4096, 16384 };
+
+    for (size_t ps_i = 0; ps_i < 2; ps_i++) {
+	for (uint32_t layout = R2LayoutSorted; layout <= R2LayoutIndexed;
+	     layout++) {
+	    R2BTreeParams params;
+	    params.pageSize = pageSizes[ps_i];
+	    params.keySize = 16;
+	    params.valSize = 8;
+	    params.nonLeafLayout = layout;
+
+	    R2IndexHeader ih;
+	    R2BTree::initIndexHeader(&ih, &params);
+
+	    R2UUIDKey k;
+	    MemPageStore ps(params.pageSize);
+
+	    R2BTree b;
+	    b.header = &ih;
+	    b.ki = &k;
+	    b.ps = &ps;
+
+	    ErrorInfo err;
+	    err.clear();
+	    if ( ! b.initTree(&err)) {
+		cout << "initTree failed: " << err.message << "\n";
+		return false;
+	    }
+
+	    uint8_t key[16];
+	    uint64_t val;
+	    size_t nBad = 0;
+	    string name = layout == R2LayoutSorted ? "sorted" : "indexed";
+	    name += params.pageSize == 4096 ? " 4K" : " 16K";
+
+	    double t0 = now_secs();
+	    for (size_t i = 0; i < n; i++) {
+		make_key(i, key);
+		val = i;
+		if ( ! b.insert(key, reinterpret_cast<uint8_t *>(&val), &err))
+		    nBad++;
+	    }
+	    report((name + " insert").c_str(), n, now_secs() - t0);
+
+	    t0 = now_secs();
+	    for (size_t i = 0; i < n; i++) {
+		make_key(mix64(i) % n, key);
+		if ( ! b.find(key, reinterpret_cast<uint8_t *>(&val), &err))
+		    nBad++;
+	    }
+	    report((name + " find").c_str(), n, now_secs() - t0);
+
+	    cout << "    non-leaf keys=" << ih.maxNumKeys[PageTypeNonLeaf]
+		 << " pages=" << ps.numPages() << " depth=" << tree_depth(&b)
+		 << "\n";
+
+	    if (nBad != 0) {
+		cout << "insert or find failed\n";
+		return false;
+	    }
+	}
+    }
+
+    return true;
+}
+
+/****************************************************/
+/* r2btree interpolation search                     */
+/****************************************************/
+
+static bool
+bench_r2btree_interpolation(size_t n)
+{
+    // random UUIDs, then composite keys, which are not spread evenly
+    for (int composite = 0; composite < 2; composite++) {
+	R2BTreeParams params;
+	params.pageSize = 4096;
+	params.keySize = 16;
+	params.valSize = 8;
+
+	R2IndexHeader ih;
+	R2BTree::initIndexHeader(&ih, &params);
+
+	R2UUIDKey k;
+	MemPageStore ps(params.pageSize);
+
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &ps;
+
+	ErrorInfo err;
+	err.clear();
+	if ( ! b.initTree(&err)) {
+	    cout << "initTree failed: " << err.message << "\n";
+	    return false;
+	}
+
+	uint8_t key[16];
+	uint64_t val;
+	size_t nBad = 0;
+	for (size_t i = 0; i < n; i++) {
+	    if (composite)
+		make_composite_key(i, key);
+	    else
+		make_key(i, key);
+	    val = i;
+	    if ( ! b.insert(key, reinterpret_cast<uint8_t *>(&val), &err))
+		nBad++;
+	}
+
+	for (int interp = 0; interp < 2; interp++) {
+	    b.interpolationSearch = interp == 1;
+	    b.resetSearchStats();
+
+	    string name = composite ? "composite" : "uuid";
+	    name += interp ? " interpolation find" : " binary find";
+
+	    double t0 = now_secs();
+	    for (size_t i = 0; i < n; i++) {
+		if (composite)
+		    make_composite_key(mix64(i) % n, key);
+		else
+		    make_key(mix64(i) % n, key);
+		if ( ! b.find(key, reinterpret_cast<uint8_t *>(&val), &err))
+		    nBad++;
+	    }
+	    report(name.c_str(), n, now_secs() - t0);
+
+	    uint64_t searches = b.getNumSearches();
+	    if (searches > 0)
+		cout << "    probes/search="
+		     << (double)b.getNumProbes() / searches
+		     << " fallbacks=" << 100.0 * b.getNumFallbacks() / searches
+		     << "%\n";
+	}
+
+	if (nBad != 0) {
+	    cout << "insert or find failed\n";
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+/****************************************************/
+/* r2btree batch insert                             */
+/****************************************************/
+
+static bool
+bench_r2btree_batch(size_t n)
+{
+    static const size_t BATCH = 4096;
+
+    // one key at a time, then batches of random keys
+    for (int batch = 0; batch < 2; batch++) {
+	R2BTreeParams params;
+	params.pageSize = 4096;
+	params.keySize = 16;
+	params.valSize = 8;
+
+	R2IndexHeader ih;
+	R2BTree::initIndexHeader(&ih, &params);
+
+	R2UUIDKey k;
+	MemPageStore ps(params.pageSize);
+
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &ps;
+
+	ErrorInfo err;
+	err.clear();
+	if ( ! b.initTree(&err)) {
+	    cout << "initTree failed: " << err.message << "\n";
+	    return false;
+	}
+
+	vector<uint8_t> keys(BATCH * 16);
+	vector<uint64_t> vals(BATCH);
+	size_t nBad = 0;
+
+	double t0 = now_secs();
+	for (size_t i = 0; i < n; i += BATCH) {
+	    uint32_t m = (uint32_t)(n - i < BATCH ? n - i : BATCH);
+	    for (uint32_t j = 0; j < m; j++) {
+		make_key(i + j, &keys[j * 16]);
+		vals[j] = i + j;
+	    }
+	    if (batch) {
+		uint32_t nInserted;
+		if ( ! b.insertBatch(&keys[0],
+				     reinterpret_cast<uint8_t *>(&vals[0]), m,
+				     &nInserted, &err))
+		    nBad++;
+	    }
+	    else {
+		for (uint32_t j = 0; j < m; j++)
+		    if ( ! b.insert(&keys[j * 16],
+				    reinterpret_cast<uint8_t *>(&vals[j]), &err))
+			nBad++;
+	    }
+	}
+	report(batch ? "r2btree insertBatch" : "r2btree insert", n,
+	       now_secs() - t0);
+	cout << "    pages=" << ps.numPages() << "\n";
+
+	uint8_t key[16];
+	uint64_t val;
+	for (size_t i = 0; i < n; i++) {
+	    make_key(i, key);
+	    if ( ! b.find(key, reinterpret_cast<uint8_t *>(&val), &err)
+		 || val != i)
+		nBad++;
+	}
+
+	if (nBad != 0) {
+	    cout << "insert or find failed\n";
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+/****************************************************/
+/* r2btree batch find                               */
+/****************************************************/
+
+static bool
+bench_r2btree_find_batch(size_t n)
+{
+    static const size_t BATCH = 1024;
+
+    R2BTreeParams params;
+    params.pageSize = 4096;
+    params.keySize = 16;
+    params.valSize = 8;
+
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, &params);
+
+    R2UUIDKey k;
+    MemPageStore ps(params.pageSize);
+
+    R2BTree b;
+    b.header = &ih;
+    b.ki = &k;
+    b.ps = &ps;
+
+    ErrorInfo err;
+    err.clear();
+    if ( ! b.initTree(&err)) {
+	cout << "initTree failed: " << err.message << "\n";
+	return false;
+    }
+
+    vector<uint8_t> keys(BATCH * 16);
+    vector<uint64_t> vals(BATCH);
+    bool found[BATCH];
+    size_t nBad = 0;
+
+    for (size_t i = 0; i < n; i += BATCH) {
+	uint32_t m = (uint32_t)(n - i < BATCH ? n - i : BATCH);
+	for (uint32_t j = 0; j < m; j++) {
+	    make_key(i + j, &keys[j * 16]);
+	    vals[j] = i + j;
+	}
+	uint32_t nInserted;
+	if ( ! b.insertBatch(&keys[0], reinterpret_cast<uint8_t *>(&vals[0]),
+			     m, &nInserted, &err))
+	    nBad++;
+    }
+
+    // half the keys asked for are in the tree
+    for (int batch = 0; batch < 2; batch++) {
+	double t0 = now_secs();
+	for (size_t i = 0; i < n; i += BATCH) {
+	    uint32_t m = (uint32_t)(n - i < BATCH ? n - i : BATCH);
+	    for (uint32_t j = 0; j < m; j++)
+		make_key(mix64(i + j) % (2 * n), &keys[j * 16]);
+	    if (batch) {
+		if ( ! b.findBatch(&keys[0],
+				   reinterpret_cast<uint8_t *>(&vals[0]),
+				   found, m, &err))
+		    nBad++;
+	    }
+	    else {
+		for (uint32_t j = 0; j < m; j++)
+		    found[j] = b.find(&keys[j * 16],
+				      reinterpret_cast<uint8_t *>(&vals[j]),
+				      &err);
+	    }
+	    for (uint32_t j = 0; j < m; j++)
+		if (found[j] != (mix64(i + j) % (2 * n) < n))
+		    nBad++;
+	}
+	report(batch ? "r2btree findBatch" : "r2btree find each", n,
+	       now_secs() - t0);
+    }
+
+    if (nBad != 0) {
+	cout << "insert or find failed\n";
+	return false;
+    }
+
+    return true;
+}
+
+/****************************************************/
+/* r2btree slotted leaves                           */
+/****************************************************/
+
+static bool
+bench_r2btree_slotted(size_t n)
+{
+    static const uint32_t valSizes[] = {8, 64, 256};
+
+    for (size_t v = 0; v < sizeof(valSizes) / sizeof(valSizes[0]); v++) {
+	for (int slotted = 0; slotted < 2; slotted++) {
+	    R2BTreeParams params;
+	    params.pageSize = 16384;
+	    params.keySize = 16;
+	    params.valSize = valSizes[v];
+	    params.leafLayout = slotted ? R2LeafSlotted : R2LeafSorted;
+
+	    R2IndexHeader ih;
+	    R2BTree::initIndexHeader(&ih, &params);
+
+	    R2UUIDKey k;
+	    MemPageStore ps(params.pageSize);
+
+	    R2BTree b;
+	    b.header = &ih;
+	    b.ki = &k;
+	    b.ps = &ps;
+
+	    ErrorInfo err;
+	    err.clear();
+	    if ( ! b.initTree(&err)) {
+		cout << "initTree failed: " << err.message << "\n";
+		return false;
+	    }
+
+	    uint8_t key[16];
+	    vector<uint8_t> val(params.valSize);
+	    size_t nBad = 0;
+
+	    string name = slotted ? "slotted" : "sorted";
+	    name += " insert val=" + to_string(params.valSize);
+
+	    double t0 = now_secs();
+	    for (size_t i = 0; i < n; i++) {
+		make_key(i, key);
+		memcpy(&val[0], &i, sizeof(i));
+		if ( ! b.insert(key, &val[0], &err))
+		    nBad++;
+	    }
+	    report(name.c_str(), n, now_secs() - t0);
+
+	    name = slotted ? "slotted" : "sorted";
+	    name += " find val=" + to_string(params.valSize);
+
+	    t0 = now_secs();
+	    for (size_t i = 0; i < n; i++) {
+		make_key(i, key);
+		if ( ! b.find(key, &val[0], &err)
+		     || memcmp(&val[0], &i, sizeof(i)) != 0)
+		    nBad++;
+	    }
+	    report(name.c_str(), n, now_secs() - t0);
+	    cout << "    pages=" << ps.numPages() << "\n";
+
+	    if (nBad != 0) {
+		cout << "insert or find failed\n";
+		return false;
+	    }
+	}
+    }
+
+    return true;
+}
+
+/****************************************************/
+/* r2btree variable length values                   */
+/****************************************************/
+
+// mostly short values, one in ten up to 1000 bytes
+static uint32_t
+var_val_len(uint64_t i)
+{
+    uint64_t r = mix64(i ^ 0x5555);
+    return r % 10 == 0 ? 200 + (r >> 8) % 801 : 8 + (r >> 8) % 17;
+}
+
+static bool
+bench_r2btree_var(size_t n)
+{
+    // values padded to the longest, then slots with overflow pages
+    for (int var = 0; var < 2; var++) {
+	R2BTreeParams params;
+	params.pageSize = 4096;
+	params.keySize = 16;
+	params.valSize = var ? 32 : 1004;
+	params.varValues = var == 1;
+
+	R2IndexHeader ih;
+	R2BTree::initIndexHeader(&ih, &params);
+
+	R2UUIDKey k;
+	MemPageStore ps(params.pageSize);
+
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &ps;
+
+	ErrorInfo err;
+	err.clear();
+	if ( ! b.initTree(&err)) {
+	    cout << "initTree failed: " << err.message << "\n";
+	    return false;
+	}
+
+	uint8_t key[16];
+	vector<uint8_t> val(1004, 0x5a), got;
+	size_t nBad = 0;
+
+	double t0 = now_secs();
+	for (size_t i = 0; i < n; i++) {
+	    make_key(i, key);
+	    uint32_t len = var_val_len(i);
+	    memcpy(&val[0], &len, sizeof(len));
+	    bool ok = var
+		? b.insertVar(key, &val[0], len, &err)
+		: b.insert(key, &val[0], &err);
+	    if ( ! ok)
+		nBad++;
+	}
+	report(var ? "var values insert" : "padded values insert", n,
+	       now_secs() - t0);
+
+	t0 = now_secs();
+	for (size_t i = 0; i < n; i++) {
+	    make_key(i, key);
+	    uint32_t len = var_val_len(i);
+	    if (var) {
+		if ( ! b.findVar(key, &got, &err) || got.size() != len)
+		    nBad++;
+	    }
+	    else {
+		if ( ! b.find(key, &val[0], &err)
+		     || memcmp(&val[0], &len, sizeof(len)) != 0)
+		    nBad++;
+	    }
+	}
+	report(var ? "var values find" : "padded values find", n,
+	       now_secs() - t0);
+	cout << "    pages=" << ps.numPages()
+	     << " MB=" << ps.numPages() * params.pageSize / (1024 * 1024)
+	     << "\n";
+
+	if (nBad != 0) {
+	    cout << "insert or find failed\n";
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+/****************************************************/
+/* r2btree variable length keys                     */
+/****************************************************/
+
+/**
+ * Path key ordered by memcmp over the whole slot.
+ */
+class PathMemcmpKey : public R2KeyInterface {
+public:
+    int compare(const uint8_t *a, const uint8_t *b) { return memcmp(a, b, 64); };
+};
+
+// catalog paths, a few machines and many directories
+static string
+make_path(uint64_t i)
+{
+    uint64_t r = mix64(i);
+    return "m" + to_string(r % 4) + "/home/u" + to_string((r >> 8) % 1000)
+	+ "/src/" + to_string(i) + ".cpp";
+}
+
+static bool
+bench_r2btree_varkey(size_t n)
+{
+    // the same 64 byte path slots compared by memcmp, and by the
+    // normalized key with and without leaf prefixes
+    for (int mode = 0; mode < 3; mode++) {
+	R2BTreeParams params;
+	params.pageSize = 4096;
+	params.keySize = 64;
+	params.valSize = 8;
+
+	R2IndexHeader ih;
+	R2BTree::initIndexHeader(&ih, &params);
+
+	PathMemcmpKey mk;
+	R2VarKey vk(params.keySize);
+	MemPageStore ps(params.pageSize);
+
+	R2BTree b;
+	b.header = &ih;
+	b.ki = mode == 0 ? static_cast<R2KeyInterface *>(&mk) : &vk;
+	b.ps = &ps;
+	b.prefixKeys = mode == 2;
+
+	ErrorInfo err;
+	err.clear();
+	if ( ! b.initTree(&err)) {
+	    cout << "initTree failed: " << err.message << "\n";
+	    return false;
+	}
+
+	const char *name = mode == 0 ? "memcmp paths"
+	    : mode == 1 ? "normalized paths" : "normalized prefixed paths";
+	uint8_t key[64];
+	size_t nBad = 0;
+
+	double t0 = now_secs();
+	for (size_t i = 0; i < n; i++) {
+	    string p = make_path(i);
+	    vk.makeKey(reinterpret_cast<const uint8_t *>(p.data()), p.size(),
+		       key);
+	    if ( ! b.insert(key, reinterpret_cast<uint8_t *>(&i), &err))
+		nBad++;
+	}
+	report((string(name) + " insert").c_str(), n, now_secs() - t0);
+
+	t0 = now_secs();
+	for (size_t i = 0; i < n; i++) {
+	    string p = make_path(i);
+	    size_t v;
+	    vk.makeKey(reinterpret_cast<const uint8_t *>(p.data()), p.size(),
+		       key);
+	    if ( ! b.find(key, reinterpret_cast<uint8_t *>(&v), &err) || v != i)
+		nBad++;
+	}
+	report((string(name) + " find").c_str(), n, now_secs() - t0);
+	cout << "    pages=" << ps.numPages() << "\n";
+
+	if (nBad != 0) {
+	    cout << "insert or find failed\n";
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+/****************************************************/
+/* r2btree largest values                           */
+/****************************************************/
+
+// block size of key i
+static uint64_t
+block_size(uint64_t i)
+{
+    return mix64(i ^ 0x3333) % (1ULL << 30);
+}
+
+static bool
+bench_r2btree_largest(size_t n)
+{
+    static const uint32_t K = 100;
+
+    // the top K by a scan of every value, then by the subtree maxima
+    for (int aug = 0; aug < 2; aug++) {
+	R2BTreeParams params;
+	params.pageSize = 4096;
+	params.keySize = 16;
+	params.valSize = 16;
+	params.subtreeMax = aug == 1;
+	params.maxOffset = 8;
+
+	R2IndexHeader ih;
+	R2BTree::initIndexHeader(&ih, &params);
+
+	R2UUIDKey k;
+	MemPageStore ps(params.pageSize);
+
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &ps;
+
+	ErrorInfo err;
+	err.clear();
+	if ( ! b.initTree(&err)) {
+	    cout << "initTree failed: " << err.message << "\n";
+	    return false;
+	}
+
+	uint8_t key[16];
+	uint64_t val[2];
+	size_t nBad = 0;
+
+	double t0 = now_secs();
+	for (size_t i = 0; i < n; i++) {
+	    make_key(i, key);
+	    val[0] = i;
+	    val[1] = block_size(i);
+	    if ( ! b.insert(key, reinterpret_cast<uint8_t *>(val), &err))
+		nBad++;
+	}
+	report(aug ? "subtree max insert" : "plain insert", n, now_secs() - t0);
+
+	vector<uint64_t> want(n);
+	for (size_t i = 0; i < n; i++)
+	    want[i] = block_size(i);
+	partial_sort(want.begin(), want.begin() + K, want.end(),
+		     greater<uint64_t>());
+
+	size_t nQueries = aug ? 1000 : 3;
+	vector<uint64_t> top;
+	t0 = now_secs();
+	for (size_t q = 0; q < nQueries; q++) {
+	    top.clear();
+	    if (aug) {
+		vector<uint8_t> keys, vals;
+		if ( ! b.findLargest(K, &keys, &vals, &err))
+		    nBad++;
+		for (size_t j = 0; j < vals.size() / 16; j++) {
+		    memcpy(val, &vals[j * 16], 16);
+		    top.push_back(val[1]);
+		}
+	    }
+	    else {
+		const uint32_t batch = 1024;
+		vector<uint8_t> keys(batch * 16);
+		vector<uint64_t> vals(batch * 2);
+		R2Cursor c(&b);
+		uint32_t got;
+		c.seekFirst(&err);
+		while ((got = c.fetch(batch, &keys[0],
+				      reinterpret_cast<uint8_t *>(&vals[0]),
+				      &err)) > 0) {
+		    for (uint32_t j = 0; j < got; j++) {
+			top.push_back(vals[j * 2 + 1]);
+			push_heap(top.begin(), top.end(), greater<uint64_t>());
+			if (top.size() > K) {
+			    pop_heap(top.begin(), top.end(),
+				     greater<uint64_t>());
+			    top.pop_back();
+			}
+		    }
+		}
+		sort(top.begin(), top.end(), greater<uint64_t>());
+	    }
+	}
+	report(aug ? "subtree max top 100" : "scan top 100", nQueries,
+	       now_secs() - t0);
+	cout << "    pages=" << ps.numPages() << "\n";
+
+	if (top.size() != K || ! equal(top.begin(), top.end(), want.begin()))
+	    nBad++;
+	if (nBad != 0) {
+	    cout << "insert or top 100 failed\n";
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+/****************************************************/
+/* r2btree appending keys                           */
+/****************************************************/
+
+// time ordered key, a big endian timestamp then a sequence number
+static void
+make_time_key(uint64_t i, uint8_t *key)
+{
+    uint64_t ts = 1700000000000ULL + i / 16;
+    for (int b = 0; b < 8; b++) {
+	key[b] = (uint8_t)(ts >> (56 - 8 * b));
+	key[8 + b] = (uint8_t)(i >> (56 - 8 * b));
+    }
+}
+
+static bool
+bench_r2btree_append(size_t n)
+{
+    // the same bytes copied to an array, as fast as an append can be
+    {
+	vector<uint8_t> keys(n * 16), vals(n * 8);
+	uint8_t key[16];
+	double t0 = now_secs();
+	for (size_t i = 0; i < n; i++) {
+	    make_time_key(i, key);
+	    memcpy(&keys[i * 16], key, 16);
+	    memcpy(&vals[i * 8], &i, 8);
+	}
+	report("append memcpy", n, now_secs() - t0);
+    }
+
+    for (int split = 0; split < 2; split++) {
+	R2BTreeParams params;
+	params.pageSize = 16384;
+	params.keySize = 16;
+	params.valSize = 8;
+
+	R2IndexHeader ih;
+	R2BTree::initIndexHeader(&ih, &params);
+
+	R2UUIDKey k;
+	MemPageStore ps(params.pageSize);
+
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &ps;
+	b.appendSplit = split != 0;
+
+	ErrorInfo err;
+	err.clear();
+	if ( ! b.initTree(&err)) {
+	    cout << "initTree failed: " << err.message << "\n";
+	    return false;
+	}
+
+	uint8_t key[16];
+	uint64_t val;
+	size_t nBad = 0;
+	const char *name = split ? "append insert, append split"
+	    : "append insert, even split";
+
+	double t0 = now_secs();
+	for (size_t i = 0; i < n; i++) {
+	    make_time_key(i, key);
+	    val = i;
+	    if ( ! b.insert(key, reinterpret_cast<uint8_t *>(&val), &err))
+		nBad++;
+	}
+	report(name, n, now_secs() - t0);
+	cout << "    pages=" << ps.numPages()
+	     << " appends=" << b.getNumAppends() << "\n";
+
+	for (size_t i = 0; i < n; i += 97) {
+	    make_time_key(i, key);
+	    if ( ! b.find(key, reinterpret_cast<uint8_t *>(&val), &err)
+		 || val != i)
+		nBad++;
+	}
+
+	if (nBad != 0) {
+	    cout << "insert or find failed\n";
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+/****************************************************/
+/* r2btree hash index                               */
+/****************************************************/
+
+static bool
+bench_r2btree_hash(size_t n)
+{
+    for (int hashed = 0; hashed < 2; hashed++) {
+	R2BTreeParams params;
+	params.pageSize = 16384;
+	params.keySize = 16;
+	params.valSize = 8;
+
+	R2IndexHeader ih;
+	R2BTree::initIndexHeader(&ih, &params);
+
+	R2UUIDKey k;
+	MemPageStore ps(params.pageSize);
+	HashIndex h(params.keySize, params.valSize);
+
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &ps;
+	if (hashed)
+	    b.hashIndex = &h;
+
+	ErrorInfo err;
+	err.clear();
+	if ( ! b.initTree(&err)) {
+	    cout << "initTree failed: " << err.message << "\n";
+	    return false;
+	}
+
+	uint8_t key[16];
+	uint64_t val;
+	size_t nBad = 0;
+	string name = hashed ? "hash index" : "tree only";
+
+	double t0 = now_secs();
+	for (size_t i = 0; i < n; i++) {
+	    make_key(i, key);
+	    val = i;
+	    if ( ! b.insert(key, reinterpret_cast<uint8_t *>(&val), &err))
+		nBad++;
+	}
+	report((name + " insert").c_str(), n, now_secs() - t0);
+
+	t0 = now_secs();
+	for (size_t i = 0; i < n; i++) {
+	    make_key(i, key);
+	    if ( ! b.find(key, reinterpret_cast<uint8_t *>(&val), &err)
+		 || val != i)
+		nBad++;
+	}
+	report((name + " find hit").c_str(), n, now_secs() - t0);
+
+	t0 = now_secs();
+	for (size_t i = 0; i < n; i++) {
+	    make_key(n + i, key);
+	    if (b.find(key, reinterpret_cast<uint8_t *>(&val), &err))
+		nBad++;
+	}
+	report((name + " find miss").c_str(), n, now_secs() - t0);
+	cout << "    tree MB=" << ps.numPages() * params.pageSize / 1048576
+	     << " hash MB=" << (hashed ? h.memoryBytes() / 1048576 : 0)
+	     << "\n";
+
+	if (nBad != 0) {
+	    cout << "insert or find failed\n";
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+/****************************************************/
+/* r2btree Bloom filter                             */
+/****************************************************/
+
+static bool
+bench_r2btree_bloom(size_t n)
+{
+    R2BTreeParams params;
+    params.pageSize = 16384;
+    params.keySize = 16;
+    params.valSize = 8;
+
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, &params);
+
+    R2UUIDKey k;
+    MemPageStore ps(params.pageSize);
+    BloomFilter f(params.keySize, n, 10);
+
+    R2BTree b;
+    b.header = &ih;
+    b.ki = &k;
+    b.ps = &ps;
+
+    ErrorInfo err;
+    err.clear();
+    if ( ! b.initTree(&err)) {
+	cout << "initTree failed: " << err.message << "\n";
+	return false;
+    }
+
+    uint8_t key[16];
+    uint64_t val;
+    size_t nBad = 0;
+
+    for (size_t i = 0; i < n; i++) {
+	make_key(i, key);
+	val = i;
+	if ( ! b.insert(key, reinterpret_cast<uint8_t *>(&val), &err))
+	    nBad++;
+    }
+
+    double t0 = now_secs();
+    b.bloomFilter = &f;
+    if ( ! b.loadBloomFilter(&err)) {
+	cout << "loadBloomFilter failed: " << err.message << "\n";
+	return false;
+    }
+    report("bloom rebuild", n, now_secs() - t0);
+
+    // the same misses with and without the filter in front
+    for (int filtered = 0; filtered < 2; filtered++) {
+	b.bloomFilter = filtered ? &f : NULL;
+	string name = filtered ? "bloom" : "tree only";
+
+	t0 = now_secs();
+	for (size_t i = 0; i < n; i++) {
+	    make_key(n + i, key);
+	    if (b.find(key, reinterpret_cast<uint8_t *>(&val), &err))
+		nBad++;
+	}
+	report((name + " find miss").c_str(), n, now_secs() - t0);
+
+	t0 = now_secs();
+	for (size_t i = 0; i < n; i++) {
+	    make_key(i, key);
+	    if ( ! b.find(key, reinterpret_cast<uint8_t *>(&val), &err)
+		 || val != i)
+		nBad++;
+	}
+	report((name + " find hit").c_str(), n, now_secs() - t0);
+    }
+
+    size_t fp = 0;
+    for (size_t i = 0; i < n; i++) {
+	make_key(n + i, key);
+	if (f.mayContain(key))
+	    fp++;
+    }
+    cout << "    false positives=" << 100.0 * fp / n << "%"
+	 << " bloom MB=" << f.memoryBytes() / 1048576 << "\n";
+
+    if (nBad != 0) {
+	cout << "insert or find failed\n";
+	return false;
+    }
+
+    return true;
+}
+
+/****************************************************/
+/* r2btree subtree counts                           */
+/****************************************************/
+
+static bool
+bench_r2btree_counts(size_t n)
+{
+    static const size_t Q = 20;
+
+    // the same ranges counted by a cursor scan, then by the subtree
+    // counts
+    vector<uint64_t> scanned;
+    for (int aug = 0; aug < 2; aug++) {
+	R2BTreeParams params;
+	params.pageSize = 4096;
+	params.keySize = 16;
+	params.valSize = 16;
+	params.subtreeCounts = aug == 1;
+	params.subtreeSums = aug == 1;
+	params.sumOffset = 8;
+
+	R2IndexHeader ih;
+	R2BTree::initIndexHeader(&ih, &params);
+
+	R2UUIDKey k;
+	MemPageStore ps(params.pageSize);
+
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &ps;
+
+	ErrorInfo err;
+	err.clear();
+	if ( ! b.initTree(&err)) {
+	    cout << "initTree failed: " << err.message << "\n";
+	    return false;
+	}
+
+	uint8_t key[16], lo[16], hi[16];
+	uint64_t val[2];
+	size_t nBad = 0;
+
+	double t0 = now_secs();
+	for (size_t i = 0; i < n; i++) {
+	    make_key(i, key);
+	    val[0] = i;
+	    val[1] = block_size(i);
+	    if ( ! b.insert(key, reinterpret_cast<uint8_t *>(val), &err))
+		nBad++;
+	}
+	report(aug ? "subtree count insert" : "plain insert", n,
+	       now_secs() - t0);
+
+	size_t nQueries = aug ? 100000 : Q;
+	t0 = now_secs();
+	for (size_t q = 0; q < nQueries; q++) {
+	    make_key(mix64(q) % n, lo);
+	    make_key(mix64(q + n) % n, hi);
+	    if (k.compare(lo, hi) > 0) {
+		memcpy(key, lo, 16);
+		memcpy(lo, hi, 16);
+		memcpy(hi, key, 16);
+	    }
+
+	    uint64_t cnt = 0, sum = 0;
+	    if (aug) {
+		if ( ! b.count(lo, hi, &cnt, &sum, &err))
+		    nBad++;
+	    }
+	    else {
+		const uint32_t batch = 1024;
+		vector<uint8_t> keys(batch * 16);
+		vector<uint64_t> vals(batch * 2);
+		R2Cursor c(&b);
+		uint32_t got;
+		bool done = ! c.seek(lo, &err);
+		while ( ! done
+			&& (got = c.fetch(batch, &keys[0],
+					  reinterpret_cast<uint8_t *>(&vals[0]),
+					  &err)) > 0) {
+		    for (uint32_t j = 0; j < got && ! done; j++) {
+			if (k.compare(&keys[j * 16], hi) >= 0)
+			    done = true;
+			else {
+			    cnt++;
+			    sum += vals[j * 2 + 1];
+			}
+		    }
+		}
+	    }
+	    if ( ! aug) {
+		scanned.push_back(cnt);
+		scanned.push_back(sum);
+	    }
+	    else if (q < Q && (scanned[q * 2] != cnt
+			       || scanned[q * 2 + 1] != sum))
+		nBad++;
+	}
+	report(aug ? "subtree count range" : "scan count range", nQueries,
+	       now_secs() - t0);
+
+	if (aug) {
+	    uint64_t r;
+	    t0 = now_secs();
+	    for (size_t q = 0; q < nQueries; q++) {
+		make_key(mix64(q) % n, key);
+		if ( ! b.rank(key, &r, NULL, &err)
+		     || ! b.select(r, lo, NULL, &err)
+		     || memcmp(lo, key, 16) != 0)
+		    nBad++;
+	    }
+	    report("subtree rank and select", nQueries, now_secs() - t0);
+	}
+	cout << "    pages=" << ps.numPages() << "\n";
+
+	if (nBad != 0) {
+	    cout << "insert or count failed\n";
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+/****************************************************/
+/* top level                                        */
+/****************************************************/
+
+static void
+usage()
+{
+    cout << "usage: dback_bench [-a] [-b] [-c] [-e] [-f] [-i] [-k] [-l]"
+	 << " [-m] [-o] [-p pool_mbytes] [-r] [-s] [-t nthreads] [-u] [-v]"
+	 << " [-w nthreads] [-x] [nkeys ...]\n"
+	 << "  -a  also run time ordered inserts, with even and append\n"
+	 << "      splits\n"
+	 << "  -b  also run random inserts one at a time and in batches\n"
+	 << "  -c  also run copy-on-write inserts, alone and while another\n"
+	 << "      thread scans snapshots\n"
+	 << "  -e  also run finds of missing keys with and without a Bloom\n"
+	 << "      filter\n"
+	 << "  -f  also run random finds one at a time and in batches\n"
+	 << "  -i  also run finds by interpolation, with probe counts\n"
+	 << "  -k  also run composite keys with and without key prefixes\n"
+	 << "  -l  also run finds with sorted and indexed non-leaf pages\n"
+	 << "  -m  also run top 100 largest values, by scan and by subtree\n"
+	 << "      maxima\n"
+	 << "  -o  also run range counts, by scan and by subtree counts, and\n"
+	 << "      rank and select\n"
+	 << "  -p  also run the buffer pool benchmark with this budget\n"
+	 << "  -r  also run variable length values, padded and with\n"
+	 << "      overflow pages\n"
+	 << "  -s  also run the page size sweep, 4K to 64K pages\n"
+	 << "  -t  also run finds from this many threads at once\n"
+	 << "  -u  also run UUID inserts and finds with and without a hash\n"
+	 << "      index\n"
+	 << "  -v  also run inserts with large values, sorted and slotted\n"
+	 << "      leaves\n"
+	 << "  -w  also run logged inserts, one commit each, from this many\n"
+	 << "      threads at once\n"
+	 << "  -x  also run path keys, compared by memcmp and by normalized\n"
+	 << "      key\n";
+}
+
+int
+main(int argc, const char **argv)
+{
+    vector<size_t> sizes;
+    size_t poolBytes = 0;
+    bool sweep = false;
+    size_t nThreads = 0;
+    size_t nWalThreads = 0;
+    bool append = false;
+    bool batch = false;
+    bool cow = false;
+    bool bloom = false;
+    bool findBatch = false;
+    bool interp = false;
+    bool prefix = false;
+    bool layout = false;
+    bool largest = false;
+    bool counts = false;
+    bool hash = false;
+    bool slotted = false;
+    bool var = false;
+    bool varKey = false;
+
+    for (int i = 1; i < argc; i++) {
+	if (strcmp(argv[i], "-a") == 0) {
+	    append = true;
+	}
+	else if (strcmp(argv[i], "-b") == 0) {
+	    batch = true;
+	}
+	else if (strcmp(argv[i], "-c") == 0) {
+	    cow = true;
+	}
+	else if (strcmp(argv[i], "-e") == 0) {
+	    bloom = true;
+	}
+	else if (strcmp(argv[i], "-f") == 0) {
+	    findBatch = true;
+	}
+	else if (strcmp(argv[i], "-i") == 0) {
+	    interp = true;
+	}
+	else if (strcmp(argv[i], "-k") == 0) {
+	    prefix = true;
+	}
+	else if (strcmp(argv[i], "-l") == 0) {
+	    layout = true;
+	}
+	else if (strcmp(argv[i], "-m") == 0) {
+	    largest = true;
+	}
+	else if (strcmp(argv[i], "-o") == 0) {
+	    counts = true;
+	}
+	else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+	    poolBytes = strtoul(argv[++i], NULL, 10) * 1024 * 1024;
+	}
+	else if (strcmp(argv[i], "-r") == 0) {
+	    var = true;
+	}
+	else if (strcmp(argv[i], "-s") == 0) {
+	    sweep = true;
+	}
+	else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+	    nThreads = strtoul(argv[++i], NULL, 10);
+	}
+	else if (strcmp(argv[i], "-u") == 0) {
+	    hash = true;
+	}
+	else if (strcmp(argv[i], "-v") == 0) {
+	    slotted = true;
+	}
+	else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+	    nWalThreads = strtoul(argv[++i], NULL, 10);
+	}
+	else if (strcmp(argv[i], "-x") == 0) {
+	    varKey = true;
+	}
+	else if (argv[i][0] == '-') {
+	    usage();
+	    return 1;
+	}
+	else {
+	    sizes.push_back(strtoul(argv[i], NULL, 10));
+	}
+    }
+
+    if (sizes.empty()) {
+	sizes.push_back(1000000);
+	sizes.push_back(10000000);
+	sizes.push_back(100000000);
+    }
+
+    for (size_t i = 0; i < sizes.size(); i++) {
+	if ( ! bench_key_search(sizes[i]))
+	    return 1;
+	if ( ! bench_r2btree_tree(sizes[i]))
+	    return 1;
+	if ( ! bench_r2btree_template(sizes[i]))
+	    return 1;
+	if ( ! bench_r2btree_bulk(sizes[i]))
+	    return 1;
+	if (poolBytes > 0 && ! bench_r2btree_pool(sizes[i], poolBytes))
+	    return 1;
+	if (sweep && ! bench_r2btree_page_sizes(sizes[i]))
+	    return 1;
+	if (nThreads > 0 && ! bench_r2btree_threads(sizes[i], nThreads))
+	    return 1;
+	if (nWalThreads > 0 && ! bench_r2btree_wal(sizes[i], nWalThreads))
+	    return 1;
+	if (cow && ! bench_r2btree_cow(sizes[i]))
+	    return 1;
+	if (interp && ! bench_r2btree_interpolation(sizes[i]))
+	    return 1;
+	if (prefix && ! bench_r2btree_prefix(sizes[i]))
+	    return 1;
+	if (layout && ! bench_r2btree_layout(sizes[i]))
+	    return 1;
+	if (batch && ! bench_r2btree_batch(sizes[i]))
+	    return 1;
+	if (findBatch && ! bench_r2btree_find_batch(sizes[i]))
+	    return 1;
+	if (slotted && ! bench_r2btree_slotted(sizes[i]))
+	    return 1;
+	if (var && ! bench_r2btree_var(sizes[i]))
+	    return 1;
+	if (varKey && ! bench_r2btree_varkey(sizes[i]))
+	    return 1;
+	if (largest && ! bench_r2btree_largest(sizes[i]))
+	    return 1;
+	if (append && ! bench_r2btree_append(sizes[i]))
+	    return 1;
+	if (hash && ! bench_r2btree_hash(sizes[i]))
+	    return 1;
+	if (bloom && ! bench_r2btree_bloom(sizes[i]))
+	    return 1;
+	if (counts && ! bench_r2btree_counts(sizes[i]))
+	    return 1;
+    }
+
+    return 0;
+}
+
+/*
+  Local Variables:
+  mode: c++
+  c-basic-offset: 4
+  End:
+*/
@@ -7,12 +7,20 @@
 #include <inttypes.h>
 
 #include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
 
 #include <cstdarg>
+#include <cstdlib>
 #include <cstring>
 
 #include <list>
+#include <map>
+#include <set>
+#include <algorithm>
 #include <vector>
+#include <unordered_map>
 #include <limits>
 #include <sstream>
 #include <exception>
@@ -22,8 +30,14 @@
 #include <boost/thread.hpp>
 
 #include "dback.h"
+#include "wal.h"
+#include "pagestore.h"
+#include "keysearch.h"
+#include "hashindex.h"
+#include "bloomfilter.h"
 #include "btree.h"
 #include "r2btree.h"
+#include "r2btreet.h"
 
 using namespace std;
 
@@ -1189,9 +1203,9 @@ TC_BTree01::run()
     {
 	IndexHeader ih;
 
-	UUIDKey::initIndexHeader(&ih, 56);
+	UUIDKey::initIndexHeader(&ih, 68);
 	ASSERT_TRUE(ih.nKeyBytes == 16);
-	ASSERT_TRUE(ih.pageSizeInBytes == 56);
+	ASSERT_TRUE(ih.pageSizeInBytes == 68);
 	ASSERT_TRUE(ih.maxNumNLeafKeys == 2);
 	ASSERT_TRUE(ih.minNumNLeafKeys == 1);
 	ASSERT_TRUE(ih.maxNumLeafKeys == 2);
@@ -1200,9 +1214,9 @@ TC_BTree01::run()
     {
 	IndexHeader ih;
 
-	UUIDKey::initIndexHeader(&ih, 80);
+	UUIDKey::initIndexHeader(&ih, 92);
 	ASSERT_TRUE(ih.nKeyBytes == 16);
-	ASSERT_TRUE(ih.pageSizeInBytes == 80);
+	ASSERT_TRUE(ih.pageSizeInBytes == 92);
 	ASSERT_TRUE(ih.maxNumNLeafKeys == 2);
 	ASSERT_TRUE(ih.minNumNLeafKeys == 1);
 	ASSERT_TRUE(ih.maxNumLeafKeys == 3);
@@ -1295,12 +1309,12 @@ ShortKey::initIndexHeader(IndexHeader *ih, uint32_t pageSize)
 
     ih->nKeyBytes = key_size;
     ih->pageSizeInBytes = pageSize;
-                          // (pgsize - 8) / 5
+                          // (pgsize - 20) / 5
     ih->maxNumNLeafKeys = (pageSize - hdr_size) / (key_size + ptr_size);
 
     ih->minNumNLeafKeys = ih->maxNumNLeafKeys / 2;
 
-                          // (pgsize - 8) / 9
+                          // (pgsize - 20) / 9
     ih->maxNumLeafKeys = (pageSize - hdr_size) / (key_size + data_size);
 
     return;
@@ -1315,7 +1329,7 @@ void
 TC_BTree03::run()
 {
     ShortKey k;
-    const size_t bufsize = 28;
+    const size_t bufsize = 40;
     IndexHeader ih;
     k.initIndexHeader(&ih, bufsize);
     ASSERT_TRUE(ih.maxNumNLeafKeys > 1);
@@ -1371,7 +1385,7 @@ void
 TC_BTree04::run()
 {
     ShortKey k;
-    const size_t bufsize = 28;
+    const size_t bufsize = 40;
     IndexHeader ih;
     k.initIndexHeader(&ih, bufsize);
     ASSERT_TRUE(ih.maxNumNLeafKeys >= 2);
@@ -1437,7 +1451,7 @@ void
 TC_BTree05::run()
 {
     ShortKey k;
-    const size_t bufsize = 28;
+    const size_t bufsize = 40;
     IndexHeader ih;
     k.initIndexHeader(&ih, bufsize);
     ASSERT_TRUE(ih.maxNumNLeafKeys >= 2);
@@ -1511,8 +1525,8 @@ void
 TC_BTree06::run()
 {
     ShortKey k;
-    // want 3 leaf keys: hdr=8 + val=8*3 + key=1*3 = 33
-    const size_t bufsize = 35;
+    // want 3 leaf keys: hdr=20 + val=8*3 + key=1*3 = 47
+    const size_t bufsize = 47;
     IndexHeader ih;
     k.initIndexHeader(&ih, bufsize);
     ASSERT_TRUE(ih.maxNumNLeafKeys >= 2);
@@ -1606,7 +1620,7 @@ void
 TC_BTree07::run()
 {
     ShortKey k;
-    const size_t bufsize = 28;
+    const size_t bufsize = 40;
     IndexHeader ih;
     k.initIndexHeader(&ih, bufsize);
     ASSERT_TRUE(ih.maxNumNLeafKeys >= 2);
@@ -1682,7 +1696,7 @@ void
 TC_BTree08::run()
 {
     ShortKey k;
-    const size_t bufsize = 28;
+    const size_t bufsize = 40;
     IndexHeader ih;
     k.initIndexHeader(&ih, bufsize);
     ASSERT_TRUE(ih.maxNumNLeafKeys >= 2);
@@ -1777,8 +1791,8 @@ void
 TC_BTree09::run()
 {
     ShortKey k;
-    // want 3 leaf keys: hdr=8 + val=8*3 + key=1*3 = 33
-    const size_t bufsize = 35;
+    // want 3 leaf keys: hdr=20 + val=8*3 + key=1*3 = 47
+    const size_t bufsize = 47;
     IndexHeader ih;
     k.initIndexHeader(&ih, bufsize);
     ASSERT_TRUE(ih.maxNumNLeafKeys >= 2);
@@ -1869,7 +1883,7 @@ void
 TC_BTree10::run()
 {
     ShortKey k;
-    const size_t bufsize = 28;
+    const size_t bufsize = 40;
     IndexHeader ih;
     k.initIndexHeader(&ih, bufsize);
     ASSERT_TRUE(ih.maxNumNLeafKeys >= 2);
@@ -1937,7 +1951,7 @@ void
 TC_BTree11::run()
 {
     ShortKey k;
-    const size_t bufsize = 28;
+    const size_t bufsize = 40;
     IndexHeader ih;
     k.initIndexHeader(&ih, bufsize);
     ASSERT_TRUE(ih.maxNumNLeafKeys >= 2);
@@ -2005,8 +2019,8 @@ void
 TC_BTree12::run()
 {
     ShortKey k;
-    // want 3 leaf keys: hdr=8 + val=8*3 + key=1*3 = 33
-    const size_t bufsize = 35;
+    // want 3 leaf keys: hdr=20 + val=8*3 + key=1*3 = 47
+    const size_t bufsize = 47;
     IndexHeader ih;
     k.initIndexHeader(&ih, bufsize);
     ASSERT_TRUE(ih.maxNumNLeafKeys >= 2);
@@ -2097,8 +2111,8 @@ void
 TC_BTree13::run()
 {
     ShortKey k;
-    // want 3 leaf keys: hdr=8 + val=8*3 + key=1*3 = 33
-    const size_t bufsize = 35;
+    // want 3 leaf keys: hdr=20 + val=8*3 + key=1*3 = 47
+    const size_t bufsize = 47;
     IndexHeader ih;
     k.initIndexHeader(&ih, bufsize);
     ASSERT_TRUE(ih.maxNumNLeafKeys >= 2);
@@ -2228,8 +2242,8 @@ void
 TC_BTree14::run()
 {
     ShortKey k;
-    // want 3 leaf keys: hdr=8 + val=8*3 + key=1*3 = 33
-    const size_t bufsize = 35;
+    // want 3 leaf keys: hdr=20 + val=8*3 + key=1*3 = 47
+    const size_t bufsize = 47;
     IndexHeader ih;
     k.initIndexHeader(&ih, bufsize);
     ASSERT_TRUE(ih.maxNumNLeafKeys >= 2);
@@ -2320,7 +2334,7 @@ void
 TC_BTree15::run()
 {
     ShortKey k;
-    const size_t bufsize = 35;
+    const size_t bufsize = 47;
     IndexHeader ih;
     k.initIndexHeader(&ih, bufsize);
     ASSERT_TRUE(ih.maxNumNLeafKeys >= 2);
@@ -2403,8 +2417,8 @@ void
 TC_BTree16::run()
 {
     ShortKey k;
-    // want 3 leaf keys: hdr=8 + val=8*3 + key=1*3 = 33
-    const size_t bufsize = 35;
+    // want 3 leaf keys: hdr=20 + val=8*3 + key=1*3 = 47
+    const size_t bufsize = 47;
     IndexHeader ih;
     k.initIndexHeader(&ih, bufsize);
     ASSERT_TRUE(ih.maxNumNLeafKeys >= 2);
@@ -2495,7 +2509,7 @@ void
 TC_BTree17::run()
 {
     ShortKey k;
-    const size_t bufsize = 35;
+    const size_t bufsize = 47;
     IndexHeader ih;
     k.initIndexHeader(&ih, bufsize);
     ASSERT_TRUE(ih.maxNumNLeafKeys >= 2);
@@ -2790,11 +2804,13 @@ TC_R2BTree00::run()
     ih.minNumKeys[PageTypeNonLeaf] = 0;
     ih.maxNumKeys[PageTypeLeaf] = 0;
     ih.minNumKeys[PageTypeLeaf] = 0;
+    ih.nonLeafLayout = R2LayoutSorted;
+    ih.leafLayout = R2LeafSorted;
 
-    ph.parentPageNum = 0;
+    ph.prefixLen = 0;
     ph.numKeys = 0;
     ph.pageType = PageTypeLeaf;
-    ph.pad = 0;
+    ph.level = 0;
 
     pa.header = &ph;
     pa.keys = NULL;
@@ -2837,17 +2853,17 @@ TC_R2BTree01::run()
 	R2IndexHeader ih;
 	R2BTreeParams p;
 
-	p.pageSize = 76;
+	p.pageSize = 88;
 	p.keySize = 16;
 	p.valSize =  8;
 	// page = <pageheader><vals><keys>
-	// <pageheader> = 8 bytes
-	// leaf: sz = 8 + 2 *(8 + 16) = 56; 
-	// non leaf: sz = 8 + 3 * ( 8 + 4 ) + 4 = 48
+	// <pageheader> = 32 bytes
+	// leaf: sz = 32 + 2 *(8 + 16) = 80; 
+	// non leaf: sz = 32 + 2 * ( 16 + 4 ) + 4 = 76
 	// but non leaf size must be even
 	R2BTree::initIndexHeader(&ih, &p);
 	ASSERT_TRUE(ih.keySize == 16);
-	ASSERT_TRUE(ih.pageSize == 76);
+	ASSERT_TRUE(ih.pageSize == 88);
 	ASSERT_TRUE(ih.maxNumKeys[PageTypeNonLeaf] == 2);
 	ASSERT_TRUE(ih.minNumKeys[PageTypeNonLeaf] == 1);
 	ASSERT_TRUE(ih.maxNumKeys[PageTypeLeaf] == 2);
@@ -2858,20 +2874,20 @@ TC_R2BTree01::run()
 	R2IndexHeader ih;
 	R2BTreeParams p;
 
-	p.pageSize = 80;
+	p.pageSize = 92;
 	p.keySize = 16;
 	p.valSize =  8;
 
 	R2BTree::initIndexHeader(&ih, &p);
 	ASSERT_TRUE(ih.keySize == 16);
-	ASSERT_TRUE(ih.pageSize == 80);
+	ASSERT_TRUE(ih.pageSize == 92);
 
-	// leaf: sz=8 + 3*(16 + 8) = 80
+	// leaf: sz=32 + 2*(16 + 8) = 80
 	// leaf sizes must be even
 	ASSERT_TRUE(ih.maxNumKeys[PageTypeLeaf] == 2);
 	ASSERT_TRUE(ih.minNumKeys[PageTypeLeaf] == 1);
 
-	// non leaf: sz=8 + 3 * (16 + 4) + 4 = 88
+	// non leaf: sz=32 + 3 * (16 + 4) + 4 = 96
 	// non leaf must be even
 	ASSERT_TRUE(ih.maxNumKeys[PageTypeNonLeaf] == 2);
 	ASSERT_TRUE(ih.minNumKeys[PageTypeNonLeaf] == 1);
@@ -2965,7 +2981,7 @@ void
 TC_R2BTree03::run()
 {
     R2ShortKey k;
-    const size_t bufsize = 28;
+    const size_t bufsize = 52;
     R2IndexHeader ih;
 
     R2BTreeParams params;
@@ -3032,7 +3048,7 @@ struct TC_R2BTree04 : public TestCase {
 void
 TC_R2BTree04::run()
 {
-    const size_t bufsize = 28;
+    const size_t bufsize = 52;
     R2BTreeParams params;
 
     params.pageSize = bufsize;
@@ -3116,7 +3132,7 @@ void
 TC_R2BTree05::run()
 {
     R2ShortKey k;
-    const size_t bufsize = 28;
+    const size_t bufsize = 52;
 
     R2BTreeParams params;
 
@@ -3206,8 +3222,8 @@ void
 TC_R2BTree06::run()
 {
     R2ShortKey k;
-    // want 3 leaf keys: hdr=8 + val=8*3 + key=1*3 = 33
-    const size_t bufsize = 45;
+    // want 3 leaf keys: hdr=20 + val=8*3 + key=1*3 = 47
+    const size_t bufsize = 69;
     R2IndexHeader ih;
 
     R2BTreeParams params;
@@ -3323,7 +3339,7 @@ void
 TC_R2BTree07::run()
 {
     R2ShortKey k;
-    const size_t bufsize = 28;
+    const size_t bufsize = 52;
 
     R2BTreeParams params;
     params.pageSize = bufsize;
@@ -3407,7 +3423,7 @@ void
 TC_R2BTree08::run()
 {
     R2ShortKey k;
-    const size_t bufsize = 280;
+    const size_t bufsize = 304;
 
     R2BTreeParams params;
     params.pageSize = bufsize;
@@ -3517,8 +3533,8 @@ void
 TC_R2BTree09::run()
 {
     R2ShortKey k;
-    // want 3 leaf keys: hdr=8 + val=8*3 + key=1*3 = 33
-    const size_t bufsize = 80;
+    // want 3 leaf keys: hdr=20 + val=8*3 + key=1*3 = 47
+    const size_t bufsize = 104;
 
     R2BTreeParams params;
     params.pageSize = bufsize;
@@ -3626,7 +3642,7 @@ void
 TC_R2BTree10::run()
 {
     R2ShortKey k;
-    const size_t bufsize = 28;
+    const size_t bufsize = 52;
 
     R2BTreeParams params;
     params.pageSize = bufsize;
@@ -3711,7 +3727,7 @@ void
 TC_R2BTree11::run()
 {
     R2ShortKey k;
-    const size_t bufsize = 28;
+    const size_t bufsize = 52;
 
     R2BTreeParams params;
     params.pageSize = bufsize;
@@ -3794,8 +3810,8 @@ void
 TC_R2BTree12::run()
 {
     R2ShortKey k;
-    // want 3 leaf keys: hdr=8 + val=8*3 + key=1*3 = 33
-    const size_t bufsize = 200;
+    // want 3 leaf keys: hdr=20 + val=8*3 + key=1*3 = 47
+    const size_t bufsize = 224;
 
     R2BTreeParams params;
     params.pageSize = bufsize;
@@ -3898,8 +3914,8 @@ void
 TC_R2BTree13::run()
 {
     R2ShortKey k;
-    // want 3 leaf keys: hdr=8 + val=8*3 + key=1*3 = 33
-    const size_t bufsize = 350;
+    // want 3 leaf keys: hdr=20 + val=8*3 + key=1*3 = 47
+    const size_t bufsize = 374;
 
     R2BTreeParams params;
     params.pageSize = bufsize;
@@ -3997,8 +4013,8 @@ void
 TC_R2BTree14::run()
 {
     R2ShortKey k;
-    // want 3 leaf keys: hdr=8 + val=8*3 + key=1*3 = 33
-    const size_t bufsize = 80;
+    // want 3 leaf keys: hdr=20 + val=8*3 + key=1*3 = 47
+    const size_t bufsize = 104;
 
     R2BTreeParams params;
     params.pageSize = bufsize;
@@ -4100,7 +4116,7 @@ void
 TC_R2BTree15::run()
 {
     R2ShortKey k;
-    const size_t bufsize = 80;
+    const size_t bufsize = 104;
 
     R2BTreeParams params;
     params.pageSize = bufsize;
@@ -4194,8 +4210,8 @@ void
 TC_R2BTree16::run()
 {
     R2ShortKey k;
-    // want 3 leaf keys: hdr=8 + val=8*3 + key=1*3 = 33
-    const size_t bufsize = 80;
+    // want 3 leaf keys: hdr=20 + val=8*3 + key=1*3 = 47
+    const size_t bufsize = 104;
 
     R2BTreeParams params;
     params.pageSize = bufsize;
@@ -4298,7 +4314,7 @@ void
 TC_R2BTree17::run()
 {
     R2ShortKey k;
-    const size_t bufsize = 80;
+    const size_t bufsize = 104;
 
     R2BTreeParams params;
     params.pageSize = bufsize;
@@ -4392,7 +4408,7 @@ void
 TC_R2BTree18::run()
 {
     const int n_keys = 20;
-    const size_t bufsize = sizeof(PageHeader)
+    const size_t bufsize = sizeof(R2PageHeader)
 	+ n_keys * (sizeof(uint64_t) + 1); /* keysize */
 
     R2BTreeParams params;
@@ -4478,7 +4494,7 @@ void
 TC_R2BTree19::run()
 {
     const int n_keys = 20;
-    const size_t bufsize = sizeof(PageHeader)
+    const size_t bufsize = sizeof(R2PageHeader)
 	+ n_keys * (sizeof(uint64_t) + 1); /* keysize */
     R2ShortKey k;
     R2IndexHeader ih;
@@ -4613,7 +4629,7 @@ void
 TC_R2BTree20::run()
 {
     const int n_keys = 20;
-    const size_t bufsize = sizeof(PageHeader)
+    const size_t bufsize = sizeof(R2PageHeader)
 	+ n_keys * (sizeof(uint64_t) + 1); /* keysize */
 
     R2BTreeParams params;
@@ -4672,7 +4688,7 @@ TC_R2BTree21::run()
     params.valSize = 4;
 
     const int n_keys = 20;
-    params.pageSize = sizeof(PageHeader)
+    params.pageSize = sizeof(R2PageHeader)
 	+ n_keys * (params.valSize + params.keySize);
 
     R2ShortKey k;
@@ -4746,7 +4762,7 @@ TC_R2BTree22::run()
     params.valSize = 4;
 
     const int n_keys = 20;
-    params.pageSize = sizeof(PageHeader)
+    params.pageSize = sizeof(R2PageHeader)
 	+ n_keys * (params.valSize + params.keySize);
 
     R2ShortKey k;
@@ -4849,7 +4865,7 @@ TC_R2BTree23::run()
     params.valSize = 4;
 
     const int n_keys = 20;
-    params.pageSize = sizeof(PageHeader)
+    params.pageSize = sizeof(R2PageHeader)
 	+ n_keys * (params.valSize + params.keySize);
 
     R2ShortKey k;
@@ -4952,7 +4968,7 @@ TC_R2BTree24::run()
     params.valSize = 4;
 
     const int n_keys = 20;
-    params.pageSize = sizeof(PageHeader)
+    params.pageSize = sizeof(R2PageHeader)
 	+ n_keys * (params.valSize + params.keySize);
 
     R2ShortKey k;
@@ -5001,6 +5017,6892 @@ TC_R2BTree24::run()
 
 }
 
+/************/
+
+namespace dback {
+
+/**
+ * Test class for 4 byte keys, stored in host byte order.
+ */
+class R2IntKey : public R2KeyInterface {
+public:
+    int compare(const uint8_t *a, const uint8_t *b);
+};
+
+int
+R2IntKey::compare(const uint8_t *a, const uint8_t *b)
+{
+    uint32_t x, y;
+    memcpy(&x, a, sizeof(x));
+    memcpy(&y, b, sizeof(y));
+    if (x < y)
+	return -1;
+    else if (x > y)
+	return 1;
+    return 0;
+}
+
+/**
+ * Walk a subtree checking key order, key counts and leaf depth.
+ *
+ * Keys in the subtree must be >= lo (if have_lo) and < hi (if have_hi).
+ * Returns false if anything is wrong.
+ */
+static bool
+r2_check_node(R2BTree *b, uint32_t pn, bool have_lo, uint32_t lo,
+	      bool have_hi, uint32_t hi, bool is_root, int depth,
+	      int *leaf_depth, size_t *count)
+{
+    PagePin pin;
+    R2PageAccess ac;
+    ErrorInfo err;
+    if ( ! b->pinPage(&pin, &ac, pn, &err))
+	return false;
+
+    uint8_t pt = ac.header->pageType;
+    if (ac.header->numKeys > b->maxKeys(&ac))
+	return false;
+    if ( ! is_root && ac.header->numKeys < b->header->minNumKeys[pt])
+	return false;
+
+    uint32_t prev = 0;
+    for (uint32_t i = 0; i < ac.header->numKeys; i++) {
+	uint32_t k;
+	memcpy(&k, ac.keys + i * 4, 4);
+	if (i > 0 && k <= prev)
+	    return false;
+	// key 0 of a non-leaf node is only a lower bound
+	if (have_hi && k >= hi)
+	    return false;
+	if (have_lo && k < lo && (pt == PageTypeLeaf || i > 0))
+	    return false;
+	prev = k;
+    }
+
+    if (pt == PageTypeLeaf) {
+	if (*leaf_depth < 0)
+	    *leaf_depth = depth;
+	*count += ac.header->numKeys;
+	return *leaf_depth == depth;
+    }
+
+    if (is_root && ac.header->numKeys < 2)
+	return false;
+
+    for (uint32_t i = 0; i < ac.header->numKeys; i++) {
+	uint32_t k_lo, k_hi;
+	bool c_have_lo = have_lo, c_have_hi = have_hi;
+	memcpy(&k_lo, ac.keys + i * 4, 4);
+	if (i > 0) {
+	    c_have_lo = true;
+	}
+	else {
+	    k_lo = lo;
+	}
+	if (i + 1 < ac.header->numKeys) {
+	    memcpy(&k_hi, ac.keys + (i + 1) * 4, 4);
+	    c_have_hi = true;
+	}
+	else {
+	    k_hi = hi;
+	}
+	if ( ! r2_check_node(b, b->getChildPageNum(&ac, i), c_have_lo, k_lo,
+			     c_have_hi, k_hi, false, depth + 1, leaf_depth,
+			     count))
+	    return false;
+    }
+
+    return true;
+}
+
+/**
+ * Walk the sibling links of every level, from the first page.
+ *
+ * Checks the prev links and page levels match, that each level has
+ * one page per key in the level above, and counts the leaf keys.
+ */
+static bool
+r2_check_links(R2BTree *b, size_t *count)
+{
+    PagePin pin;
+    R2PageAccess ac;
+    ErrorInfo err;
+    uint32_t first = b->header->rootPageNum;
+    size_t n_children = 1;
+
+    *count = 0;
+    if ( ! b->pinPage(&pin, &ac, first, &err))
+	return false;
+    int level = ac.header->level;
+
+    while (level >= 0) {
+	uint32_t pn = first;
+	uint32_t prev_pn = 0;
+	size_t n_pages = 0, n_keys = 0;
+
+	while (pn != 0) {
+	    if ( ! b->pinPage(&pin, &ac, pn, &err))
+		return false;
+	    if (ac.header->prevPageNum != prev_pn
+		|| ac.header->level != level
+		|| (ac.header->pageType == PageTypeLeaf) != (level == 0))
+		return false;
+	    if (pn == first && level > 0)
+		first = b->getChildPageNum(&ac, 0);
+	    n_pages++;
+	    n_keys += ac.header->numKeys;
+	    prev_pn = pn;
+	    pn = ac.header->nextPageNum;
+	}
+
+	if (n_pages != n_children)
+	    return false;
+	n_children = n_keys;
+	if (level == 0)
+	    *count = n_keys;
+	level--;
+    }
+
+    return true;
+}
+
+static bool
+r2_check_tree(R2BTree *b, size_t *count)
+{
+    int leaf_depth = -1;
+    size_t linked;
+    *count = 0;
+    if ( ! r2_check_node(b, b->header->rootPageNum, false, 0, false, 0,
+			 true, 0, &leaf_depth, count))
+	return false;
+    if ( ! r2_check_links(b, &linked))
+	return false;
+    return linked == *count;
+}
+
+// copy-on-write trees and snapshots have no sibling links
+static bool
+r2_check_cow(R2BTree *b, uint32_t rootPageNum, size_t *count)
+{
+    int leaf_depth = -1;
+    *count = 0;
+    return r2_check_node(b, rootPageNum, false, 0, false, 0, true, 0,
+			 &leaf_depth, count);
+}
+
+static size_t
+r2_count_pages(R2BTree *b, uint32_t pn)
+{
+    PagePin pin;
+    R2PageAccess ac;
+    ErrorInfo err;
+    size_t n = 1;
+    if ( ! b->pinPage(&pin, &ac, pn, &err))
+	return 0;
+    if (ac.header->pageType == PageTypeNonLeaf) {
+	for (uint32_t i = 0; i < ac.header->numKeys; i++)
+	    n += r2_count_pages(b, b->getChildPageNum(&ac, i));
+    }
+    return n;
+}
+
+struct TC_R2BTree25 : public TestCase {
+    TC_R2BTree25() : TestCase("TC_R2BTree25") {;};
+    void run();
+};
+
+void
+TC_R2BTree25::run()
+{
+    R2BTreeParams params;
+    params.keySize = 4;
+    params.valSize = 4;
+    params.pageSize = 40;
+
+    R2IntKey k;
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, &params);
+
+    MemPageStore ps(params.pageSize);
+
+    R2BTree b;
+    b.header = &ih;
+    b.ki = &k;
+    b.ps = &ps;
+
+    ErrorInfo err;
+    bool ok;
+
+    // too small for tree level routines
+    err.clear();
+    ok = b.initTree(&err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+
+    // 6 keys in both leaf and non-leaf pages
+    params.pageSize = 84;
+    R2BTree::initIndexHeader(&ih, &params);
+    ASSERT_TRUE(ih.maxNumKeys[PageTypeLeaf] == 6);
+    ASSERT_TRUE(ih.maxNumKeys[PageTypeNonLeaf] == 6);
+    MemPageStore ps2(params.pageSize);
+    b.ps = &ps2;
+
+    err.clear();
+    ok = b.initTree(&err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(ih.rootPageNum != 0);
+
+    const uint32_t n = 2000;
+    uint32_t key, val;
+    size_t count;
+
+    for (uint32_t i = 0; i < n; i++) {
+	key = (i * 7919) % n;
+	val = key + 1;
+	err.clear();
+	ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+		      reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+    }
+
+    ok = r2_check_tree(&b, &count);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(count == n);
+
+    for (key = 0; key < n; key++) {
+	val = 0;
+	err.clear();
+	ok = b.find(reinterpret_cast<uint8_t *>(&key),
+		    reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(val == key + 1);
+    }
+
+    key = n + 10;
+    err.clear();
+    ok = b.find(reinterpret_cast<uint8_t *>(&key), NULL, &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_KEY_NOT_FOUND);
+
+    key = 5;
+    val = 99;
+    err.clear();
+    ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+		  reinterpret_cast<uint8_t *>(&val), &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_DUPLICATE_INSERT);
+
+    // descending inserts keep going under child 0
+    MemPageStore ps3(params.pageSize);
+    b.ps = &ps3;
+    err.clear();
+    ok = b.initTree(&err);
+    ASSERT_TRUE(ok == true);
+    for (key = n; key > 0; key--) {
+	val = key;
+	ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+		      reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+    }
+    ok = r2_check_tree(&b, &count);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(count == n);
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+struct TC_R2BTree26 : public TestCase {
+    TC_R2BTree26() : TestCase("TC_R2BTree26") {;};
+    void run();
+};
+
+void
+TC_R2BTree26::run()
+{
+    R2BTreeParams params;
+    params.keySize = 4;
+    params.valSize = 4;
+    params.pageSize = 84;
+
+    R2IntKey k;
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, &params);
+
+    MemPageStore ps(params.pageSize);
+
+    R2BTree b;
+    b.header = &ih;
+    b.ki = &k;
+    b.ps = &ps;
+
+    ErrorInfo err;
+    bool ok;
+    size_t count;
+    uint32_t key, val;
+    const uint32_t n = 1500;
+
+    err.clear();
+    ok = b.initTree(&err);
+    ASSERT_TRUE(ok == true);
+
+    // ascending inserts, then erase every other key
+    for (key = 0; key < n; key++) {
+	val = key;
+	ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+		      reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+    }
+
+    for (key = 0; key < n; key += 2) {
+	err.clear();
+	ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+	ASSERT_TRUE(ok == true);
+    }
+
+    ok = r2_check_tree(&b, &count);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(count == n / 2);
+
+    key = 0;
+    err.clear();
+    ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_KEY_NOT_FOUND);
+
+    for (key = 0; key < n; key++) {
+	err.clear();
+	ok = b.find(reinterpret_cast<uint8_t *>(&key),
+		    reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == ((key & 1) == 1));
+	if (ok)
+	    ASSERT_TRUE(val == key);
+    }
+
+    // erase the rest from the top down
+    for (key = n - 1; key < n; key -= 2) {
+	err.clear();
+	ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+	ASSERT_TRUE(ok == true);
+	if (key % 101 == 0) {
+	    ok = r2_check_tree(&b, &count);
+	    ASSERT_TRUE(ok == true);
+	}
+    }
+
+    ok = r2_check_tree(&b, &count);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(count == 0);
+    ASSERT_TRUE(ps.numPages() == 1);
+
+    // tree is still usable
+    key = 42;
+    val = 43;
+    ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+		  reinterpret_cast<uint8_t *>(&val), &err);
+    ASSERT_TRUE(ok == true);
+    ok = b.find(reinterpret_cast<uint8_t *>(&key),
+		reinterpret_cast<uint8_t *>(&val), &err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(val == 43);
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+struct TC_R2BTree27 : public TestCase {
+    TC_R2BTree27() : TestCase("TC_R2BTree27") {;};
+    void run();
+};
+
+void
+TC_R2BTree27::run()
+{
+    R2UUIDKey k;
+    uint8_t a[16], b[16];
+
+    memset(a, 0, sizeof(a));
+    memset(b, 0, sizeof(b));
+    ASSERT_TRUE(k.compare(a, b) == 0);
+
+    b[15] = 1;
+    ASSERT_TRUE(k.compare(a, b) < 0);
+    ASSERT_TRUE(k.compare(b, a) > 0);
+
+    a[0] = 1;
+    ASSERT_TRUE(k.compare(a, b) > 0);
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+/**
+ * Bulk load source returning keys first, first + step, ...
+ */
+class R2IntSource : public R2BulkSource {
+public:
+    uint32_t next_key;
+    uint32_t step;
+    uint32_t remaining;
+
+    R2IntSource(uint32_t first, uint32_t s, uint32_t n)
+	: next_key(first), step(s), remaining(n) {;};
+
+    bool next(uint8_t *key, uint8_t *val);
+};
+
+bool
+R2IntSource::next(uint8_t *key, uint8_t *val)
+{
+    if (this->remaining == 0)
+	return false;
+    uint32_t v = this->next_key + 1;
+    memcpy(key, &this->next_key, sizeof(uint32_t));
+    memcpy(val, &v, sizeof(uint32_t));
+    this->next_key += this->step;
+    this->remaining--;
+    return true;
+}
+
+struct TC_R2BTree28 : public TestCase {
+    TC_R2BTree28() : TestCase("TC_R2BTree28") {;};
+    void run();
+};
+
+void
+TC_R2BTree28::run()
+{
+    R2BTreeParams params;
+    params.keySize = 4;
+    params.valSize = 4;
+    params.pageSize = 84;
+
+    R2IntKey k;
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, &params);
+
+    ErrorInfo err;
+    bool ok;
+    size_t count;
+    uint32_t key, val;
+
+    double fills[] = { 1.0, 0.75, 0.5, 0.1 };
+    uint32_t sizes[] = { 0, 1, 5, 6, 7, 12, 13, 37, 43, 216, 217, 1000, 2000 };
+
+    for (size_t f = 0; f < sizeof(fills) / sizeof(fills[0]); f++) {
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+	    uint32_t n = sizes[i];
+	    MemPageStore ps(params.pageSize);
+
+	    R2BTree b;
+	    b.header = &ih;
+	    b.ki = &k;
+	    b.ps = &ps;
+
+	    R2IntSource src(10, 3, n);
+	    err.clear();
+	    ok = b.bulkLoad(&src, fills[f], &err);
+	    ASSERT_TRUE(ok == true);
+
+	    ok = r2_check_tree(&b, &count);
+	    ASSERT_TRUE(ok == true);
+	    ASSERT_TRUE(count == n);
+
+	    // full leaves when nothing will be inserted later
+	    if (fills[f] == 1.0 && n > 0)
+		ASSERT_TRUE(ps.numPages() <= (n + 5) / 6 + (n + 29) / 30 + 2);
+
+	    for (uint32_t j = 0; j < n; j++) {
+		key = 10 + 3 * j;
+		val = 0;
+		err.clear();
+		ok = b.find(reinterpret_cast<uint8_t *>(&key),
+			    reinterpret_cast<uint8_t *>(&val), &err);
+		ASSERT_TRUE(ok == true);
+		ASSERT_TRUE(val == key + 1);
+
+		key++;
+		ok = b.find(reinterpret_cast<uint8_t *>(&key), NULL, &err);
+		ASSERT_TRUE(ok == false);
+	    }
+
+	    // the loaded tree takes normal inserts and erases
+	    for (uint32_t j = 0; j < n; j++) {
+		key = 11 + 3 * j;
+		val = key + 1;
+		err.clear();
+		ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+			      reinterpret_cast<uint8_t *>(&val), &err);
+		ASSERT_TRUE(ok == true);
+	    }
+	    for (uint32_t j = 0; j < n; j += 2) {
+		key = 10 + 3 * j;
+		err.clear();
+		ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+		ASSERT_TRUE(ok == true);
+	    }
+	    ok = r2_check_tree(&b, &count);
+	    ASSERT_TRUE(ok == true);
+	    ASSERT_TRUE(count == n + n / 2);
+	}
+    }
+
+    MemPageStore ps(params.pageSize);
+    R2BTree b;
+    b.header = &ih;
+    b.ki = &k;
+    b.ps = &ps;
+
+    // out of order and duplicate keys
+    ih.rootPageNum = 0;
+    R2IntSource down(100, (uint32_t)-1, 10);
+    err.clear();
+    ok = b.bulkLoad(&down, 1.0, &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+    ASSERT_TRUE(ih.rootPageNum == 0);
+
+    R2IntSource dup(100, 0, 10);
+    err.clear();
+    ok = b.bulkLoad(&dup, 1.0, &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_DUPLICATE_INSERT);
+
+    R2IntSource src(0, 1, 10);
+    err.clear();
+    ok = b.bulkLoad(&src, 0.0, &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+struct TC_R2BTree29 : public TestCase {
+    TC_R2BTree29() : TestCase("TC_R2BTree29") {;};
+    void run();
+};
+
+void
+TC_R2BTree29::run()
+{
+    R2BTreeParams params;
+    params.keySize = 4;
+    params.valSize = 4;
+    params.pageSize = 84;
+
+    R2IntKey k;
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, &params);
+
+    MemPageStore ps(params.pageSize);
+
+    R2BTree b;
+    b.header = &ih;
+    b.ki = &k;
+    b.ps = &ps;
+
+    ErrorInfo err;
+    bool ok;
+    size_t count;
+    uint32_t key, val, i;
+    const uint32_t n = 3000;
+
+    err.clear();
+    ok = b.initTree(&err);
+    ASSERT_TRUE(ok == true);
+
+    // empty tree
+    {
+	R2Cursor c(&b);
+	ASSERT_TRUE(c.seekFirst(&err) == false);
+	ASSERT_TRUE(c.seekLast(&err) == false);
+	key = 5;
+	ASSERT_TRUE(c.seek(reinterpret_cast<uint8_t *>(&key), &err) == false);
+	ASSERT_TRUE(c.isValid() == false);
+	ASSERT_TRUE(c.next(&err) == false);
+	ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+    }
+
+    // even keys, inserted out of order so leaves split all over
+    for (i = 0; i < n; i++) {
+	key = 2 * ((i * 7919) % n);
+	val = key + 1;
+	ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+		      reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+    }
+    for (i = 0; i < n; i += 3) {
+	key = 2 * i;
+	ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+	ASSERT_TRUE(ok == true);
+    }
+    ok = r2_check_tree(&b, &count);
+    ASSERT_TRUE(ok == true);
+
+    std::vector<uint32_t> expect;
+    for (i = 0; i < n; i++) {
+	if (i % 3 != 0)
+	    expect.push_back(2 * i);
+    }
+    ASSERT_TRUE(count == expect.size());
+
+    R2Cursor c(&b);
+
+    // forward
+    ok = c.seekFirst(&err);
+    ASSERT_TRUE(ok == true);
+    for (i = 0; i < expect.size(); i++) {
+	ASSERT_TRUE(c.isValid() == true);
+	ASSERT_TRUE(c.getKey(reinterpret_cast<uint8_t *>(&key)) == true);
+	ASSERT_TRUE(c.getVal(reinterpret_cast<uint8_t *>(&val)) == true);
+	ASSERT_TRUE(key == expect[i]);
+	ASSERT_TRUE(val == key + 1);
+	ok = c.next(&err);
+	ASSERT_TRUE(ok == (i + 1 < expect.size()));
+    }
+    ASSERT_TRUE(c.isValid() == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_KEY_NOT_FOUND);
+
+    // backward
+    ok = c.seekLast(&err);
+    ASSERT_TRUE(ok == true);
+    for (i = expect.size(); i > 0; i--) {
+	ASSERT_TRUE(c.getKey(reinterpret_cast<uint8_t *>(&key)) == true);
+	ASSERT_TRUE(key == expect[i - 1]);
+	ok = c.prev(&err);
+	ASSERT_TRUE(ok == (i > 1));
+    }
+    ASSERT_TRUE(c.getKey(reinterpret_cast<uint8_t *>(&key)) == false);
+
+    // seek to present, missing and out of range keys
+    for (i = 0; i < 2 * n + 2; i++) {
+	key = i;
+	ok = c.seek(reinterpret_cast<uint8_t *>(&key), &err);
+	std::vector<uint32_t>::iterator it;
+	it = std::lower_bound(expect.begin(), expect.end(), i);
+	if (it == expect.end()) {
+	    ASSERT_TRUE(ok == false);
+	    continue;
+	}
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(c.getKey(reinterpret_cast<uint8_t *>(&key)) == true);
+	ASSERT_TRUE(key == *it);
+	if (it != expect.begin()) {
+	    ok = c.prev(&err);
+	    ASSERT_TRUE(ok == true);
+	    ASSERT_TRUE(c.getKey(reinterpret_cast<uint8_t *>(&key)) == true);
+	    ASSERT_TRUE(key == *(it - 1));
+	}
+    }
+
+    // batched fetch from the middle, across many leaves
+    uint32_t keys[37], vals[37];
+    size_t pos = expect.size() / 3;
+    key = expect[pos] - 1;
+    ok = c.seek(reinterpret_cast<uint8_t *>(&key), &err);
+    ASSERT_TRUE(ok == true);
+    while (pos < expect.size()) {
+	uint32_t got = c.fetch(37, reinterpret_cast<uint8_t *>(keys),
+			       reinterpret_cast<uint8_t *>(vals), &err);
+	ASSERT_TRUE(got > 0);
+	ASSERT_TRUE(got == 37 || pos + got == expect.size());
+	for (i = 0; i < got; i++) {
+	    ASSERT_TRUE(keys[i] == expect[pos + i]);
+	    ASSERT_TRUE(vals[i] == keys[i] + 1);
+	}
+	pos += got;
+    }
+    ASSERT_TRUE(c.isValid() == false);
+    ASSERT_TRUE(c.fetch(37, reinterpret_cast<uint8_t *>(keys), NULL, &err) == 0);
+
+    c.close();
+    ASSERT_TRUE(c.isValid() == false);
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+struct TC_KeySearch01 : public TestCase {
+    TC_KeySearch01() : TestCase("TC_KeySearch01") {;};
+    void run();
+};
+
+void
+TC_KeySearch01::run()
+{
+    const uint32_t max_n = 40;
+    uint8_t keys[max_n * 16];
+    uint8_t key[16];
+    uint32_t n, i, j, idx;
+    bool found;
+
+    // keys that differ only in the low word, only in the high word,
+    // and in bytes with the top bit set
+    for (n = 0; n <= max_n; n++) {
+	for (i = 0; i < n; i++) {
+	    memset(keys + i * 16, 0xa5, 16);
+	    keys[i * 16 + 7] = (uint8_t)(2 * (i / 4));
+	    keys[i * 16 + 15] = (uint8_t)(0x80 + 2 * (i % 4));
+	}
+
+	for (i = 0; i < n; i++) {
+	    memcpy(key, keys + i * 16, 16);
+	    found = KeySearch::findUUIDPosition(keys, n, key, &idx);
+	    ASSERT_TRUE(found == true);
+	    ASSERT_TRUE(idx == i);
+
+	    // just above key i
+	    key[15]++;
+	    found = KeySearch::findUUIDPosition(keys, n, key, &idx);
+	    ASSERT_TRUE(found == false);
+	    ASSERT_TRUE(idx == i + 1);
+	}
+
+	// below and above everything
+	memset(key, 0, 16);
+	found = KeySearch::findUUIDPosition(keys, n, key, &idx);
+	ASSERT_TRUE(found == false);
+	ASSERT_TRUE(idx == 0);
+	memset(key, 0xff, 16);
+	found = KeySearch::findUUIDPosition(keys, n, key, &idx);
+	ASSERT_TRUE(found == false);
+	ASSERT_TRUE(idx == n);
+    }
+
+    // must agree with the compare based search in a tree page
+    R2BTreeParams params;
+    params.keySize = 16;
+    params.valSize = 8;
+    params.pageSize = 4096;
+
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, &params);
+
+    std::vector<uint8_t> buf(params.pageSize);
+    R2UUIDKey uk;
+    R2BTree b;
+    b.header = &ih;
+    b.ki = &uk;
+    b.initLeafPage(&buf[0]);
+
+    R2PageAccess ac;
+    b.initPageAccess(&ac, &buf[0]);
+
+    uint64_t val = 0;
+    for (i = 0; i < ih.maxNumKeys[PageTypeLeaf]; i++) {
+	for (j = 0; j < 16; j++)
+	    key[j] = (uint8_t)((i * 37 + j * 101) >> (j % 3));
+	uint32_t pos;
+	if (b.findKeyPosition(&ac, key, &pos))
+	    continue;
+	b.insertAt(&ac, pos, key, reinterpret_cast<uint8_t *>(&val));
+    }
+    ASSERT_TRUE(ac.header->numKeys > 100);
+
+    for (i = 1; i < ac.header->numKeys; i++)
+	ASSERT_TRUE(memcmp(ac.keys + (i - 1) * 16, ac.keys + i * 16, 16) < 0);
+
+    for (i = 0; i < ac.header->numKeys; i++) {
+	found = b.findKeyPosition(&ac, ac.keys + i * 16, &idx);
+	ASSERT_TRUE(found == true);
+	ASSERT_TRUE(idx == i);
+    }
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+// multiplying by the golden ratio spreads i evenly over the key space
+static void
+tc_keysearch02_key(uint32_t i, uint8_t *key)
+{
+    uint64_t x = (i + 1) * 0x9e3779b97f4a7c15ULL;
+    for (int j = 0; j < 8; j++) {
+	key[j] = (uint8_t)(x >> (56 - 8 * j));
+	key[8 + j] = (uint8_t)((uint64_t)i >> (56 - 8 * j));
+    }
+}
+
+struct TC_KeySearch02 : public TestCase {
+    TC_KeySearch02() : TestCase("TC_KeySearch02") {;};
+    void run();
+};
+
+void
+TC_KeySearch02::run()
+{
+    const uint32_t max_n = 300;
+    std::vector<uint8_t> keys(max_n * 16);
+    uint8_t key[16];
+    uint32_t n, i, j, idx, want, probes;
+    bool found, fell_back;
+    uint64_t total_probes = 0, n_searches = 0, n_fallbacks = 0;
+
+    // evenly spread keys, then keys crowded into a corner of the key
+    // space with a few far away ones, which defeats the guess
+    for (int skewed = 0; skewed < 2; skewed++) {
+	for (n = 0; n <= max_n; n += (n < 20 ? 1 : 17)) {
+	    uint64_t hi = 0;
+	    for (i = 0; i < n; i++) {
+		if (skewed && i % 16 != 15)
+		    hi += 1 + i % 3;
+		else
+		    hi += 1 + (0xffffffffffffffffULL / (max_n + 1)) / 2
+			+ (uint64_t)(i * 2654435761U) % 1000;
+		for (j = 0; j < 8; j++) {
+		    keys[i * 16 + j] = (uint8_t)(hi >> (56 - 8 * j));
+		    keys[i * 16 + 8 + j] = (uint8_t)(0x80 + i);
+		}
+	    }
+
+	    for (i = 0; i < n; i++) {
+		for (int d = -1; d <= 1; d++) {
+		    memcpy(key, &keys[i * 16], 16);
+		    key[15] = (uint8_t)(key[15] + d);
+		    bool want_found =
+			KeySearch::findUUIDPosition(&keys[0], n, key, &want);
+		    found = KeySearch::interpolateUUIDPosition(&keys[0], n, key,
+							       &idx, &probes,
+							       &fell_back);
+		    ASSERT_TRUE(found == want_found);
+		    ASSERT_TRUE(found == (d == 0));
+		    ASSERT_TRUE(idx == want);
+		    if (n > 100) {
+			n_searches++;
+			total_probes += probes;
+			n_fallbacks += fell_back ? 1 : 0;
+		    }
+		}
+	    }
+
+	    // below and above everything
+	    memset(key, 0, 16);
+	    found = KeySearch::interpolateUUIDPosition(&keys[0], n, key, &idx,
+						       &probes, &fell_back);
+	    ASSERT_TRUE(found == false);
+	    ASSERT_TRUE(idx == 0);
+	    memset(key, 0xff, 16);
+	    found = KeySearch::interpolateUUIDPosition(&keys[0], n, key, &idx,
+						       &probes, &fell_back);
+	    ASSERT_TRUE(found == false);
+	    ASSERT_TRUE(idx == n);
+	}
+
+	if ( ! skewed) {
+	    // a guess close enough for a short scan
+	    ASSERT_TRUE(total_probes < 4 * n_searches);
+	    ASSERT_TRUE(n_fallbacks == 0);
+	}
+	else {
+	    ASSERT_TRUE(n_fallbacks > 0);
+	}
+	total_probes = n_searches = n_fallbacks = 0;
+    }
+
+    // a tree searched by interpolation counts its probes
+    R2BTreeParams params;
+    params.keySize = 16;
+    params.valSize = 8;
+    params.pageSize = 4096;
+
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, &params);
+
+    R2UUIDKey uk;
+    MemPageStore ms(params.pageSize);
+    R2BTree b;
+    b.header = &ih;
+    b.ki = &uk;
+    b.ps = &ms;
+    b.interpolationSearch = true;
+
+    ErrorInfo err;
+    bool ok = b.initTree(&err);
+    ASSERT_TRUE(ok == true);
+
+    const uint32_t n_keys = 20000;
+    uint64_t val;
+    for (i = 0; i < n_keys; i++) {
+	tc_keysearch02_key(i, key);
+	val = i;
+	ok = b.insert(key, reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+    }
+
+    b.resetSearchStats();
+    ASSERT_TRUE(b.getNumSearches() == 0);
+    for (i = 0; i < n_keys; i++) {
+	tc_keysearch02_key(i, key);
+	ok = b.find(key, reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(val == i);
+    }
+    // one search per level
+    ASSERT_TRUE(b.getNumSearches() >= 2 * n_keys);
+    ASSERT_TRUE(b.getNumProbes() < 5 * b.getNumSearches());
+
+    // stats are only kept for interpolation
+    b.interpolationSearch = false;
+    b.resetSearchStats();
+    ok = b.find(key, NULL, &err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(b.getNumSearches() == 0 && b.getNumProbes() == 0);
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+/**
+ * Key policy matching R2IntKey.
+ */
+class R2IntKeyPolicy {
+public:
+    static const uint32_t KEY_SIZE = 4;
+    static const uint32_t VAL_SIZE = 4;
+    static const bool IS_UUID = false;
+
+    static int compare(const uint8_t *a, const uint8_t *b) {
+	uint32_t x, y;
+	memcpy(&x, a, sizeof(x));
+	memcpy(&y, b, sizeof(y));
+	if (x < y)
+	    return -1;
+	else if (x > y)
+	    return 1;
+	return 0;
+    };
+};
+
+struct TC_R2BTree30 : public TestCase {
+    TC_R2BTree30() : TestCase("TC_R2BTree30") {;};
+    void run();
+};
+
+void
+TC_R2BTree30::run()
+{
+    typedef R2BTreeT<R2IntKeyPolicy, 84> IntTree;
+
+    R2IndexHeader ih;
+    IntTree::initIndexHeader(&ih);
+    ASSERT_TRUE(ih.maxNumKeys[PageTypeLeaf] == IntTree::MAX_LEAF_KEYS);
+    ASSERT_TRUE(ih.maxNumKeys[PageTypeNonLeaf] == IntTree::MAX_NON_LEAF_KEYS);
+    ASSERT_TRUE(IntTree::MAX_LEAF_KEYS == 6);
+
+    MemPageStore ps(84);
+    IntTree t;
+    ErrorInfo err;
+    bool ok;
+    size_t count;
+    uint32_t key, val, i;
+    const uint32_t n = 3000;
+
+    // header for another layout
+    R2IndexHeader bad;
+    R2BTreeT<R2IntKeyPolicy, 128>::initIndexHeader(&bad);
+    err.clear();
+    ok = t.open(&bad, &ps, &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+
+    err.clear();
+    ok = t.open(&ih, &ps, &err);
+    ASSERT_TRUE(ok == true);
+    ok = t.initTree(&err);
+    ASSERT_TRUE(ok == true);
+
+    for (i = 0; i < n; i++) {
+	key = 2 * ((i * 7919) % n) + 1;
+	val = key + 1;
+	err.clear();
+	ok = t.insert(reinterpret_cast<uint8_t *>(&key),
+		      reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+    }
+
+    key = 7;
+    err.clear();
+    ok = t.insert(reinterpret_cast<uint8_t *>(&key),
+		  reinterpret_cast<uint8_t *>(&val), &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_DUPLICATE_INSERT);
+
+    ok = r2_check_tree(t.getTree(), &count);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(count == n);
+
+    // same pages through the runtime tree
+    R2IntKey k;
+    R2BTree b;
+    b.header = &ih;
+    b.ki = &k;
+    b.ps = &ps;
+
+    for (key = 0; key <= 2 * n; key++) {
+	val = 0;
+	err.clear();
+	ok = t.find(reinterpret_cast<uint8_t *>(&key),
+		    reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == ((key & 1) == 1));
+	if (ok) {
+	    ASSERT_TRUE(val == key + 1);
+	    ASSERT_TRUE(b.find(reinterpret_cast<uint8_t *>(&key), NULL, &err));
+	}
+	else {
+	    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_KEY_NOT_FOUND);
+	}
+    }
+
+    for (key = 1; key < 2 * n; key += 4) {
+	err.clear();
+	ok = t.erase(reinterpret_cast<uint8_t *>(&key), &err);
+	ASSERT_TRUE(ok == true);
+    }
+    ok = r2_check_tree(t.getTree(), &count);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(count == n / 2);
+
+    // uuid keys
+    typedef R2BTreeT<R2UUIDKeyPolicy, 512> UUIDTree;
+    R2IndexHeader uh;
+    UUIDTree::initIndexHeader(&uh);
+    MemPageStore ups(512);
+    UUIDTree ut;
+    ok = ut.open(&uh, &ups, &err);
+    ASSERT_TRUE(ok == true);
+    ok = ut.initTree(&err);
+    ASSERT_TRUE(ok == true);
+
+    uint8_t ukey[16];
+    uint64_t uval;
+    for (i = 0; i < n; i++) {
+	uint32_t x = (i * 7919) % n;
+	memset(ukey, 0, sizeof(ukey));
+	memcpy(ukey + 6, &x, sizeof(x));
+	uval = x;
+	ok = ut.insert(ukey, reinterpret_cast<uint8_t *>(&uval), &err);
+	ASSERT_TRUE(ok == true);
+    }
+    for (i = 0; i < n; i++) {
+	memset(ukey, 0, sizeof(ukey));
+	memcpy(ukey + 6, &i, sizeof(i));
+	ok = ut.find(ukey, reinterpret_cast<uint8_t *>(&uval), &err);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(uval == i);
+    }
+
+    R2Cursor c(ut.getTree());
+    ok = c.seekFirst(&err);
+    ASSERT_TRUE(ok == true);
+    count = 0;
+    uint8_t prev[16];
+    memset(prev, 0, sizeof(prev));
+    do {
+	ASSERT_TRUE(c.getKey(ukey) == true);
+	ASSERT_TRUE(count == 0 || memcmp(prev, ukey, 16) < 0);
+	memcpy(prev, ukey, 16);
+	count++;
+    } while (c.next(&err));
+    ASSERT_TRUE(count == n);
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+struct TC_R2BTree31 : public TestCase {
+    TC_R2BTree31() : TestCase("TC_R2BTree31") {;};
+    void run();
+};
+
+void
+TC_R2BTree31::run()
+{
+    R2BTreeParams params;
+    R2IndexHeader ih;
+    bool ok;
+
+    // 16 byte keys on large pages need more than 8 bit counts
+    params.keySize = 16;
+    params.valSize = 8;
+    for (uint32_t psize = 4096; psize <= 65536; psize *= 2) {
+	params.pageSize = psize;
+	ok = R2BTree::initIndexHeader(&ih, &params);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(ih.formatVersion == R2_FORMAT_VERSION);
+	ASSERT_TRUE(ih.rootPageNum == 0);
+	ASSERT_TRUE(ih.maxNumKeys[PageTypeLeaf]
+		    == ((psize - sizeof(R2PageHeader)) / 24 & ~1U));
+    }
+    ASSERT_TRUE(ih.maxNumKeys[PageTypeLeaf] > 255);
+
+    // bad params
+    params.keySize = 0;
+    ok = R2BTree::initIndexHeader(&ih, &params);
+    ASSERT_TRUE(ok == false);
+
+    params.keySize = 16;
+    params.pageSize = sizeof(R2PageHeader) + 10;
+    ok = R2BTree::initIndexHeader(&ih, &params);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(ih.maxNumKeys[PageTypeLeaf] == 0);
+
+    params.keySize = 1;
+    params.valSize = 1;
+    params.pageSize = 1024 * 1024;
+    ok = R2BTree::initIndexHeader(&ih, &params);
+    ASSERT_TRUE(ok == false);
+
+    // a tree with 64K pages and thousands of keys per node
+    params.keySize = 4;
+    params.valSize = 4;
+    params.pageSize = 65536;
+    ok = R2BTree::initIndexHeader(&ih, &params);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(ih.maxNumKeys[PageTypeLeaf] > 8000);
+
+    R2IntKey k;
+    MemPageStore ps(params.pageSize);
+    R2BTree b;
+    b.header = &ih;
+    b.ki = &k;
+    b.ps = &ps;
+
+    ErrorInfo err;
+    size_t count;
+    uint32_t key, val, i;
+    const uint32_t n = 100000;
+
+    // old format is refused
+    ih.formatVersion = 1;
+    err.clear();
+    ok = b.initTree(&err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+    ih.formatVersion = R2_FORMAT_VERSION;
+
+    err.clear();
+    ok = b.initTree(&err);
+    ASSERT_TRUE(ok == true);
+
+    for (i = 0; i < n; i++) {
+	key = (i * 7919) % n;
+	val = key + 1;
+	ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+		      reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+    }
+    ok = r2_check_tree(&b, &count);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(count == n);
+
+    for (key = 0; key < n; key++) {
+	ok = b.find(reinterpret_cast<uint8_t *>(&key),
+		    reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(val == key + 1);
+    }
+
+    for (key = 0; key < n; key += 2) {
+	ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+	ASSERT_TRUE(ok == true);
+    }
+    ok = r2_check_tree(&b, &count);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(count == n / 2);
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+static void *tc_r2btree32_do_insert(void *);
+static void *tc_r2btree32_do_find(void *);
+
+struct TC_R2BTree32 : public TestCase {
+    R2BTree b;
+    R2PageAccess pa;
+    int nBad;
+    int nDone;
+
+    TC_R2BTree32() : TestCase("TC_R2BTree32") {;};
+    void run();
+};
+
+void
+TC_R2BTree32::run()
+{
+    R2IntKey k;
+    const size_t bufsize = 84;
+
+    R2BTreeParams params;
+    params.pageSize = bufsize;
+    params.keySize = 4;
+    params.valSize = 4;
+
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, &params);
+    ih.minNumKeys[PageTypeLeaf] = 0;
+
+    this->b.header = &ih;
+    this->b.ki = &k;
+
+    uint8_t buf[bufsize];
+    this->b.initLeafPage(&buf[0]);
+    this->b.initPageAccess(&this->pa, &buf[0]);
+
+    ErrorInfo err;
+    bool ok;
+    uint32_t key, val;
+
+    key = 10;
+    val = 11;
+    ok = this->b.latchInsert(&this->pa, reinterpret_cast<uint8_t *>(&key),
+			     reinterpret_cast<uint8_t *>(&val), &err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(this->pa.header->version == 2);
+
+    // failed changes leave the version alone
+    err.clear();
+    ok = this->b.latchInsert(&this->pa, reinterpret_cast<uint8_t *>(&key),
+			     reinterpret_cast<uint8_t *>(&val), &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_DUPLICATE_INSERT);
+    ASSERT_TRUE(this->pa.header->version == 2);
+
+    val = 0;
+    ok = this->b.latchFind(&this->pa, reinterpret_cast<uint8_t *>(&key),
+			   reinterpret_cast<uint8_t *>(&val), &err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(val == 11);
+
+    // a reader that saw the old version must start over
+    uint32_t v = R2Latch::readLock(this->pa.header);
+    ASSERT_TRUE(R2Latch::validate(this->pa.header, v) == true);
+    ok = this->b.latchDelete(&this->pa, reinterpret_cast<uint8_t *>(&key),
+			     &err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(R2Latch::validate(this->pa.header, v) == false);
+
+    err.clear();
+    ok = this->b.latchFind(&this->pa, reinterpret_cast<uint8_t *>(&key),
+			   NULL, &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_KEY_NOT_FOUND);
+
+    // key 1 is always there, while key 2 comes and goes
+    key = 1;
+    val = 101;
+    ok = this->b.latchInsert(&this->pa, reinterpret_cast<uint8_t *>(&key),
+			     reinterpret_cast<uint8_t *>(&val), &err);
+    ASSERT_TRUE(ok == true);
+
+    this->nBad = 0;
+    this->nDone = 0;
+
+    pthread_attr_t a;
+    int e;
+
+    e = pthread_attr_init(&a);
+    ASSERT_TRUE(e == 0);
+    e = pthread_attr_setdetachstate(&a, PTHREAD_CREATE_JOINABLE);
+    ASSERT_TRUE(e == 0);
+
+    pthread_t t1, t2;
+    e = pthread_create(&t1, &a, tc_r2btree32_do_find, this);
+    ASSERT_TRUE(e == 0);
+    e = pthread_create(&t2, &a, tc_r2btree32_do_insert, this);
+    ASSERT_TRUE(e == 0);
+
+    void *junk;
+    e = pthread_join(t1, &junk);
+    ASSERT_TRUE(e == 0);
+    e = pthread_join(t2, &junk);
+    ASSERT_TRUE(e == 0);
+
+    ASSERT_TRUE(this->nBad == 0);
+    ASSERT_TRUE((this->pa.header->version & 0x01) == 0);
+
+    this->setStatus(true);
+}
+
+static void *
+tc_r2btree32_do_insert(void *ptr)
+{
+    TC_R2BTree32 *tc = reinterpret_cast<TC_R2BTree32 *>(ptr);
+    ErrorInfo err;
+    uint32_t key = 2;
+    uint32_t val = 102;
+
+    for (int i = 0; i < 20000; i++) {
+	if ( ! tc->b.latchInsert(&tc->pa, reinterpret_cast<uint8_t *>(&key),
+				 reinterpret_cast<uint8_t *>(&val), &err)
+	     || ! tc->b.latchDelete(&tc->pa,
+				    reinterpret_cast<uint8_t *>(&key), &err))
+	    __atomic_add_fetch(&tc->nBad, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&tc->nDone, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+static void *
+tc_r2btree32_do_find(void *ptr)
+{
+    TC_R2BTree32 *tc = reinterpret_cast<TC_R2BTree32 *>(ptr);
+    ErrorInfo err;
+    uint32_t key = 1;
+    uint32_t val;
+
+    while (__atomic_load_n(&tc->nDone, __ATOMIC_ACQUIRE) == 0) {
+	val = 0;
+	if ( ! tc->b.latchFind(&tc->pa, reinterpret_cast<uint8_t *>(&key),
+			       reinterpret_cast<uint8_t *>(&val), &err)
+	     || val != 101)
+	    __atomic_add_fetch(&tc->nBad, 1, __ATOMIC_RELAXED);
+    }
+
+    return NULL;
+}
+
+}
+
+/************/
+
+namespace dback {
+
+static void *tc_r2btree33_do_insert(void *);
+static void *tc_r2btree33_do_find(void *);
+
+struct TC_R2BTree33 : public TestCase {
+    static const int N_WRITERS = 4;
+    static const int N_READERS = 4;
+    static const uint32_t N_KEYS = 40000;
+
+    R2BTree b;
+    int nBad;
+    int nWritersDone;
+    int nextWriter;
+
+    TC_R2BTree33() : TestCase("TC_R2BTree33") {;};
+    void run();
+};
+
+void
+TC_R2BTree33::run()
+{
+    char path[] = "/tmp/dback_utests_olc.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_TRUE(fd >= 0);
+    close(fd);
+
+    R2BTreeParams params;
+    params.keySize = 4;
+    params.valSize = 4;
+    params.pageSize = 128;
+
+    R2IntKey k;
+    ErrorInfo err;
+    bool ok;
+    size_t count;
+    uint32_t key, val;
+
+    MMapPageStore ms(256 * 1024 * 1024);
+    err.clear();
+    ok = ms.create(path, params.pageSize, &err);
+    ASSERT_TRUE(ok == true);
+
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, &params);
+    this->b.header = &ih;
+    this->b.ki = &k;
+    this->b.ps = &ms;
+
+    ok = this->b.initTree(&err);
+    ASSERT_TRUE(ok == true);
+
+    // odd keys are there before the threads start, even keys are
+    // added by the writers while the readers look for the odd ones
+    for (key = 1; key < N_KEYS; key += 2) {
+	val = key * 3;
+	ok = this->b.insert(reinterpret_cast<uint8_t *>(&key),
+			    reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+    }
+
+    this->nBad = 0;
+    this->nWritersDone = 0;
+    this->nextWriter = 0;
+
+    pthread_attr_t a;
+    int e;
+
+    e = pthread_attr_init(&a);
+    ASSERT_TRUE(e == 0);
+    e = pthread_attr_setdetachstate(&a, PTHREAD_CREATE_JOINABLE);
+    ASSERT_TRUE(e == 0);
+
+    pthread_t t[N_WRITERS + N_READERS];
+    for (int i = 0; i < N_READERS; i++) {
+	e = pthread_create(&t[i], &a, tc_r2btree33_do_find, this);
+	ASSERT_TRUE(e == 0);
+    }
+    for (int i = 0; i < N_WRITERS; i++) {
+	e = pthread_create(&t[N_READERS + i], &a, tc_r2btree33_do_insert,
+			   this);
+	ASSERT_TRUE(e == 0);
+    }
+
+    void *junk;
+    for (int i = 0; i < N_WRITERS + N_READERS; i++) {
+	e = pthread_join(t[i], &junk);
+	ASSERT_TRUE(e == 0);
+    }
+
+    ASSERT_TRUE(this->nBad == 0);
+
+    ok = r2_check_tree(&this->b, &count);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(count == N_KEYS);
+
+    for (key = 0; key < N_KEYS; key++) {
+	ok = this->b.findConcurrent(reinterpret_cast<uint8_t *>(&key),
+				    reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(val == key * 3);
+    }
+
+    err.clear();
+    key = N_KEYS;
+    ok = this->b.findConcurrent(reinterpret_cast<uint8_t *>(&key), NULL, &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_KEY_NOT_FOUND);
+
+    // duplicates are refused
+    err.clear();
+    key = 2;
+    ok = this->b.insertConcurrent(reinterpret_cast<uint8_t *>(&key),
+				  reinterpret_cast<uint8_t *>(&val), &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_DUPLICATE_INSERT);
+
+    unlink(path);
+
+    this->setStatus(true);
+}
+
+static void *
+tc_r2btree33_do_insert(void *ptr)
+{
+    TC_R2BTree33 *tc = reinterpret_cast<TC_R2BTree33 *>(ptr);
+    ErrorInfo err;
+    uint32_t key, val;
+    uint32_t w = __atomic_fetch_add(&tc->nextWriter, 1, __ATOMIC_RELAXED);
+
+    // writers take turns along the key space so they meet in the
+    // same leaves
+    for (key = 2 * w; key < TC_R2BTree33::N_KEYS;
+	 key += 2 * TC_R2BTree33::N_WRITERS) {
+	val = key * 3;
+	if ( ! tc->b.insertConcurrent(reinterpret_cast<uint8_t *>(&key),
+				      reinterpret_cast<uint8_t *>(&val), &err))
+	    __atomic_add_fetch(&tc->nBad, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_add_fetch(&tc->nWritersDone, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+static void *
+tc_r2btree33_do_find(void *ptr)
+{
+    TC_R2BTree33 *tc = reinterpret_cast<TC_R2BTree33 *>(ptr);
+    ErrorInfo err;
+    uint32_t key, val;
+
+    key = 1;
+    while (__atomic_load_n(&tc->nWritersDone, __ATOMIC_ACQUIRE)
+	   < TC_R2BTree33::N_WRITERS) {
+	val = 0;
+	if ( ! tc->b.findConcurrent(reinterpret_cast<uint8_t *>(&key),
+				    reinterpret_cast<uint8_t *>(&val), &err)
+	     || val != key * 3)
+	    __atomic_add_fetch(&tc->nBad, 1, __ATOMIC_RELAXED);
+	key += 2 * 7919;
+	key %= TC_R2BTree33::N_KEYS;
+	key |= 1;
+    }
+
+    return NULL;
+}
+
+}
+
+/************/
+
+namespace dback {
+
+struct TC_R2BTree34 : public TestCase {
+    TC_R2BTree34() : TestCase("TC_R2BTree34") {;};
+    void run();
+};
+
+void
+TC_R2BTree34::run()
+{
+    R2BTreeParams params;
+    params.keySize = 4;
+    params.valSize = 4;
+    params.pageSize = 84;
+
+    R2IntKey k;
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, &params);
+    MemPageStore ps(params.pageSize);
+
+    R2BTree b;
+    b.header = &ih;
+    b.ki = &k;
+    b.ps = &ps;
+
+    ErrorInfo err;
+    bool ok;
+    size_t count;
+    uint32_t key, val, max = ih.maxNumKeys[PageTypeLeaf];
+    const uint32_t n = 400;
+
+    ok = b.initTree(&err);
+    ASSERT_TRUE(ok == true);
+    for (uint32_t i = 0; i < n; i++) {
+	key = ((i * 7919) % n) * 4;
+	val = key + 1;
+	ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+		      reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+    }
+    ok = r2_check_tree(&b, &count);
+    ASSERT_TRUE(ok == true);
+
+    // find a level 1 page with room for one more child
+    PagePin parent_pin;
+    R2PageAccess parent;
+    ok = b.pinPage(&parent_pin, &parent, ih.rootPageNum, &err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(parent.header->level >= 2);
+    while (parent.header->level > 1) {
+	ok = b.pinPage(&parent_pin, &parent, b.getChildPageNum(&parent, 0),
+		       &err);
+	ASSERT_TRUE(ok == true);
+    }
+    while (parent.header->numKeys == ih.maxNumKeys[PageTypeNonLeaf]) {
+	ASSERT_TRUE(parent.header->nextPageNum != 0);
+	ok = b.pinPage(&parent_pin, &parent, parent.header->nextPageNum, &err);
+	ASSERT_TRUE(ok == true);
+    }
+
+    // fill its second child
+    uint32_t leaf_pn = b.getChildPageNum(&parent, 1);
+    PagePin leaf_pin;
+    R2PageAccess leaf;
+    ok = b.pinPage(&leaf_pin, &leaf, leaf_pn, &err);
+    ASSERT_TRUE(ok == true);
+    memcpy(&key, leaf.keys, 4);
+    for (key += 2; leaf.header->numKeys < max; key += 4) {
+	val = key + 1;
+	ok = b.insertConcurrent(reinterpret_cast<uint8_t *>(&key),
+				reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+    }
+
+    // split it, but do not tell the parent about the new page yet
+    PagePin right_pin, next_pin;
+    R2PageAccess right, next;
+    uint32_t right_pn, sep;
+    uint8_t *buf = right_pin.alloc(&ps, &right_pn, &err);
+    ASSERT_TRUE(buf != NULL);
+    b.initLeafPage(buf);
+    b.initPageAccess(&right, buf);
+    ok = b.splitNode(&leaf, &right, reinterpret_cast<uint8_t *>(&sep), &err);
+    ASSERT_TRUE(ok == true);
+    right.header->prevPageNum = leaf_pn;
+    leaf.header->nextPageNum = right_pn;
+    ASSERT_TRUE(right.header->nextPageNum != 0);
+    ok = b.pinPage(&next_pin, &next, right.header->nextPageNum, &err);
+    ASSERT_TRUE(ok == true);
+    next.header->prevPageNum = right_pn;
+
+    // the parent still sends the keys of the new page to the old one,
+    // only the concurrent routines follow the link to the right
+    for (uint32_t i = 0; i < right.header->numKeys; i++) {
+	memcpy(&key, right.keys + i * 4, 4);
+	err.clear();
+	ok = b.find(reinterpret_cast<uint8_t *>(&key), NULL, &err);
+	ASSERT_TRUE(ok == false);
+	ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_KEY_NOT_FOUND);
+
+	val = 0;
+	ok = b.findConcurrent(reinterpret_cast<uint8_t *>(&key),
+			      reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(val == key + 1);
+    }
+
+    uint32_t nr = right.header->numKeys;
+    key = sep + 1;
+    val = key + 1;
+    ok = b.insertConcurrent(reinterpret_cast<uint8_t *>(&key),
+			    reinterpret_cast<uint8_t *>(&val), &err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(right.header->numKeys == nr + 1);
+
+    err.clear();
+    ok = b.insertConcurrent(reinterpret_cast<uint8_t *>(&key),
+			    reinterpret_cast<uint8_t *>(&val), &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_DUPLICATE_INSERT);
+
+    // finish the split
+    ok = b.latchInsert(&parent, reinterpret_cast<uint8_t *>(&sep),
+		       reinterpret_cast<uint8_t *>(&right_pn), &err);
+    ASSERT_TRUE(ok == true);
+
+    ok = r2_check_tree(&b, &count);
+    ASSERT_TRUE(ok == true);
+    ok = b.find(reinterpret_cast<uint8_t *>(&key),
+		reinterpret_cast<uint8_t *>(&val), &err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(val == key + 1);
+
+    // splits made by insertConcurrent go all the way up
+    for (key = 1; key < n * 4; key += 4) {
+	val = key + 1;
+	ok = b.insertConcurrent(reinterpret_cast<uint8_t *>(&key),
+				reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+    }
+    ok = r2_check_tree(&b, &count);
+    ASSERT_TRUE(ok == true);
+    for (key = 1; key < n * 4; key += 4) {
+	ok = b.find(reinterpret_cast<uint8_t *>(&key),
+		    reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(val == key + 1);
+    }
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+static void *tc_r2btree35_do_commit(void *);
+
+/**
+ * Keeps the records passed to it by WriteAheadLog::replay.
+ */
+class TC_WALRecords : public WALReplayer {
+public:
+    std::vector<uint64_t> lsns;
+    std::vector<uint32_t> types;
+    std::vector<uint32_t> pageNums;
+    std::vector<uint32_t> vals;
+
+    bool redo(uint64_t lsn, uint32_t type, uint32_t pageNum,
+	      const uint8_t *data, uint32_t len, ErrorInfo * /* err */) {
+	uint32_t v = 0;
+	if (len >= sizeof(v))
+	    memcpy(&v, data, sizeof(v));
+	this->lsns.push_back(lsn);
+	this->types.push_back(type);
+	this->pageNums.push_back(pageNum);
+	this->vals.push_back(v);
+	return true;
+    };
+};
+
+struct TC_R2BTree35 : public TestCase {
+    static const int N_THREADS = 4;
+    static const uint32_t N_COMMITS = 200;
+
+    WriteAheadLog wal;
+    int nBad;
+    int nextThread;
+
+    TC_R2BTree35() : TestCase("TC_R2BTree35") {;};
+    void run();
+};
+
+void
+TC_R2BTree35::run()
+{
+    char path[] = "/tmp/dback_utests_wal.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_TRUE(fd >= 0);
+    close(fd);
+
+    ErrorInfo err;
+    bool ok;
+    uint64_t lsn, lsn2;
+    uint32_t v;
+
+    ok = this->wal.open(path, &err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(this->wal.getAppendLsn() == 0);
+    ASSERT_TRUE(this->wal.getDurableLsn() == 0);
+
+    // append only copies to memory, commit writes
+    WALGroup g;
+    v = 1234;
+    g.add(1, 7, reinterpret_cast<uint8_t *>(&v), sizeof(v));
+    g.add(2, 8, NULL, 0);
+    ASSERT_TRUE(g.getNumRecords() == 2);
+    ok = this->wal.append(&g, &lsn, &err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(lsn == sizeof(WALGroupHeader) + 2 * sizeof(WALRecordHeader)
+		+ sizeof(v));
+    ASSERT_TRUE(this->wal.getDurableLsn() == 0);
+
+    ok = this->wal.commit(lsn, &err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(this->wal.getDurableLsn() == lsn);
+    ASSERT_TRUE(this->wal.getNumSyncs() == 1);
+
+    // already durable, nothing is written
+    ok = this->wal.commit(lsn, &err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(this->wal.getNumSyncs() == 1);
+
+    err.clear();
+    ok = this->wal.commit(lsn + 1, &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+
+    // an empty group is not added
+    g.clear();
+    ok = this->wal.append(&g, &lsn2, &err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(lsn2 == lsn);
+    ASSERT_TRUE(this->wal.getNumGroups() == 1);
+
+    // commits from many threads
+    this->wal.resetStats();
+    this->nBad = 0;
+    this->nextThread = 0;
+
+    pthread_attr_t a;
+    int e;
+
+    e = pthread_attr_init(&a);
+    ASSERT_TRUE(e == 0);
+    e = pthread_attr_setdetachstate(&a, PTHREAD_CREATE_JOINABLE);
+    ASSERT_TRUE(e == 0);
+
+    pthread_t t[N_THREADS];
+    for (int i = 0; i < N_THREADS; i++) {
+	e = pthread_create(&t[i], &a, tc_r2btree35_do_commit, this);
+	ASSERT_TRUE(e == 0);
+    }
+
+    void *junk;
+    for (int i = 0; i < N_THREADS; i++) {
+	e = pthread_join(t[i], &junk);
+	ASSERT_TRUE(e == 0);
+    }
+
+    ASSERT_TRUE(this->nBad == 0);
+    ASSERT_TRUE(this->wal.getNumGroups() == N_THREADS * N_COMMITS);
+    ASSERT_TRUE(this->wal.getNumCommits() == N_THREADS * N_COMMITS);
+    ASSERT_TRUE(this->wal.getNumSyncs() <= this->wal.getNumCommits());
+    ASSERT_TRUE(this->wal.getDurableLsn() == this->wal.getAppendLsn());
+
+    // the flusher writes groups nobody commits
+    ok = this->wal.startFlusher(1, &err);
+    ASSERT_TRUE(ok == true);
+    err.clear();
+    ok = this->wal.startFlusher(1, &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+
+    v = 99;
+    g.add(4, 9, reinterpret_cast<uint8_t *>(&v), sizeof(v));
+    ok = this->wal.append(&g, &lsn, &err);
+    ASSERT_TRUE(ok == true);
+    for (int i = 0; i < 5000 && this->wal.getDurableLsn() < lsn; i++)
+	usleep(1000);
+    ASSERT_TRUE(this->wal.getDurableLsn() == lsn);
+    this->wal.stopFlusher();
+
+    ok = this->wal.close(&err);
+    ASSERT_TRUE(ok == true);
+
+    // everything comes back in order
+    ok = this->wal.open(path, &err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(this->wal.getAppendLsn() == lsn);
+
+    TC_WALRecords r;
+    ok = this->wal.replay(&r, &err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(r.lsns.size() == 2 + N_THREADS * N_COMMITS + 1);
+    ASSERT_TRUE(r.types[0] == 1 && r.pageNums[0] == 7 && r.vals[0] == 1234);
+    ASSERT_TRUE(r.types[1] == 2 && r.pageNums[1] == 8);
+    ASSERT_TRUE(r.types.back() == 4 && r.vals.back() == 99);
+    ASSERT_TRUE(r.lsns.back() == lsn);
+
+    std::vector<uint32_t> next(N_THREADS, 0);
+    for (size_t i = 1; i < r.lsns.size(); i++) {
+	ASSERT_TRUE(r.lsns[i - 1] < r.lsns[i]);
+	if (r.types[i] == 3) {
+	    ASSERT_TRUE(r.pageNums[i] < (uint32_t)N_THREADS);
+	    ASSERT_TRUE(r.vals[i] == next[r.pageNums[i]]);
+	    next[r.pageNums[i]]++;
+	}
+    }
+    for (int i = 0; i < N_THREADS; i++)
+	ASSERT_TRUE(next[i] == N_COMMITS);
+
+    ok = this->wal.close(&err);
+    ASSERT_TRUE(ok == true);
+
+    // a torn group at the end is dropped
+    fd = ::open(path, O_WRONLY | O_APPEND);
+    ASSERT_TRUE(fd >= 0);
+    WALGroupHeader gh;
+    gh.magic = WriteAheadLog::GROUP_MAGIC;
+    gh.length = 100;
+    gh.numRecords = 1;
+    gh.crc = 0;
+    ASSERT_TRUE(write(fd, &gh, sizeof(gh)) == (ssize_t)sizeof(gh));
+    ASSERT_TRUE(write(fd, "torn", 4) == 4);
+    close(fd);
+
+    ok = this->wal.open(path, &err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(this->wal.getAppendLsn() == lsn);
+
+    // a checkpoint empties the log, LSNs carry on
+    ok = this->wal.checkpoint(&err);
+    ASSERT_TRUE(ok == true);
+    TC_WALRecords r2;
+    ok = this->wal.replay(&r2, &err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(r2.lsns.empty());
+
+    ok = this->wal.append(&g, &lsn2, &err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(lsn2 > lsn);
+    ok = this->wal.close(&err);
+    ASSERT_TRUE(ok == true);
+
+    ok = this->wal.open(path, &err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(this->wal.getAppendLsn() == lsn2);
+    ok = this->wal.replay(&r2, &err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(r2.lsns.size() == 1 && r2.lsns[0] == lsn2);
+    ok = this->wal.close(&err);
+    ASSERT_TRUE(ok == true);
+
+    unlink(path);
+
+    this->setStatus(true);
+}
+
+static void *
+tc_r2btree35_do_commit(void *ptr)
+{
+    TC_R2BTree35 *tc = reinterpret_cast<TC_R2BTree35 *>(ptr);
+    ErrorInfo err;
+    WALGroup g;
+    uint64_t lsn;
+    uint32_t w = __atomic_fetch_add(&tc->nextThread, 1, __ATOMIC_RELAXED);
+
+    for (uint32_t i = 0; i < TC_R2BTree35::N_COMMITS; i++) {
+	g.clear();
+	g.add(3, w, reinterpret_cast<uint8_t *>(&i), sizeof(i));
+	if ( ! tc->wal.append(&g, &lsn, &err)
+	     || ! tc->wal.commit(lsn, &err)
+	     || tc->wal.getDurableLsn() < lsn)
+	    __atomic_add_fetch(&tc->nBad, 1, __ATOMIC_RELAXED);
+    }
+
+    return NULL;
+}
+
+}
+
+/************/
+
+namespace dback {
+
+struct TC_R2BTree36 : public TestCase {
+    TC_R2BTree36() : TestCase("TC_R2BTree36") {;};
+    void run();
+};
+
+void
+TC_R2BTree36::run()
+{
+    char path[] = "/tmp/dback_utests_wal.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_TRUE(fd >= 0);
+    close(fd);
+
+    R2BTreeParams params;
+    params.keySize = 4;
+    params.valSize = 4;
+    params.pageSize = 84;
+
+    R2IntKey k;
+    ErrorInfo err;
+    bool ok;
+    size_t count;
+    uint32_t key, val;
+    uint64_t lsn;
+    const uint32_t n = 2000;
+
+    WriteAheadLog wal;
+    ok = wal.open(path, &err);
+    ASSERT_TRUE(ok == true);
+
+    MemPageStore ps(params.pageSize);
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, &params);
+
+    R2BTree b;
+    b.header = &ih;
+    b.ki = &k;
+    b.ps = &ps;
+    b.wal = &wal;
+
+    ok = b.initTree(&err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(wal.getNumGroups() == 1);
+
+    // an insert that only changes a leaf logs the slot, not the page
+    lsn = wal.getAppendLsn();
+    key = 0;
+    val = 0;
+    ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+		  reinterpret_cast<uint8_t *>(&val), &err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(wal.getAppendLsn() - lsn
+		== sizeof(WALGroupHeader) + sizeof(WALRecordHeader) + 12);
+
+    {
+	PagePin pin;
+	uint8_t *buf = pin.pin(&ps, ih.rootPageNum, &err);
+	ASSERT_TRUE(buf != NULL);
+	R2PageHeader *h = reinterpret_cast<R2PageHeader *>(buf);
+	ASSERT_TRUE(h->lsn == wal.getAppendLsn());
+    }
+
+    for (uint32_t i = 1; i < n; i++) {
+	key = (i * 7919) % n;
+	val = key * 3;
+	ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+		      reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+    }
+    for (key = 0; key < n; key += 3) {
+	ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+	ASSERT_TRUE(ok == true);
+    }
+    ok = r2_check_tree(&b, &count);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(count == n - (n + 2) / 3);
+
+    // failed calls are logged too, nothing is left pending
+    err.clear();
+    key = 1;
+    ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+		  reinterpret_cast<uint8_t *>(&val), &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_DUPLICATE_INSERT);
+
+    // not logged, so refused
+    err.clear();
+    key = n + 1;
+    ok = b.insertConcurrent(reinterpret_cast<uint8_t *>(&key),
+			    reinterpret_cast<uint8_t *>(&val), &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+
+    uint32_t root = ih.rootPageNum;
+    ok = wal.commit(wal.getAppendLsn(), &err);
+    ASSERT_TRUE(ok == true);
+    ok = wal.close(&err);
+    ASSERT_TRUE(ok == true);
+
+    // build the tree again from nothing but the log
+    WriteAheadLog wal2;
+    ok = wal2.open(path, &err);
+    ASSERT_TRUE(ok == true);
+
+    MemPageStore ps2(params.pageSize);
+    R2IndexHeader ih2;
+    R2BTree::initIndexHeader(&ih2, &params);
+
+    R2BTree b2;
+    b2.header = &ih2;
+    b2.ki = &k;
+    b2.ps = &ps2;
+    b2.wal = &wal2;
+
+    // replaying twice changes nothing the second time
+    for (int pass = 0; pass < 2; pass++) {
+	ok = b2.recover(&err);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(ih2.rootPageNum == root);
+
+	ok = r2_check_tree(&b2, &count);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == n - (n + 2) / 3);
+
+	for (key = 0; key < n; key++) {
+	    err.clear();
+	    ok = b2.find(reinterpret_cast<uint8_t *>(&key),
+			 reinterpret_cast<uint8_t *>(&val), &err);
+	    if (key % 3 == 0) {
+		ASSERT_TRUE(ok == false);
+		ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_KEY_NOT_FOUND);
+	    }
+	    else {
+		ASSERT_TRUE(ok == true);
+		ASSERT_TRUE(val == key * 3);
+	    }
+	}
+    }
+
+    ok = wal2.close(&err);
+    ASSERT_TRUE(ok == true);
+
+    unlink(path);
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+struct TC_R2BTree37 : public TestCase {
+    static const uint32_t N_KEYS = 3000;
+
+    TC_R2BTree37() : TestCase("TC_R2BTree37") {;};
+    void run();
+
+    /// Fill the index and exit without flushing the pool.
+    static void crash(const char *dataPath, const char *logPath,
+		      R2BTreeParams *params);
+};
+
+void
+TC_R2BTree37::run()
+{
+    char data_path[] = "/tmp/dback_utests_wal_data.XXXXXX";
+    char log_path[] = "/tmp/dback_utests_wal_log.XXXXXX";
+    int fd = mkstemp(data_path);
+    ASSERT_TRUE(fd >= 0);
+    close(fd);
+    fd = mkstemp(log_path);
+    ASSERT_TRUE(fd >= 0);
+    close(fd);
+
+    R2BTreeParams params;
+    params.keySize = 4;
+    params.valSize = 4;
+    params.pageSize = 84;
+
+    pid_t pid = fork();
+    ASSERT_TRUE(pid >= 0);
+    if (pid == 0)
+	crash(data_path, log_path, &params);
+
+    int status;
+    ASSERT_TRUE(waitpid(pid, &status, 0) == pid);
+    ASSERT_TRUE(WIFEXITED(status));
+    ASSERT_TRUE(WEXITSTATUS(status) == 0);
+
+    R2IntKey k;
+    ErrorInfo err;
+    bool ok;
+    size_t count;
+    uint32_t key, val;
+
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, &params);
+
+    {
+	BufferPool pool(params.pageSize, 1024 * 1024);
+	ok = pool.open(data_path, &err);
+	ASSERT_TRUE(ok == true);
+	WriteAheadLog wal;
+	ok = wal.open(log_path, &err);
+	ASSERT_TRUE(ok == true);
+	pool.setLog(&wal, offsetof(R2PageHeader, lsn));
+
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &pool;
+	b.wal = &wal;
+
+	ok = b.recover(&err);
+	ASSERT_TRUE(ok == true);
+
+	ok = r2_check_tree(&b, &count);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == N_KEYS - (N_KEYS + 4) / 5);
+
+	// everything is in the file after a flush and a checkpoint
+	ok = pool.flush(&err);
+	ASSERT_TRUE(ok == true);
+	ok = wal.checkpoint(&err);
+	ASSERT_TRUE(ok == true);
+	ok = pool.close(&err);
+	ASSERT_TRUE(ok == true);
+    }
+
+    BufferPool pool(params.pageSize, 1024 * 1024);
+    ok = pool.open(data_path, &err);
+    ASSERT_TRUE(ok == true);
+
+    R2BTree b;
+    b.header = &ih;
+    b.ki = &k;
+    b.ps = &pool;
+
+    ok = r2_check_tree(&b, &count);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(count == N_KEYS - (N_KEYS + 4) / 5);
+    for (key = 0; key < N_KEYS; key++) {
+	err.clear();
+	ok = b.find(reinterpret_cast<uint8_t *>(&key),
+		    reinterpret_cast<uint8_t *>(&val), &err);
+	if (key % 5 == 0) {
+	    ASSERT_TRUE(ok == false);
+	}
+	else {
+	    ASSERT_TRUE(ok == true);
+	    ASSERT_TRUE(val == key + 7);
+	}
+    }
+
+    unlink(data_path);
+    unlink(log_path);
+
+    this->setStatus(true);
+}
+
+void
+TC_R2BTree37::crash(const char *dataPath, const char *logPath,
+		    R2BTreeParams *params)
+{
+    R2IntKey k;
+    ErrorInfo err;
+    uint32_t key, val;
+
+    // a small pool so pages are evicted while the tree grows
+    BufferPool *pool = new BufferPool(params->pageSize,
+				      64 * params->pageSize);
+    WriteAheadLog *wal = new WriteAheadLog();
+    if ( ! pool->open(dataPath, &err) || ! wal->open(logPath, &err))
+	_exit(1);
+    pool->setLog(wal, offsetof(R2PageHeader, lsn));
+
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, params);
+    R2BTree b;
+    b.header = &ih;
+    b.ki = &k;
+    b.ps = pool;
+    b.wal = wal;
+
+    if ( ! b.initTree(&err))
+	_exit(1);
+
+    for (uint32_t i = 0; i < N_KEYS; i++) {
+	key = (i * 7919) % N_KEYS;
+	val = key + 7;
+	if ( ! b.insert(reinterpret_cast<uint8_t *>(&key),
+			reinterpret_cast<uint8_t *>(&val), &err))
+	    _exit(1);
+	if (i % 50 == 0 && ! wal->commit(wal->getAppendLsn(), &err))
+	    _exit(1);
+    }
+    for (key = 0; key < N_KEYS; key += 5) {
+	if ( ! b.erase(reinterpret_cast<uint8_t *>(&key), &err))
+	    _exit(1);
+    }
+    if ( ! wal->commit(wal->getAppendLsn(), &err))
+	_exit(1);
+    if (pool->getNumEvictions() == 0)
+	_exit(2);
+
+    // dirty pages are lost, no destructors run
+    _exit(0);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+struct TC_R2BTree38 : public TestCase {
+    TC_R2BTree38() : TestCase("TC_R2BTree38") {;};
+    void run();
+};
+
+void
+TC_R2BTree38::run()
+{
+    static const uint32_t N = 2000;
+
+    R2BTreeParams params;
+    params.keySize = 4;
+    params.valSize = 4;
+    params.pageSize = 96;
+
+    R2IntKey k;
+    ErrorInfo err;
+    bool ok;
+    size_t count;
+    uint32_t key, val, i;
+
+    MemPageStore ms(params.pageSize);
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, &params);
+    R2BTree b;
+    b.header = &ih;
+    b.ki = &k;
+    b.ps = &ms;
+
+    // snapshots need copy-on-write mode
+    R2Snapshot snap1, snap2;
+    err.clear();
+    ok = b.takeSnapshot(&snap1, &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+
+    b.copyOnWrite = true;
+    ok = b.initTree(&err);
+    ASSERT_TRUE(ok == true);
+
+    for (i = 0; i < N; i++) {
+	key = (i * 7919) % N;
+	val = key * 3;
+	ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+		      reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+    }
+
+    // nothing is copied without a snapshot
+    ASSERT_TRUE(b.getNumCopies() == 0);
+    ok = r2_check_cow(&b, ih.rootPageNum, &count);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(count == N);
+    ASSERT_TRUE(ms.numPages() == r2_count_pages(&b, ih.rootPageNum));
+
+    // the sibling links are not used, cursors go through the parents
+    {
+	R2Cursor c(&b);
+	ok = c.seekFirst(&err);
+	for (i = 0; ok; i++) {
+	    ok = c.getKey(reinterpret_cast<uint8_t *>(&key));
+	    ASSERT_TRUE(ok == true && key == i);
+	    ok = c.next(&err);
+	}
+	ASSERT_TRUE(i == N);
+
+	ok = c.seekLast(&err);
+	for (i = N; ok; i--) {
+	    ok = c.getKey(reinterpret_cast<uint8_t *>(&key));
+	    ASSERT_TRUE(ok == true && key == i - 1);
+	    ok = c.prev(&err);
+	}
+	ASSERT_TRUE(i == 0);
+    }
+
+    err.clear();
+    key = 1;
+    ok = b.findConcurrent(reinterpret_cast<uint8_t *>(&key), NULL, &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+
+    ok = b.takeSnapshot(&snap1, &err);
+    ASSERT_TRUE(ok == true);
+    uint32_t root1 = ih.rootPageNum;
+    ASSERT_TRUE(snap1.rootPageNum == root1);
+
+    // change the tree everywhere while snap1 is held
+    for (key = N; key < 2 * N; key++) {
+	val = key * 3;
+	ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+		      reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+    }
+    for (key = 0; key < N; key += 2) {
+	ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+	ASSERT_TRUE(ok == true);
+    }
+
+    ASSERT_TRUE(b.getNumCopies() > 0);
+    ASSERT_TRUE(ih.rootPageNum != root1);
+    ok = r2_check_cow(&b, ih.rootPageNum, &count);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(count == N + N / 2);
+
+    // snap1 still sees the tree as it was
+    ok = r2_check_cow(&b, snap1.rootPageNum, &count);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(count == N);
+    for (key = 0; key < N; key++) {
+	val = 0;
+	ok = b.findSnapshot(&snap1, reinterpret_cast<uint8_t *>(&key),
+			    reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(val == key * 3);
+    }
+    err.clear();
+    key = N;
+    ok = b.findSnapshot(&snap1, reinterpret_cast<uint8_t *>(&key), NULL, &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_KEY_NOT_FOUND);
+    key = 0;
+    ok = b.find(reinterpret_cast<uint8_t *>(&key), NULL, &err);
+    ASSERT_TRUE(ok == false);
+
+    {
+	R2Cursor c(&b, &snap1);
+	key = N / 2;
+	ok = c.seek(reinterpret_cast<uint8_t *>(&key), &err);
+	for (i = N / 2; ok; i++) {
+	    ok = c.getKey(reinterpret_cast<uint8_t *>(&key));
+	    ASSERT_TRUE(ok == true && key == i);
+	    ok = c.next(&err);
+	}
+	ASSERT_TRUE(i == N);
+	c.close();
+    }
+
+    // snap2 sees the second state while the rest is erased
+    ok = b.takeSnapshot(&snap2, &err);
+    ASSERT_TRUE(ok == true);
+    for (key = 1; key < 2 * N; key += 2) {
+	ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+	ASSERT_TRUE(ok == true);
+    }
+
+    // releasing snap1 frees only what snap2 cannot reach
+    b.releaseSnapshot(&snap1);
+    ASSERT_TRUE(snap1.rootPageNum == 0);
+    for (key = N; key < 2 * N; key += 2) {
+	ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+	ASSERT_TRUE(ok == true);
+    }
+    for (key = 0; key < 100; key++) {
+	val = key;
+	ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+		      reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+    }
+
+    ok = r2_check_cow(&b, snap2.rootPageNum, &count);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(count == N + N / 2);
+    {
+	R2Cursor c(&b, &snap2);
+	ok = c.seekFirst(&err);
+	for (i = 0; ok; i++) {
+	    ok = c.getVal(reinterpret_cast<uint8_t *>(&val));
+	    ASSERT_TRUE(ok == true);
+	    ok = c.getKey(reinterpret_cast<uint8_t *>(&key));
+	    ASSERT_TRUE(ok == true);
+	    ASSERT_TRUE(key == (i < N / 2 ? 2 * i + 1 : i + N / 2));
+	    ASSERT_TRUE(val == key * 3);
+	    ok = c.next(&err);
+	}
+	ASSERT_TRUE(i == N + N / 2);
+    }
+
+    // with no snapshot left every copied page is returned
+    b.releaseSnapshot(&snap2);
+    ok = r2_check_cow(&b, ih.rootPageNum, &count);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(count == 100);
+    ASSERT_TRUE(ms.numPages() == r2_count_pages(&b, ih.rootPageNum));
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+static void *tc_r2btree39_do_write(void *);
+static void *tc_r2btree39_do_scan(void *);
+
+struct TC_R2BTree39 : public TestCase {
+    static const int N_READERS = 3;
+    static const uint32_t N_KEYS = 20000;
+
+    R2BTree b;
+    int nBad;
+    int nScans;
+    int writerDone;
+
+    TC_R2BTree39() : TestCase("TC_R2BTree39") {;};
+    void run();
+
+    /// Step at which the writer inserts key, 7919 * 17679 = 1 mod N_KEYS.
+    static uint32_t position(uint32_t key) {
+	return (key * 17679) % N_KEYS;
+    };
+};
+
+void
+TC_R2BTree39::run()
+{
+    char path[] = "/tmp/dback_utests_cow.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_TRUE(fd >= 0);
+    close(fd);
+
+    R2BTreeParams params;
+    params.keySize = 4;
+    params.valSize = 4;
+    params.pageSize = 128;
+
+    R2IntKey k;
+    ErrorInfo err;
+    bool ok;
+    size_t count;
+
+    MMapPageStore ms(256 * 1024 * 1024);
+    err.clear();
+    ok = ms.create(path, params.pageSize, &err);
+    ASSERT_TRUE(ok == true);
+
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, &params);
+    this->b.header = &ih;
+    this->b.ki = &k;
+    this->b.ps = &ms;
+    this->b.copyOnWrite = true;
+
+    ok = this->b.initTree(&err);
+    ASSERT_TRUE(ok == true);
+
+    this->nBad = 0;
+    this->nScans = 0;
+    this->writerDone = 0;
+
+    pthread_attr_t a;
+    int e;
+
+    e = pthread_attr_init(&a);
+    ASSERT_TRUE(e == 0);
+    e = pthread_attr_setdetachstate(&a, PTHREAD_CREATE_JOINABLE);
+    ASSERT_TRUE(e == 0);
+
+    pthread_t t[N_READERS + 1];
+    for (int i = 0; i < N_READERS; i++) {
+	e = pthread_create(&t[i], &a, tc_r2btree39_do_scan, this);
+	ASSERT_TRUE(e == 0);
+    }
+    e = pthread_create(&t[N_READERS], &a, tc_r2btree39_do_write, this);
+    ASSERT_TRUE(e == 0);
+
+    void *junk;
+    for (int i = 0; i < N_READERS + 1; i++) {
+	e = pthread_join(t[i], &junk);
+	ASSERT_TRUE(e == 0);
+    }
+
+    ASSERT_TRUE(this->nBad == 0);
+    ASSERT_TRUE(this->nScans > 0);
+
+    // the writer erased the first half again
+    ok = r2_check_cow(&this->b, ih.rootPageNum, &count);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(count == N_KEYS / 2);
+    ASSERT_TRUE(ms.numPages() == r2_count_pages(&this->b, ih.rootPageNum));
+
+    unlink(path);
+
+    this->setStatus(true);
+}
+
+static void *
+tc_r2btree39_do_write(void *ptr)
+{
+    TC_R2BTree39 *tc = reinterpret_cast<TC_R2BTree39 *>(ptr);
+    ErrorInfo err;
+    uint32_t i, key, val;
+
+    // key k goes in at step position(k), and the first half is taken
+    // out again in the same order
+    for (i = 0; i < TC_R2BTree39::N_KEYS; i++) {
+	key = (i * 7919) % TC_R2BTree39::N_KEYS;
+	val = key * 3;
+	if ( ! tc->b.insert(reinterpret_cast<uint8_t *>(&key),
+			    reinterpret_cast<uint8_t *>(&val), &err))
+	    __atomic_add_fetch(&tc->nBad, 1, __ATOMIC_RELAXED);
+    }
+    for (i = 0; i < TC_R2BTree39::N_KEYS / 2; i++) {
+	key = (i * 7919) % TC_R2BTree39::N_KEYS;
+	if ( ! tc->b.erase(reinterpret_cast<uint8_t *>(&key), &err))
+	    __atomic_add_fetch(&tc->nBad, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&tc->writerDone, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+static void *
+tc_r2btree39_do_scan(void *ptr)
+{
+    TC_R2BTree39 *tc = reinterpret_cast<TC_R2BTree39 *>(ptr);
+    ErrorInfo err;
+    uint32_t key, val, prev_key, lo, hi, count;
+    bool ok;
+
+    while ( ! __atomic_load_n(&tc->writerDone, __ATOMIC_ACQUIRE)) {
+	R2Snapshot snap;
+	if ( ! tc->b.takeSnapshot(&snap, &err)) {
+	    __atomic_add_fetch(&tc->nBad, 1, __ATOMIC_RELAXED);
+	    break;
+	}
+
+	// a consistent view holds the keys of one run of writer steps
+	R2Cursor c(&tc->b, &snap);
+	lo = TC_R2BTree39::N_KEYS;
+	hi = 0;
+	count = 0;
+	prev_key = 0;
+	for (ok = c.seekFirst(&err); ok; ok = c.next(&err)) {
+	    c.getKey(reinterpret_cast<uint8_t *>(&key));
+	    c.getVal(reinterpret_cast<uint8_t *>(&val));
+	    uint32_t pos = TC_R2BTree39::position(key);
+	    if ((count > 0 && key <= prev_key) || val != key * 3)
+		__atomic_add_fetch(&tc->nBad, 1, __ATOMIC_RELAXED);
+	    lo = pos < lo ? pos : lo;
+	    hi = pos > hi ? pos : hi;
+	    prev_key = key;
+	    count++;
+	}
+	c.close();
+	if (count > 0 && hi - lo + 1 != count)
+	    __atomic_add_fetch(&tc->nBad, 1, __ATOMIC_RELAXED);
+	if (count > 0
+	    && ! tc->b.findSnapshot(&snap, reinterpret_cast<uint8_t *>(&prev_key),
+				    NULL, &err))
+	    __atomic_add_fetch(&tc->nBad, 1, __ATOMIC_RELAXED);
+
+	tc->b.releaseSnapshot(&snap);
+	__atomic_add_fetch(&tc->nScans, 1, __ATOMIC_RELAXED);
+    }
+
+    return NULL;
+}
+
+}
+
+/************/
+
+namespace dback {
+
+/*
+ * Walk a subtree of memcmp ordered keys checking key order and that
+ * a leaf prefix is shared by both fences of the leaf.
+ *
+ * lo and hi are NULL for an unbounded fence.
+ */
+static bool
+r2_check_prefix(R2BTree *b, uint32_t pn, const uint8_t *lo,
+		const uint8_t *hi, size_t *count, size_t *numPrefixed)
+{
+    PagePin pin;
+    R2PageAccess ac;
+    ErrorInfo err;
+    if ( ! b->pinPage(&pin, &ac, pn, &err))
+	return false;
+    if (ac.header->numKeys > b->maxKeys(&ac))
+	return false;
+
+    size_t ks = b->header->keySize;
+    std::vector<uint8_t> k(ks), prev(ks);
+    uint32_t n = ac.header->numKeys;
+    if (ac.header->pageType == PageTypeLeaf) {
+	uint32_t p = ac.header->prefixLen;
+	if (p > 0) {
+	    if (lo == NULL || hi == NULL)
+		return false;
+	    if (memcmp(lo, ac.keys - p, p) != 0
+		|| memcmp(hi, ac.keys - p, p) != 0)
+		return false;
+	    (*numPrefixed)++;
+	}
+	for (uint32_t i = 0; i < n; i++) {
+	    b->copyKey(&ac, i, &k[0]);
+	    if (i > 0 && memcmp(&prev[0], &k[0], ks) >= 0)
+		return false;
+	    if ((lo != NULL && memcmp(&k[0], lo, ks) < 0)
+		|| (hi != NULL && memcmp(&k[0], hi, ks) >= 0))
+		return false;
+	    prev = k;
+	}
+	*count += n;
+	return true;
+    }
+
+    if (ac.header->prefixLen != 0)
+	return false;
+    for (uint32_t i = 0; i < n; i++) {
+	const uint8_t *c_lo = i > 0 ? ac.keys + i * ks : lo;
+	const uint8_t *c_hi = i + 1 < n ? ac.keys + (i + 1) * ks : hi;
+	if (i > 0 && memcmp(ac.keys + (i - 1) * ks, ac.keys + i * ks, ks) >= 0)
+	    return false;
+	if ( ! r2_check_prefix(b, b->getChildPageNum(&ac, i), c_lo, c_hi,
+			       count, numPrefixed))
+	    return false;
+    }
+
+    return true;
+}
+
+// machine id followed by a sequence number, both big-endian
+static void
+r2_composite_key(uint64_t group, uint64_t seq, uint8_t *key)
+{
+    for (int i = 0; i < 8; i++) {
+	key[7 - i] = static_cast<uint8_t>(group >> (8 * i));
+	key[15 - i] = static_cast<uint8_t>(seq >> (8 * i));
+    }
+}
+
+struct TC_R2BTree40 : public TestCase {
+    TC_R2BTree40() : TestCase("TC_R2BTree40") {;};
+    void run();
+};
+
+void
+TC_R2BTree40::run()
+{
+    static const uint32_t N_GROUPS = 8;
+    static const uint32_t N_SEQ = 1000;
+    static const uint32_t N = N_GROUPS * N_SEQ;
+
+    R2BTreeParams params;
+    params.keySize = 16;
+    params.valSize = 4;
+    params.pageSize = 256;
+
+    R2UUIDKey k;
+    ErrorInfo err;
+    bool ok;
+    size_t count, n_prefixed;
+    uint32_t val, i;
+    uint8_t key[16];
+
+    MemPageStore ms(params.pageSize), plain_ms(params.pageSize);
+    R2IndexHeader ih, plain_ih;
+    R2BTree::initIndexHeader(&ih, &params);
+    R2BTree::initIndexHeader(&plain_ih, &params);
+    R2BTree b, plain;
+    b.header = &ih;
+    b.ki = &k;
+    b.ps = &ms;
+    b.prefixKeys = true;
+    plain.header = &plain_ih;
+    plain.ki = &k;
+    plain.ps = &plain_ms;
+
+    ok = b.initTree(&err);
+    ASSERT_TRUE(ok == true);
+    ok = plain.initTree(&err);
+    ASSERT_TRUE(ok == true);
+
+    // groups are filled in turn, sequence numbers in a scattered order
+    for (i = 0; i < N; i++) {
+	uint32_t seq = (i / N_GROUPS * 7919) % N_SEQ;
+	r2_composite_key(i % N_GROUPS, seq, key);
+	val = (i % N_GROUPS) * N_SEQ + seq;
+	ok = b.insert(key, reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+	ok = plain.insert(key, reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+    }
+
+    count = n_prefixed = 0;
+    ok = r2_check_prefix(&b, ih.rootPageNum, NULL, NULL, &count, &n_prefixed);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(count == N);
+    ASSERT_TRUE(n_prefixed > 0);
+    ASSERT_TRUE(2 * r2_count_pages(&b, ih.rootPageNum)
+		< r2_count_pages(&plain, plain_ih.rootPageNum));
+
+    for (i = 0; i < N; i++) {
+	r2_composite_key(i / N_SEQ, i % N_SEQ, key);
+	val = N;
+	ok = b.find(key, reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(val == i);
+    }
+    err.clear();
+    r2_composite_key(N_GROUPS, 0, key);
+    ok = b.find(key, NULL, &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_KEY_NOT_FOUND);
+    r2_composite_key(3, 0, key);
+    ok = b.insert(key, reinterpret_cast<uint8_t *>(&val), &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_DUPLICATE_INSERT);
+
+    // cursors hand back whole keys
+    {
+	R2Cursor c(&b);
+	std::vector<uint8_t> keys(64 * 16), vals(64 * 4);
+	uint32_t got;
+	ok = c.seekFirst(&err);
+	ASSERT_TRUE(ok == true);
+	for (i = 0; i < N; i += got) {
+	    got = c.fetch(64, &keys[0], &vals[0], &err);
+	    ASSERT_TRUE(got > 0);
+	    for (uint32_t j = 0; j < got; j++) {
+		r2_composite_key((i + j) / N_SEQ, (i + j) % N_SEQ, key);
+		ASSERT_TRUE(memcmp(&keys[j * 16], key, 16) == 0);
+		memcpy(&val, &vals[j * 4], 4);
+		ASSERT_TRUE(val == i + j);
+	    }
+	}
+	ASSERT_TRUE(i == N);
+
+	ok = c.seekLast(&err);
+	for (i = N; ok; i--) {
+	    uint8_t got_key[16];
+	    ok = c.getKey(got_key);
+	    ASSERT_TRUE(ok == true);
+	    r2_composite_key((i - 1) / N_SEQ, (i - 1) % N_SEQ, key);
+	    ASSERT_TRUE(memcmp(got_key, key, 16) == 0);
+	    ok = c.prev(&err);
+	}
+	ASSERT_TRUE(i == 0);
+    }
+
+    // erase every other key, then the rest
+    for (i = 0; i < N; i += 2) {
+	r2_composite_key(i / N_SEQ, i % N_SEQ, key);
+	ok = b.erase(key, &err);
+	ASSERT_TRUE(ok == true);
+    }
+    count = n_prefixed = 0;
+    ok = r2_check_prefix(&b, ih.rootPageNum, NULL, NULL, &count, &n_prefixed);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(count == N / 2);
+    for (i = 0; i < N; i++) {
+	r2_composite_key(i / N_SEQ, i % N_SEQ, key);
+	ok = b.find(key, NULL, &err);
+	ASSERT_TRUE(ok == (i % 2 == 1));
+    }
+
+    for (i = 1; i < N; i += 2) {
+	r2_composite_key(i / N_SEQ, i % N_SEQ, key);
+	ok = b.erase(key, &err);
+	ASSERT_TRUE(ok == true);
+	if (i % 501 == 0) {
+	    count = n_prefixed = 0;
+	    ok = r2_check_prefix(&b, ih.rootPageNum, NULL, NULL, &count,
+				 &n_prefixed);
+	    ASSERT_TRUE(ok == true);
+	    ASSERT_TRUE(count == N / 2 - (i + 1) / 2);
+	}
+    }
+    ASSERT_TRUE(r2_count_pages(&b, ih.rootPageNum) == 1);
+    ASSERT_TRUE(ms.numPages() == 1);
+
+    // the concurrent routines read keys in place and refuse
+    err.clear();
+    ok = b.insertConcurrent(key, reinterpret_cast<uint8_t *>(&val), &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+
+    // keys that do not sort as by memcmp cannot have a prefix
+    R2IntKey ik;
+    R2BTreeParams int_params;
+    int_params.keySize = 4;
+    int_params.valSize = 4;
+    int_params.pageSize = 96;
+    MemPageStore int_ms(int_params.pageSize);
+    R2IndexHeader int_ih;
+    R2BTree::initIndexHeader(&int_ih, &int_params);
+    R2BTree ib;
+    ib.header = &int_ih;
+    ib.ki = &ik;
+    ib.ps = &int_ms;
+    ib.prefixKeys = true;
+    err.clear();
+    ok = ib.initTree(&err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+/*
+ * Check that the search index of every non-leaf page below pn picks
+ * the same child as a binary search of the key array, for each key
+ * of the page and the keys around it.
+ */
+static bool
+r2_check_index(R2BTree *b, uint32_t pn)
+{
+    PagePin pin;
+    R2PageAccess ac;
+    ErrorInfo err;
+    if ( ! b->pinPage(&pin, &ac, pn, &err))
+	return false;
+    if (ac.header->pageType == PageTypeLeaf)
+	return true;
+
+    size_t ks = b->header->keySize;
+    std::vector<uint8_t> probe(ks);
+    for (uint32_t i = 0; i < ac.header->numKeys; i++) {
+	for (int d = -1; d <= 1; d++) {
+	    memcpy(&probe[0], ac.keys + i * ks, ks);
+	    // step the last byte, keys are UUIDs or little endian ints
+	    size_t at = ks == 16 ? ks - 1 : 0;
+	    probe[at] = static_cast<uint8_t>(probe[at] + d);
+
+	    uint32_t idx, want;
+	    if (b->findKeyPosition(&ac, &probe[0], &idx))
+		want = idx;
+	    else
+		want = idx > 0 ? idx - 1 : 0;
+	    if (b->searchIndex(&ac, &probe[0]) != want)
+		return false;
+	}
+    }
+
+    for (uint32_t i = 0; i < ac.header->numKeys; i++) {
+	if ( ! r2_check_index(b, b->getChildPageNum(&ac, i)))
+	    return false;
+    }
+
+    return true;
+}
+
+struct TC_R2BTree41 : public TestCase {
+    TC_R2BTree41() : TestCase("TC_R2BTree41") {;};
+    void run();
+};
+
+void
+TC_R2BTree41::run()
+{
+    ErrorInfo err;
+    bool ok;
+    size_t count, n_prefixed;
+    uint32_t i;
+
+    // 16 byte keys, four to a cache line, two index levels
+    {
+	static const uint32_t N = 20000;
+
+	R2BTreeParams params;
+	params.keySize = 16;
+	params.valSize = 8;
+	params.pageSize = 1024;
+	params.nonLeafLayout = R2LayoutIndexed;
+
+	R2IndexHeader ih, sorted_ih;
+	ok = R2BTree::initIndexHeader(&ih, &params);
+	ASSERT_TRUE(ok == true);
+	params.nonLeafLayout = R2LayoutSorted;
+	R2BTree::initIndexHeader(&sorted_ih, &params);
+	ASSERT_TRUE(ih.nonLeafLayout == R2LayoutIndexed);
+	ASSERT_TRUE(ih.maxNumKeys[PageTypeNonLeaf] == 36);
+	ASSERT_TRUE(sorted_ih.maxNumKeys[PageTypeNonLeaf] == 48);
+	ASSERT_TRUE(ih.maxNumKeys[PageTypeLeaf]
+		    == sorted_ih.maxNumKeys[PageTypeLeaf]);
+
+	R2UUIDKey k;
+	MemPageStore ms(params.pageSize);
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &ms;
+	ok = b.initTree(&err);
+	ASSERT_TRUE(ok == true);
+
+	uint8_t key[16];
+	uint64_t val;
+	for (i = 0; i < N; i++) {
+	    r2_composite_key((i * 7919) % N * 0x9e3779b97f4a7c15ULL, i, key);
+	    val = i;
+	    ok = b.insert(key, reinterpret_cast<uint8_t *>(&val), &err);
+	    ASSERT_TRUE(ok == true);
+	}
+
+	count = n_prefixed = 0;
+	ok = r2_check_prefix(&b, ih.rootPageNum, NULL, NULL, &count,
+			     &n_prefixed);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == N);
+	ok = r2_check_index(&b, ih.rootPageNum);
+	ASSERT_TRUE(ok == true);
+
+	for (i = 0; i < N; i++) {
+	    r2_composite_key((i * 7919) % N * 0x9e3779b97f4a7c15ULL, i, key);
+	    ok = b.find(key, reinterpret_cast<uint8_t *>(&val), &err);
+	    ASSERT_TRUE(ok == true);
+	    ASSERT_TRUE(val == i);
+	}
+
+	// the cursor seeks through the index too
+	{
+	    R2Cursor c(&b);
+	    uint8_t got[16];
+	    r2_composite_key(0, 0, key);
+	    ok = c.seek(key, &err);
+	    for (i = 0; ok; i++) {
+		ok = c.getKey(got);
+		ASSERT_TRUE(ok == true);
+		ASSERT_TRUE(i == 0 || memcmp(key, got, 16) < 0);
+		memcpy(key, got, 16);
+		ok = c.next(&err);
+	    }
+	    ASSERT_TRUE(i == N);
+	}
+
+	for (i = 0; i < N; i++) {
+	    if (i % 5 == 0)
+		continue;
+	    r2_composite_key((i * 7919) % N * 0x9e3779b97f4a7c15ULL, i, key);
+	    ok = b.erase(key, &err);
+	    ASSERT_TRUE(ok == true);
+	}
+	count = n_prefixed = 0;
+	ok = r2_check_prefix(&b, ih.rootPageNum, NULL, NULL, &count,
+			     &n_prefixed);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == N / 5);
+	ok = r2_check_index(&b, ih.rootPageNum);
+	ASSERT_TRUE(ok == true);
+	for (i = 0; i < N; i++) {
+	    r2_composite_key((i * 7919) % N * 0x9e3779b97f4a7c15ULL, i, key);
+	    ok = b.find(key, NULL, &err);
+	    ASSERT_TRUE(ok == (i % 5 == 0));
+	}
+
+	// the compile time tree only reads sorted pages
+	R2BTreeT<R2UUIDKeyPolicy, 1024> t;
+	err.clear();
+	ok = t.open(&ih, &ms, &err);
+	ASSERT_TRUE(ok == false);
+	ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+    }
+
+    // 4 byte keys, sixteen to a cache line, bulk loaded then changed
+    {
+	static const uint32_t N = 300000;
+
+	R2BTreeParams params;
+	params.keySize = 4;
+	params.valSize = 4;
+	params.pageSize = 4096;
+	params.nonLeafLayout = R2LayoutIndexed;
+
+	R2IndexHeader ih;
+	ok = R2BTree::initIndexHeader(&ih, &params);
+	ASSERT_TRUE(ok == true);
+
+	R2IntKey k;
+	MemPageStore ms(params.pageSize);
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &ms;
+
+	R2IntSource src(10, 3, N);
+	ok = b.bulkLoad(&src, 1.0, &err);
+	ASSERT_TRUE(ok == true);
+	ok = r2_check_tree(&b, &count);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == N);
+	ok = r2_check_index(&b, ih.rootPageNum);
+	ASSERT_TRUE(ok == true);
+
+	uint32_t key, val;
+	for (i = 0; i < N; i++) {
+	    key = 10 + 3 * i;
+	    ok = b.find(reinterpret_cast<uint8_t *>(&key),
+			reinterpret_cast<uint8_t *>(&val), &err);
+	    ASSERT_TRUE(ok == true);
+	    ASSERT_TRUE(val == key + 1);
+	    key++;
+	    ok = b.find(reinterpret_cast<uint8_t *>(&key), NULL, &err);
+	    ASSERT_TRUE(ok == false);
+	}
+
+	// keys below the first one lower key 0, which is not indexed
+	for (i = 0; i < N / 2; i++) {
+	    key = (i < 10 ? i : 11 + 3 * i);
+	    val = key + 1;
+	    ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+			  reinterpret_cast<uint8_t *>(&val), &err);
+	    ASSERT_TRUE(ok == true);
+	}
+	for (i = 0; i < N; i += 2) {
+	    key = 10 + 3 * i;
+	    ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+	    ASSERT_TRUE(ok == true);
+	}
+	ok = r2_check_tree(&b, &count);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == N);
+	ok = r2_check_index(&b, ih.rootPageNum);
+	ASSERT_TRUE(ok == true);
+	for (i = 0; i < N; i++) {
+	    key = 10 + 3 * i;
+	    ok = b.find(reinterpret_cast<uint8_t *>(&key), NULL, &err);
+	    ASSERT_TRUE(ok == (i % 2 == 1));
+	}
+    }
+
+    // unknown layouts are refused
+    {
+	R2BTreeParams params;
+	params.keySize = 16;
+	params.valSize = 8;
+	params.pageSize = 4096;
+	params.nonLeafLayout = R2LayoutIndexed + 1;
+	R2IndexHeader ih;
+	ok = R2BTree::initIndexHeader(&ih, &params);
+	ASSERT_TRUE(ok == false);
+    }
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+struct TC_R2BTree42 : public TestCase {
+    TC_R2BTree42() : TestCase("TC_R2BTree42") {;};
+    void run();
+};
+
+void
+TC_R2BTree42::run()
+{
+    static const uint32_t RANGE = 20000;
+    static const uint32_t BATCH = 500;
+
+    R2BTreeParams params;
+    params.keySize = 4;
+    params.valSize = 4;
+    params.pageSize = 96;
+
+    R2IntKey k;
+    ErrorInfo err;
+    bool ok;
+    size_t count;
+    uint32_t i, key, val, n_inserted;
+
+    MemPageStore ms(params.pageSize);
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, &params);
+    R2BTree b;
+    b.header = &ih;
+    b.ki = &k;
+    b.ps = &ms;
+    ok = b.initTree(&err);
+    ASSERT_TRUE(ok == true);
+
+    // an empty batch changes nothing
+    ok = b.insertBatch(NULL, NULL, 0, &n_inserted, &err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(n_inserted == 0);
+
+    // batches in any order, some keys repeated in the batch or
+    // already in the tree
+    std::vector<bool> present(RANGE, false);
+    std::vector<uint32_t> keys(BATCH), vals(BATCH);
+    size_t n_present = 0;
+    uint32_t seed = 1;
+    for (int round = 0; round < 60; round++) {
+	uint32_t expect = 0;
+	std::vector<bool> in_batch(RANGE, false);
+	for (i = 0; i < BATCH; i++) {
+	    seed = seed * 1103515245 + 12345;
+	    keys[i] = (seed >> 8) % RANGE;
+	    if (round % 3 == 0)
+		keys[i] = (round * BATCH + i) % RANGE;
+	    vals[i] = keys[i] * 3 + (in_batch[keys[i]] ? 1 : 0);
+	    if ( ! present[keys[i]] && ! in_batch[keys[i]])
+		expect++;
+	    in_batch[keys[i]] = true;
+	}
+
+	err.clear();
+	ok = b.insertBatch(reinterpret_cast<uint8_t *>(&keys[0]),
+			   reinterpret_cast<uint8_t *>(&vals[0]), BATCH,
+			   &n_inserted, &err);
+	ASSERT_TRUE(n_inserted == expect);
+	ASSERT_TRUE(ok == (expect == BATCH));
+	if ( ! ok)
+	    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_DUPLICATE_INSERT);
+
+	for (i = 0; i < BATCH; i++) {
+	    if ( ! present[keys[i]])
+		n_present++;
+	    present[keys[i]] = true;
+	}
+
+	ok = r2_check_tree(&b, &count);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == n_present);
+    }
+
+    // the first value given for a key is kept
+    for (key = 0; key < RANGE; key++) {
+	ok = b.find(reinterpret_cast<uint8_t *>(&key),
+		    reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == present[key]);
+	if (ok)
+	    ASSERT_TRUE(val == key * 3);
+    }
+
+    // a batch of keys that share prefixes lands in leaves that have them
+    {
+	static const uint32_t N = 4000;
+
+	R2BTreeParams pparams;
+	pparams.keySize = 16;
+	pparams.valSize = 4;
+	pparams.pageSize = 256;
+
+	R2UUIDKey uk;
+	MemPageStore pms(pparams.pageSize);
+	R2IndexHeader pih;
+	R2BTree::initIndexHeader(&pih, &pparams);
+	R2BTree pb;
+	pb.header = &pih;
+	pb.ki = &uk;
+	pb.ps = &pms;
+	pb.prefixKeys = true;
+	ok = pb.initTree(&err);
+	ASSERT_TRUE(ok == true);
+
+	std::vector<uint8_t> pkeys(N * 16);
+	std::vector<uint32_t> pvals(N);
+	for (uint32_t pass = 0; pass < 2; pass++) {
+	    // even sequence numbers first, then the odd ones between them
+	    for (i = 0; i < N; i++) {
+		uint32_t j = (i * 7919) % N;
+		uint32_t seq = 2 * (j / 4) + pass;
+		r2_composite_key(j % 4, seq, &pkeys[i * 16]);
+		pvals[i] = (j % 4) * 2 * N + seq;
+	    }
+	    ok = pb.insertBatch(&pkeys[0], reinterpret_cast<uint8_t *>(&pvals[0]),
+				N, &n_inserted, &err);
+	    ASSERT_TRUE(ok == true);
+	    ASSERT_TRUE(n_inserted == N);
+	}
+
+	size_t n_prefixed = 0;
+	count = 0;
+	ok = r2_check_prefix(&pb, pih.rootPageNum, NULL, NULL, &count,
+			     &n_prefixed);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == 2 * N);
+	ASSERT_TRUE(n_prefixed > 0);
+
+	uint8_t pkey[16];
+	for (i = 0; i < 2 * N; i++) {
+	    r2_composite_key(i / (N / 2), i % (N / 2), pkey);
+	    ok = pb.find(pkey, reinterpret_cast<uint8_t *>(&val), &err);
+	    ASSERT_TRUE(ok == true);
+	    ASSERT_TRUE(val == (i / (N / 2)) * 2 * N + i % (N / 2));
+	}
+    }
+
+    // pages held by a snapshot are copied, not changed
+    {
+	MemPageStore cms(params.pageSize);
+	R2IndexHeader cih;
+	R2BTree::initIndexHeader(&cih, &params);
+	R2BTree cb;
+	cb.header = &cih;
+	cb.ki = &k;
+	cb.ps = &cms;
+	cb.copyOnWrite = true;
+	ok = cb.initTree(&err);
+	ASSERT_TRUE(ok == true);
+
+	for (i = 0; i < BATCH; i++) {
+	    keys[i] = 2 * i;
+	    vals[i] = i;
+	}
+	ok = cb.insertBatch(reinterpret_cast<uint8_t *>(&keys[0]),
+			    reinterpret_cast<uint8_t *>(&vals[0]), BATCH,
+			    NULL, &err);
+	ASSERT_TRUE(ok == true);
+
+	R2Snapshot snap;
+	ok = cb.takeSnapshot(&snap, &err);
+	ASSERT_TRUE(ok == true);
+	for (i = 0; i < BATCH; i++)
+	    keys[i] = 2 * i + 1;
+	ok = cb.insertBatch(reinterpret_cast<uint8_t *>(&keys[0]),
+			    reinterpret_cast<uint8_t *>(&vals[0]), BATCH,
+			    NULL, &err);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(cb.getNumCopies() > 0);
+
+	ok = r2_check_cow(&cb, snap.rootPageNum, &count);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == BATCH);
+	ok = r2_check_cow(&cb, cih.rootPageNum, &count);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == 2 * BATCH);
+	cb.releaseSnapshot(&snap);
+	ASSERT_TRUE(cms.numPages() == r2_count_pages(&cb, cih.rootPageNum));
+    }
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+struct TC_R2BTree43 : public TestCase {
+    TC_R2BTree43() : TestCase("TC_R2BTree43") {;};
+    void run();
+};
+
+void
+TC_R2BTree43::run()
+{
+    static const uint32_t N = 6000;
+
+    ErrorInfo err;
+    bool ok;
+    uint32_t i;
+
+    // 4 byte keys with a generic compare, then UUID keys with sorted
+    // and indexed non-leaf pages, then UUID keys with key prefixes
+    for (int mode = 0; mode < 4; mode++) {
+	R2BTreeParams params;
+	params.keySize = mode == 0 ? 4 : 16;
+	params.valSize = 4;
+	params.pageSize = mode == 0 ? 96 : 512;
+	if (mode == 2)
+	    params.nonLeafLayout = R2LayoutIndexed;
+	size_t ks = params.keySize;
+
+	R2IntKey ik;
+	R2UUIDKey uk;
+	MemPageStore ms(params.pageSize);
+	R2IndexHeader ih;
+	R2BTree::initIndexHeader(&ih, &params);
+	R2BTree b;
+	b.header = &ih;
+	b.ki = mode == 0 ? static_cast<R2KeyInterface *>(&ik) : &uk;
+	b.ps = &ms;
+	b.prefixKeys = mode == 3;
+	ok = b.initTree(&err);
+	ASSERT_TRUE(ok == true);
+
+	// key i for i < 2 * N, only the even ones are inserted
+	std::vector<uint8_t> keys(2 * N * ks);
+	for (i = 0; i < 2 * N; i++) {
+	    if (mode == 0)
+		memcpy(&keys[i * ks], &i, sizeof(i));
+	    else
+		r2_composite_key(i % 5, i * 0x9e3779b97f4a7c15ULL >> 20,
+				 &keys[i * ks]);
+	}
+
+	std::vector<uint32_t> vals(2 * N, 0);
+	std::vector<bool> want(2 * N);
+	bool found[2 * N];
+	uint32_t n_found;
+
+	for (int full = 0; full < 2; full++) {
+	    // the root alone, then a tree of several levels
+	    uint32_t n_keys = full ? N : 5;
+	    for (i = full ? 5 : 0; i < n_keys; i++) {
+		uint32_t v = 2 * i;
+		ok = b.insert(&keys[2 * i * ks], reinterpret_cast<uint8_t *>(&v),
+			      &err);
+		ASSERT_TRUE(ok == true);
+	    }
+
+	    // ask in a scrambled order, a count that is not a whole
+	    // number of groups
+	    uint32_t n = 2 * N - 3;
+	    std::vector<uint8_t> ask(n * ks);
+	    for (i = 0; i < n; i++) {
+		uint32_t j = (i * 7919) % (2 * N);
+		memcpy(&ask[i * ks], &keys[j * ks], ks);
+		want[i] = j % 2 == 0 && j < 2 * n_keys;
+		vals[i] = UINT32_MAX;
+	    }
+
+	    ok = b.findBatch(&ask[0], reinterpret_cast<uint8_t *>(&vals[0]),
+			     found, n, &err);
+	    ASSERT_TRUE(ok == true);
+	    n_found = 0;
+	    for (i = 0; i < n; i++) {
+		ASSERT_TRUE(found[i] == want[i]);
+		if (found[i]) {
+		    ASSERT_TRUE(vals[i] == (i * 7919) % (2 * N));
+		    n_found++;
+		}
+		else {
+		    ASSERT_TRUE(vals[i] == UINT32_MAX);
+		}
+
+		uint32_t v;
+		ok = b.find(&ask[i * ks], reinterpret_cast<uint8_t *>(&v), &err);
+		ASSERT_TRUE(ok == found[i]);
+	    }
+	    ASSERT_TRUE(n_found > 0);
+
+	    // no values wanted
+	    ok = b.findBatch(&ask[0], NULL, found, n, &err);
+	    ASSERT_TRUE(ok == true);
+	    for (i = 0; i < n; i++)
+		ASSERT_TRUE(found[i] == want[i]);
+	}
+
+	ok = b.findBatch(NULL, NULL, NULL, 0, &err);
+	ASSERT_TRUE(ok == true);
+    }
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+// the cells of a slotted leaf are distinct and in use, for every leaf
+static bool
+r2_check_slots(R2BTree *b, uint32_t pn, size_t *nFree)
+{
+    PagePin pin;
+    R2PageAccess ac;
+    ErrorInfo err;
+    if ( ! b->pinPage(&pin, &ac, pn, &err))
+	return false;
+
+    if (ac.header->pageType == PageTypeNonLeaf) {
+	for (uint32_t i = 0; i < ac.header->numKeys; i++)
+	    if ( ! r2_check_slots(b, b->getChildPageNum(&ac, i), nFree))
+		return false;
+	return ac.slots == NULL && ac.header->numCells == 0;
+    }
+
+    if (ac.slots == NULL || ac.header->numCells > b->maxKeys(&ac)
+	|| ac.header->numCells < ac.header->numKeys)
+	return false;
+
+    std::vector<bool> used(ac.header->numCells, false);
+    for (uint32_t i = 0; i < ac.header->numKeys; i++) {
+	if (ac.slots[i] >= ac.header->numCells || used[ac.slots[i]])
+	    return false;
+	used[ac.slots[i]] = true;
+    }
+    *nFree += ac.header->numCells - ac.header->numKeys;
+
+    return true;
+}
+
+static void
+r2_slotted_val(uint32_t key, uint32_t round, uint8_t *val)
+{
+    for (uint32_t j = 0; j < 40; j++)
+	val[j] = static_cast<uint8_t>(key * 7 + round + j);
+}
+
+struct TC_R2BTree44 : public TestCase {
+    TC_R2BTree44() : TestCase("TC_R2BTree44") {;};
+    void run();
+};
+
+void
+TC_R2BTree44::run()
+{
+    static const uint32_t RANGE = 3000;
+
+    R2BTreeParams params;
+    params.keySize = 4;
+    params.valSize = 40;
+    params.pageSize = 512;
+    params.leafLayout = R2LeafSlotted;
+
+    R2IntKey k;
+    ErrorInfo err;
+    bool ok;
+    size_t count, n_free;
+    uint32_t i, key;
+    uint8_t val[40], want[40];
+
+    // two bytes of slot per key
+    R2IndexHeader ih;
+    ok = R2BTree::initIndexHeader(&ih, &params);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(ih.leafLayout == R2LeafSlotted);
+    ASSERT_TRUE(ih.maxNumKeys[PageTypeLeaf] == 10);
+    params.leafLayout = R2LeafSlotted + 1;
+    R2IndexHeader bad_ih;
+    ok = R2BTree::initIndexHeader(&bad_ih, &params);
+    ASSERT_TRUE(ok == false);
+    params.leafLayout = R2LeafSlotted;
+
+    MemPageStore ms(params.pageSize);
+    R2BTree b;
+    b.header = &ih;
+    b.ki = &k;
+    b.ps = &ms;
+    ok = b.initTree(&err);
+    ASSERT_TRUE(ok == true);
+
+    // inserts and erases in random order leave free cells behind,
+    // which are reused once the heap is compacted
+    std::vector<int> round_of(RANGE, -1);
+    size_t n_present = 0, most_free = 0;
+    uint32_t seed = 7;
+    for (uint32_t round = 0; round < 40; round++) {
+	for (i = 0; i < 500; i++) {
+	    seed = seed * 1103515245 + 12345;
+	    key = (seed >> 8) % RANGE;
+	    if (round_of[key] < 0) {
+		r2_slotted_val(key, round, val);
+		ok = b.insert(reinterpret_cast<uint8_t *>(&key), val, &err);
+		ASSERT_TRUE(ok == true);
+		round_of[key] = round;
+		n_present++;
+	    }
+	    else if (round % 2 == 1) {
+		ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+		ASSERT_TRUE(ok == true);
+		round_of[key] = -1;
+		n_present--;
+	    }
+	}
+
+	ok = r2_check_tree(&b, &count);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == n_present);
+	n_free = 0;
+	ok = r2_check_slots(&b, ih.rootPageNum, &n_free);
+	ASSERT_TRUE(ok == true);
+	most_free = std::max(most_free, n_free);
+    }
+    ASSERT_TRUE(most_free > 0);
+
+    for (key = 0; key < RANGE; key++) {
+	ok = b.find(reinterpret_cast<uint8_t *>(&key), val, &err);
+	ASSERT_TRUE(ok == (round_of[key] >= 0));
+	if (ok) {
+	    r2_slotted_val(key, round_of[key], want);
+	    ASSERT_TRUE(memcmp(val, want, 40) == 0);
+	}
+    }
+
+    // a cursor reads the values through the slots
+    {
+	R2Cursor c(&b);
+	ok = c.seekFirst(&err);
+	ASSERT_TRUE(ok == true);
+	std::vector<uint32_t> keys(RANGE);
+	std::vector<uint8_t> vals(RANGE * 40);
+	uint32_t got = c.fetch(RANGE, reinterpret_cast<uint8_t *>(&keys[0]),
+			       &vals[0], &err);
+	ASSERT_TRUE(got == n_present);
+	for (i = 0; i < got; i++) {
+	    ASSERT_TRUE(round_of[keys[i]] >= 0);
+	    r2_slotted_val(keys[i], round_of[keys[i]], want);
+	    ASSERT_TRUE(memcmp(&vals[i * 40], want, 40) == 0);
+	}
+    }
+
+    // batches merge into the heap as well
+    {
+	std::vector<uint32_t> keys;
+	std::vector<uint8_t> vals;
+	for (key = 0; key < RANGE; key += 3) {
+	    if (round_of[key] >= 0)
+		continue;
+	    keys.push_back(key);
+	    vals.resize(keys.size() * 40);
+	    r2_slotted_val(key, 100, &vals[(keys.size() - 1) * 40]);
+	    round_of[key] = 100;
+	    n_present++;
+	}
+	uint32_t n_inserted;
+	ok = b.insertBatch(reinterpret_cast<uint8_t *>(&keys[0]), &vals[0],
+			   keys.size(), &n_inserted, &err);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(n_inserted == keys.size());
+
+	ok = r2_check_tree(&b, &count);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == n_present);
+	n_free = 0;
+	ok = r2_check_slots(&b, ih.rootPageNum, &n_free);
+	ASSERT_TRUE(ok == true);
+
+	for (key = 0; key < RANGE; key++) {
+	    ok = b.find(reinterpret_cast<uint8_t *>(&key), val, &err);
+	    ASSERT_TRUE(ok == (round_of[key] >= 0));
+	    if (ok) {
+		r2_slotted_val(key, round_of[key], want);
+		ASSERT_TRUE(memcmp(val, want, 40) == 0);
+	    }
+	}
+    }
+
+    // erase everything, leaves are merged and borrow from each other
+    for (key = 0; key < RANGE; key++) {
+	if (round_of[key] < 0)
+	    continue;
+	ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+	ASSERT_TRUE(ok == true);
+	if (key % 100 == 0) {
+	    n_free = 0;
+	    ok = r2_check_slots(&b, ih.rootPageNum, &n_free);
+	    ASSERT_TRUE(ok == true);
+	}
+    }
+    ok = r2_check_tree(&b, &count);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(count == 0);
+
+    // bulk loaded leaves start out compacted
+    {
+	MemPageStore bms(params.pageSize);
+	R2IndexHeader bih;
+	R2BTree::initIndexHeader(&bih, &params);
+	R2BTree bb;
+	bb.header = &bih;
+	bb.ki = &k;
+	bb.ps = &bms;
+
+	R2IntSource src(10, 3, 1000);
+	ok = bb.bulkLoad(&src, 0.7, &err);
+	ASSERT_TRUE(ok == true);
+	n_free = 0;
+	ok = r2_check_slots(&bb, bih.rootPageNum, &n_free);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(n_free == 0);
+
+	for (i = 0; i < 1000; i++) {
+	    key = 10 + 3 * i;
+	    ok = bb.find(reinterpret_cast<uint8_t *>(&key), val, &err);
+	    ASSERT_TRUE(ok == true);
+	    uint32_t v;
+	    memcpy(&v, val, sizeof(v));
+	    ASSERT_TRUE(v == key + 1);
+	}
+    }
+
+    // key prefixes shrink the keys, not the slots
+    {
+	R2BTreeParams pparams;
+	pparams.keySize = 16;
+	pparams.valSize = 40;
+	pparams.pageSize = 512;
+	pparams.leafLayout = R2LeafSlotted;
+
+	R2UUIDKey uk;
+	MemPageStore pms(pparams.pageSize);
+	R2IndexHeader pih;
+	R2BTree::initIndexHeader(&pih, &pparams);
+	R2BTree pb;
+	pb.header = &pih;
+	pb.ki = &uk;
+	pb.ps = &pms;
+	pb.prefixKeys = true;
+	ok = pb.initTree(&err);
+	ASSERT_TRUE(ok == true);
+
+	uint8_t pkey[16];
+	for (i = 0; i < 2000; i++) {
+	    r2_composite_key(i % 3, (i * 7919) % 2000, pkey);
+	    r2_slotted_val(i, 0, val);
+	    ok = pb.insert(pkey, val, &err);
+	    ASSERT_TRUE(ok == true);
+	}
+	for (i = 0; i < 2000; i += 2) {
+	    r2_composite_key(i % 3, (i * 7919) % 2000, pkey);
+	    ok = pb.erase(pkey, &err);
+	    ASSERT_TRUE(ok == true);
+	}
+
+	size_t n_prefixed = 0;
+	count = 0;
+	ok = r2_check_prefix(&pb, pih.rootPageNum, NULL, NULL, &count,
+			     &n_prefixed);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == 1000);
+	ASSERT_TRUE(n_prefixed > 0);
+	n_free = 0;
+	ok = r2_check_slots(&pb, pih.rootPageNum, &n_free);
+	ASSERT_TRUE(ok == true);
+
+	for (i = 0; i < 2000; i++) {
+	    r2_composite_key(i % 3, (i * 7919) % 2000, pkey);
+	    ok = pb.find(pkey, val, &err);
+	    ASSERT_TRUE(ok == (i % 2 == 1));
+	    if (ok) {
+		r2_slotted_val(i, 0, want);
+		ASSERT_TRUE(memcmp(val, want, 40) == 0);
+	    }
+	}
+    }
+
+    // the compile time tree only reads sorted leaves
+    {
+	R2IndexHeader tih;
+	R2BTreeT<R2UUIDKeyPolicy, 4096>::initIndexHeader(&tih);
+	tih.leafLayout = R2LeafSlotted;
+	MemPageStore tms(4096);
+	R2BTreeT<R2UUIDKeyPolicy, 4096> t;
+	ok = t.open(&tih, &tms, &err);
+	ASSERT_TRUE(ok == false);
+	ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+    }
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+// value of key, round r, some of them longer than several pages
+static void
+r2_var_val(uint32_t key, uint32_t r, std::vector<uint8_t> *val)
+{
+    val->resize((key * 37 + r) % 700);
+    for (size_t j = 0; j < val->size(); j++)
+	(*val)[j] = static_cast<uint8_t>(key + r + j * 13);
+}
+
+// overflow pages of the values in the tree under pn
+static size_t
+r2_count_overflow(R2BTree *b, uint32_t pn)
+{
+    PagePin pin;
+    R2PageAccess ac;
+    ErrorInfo err;
+    size_t n = 0;
+    size_t room = b->header->pageSize - sizeof(R2PageHeader);
+    if ( ! b->pinPage(&pin, &ac, pn, &err))
+	return 0;
+    for (uint32_t i = 0; i < ac.header->numKeys; i++) {
+	if (ac.header->pageType == PageTypeNonLeaf) {
+	    n += r2_count_overflow(b, b->getChildPageNum(&ac, i));
+	    continue;
+	}
+	uint32_t len;
+	memcpy(&len, b->valAt(&ac, i), sizeof(len));
+	if (len > b->header->valSize[PageTypeLeaf] - sizeof(len))
+	    n += (len + room - 1) / room;
+    }
+    return n;
+}
+
+struct TC_R2BTree45 : public TestCase {
+    TC_R2BTree45() : TestCase("TC_R2BTree45") {;};
+    void run();
+};
+
+void
+TC_R2BTree45::run()
+{
+    static const uint32_t N = 1000;
+
+    char path[] = "/tmp/dback_utests_wal.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_TRUE(fd >= 0);
+    close(fd);
+
+    R2BTreeParams params;
+    params.keySize = 4;
+    params.valSize = 24;
+    params.pageSize = 256;
+    params.varValues = true;
+
+    R2IntKey k;
+    ErrorInfo err;
+    bool ok;
+    size_t count;
+    uint32_t key;
+    std::vector<uint8_t> val, want;
+
+    // the slot must hold a length and a page number
+    {
+	R2BTreeParams small = params;
+	small.valSize = 4;
+	R2IndexHeader sih;
+	ok = R2BTree::initIndexHeader(&sih, &small);
+	ASSERT_TRUE(ok == false);
+    }
+
+    // only for trees made for it
+    {
+	R2BTreeParams fixed = params;
+	fixed.varValues = false;
+	MemPageStore fms(fixed.pageSize);
+	R2IndexHeader fih;
+	R2BTree::initIndexHeader(&fih, &fixed);
+	R2BTree fb;
+	fb.header = &fih;
+	fb.ki = &k;
+	fb.ps = &fms;
+	ok = fb.initTree(&err);
+	ASSERT_TRUE(ok == true);
+	key = 1;
+	err.clear();
+	ok = fb.insertVar(reinterpret_cast<uint8_t *>(&key), NULL, 0, &err);
+	ASSERT_TRUE(ok == false);
+	ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+    }
+
+    WriteAheadLog wal;
+    ok = wal.open(path, &err);
+    ASSERT_TRUE(ok == true);
+
+    MemPageStore ms(params.pageSize);
+    R2IndexHeader ih;
+    ok = R2BTree::initIndexHeader(&ih, &params);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(ih.varValues != 0);
+    R2BTree b;
+    b.header = &ih;
+    b.ki = &k;
+    b.ps = &ms;
+    b.wal = &wal;
+    ok = b.initTree(&err);
+    ASSERT_TRUE(ok == true);
+
+    for (uint32_t i = 0; i < N; i++) {
+	key = (i * 7919) % N;
+	r2_var_val(key, 0, &val);
+	ok = b.insertVar(reinterpret_cast<uint8_t *>(&key),
+			 val.empty() ? NULL : &val[0], val.size(), &err);
+	ASSERT_TRUE(ok == true);
+    }
+
+    // a duplicate leaves no overflow pages behind
+    size_t n_pages = ms.numPages();
+    key = 18;
+    r2_var_val(key, 1, &val);
+    ASSERT_TRUE(val.size() > 600);
+    err.clear();
+    ok = b.insertVar(reinterpret_cast<uint8_t *>(&key), &val[0], val.size(),
+		     &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_DUPLICATE_INSERT);
+    ASSERT_TRUE(ms.numPages() == n_pages);
+
+    // erase frees the chains
+    for (key = 0; key < N; key += 3) {
+	ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+	ASSERT_TRUE(ok == true);
+    }
+    ok = r2_check_tree(&b, &count);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(count == N - (N + 2) / 3);
+    size_t n_overflow = r2_count_overflow(&b, ih.rootPageNum);
+    ASSERT_TRUE(n_overflow > count);
+    ASSERT_TRUE(ms.numPages()
+		== r2_count_pages(&b, ih.rootPageNum) + n_overflow);
+
+    for (key = 0; key < N; key++) {
+	ok = b.findVar(reinterpret_cast<uint8_t *>(&key), &val, &err);
+	ASSERT_TRUE(ok == (key % 3 != 0));
+	if (ok) {
+	    r2_var_val(key, 0, &want);
+	    ASSERT_TRUE(val == want);
+	}
+    }
+
+    // a cursor returns slots, which readValue turns into values
+    {
+	R2Cursor c(&b);
+	ok = c.seekFirst(&err);
+	ASSERT_TRUE(ok == true);
+	std::vector<uint8_t> slot(params.valSize);
+	count = 0;
+	while (c.getKey(reinterpret_cast<uint8_t *>(&key))) {
+	    ok = c.getVal(&slot[0]);
+	    ASSERT_TRUE(ok == true);
+	    ok = b.readValue(&slot[0], &val, &err);
+	    ASSERT_TRUE(ok == true);
+	    r2_var_val(key, 0, &want);
+	    ASSERT_TRUE(val == want);
+	    count++;
+	    if ( ! c.next(&err))
+		break;
+	}
+	ASSERT_TRUE(count == N - (N + 2) / 3);
+    }
+
+    // overflow pages are replayed with the leaves
+    uint32_t root = ih.rootPageNum;
+    ok = wal.commit(wal.getAppendLsn(), &err);
+    ASSERT_TRUE(ok == true);
+    ok = wal.close(&err);
+    ASSERT_TRUE(ok == true);
+    {
+	WriteAheadLog wal2;
+	ok = wal2.open(path, &err);
+	ASSERT_TRUE(ok == true);
+
+	MemPageStore ms2(params.pageSize);
+	R2IndexHeader ih2;
+	R2BTree::initIndexHeader(&ih2, &params);
+	R2BTree b2;
+	b2.header = &ih2;
+	b2.ki = &k;
+	b2.ps = &ms2;
+	b2.wal = &wal2;
+	ok = b2.recover(&err);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(ih2.rootPageNum == root);
+
+	for (key = 0; key < N; key++) {
+	    ok = b2.findVar(reinterpret_cast<uint8_t *>(&key), &val, &err);
+	    ASSERT_TRUE(ok == (key % 3 != 0));
+	    if (ok) {
+		r2_var_val(key, 0, &want);
+		ASSERT_TRUE(val == want);
+	    }
+	}
+	ok = wal2.close(&err);
+	ASSERT_TRUE(ok == true);
+    }
+    unlink(path);
+
+    // a snapshot keeps the chains of values erased after it
+    {
+	MemPageStore cms(params.pageSize);
+	R2IndexHeader cih;
+	R2BTree::initIndexHeader(&cih, &params);
+	R2BTree cb;
+	cb.header = &cih;
+	cb.ki = &k;
+	cb.ps = &cms;
+	cb.copyOnWrite = true;
+	ok = cb.initTree(&err);
+	ASSERT_TRUE(ok == true);
+
+	for (key = 0; key < 200; key++) {
+	    r2_var_val(key, 0, &val);
+	    ok = cb.insertVar(reinterpret_cast<uint8_t *>(&key),
+			      val.empty() ? NULL : &val[0], val.size(), &err);
+	    ASSERT_TRUE(ok == true);
+	}
+
+	R2Snapshot snap;
+	ok = cb.takeSnapshot(&snap, &err);
+	ASSERT_TRUE(ok == true);
+	for (key = 0; key < 200; key += 2) {
+	    ok = cb.erase(reinterpret_cast<uint8_t *>(&key), &err);
+	    ASSERT_TRUE(ok == true);
+	}
+
+	std::vector<uint8_t> slot(params.valSize);
+	for (key = 0; key < 200; key++) {
+	    ok = cb.findSnapshot(&snap, reinterpret_cast<uint8_t *>(&key),
+				 &slot[0], &err);
+	    ASSERT_TRUE(ok == true);
+	    ok = cb.readValue(&slot[0], &val, &err);
+	    ASSERT_TRUE(ok == true);
+	    r2_var_val(key, 0, &want);
+	    ASSERT_TRUE(val == want);
+	}
+
+	cb.releaseSnapshot(&snap);
+	ASSERT_TRUE(cms.numPages()
+		    == r2_count_pages(&cb, cih.rootPageNum)
+		    + r2_count_overflow(&cb, cih.rootPageNum));
+    }
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+struct TC_R2BTree46 : public TestCase {
+    TC_R2BTree46() : TestCase("TC_R2BTree46") {;};
+    void run();
+};
+
+void
+TC_R2BTree46::run()
+{
+    static const uint32_t KS = 48;
+
+    R2VarKey k(KS);
+    ErrorInfo err;
+    bool ok;
+    uint32_t i;
+    uint8_t a[KS], b[KS];
+
+    ASSERT_TRUE(k.getMaxLength() == KS - 2);
+    ASSERT_TRUE(k.isBytewise() == true);
+    ASSERT_TRUE(k.isUUID() == false);
+
+    std::string long_str(KS - 1, 'x');
+    ok = k.makeKey(reinterpret_cast<const uint8_t *>(long_str.data()),
+		   long_str.size(), a);
+    ASSERT_TRUE(ok == false);
+    long_str.resize(KS - 2);
+    ok = k.makeKey(reinterpret_cast<const uint8_t *>(long_str.data()),
+		   long_str.size(), a);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(k.getLength(a) == KS - 2);
+    ASSERT_TRUE(memcmp(a, long_str.data(), KS - 2) == 0);
+
+    // strings order as std::string does, zero bytes included, and
+    // the compare agrees with memcmp on the slots
+    std::vector<std::string> strs;
+    strs.push_back("");
+    strs.push_back(std::string("\0", 1));
+    strs.push_back(std::string("a", 1));
+    strs.push_back(std::string("a\0", 2));
+    strs.push_back(std::string("a\0\0", 3));
+    strs.push_back(std::string("a\0b", 3));
+    strs.push_back("ab");
+    strs.push_back("abcdefgh");
+    strs.push_back("abcdefgh1");
+    strs.push_back("abcdefgi");
+    strs.push_back("b");
+    uint32_t seed = 3;
+    for (i = 0; i < 300; i++) {
+	std::string s;
+	seed = seed * 1103515245 + 12345;
+	uint32_t len = (seed >> 8) % 20;
+	for (uint32_t j = 0; j < len; j++) {
+	    seed = seed * 1103515245 + 12345;
+	    s.push_back(static_cast<char>("\0ab\xff"[(seed >> 8) % 4]));
+	}
+	strs.push_back(s);
+    }
+    for (size_t x = 0; x < strs.size(); x++) {
+	for (size_t y = 0; y < strs.size(); y++) {
+	    k.makeKey(reinterpret_cast<const uint8_t *>(strs[x].data()),
+		      strs[x].size(), a);
+	    k.makeKey(reinterpret_cast<const uint8_t *>(strs[y].data()),
+		      strs[y].size(), b);
+	    int c = k.compare(a, b);
+	    int m = memcmp(a, b, KS);
+	    int want = strs[x].compare(strs[y]);
+	    ASSERT_TRUE((c < 0) == (want < 0) && (c > 0) == (want > 0));
+	    ASSERT_TRUE((m < 0) == (want < 0) && (m > 0) == (want > 0));
+	}
+    }
+
+    // a catalog of paths, machine ids and directories are shared by
+    // the keys of a leaf
+    R2BTreeParams params;
+    params.keySize = KS;
+    params.valSize = 4;
+    params.pageSize = 1024;
+
+    MemPageStore ms(params.pageSize);
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, &params);
+    R2BTree t;
+    t.header = &ih;
+    t.ki = &k;
+    t.ps = &ms;
+    t.prefixKeys = true;
+    ok = t.initTree(&err);
+    ASSERT_TRUE(ok == true);
+
+    std::vector<std::string> paths;
+    for (uint32_t m = 0; m < 3; m++)
+	for (uint32_t d = 0; d < 20; d++)
+	    for (uint32_t f = 0; f < 60; f++)
+		paths.push_back("m" + std::to_string(m) + "/home/dir"
+				+ std::to_string(d) + "/f" + std::to_string(f));
+    uint32_t n = paths.size();
+
+    uint8_t key[KS];
+    uint32_t val;
+    for (i = 0; i < n; i++) {
+	uint32_t j = (i * 7919) % n;
+	ok = k.makeKey(reinterpret_cast<const uint8_t *>(paths[j].data()),
+		       paths[j].size(), key);
+	ASSERT_TRUE(ok == true);
+	ok = t.insert(key, reinterpret_cast<uint8_t *>(&j), &err);
+	ASSERT_TRUE(ok == true);
+    }
+
+    size_t count = 0, n_prefixed = 0;
+    ok = r2_check_prefix(&t, ih.rootPageNum, NULL, NULL, &count, &n_prefixed);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(count == n);
+    ASSERT_TRUE(n_prefixed > 0);
+
+    // a scan returns the paths in string order
+    std::vector<std::string> sorted(paths);
+    std::sort(sorted.begin(), sorted.end());
+    {
+	R2Cursor c(&t);
+	ok = c.seekFirst(&err);
+	ASSERT_TRUE(ok == true);
+	for (i = 0; i < n; i++) {
+	    ok = c.getKey(key);
+	    ASSERT_TRUE(ok == true);
+	    std::string got(reinterpret_cast<char *>(key), k.getLength(key));
+	    ASSERT_TRUE(got == sorted[i]);
+	    ok = c.getVal(reinterpret_cast<uint8_t *>(&val));
+	    ASSERT_TRUE(ok == true);
+	    ASSERT_TRUE(paths[val] == got);
+	    ok = c.next(&err);
+	    ASSERT_TRUE(ok == (i + 1 < n));
+	}
+    }
+
+    for (i = 0; i < n; i += 2) {
+	k.makeKey(reinterpret_cast<const uint8_t *>(paths[i].data()),
+		  paths[i].size(), key);
+	ok = t.erase(key, &err);
+	ASSERT_TRUE(ok == true);
+    }
+    for (i = 0; i < n; i++) {
+	k.makeKey(reinterpret_cast<const uint8_t *>(paths[i].data()),
+		  paths[i].size(), key);
+	ok = t.find(key, reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == (i % 2 == 1));
+	if (ok)
+	    ASSERT_TRUE(val == i);
+    }
+
+    // a path that is a prefix of others is not confused with them
+    std::string dir("m1/home/dir1");
+    k.makeKey(reinterpret_cast<const uint8_t *>(dir.data()), dir.size(), key);
+    ok = t.find(key, NULL, &err);
+    ASSERT_TRUE(ok == false);
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+/*
+ * Check every subtree maximum under pn, setting m to the largest
+ * value field under it.
+ */
+static bool
+r2_check_max(R2BTree *b, uint32_t pn, uint64_t *m)
+{
+    PagePin pin;
+    R2PageAccess ac;
+    ErrorInfo err;
+    if ( ! b->pinPage(&pin, &ac, pn, &err))
+	return false;
+
+    *m = 0;
+    for (uint32_t i = 0; i < ac.header->numKeys; i++) {
+	uint64_t f;
+	if (ac.header->pageType == PageTypeLeaf)
+	    f = b->valueField(b->valAt(&ac, i));
+	else {
+	    if ( ! r2_check_max(b, b->getChildPageNum(&ac, i), &f))
+		return false;
+	    if (b->getChildMax(&ac, i) != f)
+		return false;
+	}
+	*m = std::max(*m, f);
+    }
+    return true;
+}
+
+// block size of key, sizes repeat so that some are tied
+static uint64_t
+r2_block_size(uint32_t key)
+{
+    return ((uint64_t)key * 2654435761u) % 5003 * 1000;
+}
+
+// value of 16 bytes, the key and then the block size
+static void
+r2_block_val(uint32_t key, uint64_t size, uint8_t *val)
+{
+    memset(val, 0, 16);
+    memcpy(val, &key, sizeof(key));
+    memcpy(val + 8, &size, sizeof(size));
+}
+
+/*
+ * Check findLargest(k) against the sizes of the keys in model.
+ */
+static bool
+r2_check_largest(R2BTree *b, std::map<uint32_t, uint64_t> *model, uint32_t k)
+{
+    std::vector<uint8_t> keys, vals;
+    ErrorInfo err;
+    if ( ! b->findLargest(k, &keys, &vals, &err))
+	return false;
+
+    std::vector<uint64_t> sizes;
+    std::map<uint32_t, uint64_t>::iterator iter;
+    for (iter = model->begin(); iter != model->end(); iter++)
+	sizes.push_back(iter->second);
+    std::sort(sizes.rbegin(), sizes.rend());
+    size_t n = std::min<size_t>(k, sizes.size());
+    if (keys.size() != n * 4 || vals.size() != n * 16)
+	return false;
+
+    for (size_t i = 0; i < n; i++) {
+	uint32_t key;
+	uint64_t size;
+	memcpy(&key, &keys[i * 4], sizeof(key));
+	memcpy(&size, &vals[i * 16 + 8], sizeof(size));
+	if (size != sizes[i] || model->count(key) == 0
+	    || (*model)[key] != size)
+	    return false;
+    }
+    return true;
+}
+
+/**
+ * Bulk load source of keys 0, 2, 4, ... with block size values.
+ */
+class R2BlockSource : public R2BulkSource {
+public:
+    uint32_t nextKey;
+    uint32_t remaining;
+
+    R2BlockSource(uint32_t n) : nextKey(0), remaining(n) {;};
+
+    bool next(uint8_t *key, uint8_t *val) {
+	if (this->remaining == 0)
+	    return false;
+	memcpy(key, &this->nextKey, sizeof(uint32_t));
+	r2_block_val(this->nextKey, r2_block_size(this->nextKey), val);
+	this->nextKey += 2;
+	this->remaining--;
+	return true;
+    };
+};
+
+struct TC_R2BTree47 : public TestCase {
+    TC_R2BTree47() : TestCase("TC_R2BTree47") {;};
+    void run();
+};
+
+void
+TC_R2BTree47::run()
+{
+    static const uint32_t N = 3000;
+
+    char path[] = "/tmp/dback_utests_wal.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_TRUE(fd >= 0);
+    close(fd);
+
+    R2BTreeParams params;
+    params.keySize = 4;
+    params.valSize = 16;
+    params.pageSize = 512;
+    params.subtreeMax = true;
+    params.maxOffset = 8;
+
+    R2IntKey k;
+    ErrorInfo err;
+    bool ok;
+    size_t count;
+    uint32_t key, i;
+    uint64_t m;
+    uint8_t val[16];
+
+    // non-leaf values grow by the maximum, the field must fit
+    {
+	R2IndexHeader ih;
+	ok = R2BTree::initIndexHeader(&ih, &params);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(ih.valSize[PageTypeNonLeaf] == 12);
+	R2BTreeParams plain = params;
+	plain.subtreeMax = false;
+	R2IndexHeader pih;
+	R2BTree::initIndexHeader(&pih, &plain);
+	ASSERT_TRUE(pih.maxNumKeys[PageTypeNonLeaf]
+		    > ih.maxNumKeys[PageTypeNonLeaf]);
+
+	R2BTreeParams bad = params;
+	bad.maxOffset = 9;
+	ok = R2BTree::initIndexHeader(&ih, &bad);
+	ASSERT_TRUE(ok == false);
+	bad = params;
+	bad.varValues = true;
+	ok = R2BTree::initIndexHeader(&ih, &bad);
+	ASSERT_TRUE(ok == false);
+
+	// only trees made for it
+	MemPageStore pms(plain.pageSize);
+	R2BTree pb;
+	pb.header = &pih;
+	pb.ki = &k;
+	pb.ps = &pms;
+	ok = pb.initTree(&err);
+	ASSERT_TRUE(ok == true);
+	std::vector<uint8_t> keys, vals;
+	err.clear();
+	ok = pb.findLargest(1, &keys, &vals, &err);
+	ASSERT_TRUE(ok == false);
+	ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+    }
+
+    for (uint32_t layout = R2LayoutSorted; layout <= R2LayoutIndexed;
+	 layout++) {
+	params.nonLeafLayout = layout;
+
+	WriteAheadLog wal;
+	ok = wal.open(path, &err);
+	ASSERT_TRUE(ok == true);
+
+	MemPageStore ms(params.pageSize);
+	R2IndexHeader ih;
+	ok = R2BTree::initIndexHeader(&ih, &params);
+	ASSERT_TRUE(ok == true);
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &ms;
+	b.wal = &wal;
+	ok = b.initTree(&err);
+	ASSERT_TRUE(ok == true);
+
+	std::map<uint32_t, uint64_t> model;
+	ok = r2_check_largest(&b, &model, 5);
+	ASSERT_TRUE(ok == true);
+
+	for (i = 0; i < N; i++) {
+	    key = (i * 7919) % N;
+	    r2_block_val(key, r2_block_size(key), val);
+	    ok = b.insert(reinterpret_cast<uint8_t *>(&key), val, &err);
+	    ASSERT_TRUE(ok == true);
+	    model[key] = r2_block_size(key);
+	}
+
+	// a failed insert raises nothing
+	key = 5;
+	r2_block_val(key, UINT64_MAX, val);
+	ok = b.insert(reinterpret_cast<uint8_t *>(&key), val, &err);
+	ASSERT_TRUE(ok == false);
+
+	ok = r2_check_tree(&b, &count);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == N);
+	ok = r2_check_max(&b, ih.rootPageNum, &m);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(m == 5002 * 1000);
+	ASSERT_TRUE(r2_check_largest(&b, &model, 1) == true);
+	ASSERT_TRUE(r2_check_largest(&b, &model, 25) == true);
+
+	// take away the largest blocks, and every third one
+	for (uint32_t n = 0; n < 40; n++) {
+	    std::map<uint32_t, uint64_t>::iterator iter, big = model.begin();
+	    for (iter = model.begin(); iter != model.end(); iter++) {
+		if (iter->second > big->second)
+		    big = iter;
+	    }
+	    key = big->first;
+	    ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+	    ASSERT_TRUE(ok == true);
+	    model.erase(big);
+	}
+	for (key = 0; key < N; key += 3) {
+	    if (model.count(key) == 0)
+		continue;
+	    ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+	    ASSERT_TRUE(ok == true);
+	    model.erase(key);
+	}
+	ok = r2_check_tree(&b, &count);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == model.size());
+	ok = r2_check_max(&b, ih.rootPageNum, &m);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(r2_check_largest(&b, &model, 25) == true);
+
+	// keys already in the tree raise nothing
+	std::vector<uint8_t> bkeys, bvals;
+	std::map<uint32_t, uint64_t>::iterator in_tree = model.begin();
+	for (i = 0; i < 600; i++) {
+	    key = i < 100 ? (in_tree++)->first : N + (i * 13) % 500;
+	    uint64_t size = i < 100 ? UINT64_MAX : r2_block_size(key) * 2;
+	    r2_block_val(key, size, val);
+	    bkeys.insert(bkeys.end(), reinterpret_cast<uint8_t *>(&key),
+			 reinterpret_cast<uint8_t *>(&key) + 4);
+	    bvals.insert(bvals.end(), val, val + 16);
+	    if (i >= 100)
+		model[key] = size;
+	}
+	uint32_t n_inserted;
+	ok = b.insertBatch(&bkeys[0], &bvals[0], 600, &n_inserted, &err);
+	ASSERT_TRUE(ok == false);
+	ASSERT_TRUE(n_inserted == 500);
+	ok = r2_check_tree(&b, &count);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == model.size());
+	ok = r2_check_max(&b, ih.rootPageNum, &m);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(r2_check_largest(&b, &model, 25) == true);
+	ASSERT_TRUE(r2_check_largest(&b, &model, N * 2) == true);
+	if (layout == R2LayoutIndexed) {
+	    ok = r2_check_index(&b, ih.rootPageNum);
+	    ASSERT_TRUE(ok == true);
+	}
+
+	// the maxima are replayed with their pages
+	uint32_t root = ih.rootPageNum;
+	ok = wal.commit(wal.getAppendLsn(), &err);
+	ASSERT_TRUE(ok == true);
+	ok = wal.close(&err);
+	ASSERT_TRUE(ok == true);
+	{
+	    WriteAheadLog wal2;
+	    ok = wal2.open(path, &err);
+	    ASSERT_TRUE(ok == true);
+
+	    MemPageStore ms2(params.pageSize);
+	    R2IndexHeader ih2;
+	    R2BTree::initIndexHeader(&ih2, &params);
+	    R2BTree b2;
+	    b2.header = &ih2;
+	    b2.ki = &k;
+	    b2.ps = &ms2;
+	    b2.wal = &wal2;
+	    ok = b2.recover(&err);
+	    ASSERT_TRUE(ok == true);
+	    ASSERT_TRUE(ih2.rootPageNum == root);
+	    ok = r2_check_max(&b2, ih2.rootPageNum, &m);
+	    ASSERT_TRUE(ok == true);
+	    ASSERT_TRUE(r2_check_largest(&b2, &model, 25) == true);
+	    ok = wal2.close(&err);
+	    ASSERT_TRUE(ok == true);
+	}
+	unlink(path);
+    }
+
+    // bulkLoad fills in the maxima once the tree is built
+    {
+	MemPageStore ms(params.pageSize);
+	R2IndexHeader ih;
+	R2BTree::initIndexHeader(&ih, &params);
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &ms;
+	R2BlockSource src(N);
+	ok = b.bulkLoad(&src, 0.8, &err);
+	ASSERT_TRUE(ok == true);
+
+	std::map<uint32_t, uint64_t> model;
+	for (key = 0; key < 2 * N; key += 2)
+	    model[key] = r2_block_size(key);
+	ok = r2_check_max(&b, ih.rootPageNum, &m);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(r2_check_largest(&b, &model, 25) == true);
+
+	r2_block_val(1, UINT64_MAX, val);
+	key = 1;
+	ok = b.insertConcurrent(reinterpret_cast<uint8_t *>(&key), val, &err);
+	ASSERT_TRUE(ok == false);
+	ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+    }
+
+    // copies made for a snapshot keep their maxima, the snapshot its own
+    {
+	MemPageStore ms(params.pageSize);
+	R2IndexHeader ih;
+	R2BTree::initIndexHeader(&ih, &params);
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &ms;
+	b.copyOnWrite = true;
+	ok = b.initTree(&err);
+	ASSERT_TRUE(ok == true);
+
+	for (key = 0; key < N; key++) {
+	    r2_block_val(key, r2_block_size(key), val);
+	    ok = b.insert(reinterpret_cast<uint8_t *>(&key), val, &err);
+	    ASSERT_TRUE(ok == true);
+	}
+	uint64_t before;
+	ok = r2_check_max(&b, ih.rootPageNum, &before);
+	ASSERT_TRUE(ok == true);
+
+	R2Snapshot snap;
+	ok = b.takeSnapshot(&snap, &err);
+	ASSERT_TRUE(ok == true);
+	for (key = 0; key < N; key++) {
+	    if (r2_block_size(key) >= before - 100000) {
+		ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+		ASSERT_TRUE(ok == true);
+	    }
+	}
+	key = N;
+	r2_block_val(key, 7, val);
+	ok = b.insert(reinterpret_cast<uint8_t *>(&key), val, &err);
+	ASSERT_TRUE(ok == true);
+
+	ok = r2_check_max(&b, ih.rootPageNum, &m);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(m < before - 100000);
+	ok = r2_check_max(&b, snap.rootPageNum, &m);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(m == before);
+	b.releaseSnapshot(&snap);
+    }
+
+    this->setStatus(true);
+}
+
+}
+
+/****************************************************/
+
+namespace dback {
+
+/**
+ * Count the pages of a level, and the pages other than the last one
+ * holding fewer than min keys.
+ */
+static bool
+r2_level_pages(R2BTree *b, int level, uint32_t min, size_t *pages,
+	       size_t *below)
+{
+    PagePin pin;
+    R2PageAccess ac;
+    ErrorInfo err;
+    uint32_t pn = b->header->rootPageNum;
+
+    *pages = 0;
+    *below = 0;
+    if ( ! b->pinPage(&pin, &ac, pn, &err))
+	return false;
+    while (ac.header->level > level) {
+	pn = b->getChildPageNum(&ac, 0);
+	if ( ! b->pinPage(&pin, &ac, pn, &err))
+	    return false;
+    }
+
+    while (pn != 0) {
+	if ( ! b->pinPage(&pin, &ac, pn, &err))
+	    return false;
+	pn = ac.header->nextPageNum;
+	(*pages)++;
+	if (pn != 0 && ac.header->numKeys < min)
+	    (*below)++;
+    }
+
+    return true;
+}
+
+/**
+ * Same as r2_check_tree, for trees split with appendSplit, where the
+ * last page of each level may hold fewer than minNumKeys keys.
+ */
+static bool
+r2_check_append(R2BTree *b, size_t *count)
+{
+    PagePin pin;
+    R2PageAccess ac;
+    ErrorInfo err;
+    size_t pages, below;
+
+    if ( ! b->pinPage(&pin, &ac, b->header->rootPageNum, &err))
+	return false;
+    for (int level = ac.header->level; level >= 0; level--) {
+	int pt = level == 0 ? PageTypeLeaf : PageTypeNonLeaf;
+	if ( ! r2_level_pages(b, level, b->header->minNumKeys[pt], &pages,
+			      &below)
+	    || below != 0)
+	    return false;
+    }
+
+    // the order and depth checks, with the last pages let through
+    R2IndexHeader *h = b->header;
+    R2IndexHeader relaxed = *h;
+    relaxed.minNumKeys[PageTypeLeaf] = 1;
+    relaxed.minNumKeys[PageTypeNonLeaf] = 1;
+    b->header = &relaxed;
+    bool ok = r2_check_tree(b, count);
+    b->header = h;
+
+    return ok;
+}
+
+struct TC_R2BTree48 : public TestCase {
+    TC_R2BTree48() : TestCase("TC_R2BTree48") {;};
+    void run();
+};
+
+void
+TC_R2BTree48::run()
+{
+    static const uint32_t N = 5000;
+
+    char path[] = "/tmp/dback_utests_wal.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_TRUE(fd >= 0);
+    close(fd);
+
+    R2BTreeParams params;
+    params.keySize = 4;
+    params.valSize = 4;
+    params.pageSize = 512;
+
+    R2IntKey k;
+    ErrorInfo err;
+    bool ok;
+    size_t count, pages, below, even_pages;
+    uint32_t key, val, i;
+
+    for (uint32_t layout = R2LeafSorted; layout <= R2LeafSlotted; layout++) {
+	params.leafLayout = layout;
+
+	// an even split leaves the pages behind the appends half full
+	{
+	    MemPageStore ms(params.pageSize);
+	    R2IndexHeader ih;
+	    ok = R2BTree::initIndexHeader(&ih, &params);
+	    ASSERT_TRUE(ok == true);
+	    R2BTree b;
+	    b.header = &ih;
+	    b.ki = &k;
+	    b.ps = &ms;
+	    ok = b.initTree(&err);
+	    ASSERT_TRUE(ok == true);
+
+	    for (key = 0; key < N; key++) {
+		val = key * 3;
+		ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+			      reinterpret_cast<uint8_t *>(&val), &err);
+		ASSERT_TRUE(ok == true);
+	    }
+	    ok = r2_check_tree(&b, &count);
+	    ASSERT_TRUE(ok == true);
+	    ASSERT_TRUE(count == N);
+
+	    // only the inserts that split a leaf go down from the root
+	    uint32_t max = ih.maxNumKeys[PageTypeLeaf];
+	    ok = r2_level_pages(&b, 0, max, &even_pages, &below);
+	    ASSERT_TRUE(ok == true);
+	    ASSERT_TRUE(below == even_pages - 1);
+	    ASSERT_TRUE(b.getNumAppends() > N - 2 * even_pages);
+	}
+
+	WriteAheadLog wal;
+	ok = wal.open(path, &err);
+	ASSERT_TRUE(ok == true);
+
+	MemPageStore ms(params.pageSize);
+	R2IndexHeader ih;
+	ok = R2BTree::initIndexHeader(&ih, &params);
+	ASSERT_TRUE(ok == true);
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &ms;
+	b.wal = &wal;
+	b.appendSplit = true;
+	ok = b.initTree(&err);
+	ASSERT_TRUE(ok == true);
+
+	for (key = 0; key < N; key++) {
+	    val = key * 3;
+	    ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+			  reinterpret_cast<uint8_t *>(&val), &err);
+	    ASSERT_TRUE(ok == true);
+	}
+	ok = r2_check_append(&b, &count);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == N);
+
+	// every leaf but the last is full, every non-leaf all but full
+	uint32_t max = ih.maxNumKeys[PageTypeLeaf];
+	ok = r2_level_pages(&b, 0, max, &pages, &below);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(below == 0);
+	ASSERT_TRUE(pages == (N + max - 1) / max);
+	ASSERT_TRUE(even_pages > pages * 3 / 2);
+	ok = r2_level_pages(&b, 1, ih.maxNumKeys[PageTypeNonLeaf] - 2, &pages,
+			    &below);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(below == 0);
+	ASSERT_TRUE(b.getNumAppends() == N - (N + max - 1) / max);
+
+	// a key that is not past the last goes down from the root
+	key = N / 2;
+	ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+		      reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == false);
+	ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_DUPLICATE_INSERT);
+	key = N - 1;
+	err.clear();
+	ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+		      reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == false);
+	ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_DUPLICATE_INSERT);
+
+	// keys past the end in random order, and erases all over
+	std::set<uint32_t> model;
+	for (key = 0; key < N; key++)
+	    model.insert(key);
+	for (i = 0; i < N; i++) {
+	    key = N + (i * 7919) % N;
+	    val = key * 3;
+	    ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+			  reinterpret_cast<uint8_t *>(&val), &err);
+	    ASSERT_TRUE(ok == true);
+	    model.insert(key);
+	    if (i % 2 == 0) {
+		key = (i * 4001) % (2 * N);
+		if (model.erase(key) == 1) {
+		    ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+		    ASSERT_TRUE(ok == true);
+		}
+	    }
+	}
+	ok = r2_check_append(&b, &count);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == model.size());
+
+	// erase the last leaves, the one remembered is freed
+	for (i = 0; i < 3 * max; i++) {
+	    key = *model.rbegin();
+	    ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+	    ASSERT_TRUE(ok == true);
+	    model.erase(key);
+	}
+	for (key = 3 * N; key < 3 * N + 2 * max; key++) {
+	    val = key * 3;
+	    ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+			  reinterpret_cast<uint8_t *>(&val), &err);
+	    ASSERT_TRUE(ok == true);
+	    model.insert(key);
+	}
+	ok = r2_check_append(&b, &count);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == model.size());
+	for (std::set<uint32_t>::iterator iter = model.begin();
+	     iter != model.end(); iter++) {
+	    key = *iter;
+	    ok = b.find(reinterpret_cast<uint8_t *>(&key),
+			reinterpret_cast<uint8_t *>(&val), &err);
+	    ASSERT_TRUE(ok == true);
+	    ASSERT_TRUE(val == key * 3);
+	}
+
+	// the appends are logged like any other insert
+	uint32_t root = ih.rootPageNum;
+	ok = wal.commit(wal.getAppendLsn(), &err);
+	ASSERT_TRUE(ok == true);
+	ok = wal.close(&err);
+	ASSERT_TRUE(ok == true);
+	{
+	    WriteAheadLog wal2;
+	    ok = wal2.open(path, &err);
+	    ASSERT_TRUE(ok == true);
+
+	    MemPageStore ms2(params.pageSize);
+	    R2IndexHeader ih2;
+	    R2BTree::initIndexHeader(&ih2, &params);
+	    R2BTree b2;
+	    b2.header = &ih2;
+	    b2.ki = &k;
+	    b2.ps = &ms2;
+	    b2.wal = &wal2;
+	    ok = b2.recover(&err);
+	    ASSERT_TRUE(ok == true);
+	    ASSERT_TRUE(ih2.rootPageNum == root);
+	    ok = r2_check_append(&b2, &count);
+	    ASSERT_TRUE(ok == true);
+	    ASSERT_TRUE(count == model.size());
+	    ok = wal2.close(&err);
+	    ASSERT_TRUE(ok == true);
+	}
+	unlink(path);
+    }
+
+    // copy-on-write trees always go down from the root
+    {
+	MemPageStore ms(params.pageSize);
+	R2IndexHeader ih;
+	R2BTree::initIndexHeader(&ih, &params);
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &ms;
+	b.copyOnWrite = true;
+	b.appendSplit = true;
+	ok = b.initTree(&err);
+	ASSERT_TRUE(ok == true);
+
+	R2Snapshot snap;
+	for (key = 0; key < N; key++) {
+	    if (key == N / 2) {
+		ok = b.takeSnapshot(&snap, &err);
+		ASSERT_TRUE(ok == true);
+	    }
+	    val = key * 3;
+	    ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+			  reinterpret_cast<uint8_t *>(&val), &err);
+	    ASSERT_TRUE(ok == true);
+	}
+	ASSERT_TRUE(b.getNumAppends() == 0);
+	R2IndexHeader relaxed = ih;
+	relaxed.minNumKeys[PageTypeLeaf] = 1;
+	relaxed.minNumKeys[PageTypeNonLeaf] = 1;
+	b.header = &relaxed;
+	ok = r2_check_cow(&b, relaxed.rootPageNum, &count);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == N);
+	ok = r2_check_cow(&b, snap.rootPageNum, &count);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == N / 2);
+	b.header = &ih;
+	b.releaseSnapshot(&snap);
+    }
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+struct TC_HashIndex01 : public TestCase {
+    TC_HashIndex01() : TestCase("TC_HashIndex01") {;};
+    void run();
+};
+
+void
+TC_HashIndex01::run()
+{
+    static const uint32_t N = 20000;
+
+    // 16 byte keys and an odd size, hashed a word and a tail at a time
+    for (uint32_t ks = 5; ks <= 16; ks += 11) {
+	HashIndex h(ks, 4);
+	std::map<uint32_t, uint32_t> model;
+	std::vector<uint8_t> key(ks, 0);
+	uint32_t i, x, val;
+
+	ASSERT_TRUE(h.size() == 0);
+	ASSERT_TRUE(h.getKeySize() == ks);
+	ASSERT_TRUE(h.getValSize() == 4);
+	x = 7;
+	memcpy(&key[ks - 4], &x, 4);
+	ASSERT_TRUE(h.find(&key[0], NULL) == false);
+	ASSERT_TRUE(h.remove(&key[0]) == false);
+
+	// adds, replaces and removes against a map
+	for (i = 0; i < 3 * N; i++) {
+	    x = (i * 7919) % N;
+	    memcpy(&key[ks - 4], &x, 4);
+	    if (i % 3 == 2) {
+		ASSERT_TRUE(h.remove(&key[0]) == (model.erase(x) == 1));
+	    }
+	    else {
+		val = i;
+		bool added = model.count(x) == 0;
+		ASSERT_TRUE(h.insert(&key[0],
+				     reinterpret_cast<uint8_t *>(&val))
+			    == added);
+		model[x] = i;
+	    }
+	}
+	ASSERT_TRUE(h.size() == model.size());
+	ASSERT_TRUE(h.memoryBytes() * 3 >= h.size() * (ks + 5) * 4);
+
+	// room made ahead leaves the keys where they can be found
+	size_t before = h.memoryBytes();
+	h.reserve(model.size() / 2);
+	ASSERT_TRUE(h.memoryBytes() == before);
+	h.reserve(4 * N);
+	ASSERT_TRUE(h.memoryBytes() >= before * 4);
+	ASSERT_TRUE(h.size() == model.size());
+
+	for (x = 0; x < N + 100; x++) {
+	    memcpy(&key[ks - 4], &x, 4);
+	    val = UINT32_MAX;
+	    bool found = h.find(&key[0], reinterpret_cast<uint8_t *>(&val));
+	    ASSERT_TRUE(found == (model.count(x) == 1));
+	    ASSERT_TRUE( ! found || val == model[x]);
+	}
+
+	// removing everything leaves every probe ending at once
+	for (x = 0; x < N; x++) {
+	    memcpy(&key[ks - 4], &x, 4);
+	    ASSERT_TRUE(h.remove(&key[0]) == (model.erase(x) == 1));
+	}
+	ASSERT_TRUE(h.size() == 0);
+	x = 1;
+	val = 2;
+	memcpy(&key[ks - 4], &x, 4);
+	ASSERT_TRUE(h.insert(&key[0], reinterpret_cast<uint8_t *>(&val)));
+	h.clear();
+	ASSERT_TRUE(h.size() == 0);
+	ASSERT_TRUE(h.find(&key[0], NULL) == false);
+	ASSERT_TRUE(h.memoryBytes() == HashIndex::MIN_SLOTS * (ks + 5));
+    }
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+// a UUID whose bytes are spread out like random ones
+static void
+r2_hash_key(uint32_t x, uint8_t *key)
+{
+    uint32_t spread = x * 2654435761U;
+    memset(key, 0, 16);
+    for (int j = 0; j < 4; j++) {
+	key[j] = (uint8_t)(spread >> (24 - 8 * j));
+	key[12 + j] = (uint8_t)(x >> (24 - 8 * j));
+    }
+}
+
+// a UUID past every r2_hash_key, x in big endian at the end
+static void
+r2_last_key(uint32_t x, uint8_t *key)
+{
+    memset(key, 0xff, 16);
+    for (int j = 0; j < 4; j++)
+	key[12 + j] = (uint8_t)(x >> (24 - 8 * j));
+}
+
+/**
+ * Check the hash index of a tree holds the keys of a model, with the
+ * values the tree holds for them.
+ */
+static bool
+r2_check_hash(R2BTree *b, std::map<uint32_t, uint64_t> *model, uint32_t n)
+{
+    ErrorInfo err;
+    uint8_t key[16];
+    uint64_t val;
+
+    if (b->hashIndex->size() != model->size())
+	return false;
+
+    for (uint32_t x = 0; x < n; x++) {
+	r2_hash_key(x, key);
+	bool in_model = model->count(x) == 1;
+	if (b->hashIndex->find(key, reinterpret_cast<uint8_t *>(&val))
+	    != in_model)
+	    return false;
+	if (in_model && val != (*model)[x])
+	    return false;
+
+	// and the tree agrees
+	err.clear();
+	bool in_tree = b->findFrom(b->header->rootPageNum, key,
+				   reinterpret_cast<uint8_t *>(&val), &err);
+	if (in_tree != in_model || (in_tree && val != (*model)[x]))
+	    return false;
+    }
+
+    return true;
+}
+
+/**
+ * Memory page store whose getPage fails after a number of pins, for
+ * the error paths that follow a failed read.
+ */
+class R2FailingStore : public MemPageStore {
+public:
+    /// Pins left before getPage fails, never fails if negative.
+    int pinsLeft;
+
+    R2FailingStore(uint32_t sz) : MemPageStore(sz), pinsLeft(-1) {;};
+
+    uint8_t *getPage(uint32_t pageNum, ErrorInfo *err) {
+	if (this->pinsLeft == 0) {
+	    err->setErrNum(ErrorInfo::ERR_IO);
+	    err->message.assign("page read failed");
+	    return NULL;
+	}
+	if (this->pinsLeft > 0)
+	    this->pinsLeft--;
+	return MemPageStore::getPage(pageNum, err);
+    };
+};
+
+struct TC_R2BTree49 : public TestCase {
+    TC_R2BTree49() : TestCase("TC_R2BTree49") {;};
+    void run();
+};
+
+void
+TC_R2BTree49::run()
+{
+    static const uint32_t N = 4000;
+
+    char path[] = "/tmp/dback_utests_wal.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_TRUE(fd >= 0);
+    close(fd);
+
+    R2BTreeParams params;
+    params.keySize = 16;
+    params.valSize = 8;
+    params.pageSize = 512;
+
+    R2UUIDKey k;
+    ErrorInfo err;
+    bool ok;
+    uint32_t x, i;
+    uint8_t key[16];
+    uint64_t val;
+
+    // the hash index must hold the leaf keys and values
+    {
+	MemPageStore ms(params.pageSize);
+	R2IndexHeader ih;
+	R2BTree::initIndexHeader(&ih, &params);
+	HashIndex h(16, 4);
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &ms;
+	b.hashIndex = &h;
+	ok = b.initTree(&err);
+	ASSERT_TRUE(ok == false);
+	ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+	b.hashIndex = NULL;
+	err.clear();
+	ok = b.loadHashIndex(&err);
+	ASSERT_TRUE(ok == false);
+	ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+    }
+
+    WriteAheadLog wal;
+    ok = wal.open(path, &err);
+    ASSERT_TRUE(ok == true);
+
+    MemPageStore ms(params.pageSize);
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, &params);
+    HashIndex h(16, 8);
+    R2BTree b;
+    b.header = &ih;
+    b.ki = &k;
+    b.ps = &ms;
+    b.wal = &wal;
+    b.hashIndex = &h;
+    ok = b.initTree(&err);
+    ASSERT_TRUE(ok == true);
+
+    std::map<uint32_t, uint64_t> model;
+    for (i = 0; i < N; i++) {
+	x = (i * 7919) % N;
+	r2_hash_key(x, key);
+	val = x * 3;
+	ok = b.insert(key, reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+	model[x] = val;
+    }
+    ok = r2_check_hash(&b, &model, 2 * N);
+    ASSERT_TRUE(ok == true);
+
+    // a miss is answered by the hash index alone
+    r2_hash_key(N, key);
+    err.clear();
+    ok = b.find(key, reinterpret_cast<uint8_t *>(&val), &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_KEY_NOT_FOUND);
+    r2_hash_key(17, key);
+    ok = b.find(key, reinterpret_cast<uint8_t *>(&val), &err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(val == 17 * 3);
+
+    // a duplicate leaves the value alone
+    val = 1;
+    ok = b.insert(key, reinterpret_cast<uint8_t *>(&val), &err);
+    ASSERT_TRUE(ok == false);
+    ok = b.find(key, reinterpret_cast<uint8_t *>(&val), &err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(val == 17 * 3);
+
+    // erases, with the merges and moves they cause
+    for (x = 0; x < N; x++) {
+	if (x % 3 == 0 || (x > N / 2 && x < N / 2 + 400)) {
+	    r2_hash_key(x, key);
+	    ok = b.erase(key, &err);
+	    ASSERT_TRUE(ok == true);
+	    model.erase(x);
+	}
+    }
+    r2_hash_key(0, key);
+    ok = b.erase(key, &err);
+    ASSERT_TRUE(ok == false);
+    ok = r2_check_hash(&b, &model, 2 * N);
+    ASSERT_TRUE(ok == true);
+
+    // batches, with keys already there and repeated
+    std::vector<uint8_t> bkeys, bvals;
+    for (i = 0; i < 600; i++) {
+	x = i < 100 ? model.begin()->first + 3 * i : N + (i * 13) % 500;
+	r2_hash_key(x, key);
+	val = x * 3;
+	bkeys.insert(bkeys.end(), key, key + 16);
+	bvals.insert(bvals.end(), reinterpret_cast<uint8_t *>(&val),
+		     reinterpret_cast<uint8_t *>(&val) + 8);
+	if (i >= 100)
+	    model[x] = val;
+    }
+    uint32_t n_inserted;
+    ok = b.insertBatch(&bkeys[0], &bvals[0], 600, &n_inserted, &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(n_inserted == 500);
+    ok = r2_check_hash(&b, &model, 2 * N);
+    ASSERT_TRUE(ok == true);
+
+    std::vector<uint8_t> fvals(600 * 8);
+    bool found[600];
+    ok = b.findBatch(&bkeys[0], &fvals[0], found, 600, &err);
+    ASSERT_TRUE(ok == true);
+    for (i = 0; i < 600; i++) {
+	ASSERT_TRUE(found[i] == true);
+	ASSERT_TRUE(memcmp(&fvals[i * 8], &bvals[i * 8], 8) == 0);
+    }
+
+    // time ordered keys go through the rightmost leaf fast path
+    uint64_t appends = b.getNumAppends();
+    for (x = 0x40000000; x < 0x40000000 + 300; x++) {
+	r2_last_key(x, key);
+	val = x;
+	ok = b.insert(key, reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+	ok = b.find(key, reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(val == x);
+    }
+    ASSERT_TRUE(b.getNumAppends() > appends);
+    ASSERT_TRUE(h.size() == model.size() + 300);
+    for (x = 0x40000000; x < 0x40000000 + 300; x++) {
+	r2_last_key(x, key);
+	ok = b.erase(key, &err);
+	ASSERT_TRUE(ok == true);
+    }
+    ASSERT_TRUE(h.size() == model.size());
+
+    r2_hash_key(3 * N, key);
+    err.clear();
+    ok = b.insertConcurrent(key, reinterpret_cast<uint8_t *>(&val), &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+
+    // the hash index is not logged, recover fills it from the tree
+    ok = wal.commit(wal.getAppendLsn(), &err);
+    ASSERT_TRUE(ok == true);
+    ok = wal.close(&err);
+    ASSERT_TRUE(ok == true);
+    {
+	WriteAheadLog wal2;
+	ok = wal2.open(path, &err);
+	ASSERT_TRUE(ok == true);
+
+	MemPageStore ms2(params.pageSize);
+	R2IndexHeader ih2;
+	R2BTree::initIndexHeader(&ih2, &params);
+	HashIndex h2(16, 8);
+	R2BTree b2;
+	b2.header = &ih2;
+	b2.ki = &k;
+	b2.ps = &ms2;
+	b2.wal = &wal2;
+	b2.hashIndex = &h2;
+	ok = b2.recover(&err);
+	ASSERT_TRUE(ok == true);
+	ok = r2_check_hash(&b2, &model, 2 * N);
+	ASSERT_TRUE(ok == true);
+	ok = wal2.close(&err);
+	ASSERT_TRUE(ok == true);
+    }
+    unlink(path);
+
+    // bulkLoad refills the hash index once the tree is built
+    {
+	R2BTreeParams ip;
+	ip.keySize = 4;
+	ip.valSize = 4;
+	ip.pageSize = 512;
+	R2IntKey ik;
+	MemPageStore ims(ip.pageSize);
+	R2IndexHeader iih;
+	R2BTree::initIndexHeader(&iih, &ip);
+	HashIndex ih4(4, 4);
+	R2BTree ib;
+	ib.header = &iih;
+	ib.ki = &ik;
+	ib.ps = &ims;
+	ib.hashIndex = &ih4;
+	R2IntSource src(0, 2, N);
+	ok = ib.bulkLoad(&src, 0.8, &err);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(ih4.size() == N);
+	uint32_t ikey, ival;
+	for (ikey = 0; ikey < 2 * N; ikey++) {
+	    ok = ib.find(reinterpret_cast<uint8_t *>(&ikey),
+			 reinterpret_cast<uint8_t *>(&ival), &err);
+	    ASSERT_TRUE(ok == (ikey % 2 == 0));
+	    ASSERT_TRUE( ! ok || ival == ikey + 1);
+	}
+
+	// a failed load leaves the old tree, and its keys in the index
+	R2IntSource dup(1, 0, 10);
+	err.clear();
+	ok = ib.bulkLoad(&dup, 0.8, &err);
+	ASSERT_TRUE(ok == false);
+	ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_DUPLICATE_INSERT);
+	ASSERT_TRUE(ih4.size() == N);
+	for (ikey = 0; ikey < 2 * N; ikey++) {
+	    ok = ib.find(reinterpret_cast<uint8_t *>(&ikey),
+			 reinterpret_cast<uint8_t *>(&ival), &err);
+	    ASSERT_TRUE(ok == (ikey % 2 == 0));
+	    ASSERT_TRUE( ! ok || ival == ikey + 1);
+	}
+
+	ok = ib.initTree(&err);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(ih4.size() == 0);
+    }
+
+    // a read that fails at any point of a load, the walk that fills the
+    // hash index included, leaves the old tree and its index
+    {
+	R2BTreeParams ip;
+	ip.keySize = 4;
+	ip.valSize = 4;
+	ip.pageSize = 512;
+	R2IntKey ik;
+	R2FailingStore fs(ip.pageSize);
+	R2IndexHeader iih;
+	R2BTree::initIndexHeader(&iih, &ip);
+	HashIndex ih4(4, 4);
+	R2BTree ib;
+	ib.header = &iih;
+	ib.ki = &ik;
+	ib.ps = &fs;
+	ib.hashIndex = &ih4;
+	R2IntSource old_src(0, 2, N / 4);
+	ok = ib.bulkLoad(&old_src, 0.8, &err);
+	ASSERT_TRUE(ok == true);
+	uint32_t root = iih.rootPageNum;
+
+	uint32_t ikey, ival;
+	int pins;
+	for (pins = 0; ; pins++) {
+	    R2IntSource src(1, 2, N / 4);
+	    fs.pinsLeft = pins;
+	    err.clear();
+	    ok = ib.bulkLoad(&src, 0.8, &err);
+	    fs.pinsLeft = -1;
+	    if (ok)
+		break;
+	    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_IO);
+	    ASSERT_TRUE(iih.rootPageNum == root);
+	    ASSERT_TRUE(ih4.size() == N / 4);
+	    for (ikey = 0; ikey < N / 2; ikey++) {
+		ok = ib.find(reinterpret_cast<uint8_t *>(&ikey),
+			     reinterpret_cast<uint8_t *>(&ival), &err);
+		ASSERT_TRUE(ok == (ikey % 2 == 0));
+		ASSERT_TRUE( ! ok || ival == ikey + 1);
+	    }
+	}
+
+	// the walk reads every page of the new tree
+	ASSERT_TRUE(pins >= (int)r2_count_pages(&ib, iih.rootPageNum));
+	ASSERT_TRUE(ih4.size() == N / 4);
+	for (ikey = 0; ikey < N / 2; ikey++) {
+	    ok = ib.find(reinterpret_cast<uint8_t *>(&ikey),
+			 reinterpret_cast<uint8_t *>(&ival), &err);
+	    ASSERT_TRUE(ok == (ikey % 2 == 1));
+	    ASSERT_TRUE( ! ok || ival == ikey + 1);
+	}
+    }
+
+    // R2BTreeT passes its finds and inserts to a tree with a hash index
+    {
+	typedef R2BTreeT<R2UUIDKeyPolicy, 512> UUIDTree;
+	R2IndexHeader uh;
+	UUIDTree::initIndexHeader(&uh);
+	MemPageStore ups(512);
+	HashIndex uhash(16, 8);
+	UUIDTree ut;
+	ok = ut.open(&uh, &ups, &err);
+	ASSERT_TRUE(ok == true);
+	ok = ut.initTree(&err);
+	ASSERT_TRUE(ok == true);
+	for (x = 0; x < N / 2; x++) {
+	    r2_hash_key(x, key);
+	    val = x;
+	    ok = ut.insert(key, reinterpret_cast<uint8_t *>(&val), &err);
+	    ASSERT_TRUE(ok == true);
+	}
+
+	// attached to a tree that is already there
+	ut.getTree()->hashIndex = &uhash;
+	ok = ut.getTree()->loadHashIndex(&err);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(uhash.size() == N / 2);
+	for (x = N / 2; x < N; x++) {
+	    r2_hash_key(x, key);
+	    val = x;
+	    ok = ut.insert(key, reinterpret_cast<uint8_t *>(&val), &err);
+	    ASSERT_TRUE(ok == true);
+	}
+	ASSERT_TRUE(uhash.size() == N);
+	for (x = 0; x < N; x++) {
+	    r2_hash_key(x, key);
+	    ok = ut.find(key, reinterpret_cast<uint8_t *>(&val), &err);
+	    ASSERT_TRUE(ok == true);
+	    ASSERT_TRUE(val == x);
+	}
+    }
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+struct TC_BloomFilter01 : public TestCase {
+    TC_BloomFilter01() : TestCase("TC_BloomFilter01") {;};
+    void run();
+};
+
+void
+TC_BloomFilter01::run()
+{
+    static const uint32_t N = 20000;
+
+    char path[] = "/tmp/dback_utests_bloom.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_TRUE(fd >= 0);
+    close(fd);
+
+    ErrorInfo err;
+    bool ok;
+    uint32_t x, fp;
+    uint8_t key[16];
+
+    BloomFilter f(16, N, 10);
+    ASSERT_TRUE(f.getKeySize() == 16);
+    ASSERT_TRUE(f.getNumHashes() == 7);
+    ASSERT_TRUE(f.getNumBlocks() == (N * 10 + 511) / 512);
+    ASSERT_TRUE(f.memoryBytes() == f.getNumBlocks() * BloomFilter::BLOCK_SIZE);
+    r2_hash_key(1, key);
+    ASSERT_TRUE(f.mayContain(key) == false);
+
+    // no key added is ever ruled out
+    for (x = 0; x < N; x++) {
+	r2_hash_key(x, key);
+	f.add(key);
+    }
+    ASSERT_TRUE(f.getNumKeys() == N);
+    for (x = 0; x < N; x++) {
+	r2_hash_key(x, key);
+	ASSERT_TRUE(f.mayContain(key) == true);
+    }
+
+    // and about 1% of the others pass
+    fp = 0;
+    for (x = N; x < 11 * N; x++) {
+	r2_hash_key(x, key);
+	if (f.mayContain(key))
+	    fp++;
+    }
+    ASSERT_TRUE(fp > 0);
+    ASSERT_TRUE(fp < 10 * N / 50);
+
+    // keys that are not a whole number of words
+    {
+	BloomFilter g(5, 100, 10);
+	uint8_t k5[5] = { 1, 2, 3, 4, 5 };
+	g.add(k5);
+	ASSERT_TRUE(g.mayContain(k5) == true);
+	ASSERT_TRUE(g.getNumBlocks() == 2);
+    }
+
+    // a filter of the same shape, filled aside and swapped in
+    {
+	BloomFilter g(&f);
+	ASSERT_TRUE(g.getKeySize() == 16);
+	ASSERT_TRUE(g.getNumHashes() == f.getNumHashes());
+	ASSERT_TRUE(g.getNumBlocks() == f.getNumBlocks());
+	ASSERT_TRUE(g.getNumKeys() == 0);
+	r2_hash_key(N, key);
+	g.add(key);
+	g.swap(&f);
+	ASSERT_TRUE(f.getNumKeys() == 1);
+	ASSERT_TRUE(f.mayContain(key) == true);
+	ASSERT_TRUE(g.getNumKeys() == N);
+	g.swap(&f);
+	ASSERT_TRUE(f.getNumKeys() == N);
+	for (x = 0; x < N; x++) {
+	    r2_hash_key(x, key);
+	    ASSERT_TRUE(f.mayContain(key) == true);
+	}
+    }
+
+    // a saved filter reads back the same
+    ok = f.save(path, &err);
+    ASSERT_TRUE(ok == true);
+    std::string tmp(path);
+    tmp += ".tmp";
+    ASSERT_TRUE(access(tmp.c_str(), F_OK) != 0);
+    {
+	BloomFilter g(16, N, 10);
+	ok = g.load(path, &err);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(g.getNumKeys() == N);
+	for (x = 0; x < 11 * N; x++) {
+	    r2_hash_key(x, key);
+	    ASSERT_TRUE(g.mayContain(key) == f.mayContain(key));
+	}
+    }
+
+    // into a filter of another shape it does not
+    {
+	BloomFilter g(16, 2 * N, 10);
+	err.clear();
+	ok = g.load(path, &err);
+	ASSERT_TRUE(ok == false);
+	ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+	ASSERT_TRUE(g.getNumKeys() == 0);
+    }
+    {
+	BloomFilter g(16, N, 12);
+	err.clear();
+	ok = g.load(path, &err);
+	ASSERT_TRUE(ok == false);
+	ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+    }
+
+    // a damaged file leaves the filter as it was
+    fd = open(path, O_RDWR);
+    ASSERT_TRUE(fd >= 0);
+    uint8_t byte;
+    off_t off = sizeof(BloomFileHeader) + 100;
+    ASSERT_TRUE(pread(fd, &byte, 1, off) == 1);
+    byte ^= 0x10;
+    ASSERT_TRUE(pwrite(fd, &byte, 1, off) == 1);
+    close(fd);
+    {
+	BloomFilter g(16, N, 10);
+	r2_hash_key(0, key);
+	g.add(key);
+	err.clear();
+	ok = g.load(path, &err);
+	ASSERT_TRUE(ok == false);
+	ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_IO);
+	ASSERT_TRUE(g.getNumKeys() == 1);
+	ASSERT_TRUE(g.mayContain(key) == true);
+    }
+
+    // and so does a short one
+    ASSERT_TRUE(truncate(path, sizeof(BloomFileHeader) + 64) == 0);
+    err.clear();
+    ok = f.load(path, &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_IO);
+    ASSERT_TRUE(f.getNumKeys() == N);
+
+    unlink(path);
+    err.clear();
+    ok = f.load(path, &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_IO);
+
+    f.clear();
+    ASSERT_TRUE(f.getNumKeys() == 0);
+    r2_hash_key(1, key);
+    ASSERT_TRUE(f.mayContain(key) == false);
+
+    this->setStatus(true);
+}
+
+struct TC_R2BTree50 : public TestCase {
+    TC_R2BTree50() : TestCase("TC_R2BTree50") {;};
+    void run();
+};
+
+void
+TC_R2BTree50::run()
+{
+    static const uint32_t N = 4000;
+
+    char path[] = "/tmp/dback_utests_wal.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_TRUE(fd >= 0);
+    close(fd);
+
+    R2BTreeParams params;
+    params.keySize = 16;
+    params.valSize = 8;
+    params.pageSize = 512;
+
+    R2UUIDKey k;
+    ErrorInfo err;
+    bool ok;
+    uint32_t x, i;
+    uint8_t key[16];
+    uint64_t val;
+
+    // the filter must be of the tree keys
+    {
+	MemPageStore ms(params.pageSize);
+	R2IndexHeader ih;
+	R2BTree::initIndexHeader(&ih, &params);
+	BloomFilter f(8, N, 10);
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &ms;
+	b.bloomFilter = &f;
+	ok = b.initTree(&err);
+	ASSERT_TRUE(ok == false);
+	ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+	b.bloomFilter = NULL;
+	err.clear();
+	ok = b.loadBloomFilter(&err);
+	ASSERT_TRUE(ok == false);
+	ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+    }
+
+    WriteAheadLog wal;
+    ok = wal.open(path, &err);
+    ASSERT_TRUE(ok == true);
+
+    MemPageStore ms(params.pageSize);
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, &params);
+    BloomFilter f(16, 2 * N, 10);
+    R2BTree b;
+    b.header = &ih;
+    b.ki = &k;
+    b.ps = &ms;
+    b.wal = &wal;
+    b.bloomFilter = &f;
+    b.interpolationSearch = true;
+    ok = b.initTree(&err);
+    ASSERT_TRUE(ok == true);
+
+    for (i = 0; i < N; i++) {
+	x = (i * 7919) % N;
+	r2_hash_key(x, key);
+	val = x * 3;
+	ok = b.insert(key, reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == true);
+    }
+    ASSERT_TRUE(f.getNumKeys() == N);
+
+    // a miss the filter rules out searches no page
+    uint32_t n_ruled_out = 0;
+    for (x = 0; x < 3 * N; x++) {
+	r2_hash_key(x, key);
+	uint64_t searches = b.getNumSearches();
+	err.clear();
+	ok = b.find(key, reinterpret_cast<uint8_t *>(&val), &err);
+	ASSERT_TRUE(ok == (x < N));
+	ASSERT_TRUE( ! ok || val == x * 3);
+	ASSERT_TRUE(ok || err.errorNum == ErrorInfo::ERR_KEY_NOT_FOUND);
+	if ( ! f.mayContain(key)) {
+	    ASSERT_TRUE(b.getNumSearches() == searches);
+	    n_ruled_out++;
+	}
+    }
+    ASSERT_TRUE(n_ruled_out > 2 * N * 9 / 10);
+
+    // erased keys stay in the filter until it is rebuilt
+    for (x = 0; x < N; x += 2) {
+	r2_hash_key(x, key);
+	ok = b.erase(key, &err);
+	ASSERT_TRUE(ok == true);
+    }
+    ASSERT_TRUE(f.getNumKeys() == N);
+    for (x = 0; x < N; x++) {
+	r2_hash_key(x, key);
+	ASSERT_TRUE(f.mayContain(key) == true);
+	err.clear();
+	ok = b.find(key, NULL, &err);
+	ASSERT_TRUE(ok == (x % 2 == 1));
+    }
+    ok = b.loadBloomFilter(&err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(f.getNumKeys() == N / 2);
+    for (x = 1; x < N; x += 2) {
+	r2_hash_key(x, key);
+	ASSERT_TRUE(f.mayContain(key) == true);
+    }
+
+    // batches add what they insert, and find around the filter
+    std::vector<uint8_t> bkeys, bvals;
+    for (i = 0; i < 600; i++) {
+	x = N + i;
+	r2_hash_key(x, key);
+	val = x * 3;
+	bkeys.insert(bkeys.end(), key, key + 16);
+	bvals.insert(bvals.end(), reinterpret_cast<uint8_t *>(&val),
+		     reinterpret_cast<uint8_t *>(&val) + 8);
+    }
+    uint32_t n_inserted;
+    ok = b.insertBatch(&bkeys[0], &bvals[0], 300, &n_inserted, &err);
+    ASSERT_TRUE(ok == true);
+    ASSERT_TRUE(n_inserted == 300);
+    ASSERT_TRUE(f.getNumKeys() == N / 2 + 300);
+
+    std::vector<uint8_t> fvals(600 * 8);
+    bool found[600];
+    ok = b.findBatch(&bkeys[0], &fvals[0], found, 600, &err);
+    ASSERT_TRUE(ok == true);
+    for (i = 0; i < 600; i++) {
+	ASSERT_TRUE(found[i] == (i < 300));
+	ASSERT_TRUE( ! found[i]
+		     || memcmp(&fvals[i * 8], &bvals[i * 8], 8) == 0);
+    }
+
+    r2_hash_key(3 * N, key);
+    err.clear();
+    ok = b.insertConcurrent(key, reinterpret_cast<uint8_t *>(&val), &err);
+    ASSERT_TRUE(ok == false);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+
+    // the filter is not logged, recover fills it from the tree
+    ok = wal.commit(wal.getAppendLsn(), &err);
+    ASSERT_TRUE(ok == true);
+    ok = wal.close(&err);
+    ASSERT_TRUE(ok == true);
+    {
+	WriteAheadLog wal2;
+	ok = wal2.open(path, &err);
+	ASSERT_TRUE(ok == true);
+
+	MemPageStore ms2(params.pageSize);
+	R2IndexHeader ih2;
+	R2BTree::initIndexHeader(&ih2, &params);
+	BloomFilter f2(16, 2 * N, 10);
+	HashIndex h2(16, 8);
+	R2BTree b2;
+	b2.header = &ih2;
+	b2.ki = &k;
+	b2.ps = &ms2;
+	b2.wal = &wal2;
+	b2.bloomFilter = &f2;
+	b2.hashIndex = &h2;
+	ok = b2.recover(&err);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(f2.getNumKeys() == N / 2 + 300);
+	ASSERT_TRUE(h2.size() == N / 2 + 300);
+
+	// and works in front of the hash index
+	for (x = 0; x < 2 * N; x++) {
+	    r2_hash_key(x, key);
+	    err.clear();
+	    ok = b2.find(key, reinterpret_cast<uint8_t *>(&val), &err);
+	    ASSERT_TRUE(ok == ((x < N && x % 2 == 1)
+			       || (x >= N && x < N + 300)));
+	    ASSERT_TRUE( ! ok || val == x * 3);
+	}
+	ok = b2.findBatch(&bkeys[0], &fvals[0], found, 600, &err);
+	ASSERT_TRUE(ok == true);
+	for (i = 0; i < 600; i++)
+	    ASSERT_TRUE(found[i] == (i < 300));
+	ok = wal2.close(&err);
+	ASSERT_TRUE(ok == true);
+    }
+    unlink(path);
+
+    // bulkLoad rebuilds the filter
+    {
+	R2BTreeParams ip;
+	ip.keySize = 4;
+	ip.valSize = 4;
+	ip.pageSize = 512;
+	R2IntKey ik;
+	MemPageStore ims(ip.pageSize);
+	R2IndexHeader iih;
+	R2BTree::initIndexHeader(&iih, &ip);
+	BloomFilter f4(4, N, 10);
+	uint32_t ikey = 12345;
+	f4.add(reinterpret_cast<uint8_t *>(&ikey));
+	R2BTree ib;
+	ib.header = &iih;
+	ib.ki = &ik;
+	ib.ps = &ims;
+	ib.bloomFilter = &f4;
+	R2IntSource src(0, 2, N);
+	ok = ib.bulkLoad(&src, 0.8, &err);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(f4.getNumKeys() == N);
+	uint32_t ival;
+	for (ikey = 0; ikey < 2 * N; ikey++) {
+	    err.clear();
+	    ok = ib.find(reinterpret_cast<uint8_t *>(&ikey),
+			 reinterpret_cast<uint8_t *>(&ival), &err);
+	    ASSERT_TRUE(ok == (ikey % 2 == 0));
+	    ASSERT_TRUE( ! ok || ival == ikey + 1);
+	}
+
+	// a failed load must not take the old keys out of the filter
+	R2IntSource down(2 * N + 1, (uint32_t)-1, 10);
+	err.clear();
+	ok = ib.bulkLoad(&down, 0.8, &err);
+	ASSERT_TRUE(ok == false);
+	ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+	ASSERT_TRUE(f4.getNumKeys() == N);
+	for (ikey = 0; ikey < 2 * N; ikey += 2) {
+	    ok = ib.find(reinterpret_cast<uint8_t *>(&ikey),
+			 reinterpret_cast<uint8_t *>(&ival), &err);
+	    ASSERT_TRUE(ok == true);
+	    ASSERT_TRUE(ival == ikey + 1);
+	}
+
+	ok = ib.initTree(&err);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(f4.getNumKeys() == 0);
+    }
+
+    // nor may a read that fails at any point of a load
+    {
+	R2BTreeParams ip;
+	ip.keySize = 4;
+	ip.valSize = 4;
+	ip.pageSize = 512;
+	R2IntKey ik;
+	R2FailingStore fs(ip.pageSize);
+	R2IndexHeader iih;
+	R2BTree::initIndexHeader(&iih, &ip);
+	BloomFilter f4(4, N, 10);
+	R2BTree ib;
+	ib.header = &iih;
+	ib.ki = &ik;
+	ib.ps = &fs;
+	ib.bloomFilter = &f4;
+	R2IntSource old_src(0, 2, N / 4);
+	ok = ib.bulkLoad(&old_src, 0.8, &err);
+	ASSERT_TRUE(ok == true);
+	uint32_t root = iih.rootPageNum;
+
+	uint32_t ikey, ival;
+	int pins;
+	for (pins = 0; ; pins++) {
+	    R2IntSource src(1, 2, N / 4);
+	    fs.pinsLeft = pins;
+	    err.clear();
+	    ok = ib.bulkLoad(&src, 0.8, &err);
+	    fs.pinsLeft = -1;
+	    if (ok)
+		break;
+	    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_IO);
+	    ASSERT_TRUE(iih.rootPageNum == root);
+	    ASSERT_TRUE(f4.getNumKeys() == N / 4);
+	    for (ikey = 0; ikey < N / 2; ikey += 2) {
+		ok = ib.find(reinterpret_cast<uint8_t *>(&ikey),
+			     reinterpret_cast<uint8_t *>(&ival), &err);
+		ASSERT_TRUE(ok == true);
+		ASSERT_TRUE(ival == ikey + 1);
+	    }
+	}
+
+	ASSERT_TRUE(pins >= (int)r2_count_pages(&ib, iih.rootPageNum));
+	ASSERT_TRUE(f4.getNumKeys() == N / 4);
+	for (ikey = 1; ikey < N / 2; ikey += 2) {
+	    ok = ib.find(reinterpret_cast<uint8_t *>(&ikey),
+			 reinterpret_cast<uint8_t *>(&ival), &err);
+	    ASSERT_TRUE(ok == true);
+	    ASSERT_TRUE(ival == ikey + 1);
+	}
+    }
+
+    // R2BTreeT passes its finds and inserts to a tree with a filter
+    {
+	typedef R2BTreeT<R2UUIDKeyPolicy, 512> UUIDTree;
+	R2IndexHeader uh;
+	UUIDTree::initIndexHeader(&uh);
+	MemPageStore ups(512);
+	BloomFilter uf(16, N, 10);
+	UUIDTree ut;
+	ok = ut.open(&uh, &ups, &err);
+	ASSERT_TRUE(ok == true);
+	ok = ut.initTree(&err);
+	ASSERT_TRUE(ok == true);
+	ut.getTree()->bloomFilter = &uf;
+	for (x = 0; x < N; x++) {
+	    r2_hash_key(x, key);
+	    val = x;
+	    ok = ut.insert(key, reinterpret_cast<uint8_t *>(&val), &err);
+	    ASSERT_TRUE(ok == true);
+	}
+	ASSERT_TRUE(uf.getNumKeys() == N);
+	for (x = 0; x < 2 * N; x++) {
+	    r2_hash_key(x, key);
+	    err.clear();
+	    ok = ut.find(key, reinterpret_cast<uint8_t *>(&val), &err);
+	    ASSERT_TRUE(ok == (x < N));
+	    ASSERT_TRUE( ! ok || val == x);
+	}
+    }
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+/*
+ * Check every subtree count and sum under pn, setting n and sum to
+ * those of pn.
+ */
+static bool
+r2_check_counts(R2BTree *b, uint32_t pn, uint64_t *n, uint64_t *sum)
+{
+    PagePin pin;
+    R2PageAccess ac;
+    ErrorInfo err;
+    if ( ! b->pinPage(&pin, &ac, pn, &err))
+	return false;
+
+    *n = 0;
+    *sum = 0;
+    for (uint32_t i = 0; i < ac.header->numKeys; i++) {
+	uint64_t cn = 1, cs = 0;
+	if (ac.header->pageType == PageTypeLeaf) {
+	    if (b->header->subtreeSums)
+		cs = b->sumField(b->valAt(&ac, i));
+	}
+	else {
+	    if ( ! r2_check_counts(b, b->getChildPageNum(&ac, i), &cn, &cs))
+		return false;
+	    if (b->getChildCount(&ac, i) != cn)
+		return false;
+	    if (b->header->subtreeSums && b->getChildSum(&ac, i) != cs)
+		return false;
+	}
+	*n += cn;
+	*sum += cs;
+    }
+    return true;
+}
+
+/*
+ * Check rank, select and count against a model of keys and block
+ * sizes, keys up to 2 * n.
+ */
+static bool
+r2_check_rank(R2BTree *b, std::map<uint32_t, uint64_t> *model, uint32_t n)
+{
+    ErrorInfo err;
+    uint64_t r, sum, m;
+    uint32_t key, got;
+    bool sums = b->header->subtreeSums != 0;
+    uint8_t val[16];
+
+    uint64_t root_n, root_sum;
+    if ( ! r2_check_counts(b, b->header->rootPageNum, &root_n, &root_sum)
+	|| root_n != model->size())
+	return false;
+
+    // rank of every key, in the tree or not
+    std::map<uint32_t, uint64_t>::iterator iter = model->begin();
+    uint64_t below = 0, below_sum = 0;
+    for (key = 0; key < 2 * n; key++) {
+	if ( ! b->rank(reinterpret_cast<uint8_t *>(&key), &r,
+		       sums ? &sum : NULL, &err))
+	    return false;
+	if (r != below || (sums && sum != below_sum))
+	    return false;
+	if (iter != model->end() && iter->first == key) {
+	    below++;
+	    below_sum += iter->second;
+	    iter++;
+	}
+    }
+
+    // select of every position, and one past the end
+    r = 0;
+    for (iter = model->begin(); iter != model->end(); iter++, r++) {
+	if ( ! b->select(r, reinterpret_cast<uint8_t *>(&got), val, &err))
+	    return false;
+	memcpy(&m, val + 8, sizeof(m));
+	if (got != iter->first || m != iter->second)
+	    return false;
+    }
+    err.clear();
+    if (b->select(r, reinterpret_cast<uint8_t *>(&got), NULL, &err)
+	|| err.errorNum != ErrorInfo::ERR_KEY_NOT_FOUND)
+	return false;
+
+    // a few ranges, open ends included
+    for (uint32_t lo = 0; lo < 2 * n; lo += n / 3 + 1) {
+	for (uint32_t hi = 0; hi < 2 * n + n / 2; hi += n / 4 + 1) {
+	    uint64_t want = 0, want_sum = 0;
+	    for (iter = model->lower_bound(lo);
+		 iter != model->end() && iter->first < hi; iter++) {
+		want++;
+		want_sum += iter->second;
+	    }
+	    if ( ! b->count(reinterpret_cast<uint8_t *>(&lo),
+			    reinterpret_cast<uint8_t *>(&hi), &r,
+			    sums ? &sum : NULL, &err))
+		return false;
+	    if (r != want || (sums && sum != want_sum))
+		return false;
+	}
+    }
+    if ( ! b->count(NULL, NULL, &r, sums ? &sum : NULL, &err)
+	|| r != model->size() || (sums && sum != root_sum))
+	return false;
+    key = n;
+    iter = model->lower_bound(key);
+    if ( ! b->count(reinterpret_cast<uint8_t *>(&key), NULL, &r, NULL, &err)
+	|| r != (uint64_t)std::distance(iter, model->end()))
+	return false;
+
+    return true;
+}
+
+struct TC_R2BTree51 : public TestCase {
+    TC_R2BTree51() : TestCase("TC_R2BTree51") {;};
+    void run();
+};
+
+void
+TC_R2BTree51::run()
+{
+    static const uint32_t N = 3000;
+
+    char path[] = "/tmp/dback_utests_wal.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_TRUE(fd >= 0);
+    close(fd);
+
+    R2BTreeParams params;
+    params.keySize = 4;
+    params.valSize = 16;
+    params.pageSize = 512;
+    params.subtreeCounts = true;
+    params.subtreeSums = true;
+    params.sumOffset = 8;
+
+    R2IntKey k;
+    ErrorInfo err;
+    bool ok;
+    size_t count;
+    uint32_t key, i;
+    uint64_t n, sum;
+    uint8_t val[16];
+
+    // non-leaf values grow by the count and the sum, the field must fit
+    {
+	R2IndexHeader ih;
+	ok = R2BTree::initIndexHeader(&ih, &params);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(ih.valSize[PageTypeNonLeaf] == 20);
+	R2BTreeParams p = params;
+	p.subtreeMax = true;
+	ok = R2BTree::initIndexHeader(&ih, &p);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(ih.valSize[PageTypeNonLeaf] == 28);
+
+	R2BTreeParams bad = params;
+	bad.sumOffset = 9;
+	ok = R2BTree::initIndexHeader(&ih, &bad);
+	ASSERT_TRUE(ok == false);
+	bad = params;
+	bad.subtreeCounts = false;
+	ok = R2BTree::initIndexHeader(&ih, &bad);
+	ASSERT_TRUE(ok == false);
+	bad = params;
+	bad.varValues = true;
+	ok = R2BTree::initIndexHeader(&ih, &bad);
+	ASSERT_TRUE(ok == false);
+	bad.subtreeSums = false;
+	ok = R2BTree::initIndexHeader(&ih, &bad);
+	ASSERT_TRUE(ok == true);
+
+	// the header must agree with itself
+	MemPageStore ms(params.pageSize);
+	R2BTree::initIndexHeader(&ih, &params);
+	ih.subtreeSums = 0;
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &ms;
+	ok = b.initTree(&err);
+	ASSERT_TRUE(ok == false);
+	ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+
+	// only trees made for it
+	R2BTreeParams plain = params;
+	plain.subtreeCounts = false;
+	plain.subtreeSums = false;
+	R2BTree::initIndexHeader(&ih, &plain);
+	ok = b.initTree(&err);
+	ASSERT_TRUE(ok == true);
+	key = 1;
+	err.clear();
+	ok = b.rank(reinterpret_cast<uint8_t *>(&key), &n, NULL, &err);
+	ASSERT_TRUE(ok == false);
+	ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+	err.clear();
+	ok = b.select(0, reinterpret_cast<uint8_t *>(&key), NULL, &err);
+	ASSERT_TRUE(ok == false);
+	ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+
+	// and sums only from trees that keep them
+	p = params;
+	p.subtreeSums = false;
+	R2BTree::initIndexHeader(&ih, &p);
+	ok = b.initTree(&err);
+	ASSERT_TRUE(ok == true);
+	err.clear();
+	ok = b.count(NULL, NULL, &n, &sum, &err);
+	ASSERT_TRUE(ok == false);
+	ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+	ok = b.count(NULL, NULL, &n, NULL, &err);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(n == 0);
+    }
+
+    // counts alone, with sums, and next to maxima
+    for (uint32_t variant = 0; variant < 3; variant++) {
+	params.subtreeSums = variant > 0;
+	params.subtreeMax = variant == 2;
+	params.maxOffset = 8;
+	params.nonLeafLayout = variant == 2 ? R2LayoutIndexed : R2LayoutSorted;
+
+	WriteAheadLog wal;
+	ok = wal.open(path, &err);
+	ASSERT_TRUE(ok == true);
+
+	MemPageStore ms(params.pageSize);
+	R2IndexHeader ih;
+	ok = R2BTree::initIndexHeader(&ih, &params);
+	ASSERT_TRUE(ok == true);
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &ms;
+	b.wal = &wal;
+	ok = b.initTree(&err);
+	ASSERT_TRUE(ok == true);
+
+	std::map<uint32_t, uint64_t> model;
+	ok = r2_check_rank(&b, &model, 10);
+	ASSERT_TRUE(ok == true);
+
+	// even keys only, so that odd ones are between
+	for (i = 0; i < N; i++) {
+	    key = 2 * ((i * 7919) % N);
+	    r2_block_val(key, r2_block_size(key), val);
+	    ok = b.insert(reinterpret_cast<uint8_t *>(&key), val, &err);
+	    ASSERT_TRUE(ok == true);
+	    model[key] = r2_block_size(key);
+	}
+
+	// a failed insert counts nothing
+	key = 6;
+	ok = b.insert(reinterpret_cast<uint8_t *>(&key), val, &err);
+	ASSERT_TRUE(ok == false);
+
+	ok = r2_check_tree(&b, &count);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == N);
+	ok = r2_check_rank(&b, &model, N);
+	ASSERT_TRUE(ok == true);
+	if (variant == 2) {
+	    uint64_t m;
+	    ok = r2_check_max(&b, ih.rootPageNum, &m);
+	    ASSERT_TRUE(ok == true);
+	    ASSERT_TRUE(r2_check_largest(&b, &model, 25) == true);
+	}
+
+	// an insert that splits nothing logs records, not page images
+	key = 2 * N + 1;
+	uint64_t lsn = wal.getAppendLsn();
+	r2_block_val(key, 7, val);
+	ok = b.insert(reinterpret_cast<uint8_t *>(&key), val, &err);
+	ASSERT_TRUE(ok == true);
+	model[key] = 7;
+	ASSERT_TRUE(wal.getAppendLsn() - lsn < params.pageSize);
+
+	// erases, with the merges and moves they cause
+	for (key = 0; key < 2 * N; key += 6) {
+	    ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+	    ASSERT_TRUE(ok == true);
+	    model.erase(key);
+	}
+	for (key = N / 2; key < N; key += 2) {
+	    if (model.count(key) == 0)
+		continue;
+	    ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+	    ASSERT_TRUE(ok == true);
+	    model.erase(key);
+	}
+	key = 0;
+	ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+	ASSERT_TRUE(ok == false);
+	ok = r2_check_tree(&b, &count);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == model.size());
+	ok = r2_check_rank(&b, &model, N);
+	ASSERT_TRUE(ok == true);
+
+	// batches, with keys already there
+	std::vector<uint8_t> bkeys, bvals;
+	std::map<uint32_t, uint64_t>::iterator in_tree = model.begin();
+	for (i = 0; i < 600; i++) {
+	    key = i < 100 ? (in_tree++)->first : 2 * (N + 1 + (i * 13) % 500) + 1;
+	    uint64_t size = i < 100 ? UINT64_MAX : r2_block_size(key);
+	    r2_block_val(key, size, val);
+	    bkeys.insert(bkeys.end(), reinterpret_cast<uint8_t *>(&key),
+			 reinterpret_cast<uint8_t *>(&key) + 4);
+	    bvals.insert(bvals.end(), val, val + 16);
+	    if (i >= 100)
+		model[key] = size;
+	}
+	uint32_t n_inserted;
+	ok = b.insertBatch(&bkeys[0], &bvals[0], 600, &n_inserted, &err);
+	ASSERT_TRUE(ok == false);
+	ASSERT_TRUE(n_inserted == 500);
+	ok = r2_check_rank(&b, &model, 2 * N);
+	ASSERT_TRUE(ok == true);
+	if (variant == 2) {
+	    ok = r2_check_index(&b, ih.rootPageNum);
+	    ASSERT_TRUE(ok == true);
+	}
+
+	key = 1;
+	err.clear();
+	ok = b.insertConcurrent(reinterpret_cast<uint8_t *>(&key), val, &err);
+	ASSERT_TRUE(ok == false);
+	ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+
+	// the counts are replayed from records and page images
+	uint32_t root = ih.rootPageNum;
+	ok = wal.commit(wal.getAppendLsn(), &err);
+	ASSERT_TRUE(ok == true);
+	ok = wal.close(&err);
+	ASSERT_TRUE(ok == true);
+	{
+	    WriteAheadLog wal2;
+	    ok = wal2.open(path, &err);
+	    ASSERT_TRUE(ok == true);
+
+	    MemPageStore ms2(params.pageSize);
+	    R2IndexHeader ih2;
+	    R2BTree::initIndexHeader(&ih2, &params);
+	    R2BTree b2;
+	    b2.header = &ih2;
+	    b2.ki = &k;
+	    b2.ps = &ms2;
+	    b2.wal = &wal2;
+	    ok = b2.recover(&err);
+	    ASSERT_TRUE(ok == true);
+	    ASSERT_TRUE(ih2.rootPageNum == root);
+	    ok = r2_check_rank(&b2, &model, 2 * N);
+	    ASSERT_TRUE(ok == true);
+	    ok = wal2.close(&err);
+	    ASSERT_TRUE(ok == true);
+	}
+	unlink(path);
+    }
+
+    // copy-on-write trees count the pages they copy
+    {
+	MemPageStore ms(params.pageSize);
+	R2IndexHeader ih;
+	R2BTree::initIndexHeader(&ih, &params);
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &ms;
+	b.copyOnWrite = true;
+	ok = b.initTree(&err);
+	ASSERT_TRUE(ok == true);
+
+	std::map<uint32_t, uint64_t> model;
+	for (i = 0; i < N; i++) {
+	    key = (i * 7919) % N;
+	    r2_block_val(key, r2_block_size(key), val);
+	    ok = b.insert(reinterpret_cast<uint8_t *>(&key), val, &err);
+	    ASSERT_TRUE(ok == true);
+	    model[key] = r2_block_size(key);
+	}
+	R2Snapshot snap;
+	ok = b.takeSnapshot(&snap, &err);
+	ASSERT_TRUE(ok == true);
+	for (key = 0; key < N; key += 2) {
+	    ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+	    ASSERT_TRUE(ok == true);
+	    model.erase(key);
+	}
+	ok = r2_check_rank(&b, &model, N);
+	ASSERT_TRUE(ok == true);
+	ok = r2_check_counts(&b, snap.rootPageNum, &n, &sum);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(n == N);
+	b.releaseSnapshot(&snap);
+    }
+
+    // bulkLoad computes the counts once the tree is built
+    {
+	MemPageStore ms(params.pageSize);
+	R2IndexHeader ih;
+	R2BTree::initIndexHeader(&ih, &params);
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &ms;
+	R2BlockSource src(N);
+	ok = b.bulkLoad(&src, 0.8, &err);
+	ASSERT_TRUE(ok == true);
+
+	std::map<uint32_t, uint64_t> model;
+	for (key = 0; key < 2 * N; key += 2)
+	    model[key] = r2_block_size(key);
+	ok = r2_check_rank(&b, &model, N);
+	ASSERT_TRUE(ok == true);
+    }
+
+    // and before the header names it, so that a read that fails on
+    // the way leaves the old tree with its counts and maxima
+    {
+	R2FailingStore fs(params.pageSize);
+	R2IndexHeader ih;
+	R2BTree::initIndexHeader(&ih, &params);
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &fs;
+	R2BlockSource old_src(N / 10);
+	ok = b.bulkLoad(&old_src, 0.8, &err);
+	ASSERT_TRUE(ok == true);
+	uint32_t root = ih.rootPageNum;
+
+	std::map<uint32_t, uint64_t> model;
+	for (key = 0; key < N / 5; key += 2)
+	    model[key] = r2_block_size(key);
+
+	uint64_t m;
+	int pins;
+	for (pins = 0; ; pins++) {
+	    R2BlockSource src(N / 10);
+	    src.nextKey = 1;
+	    fs.pinsLeft = pins;
+	    err.clear();
+	    ok = b.bulkLoad(&src, 0.8, &err);
+	    fs.pinsLeft = -1;
+	    if (ok)
+		break;
+	    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_IO);
+	    ASSERT_TRUE(ih.rootPageNum == root);
+	    ok = r2_check_rank(&b, &model, N / 10);
+	    ASSERT_TRUE(ok == true);
+	    ok = r2_check_max(&b, ih.rootPageNum, &m);
+	    ASSERT_TRUE(ok == true);
+	}
+	ASSERT_TRUE(pins >= (int)r2_count_pages(&b, ih.rootPageNum));
+
+	model.clear();
+	for (key = 1; key < N / 5; key += 2)
+	    model[key] = r2_block_size(key);
+	ok = r2_check_rank(&b, &model, N / 10);
+	ASSERT_TRUE(ok == true);
+	ok = r2_check_max(&b, ih.rootPageNum, &m);
+	ASSERT_TRUE(ok == true);
+    }
+
+    // R2BTreeT does not keep counts
+    {
+	typedef R2BTreeT<R2IntKeyPolicy, 512> IntTree;
+	R2IndexHeader ih;
+	IntTree::initIndexHeader(&ih);
+	ih.subtreeCounts = 1;
+	MemPageStore ms(512);
+	IntTree t;
+	ok = t.open(&ih, &ms, &err);
+	ASSERT_TRUE(ok == false);
+	ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+    }
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+struct TC_R2BTree52 : public TestCase {
+    TC_R2BTree52() : TestCase("TC_R2BTree52") {;};
+    void run();
+};
+
+void
+TC_R2BTree52::run()
+{
+    static const uint32_t N = 20000;
+
+    R2BTreeParams params;
+    params.keySize = 4;
+    params.valSize = 4;
+    params.pageSize = 512;
+
+    R2IntKey k;
+    ErrorInfo err;
+    bool ok;
+    size_t count;
+    uint32_t key, val, i, n_inserted;
+    uint64_t n, sum;
+
+    // append split pages on the right edge underflow, one at a time or
+    // in batches of one, with and without counts
+    for (uint32_t variant = 0; variant < 3; variant++) {
+	params.subtreeCounts = variant == 2;
+
+	MemPageStore ms(params.pageSize);
+	R2IndexHeader ih;
+	ok = R2BTree::initIndexHeader(&ih, &params);
+	ASSERT_TRUE(ok == true);
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &ms;
+	b.appendSplit = true;
+	ok = b.initTree(&err);
+	ASSERT_TRUE(ok == true);
+
+	// ascending keys, with erases in between
+	std::set<uint32_t> model;
+	for (key = 0; key < N; key++) {
+	    val = key * 3;
+	    if (variant == 1)
+		ok = b.insertBatch(reinterpret_cast<uint8_t *>(&key),
+				   reinterpret_cast<uint8_t *>(&val), 1,
+				   &n_inserted, &err);
+	    else
+		ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+			      reinterpret_cast<uint8_t *>(&val), &err);
+	    ASSERT_TRUE(ok == true);
+	    model.insert(key);
+
+	    // the key just added, alone in its leaf after a split
+	    if (key % 2 == 1) {
+		ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+		ASSERT_TRUE(ok == true);
+		model.erase(key);
+	    }
+	    else if (key % 3 == 0) {
+		uint32_t old = (key * 7919) % (key + 1);
+		if (model.erase(old) == 1) {
+		    ok = b.erase(reinterpret_cast<uint8_t *>(&old), &err);
+		    ASSERT_TRUE(ok == true);
+		}
+	    }
+	}
+	ok = r2_check_append(&b, &count);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == model.size());
+
+	// then from the end, emptying the right edge page by page
+	while (model.size() > N / 4) {
+	    key = *model.rbegin();
+	    ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+	    ASSERT_TRUE(ok == true);
+	    model.erase(key);
+	}
+	ok = r2_check_append(&b, &count);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == model.size());
+	if (variant == 2) {
+	    ok = r2_check_counts(&b, ih.rootPageNum, &n, &sum);
+	    ASSERT_TRUE(ok == true);
+	    ASSERT_TRUE(n == model.size());
+	}
+
+	for (i = 0; i < N; i += 7) {
+	    key = i;
+	    ok = b.find(reinterpret_cast<uint8_t *>(&key),
+			reinterpret_cast<uint8_t *>(&val), &err);
+	    ASSERT_TRUE(ok == (model.count(key) == 1));
+	    if (ok)
+		ASSERT_TRUE(val == key * 3);
+	}
+    }
+
+    this->setStatus(true);
+}
+
+}
+
+/****************************************************/
+/****************************************************/
+/* page store tests                                 */
+/****************************************************/
+/****************************************************/
+
+namespace dback {
+
+struct TC_BufferPool01 : public TestCase {
+    TC_BufferPool01() : TestCase("TC_BufferPool01") {;};
+    void run();
+};
+
+void
+TC_BufferPool01::run()
+{
+    char path[] = "/tmp/dback_utests_bp.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_TRUE(fd >= 0);
+    close(fd);
+
+    const uint32_t psize = 64;
+    BufferPool bp(psize, 0);
+    ASSERT_TRUE(bp.getNumFrames() == 8);
+
+    ErrorInfo err;
+    bool ok;
+    uint8_t *buf;
+    uint32_t pn[9];
+
+    err.clear();
+    buf = bp.allocPage(&pn[0], &err);
+    ASSERT_TRUE(buf == NULL);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+
+    err.clear();
+    ok = bp.open(path, &err);
+    ASSERT_TRUE(ok == true);
+
+    // fill every frame with a pinned page
+    for (int i = 0; i < 8; i++) {
+	err.clear();
+	buf = bp.allocPage(&pn[i], &err);
+	ASSERT_TRUE(buf != NULL);
+	ASSERT_TRUE(pn[i] == (uint32_t)i + 1);
+	memset(buf, i + 1, psize);
+    }
+
+    err.clear();
+    buf = bp.allocPage(&pn[8], &err);
+    ASSERT_TRUE(buf == NULL);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_NO_SPACE);
+
+    err.clear();
+    buf = bp.getPage(0, &err);
+    ASSERT_TRUE(buf == NULL);
+    ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+
+    for (int i = 0; i < 8; i++)
+	bp.releasePage(pn[i], true);
+
+    // a second set of pages pushes the first set out
+    for (int i = 0; i < 8; i++) {
+	uint32_t n;
+	err.clear();
+	buf = bp.allocPage(&n, &err);
+	ASSERT_TRUE(buf != NULL);
+	memset(buf, 0x80 + i, psize);
+	bp.releasePage(n, true);
+    }
+    ASSERT_TRUE(bp.getNumEvictions() == 8);
+    ASSERT_TRUE(bp.getNumWrites() == 8);
+
+    for (int i = 0; i < 8; i++) {
+	err.clear();
+	buf = bp.getPage(pn[i], &err);
+	ASSERT_TRUE(buf != NULL);
+	ASSERT_TRUE(buf[0] == i + 1 && buf[psize - 1] == i + 1);
+	bp.releasePage(pn[i], false);
+    }
+    ASSERT_TRUE(bp.getNumMisses() == 8);
+
+    err.clear();
+    buf = bp.getPage(pn[3], &err);
+    ASSERT_TRUE(buf != NULL);
+    bp.releasePage(pn[3], false);
+    ASSERT_TRUE(bp.getNumHits() == 1);
+    ASSERT_TRUE(bp.getHitRatio() > 0.1 && bp.getHitRatio() < 0.12);
+
+    bp.resetStats();
+    ASSERT_TRUE(bp.getHitRatio() == 0.0);
+
+    // freed page numbers are reused
+    bp.freePage(pn[2]);
+    uint32_t n;
+    err.clear();
+    buf = bp.allocPage(&n, &err);
+    ASSERT_TRUE(buf != NULL);
+    ASSERT_TRUE(n == pn[2]);
+
+    err.clear();
+    ok = bp.close(&err);
+    ASSERT_TRUE(ok == false);
+    bp.releasePage(n, true);
+
+    err.clear();
+    ok = bp.close(&err);
+    ASSERT_TRUE(ok == true);
+
+    unlink(path);
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+struct TC_BufferPool02 : public TestCase {
+    TC_BufferPool02() : TestCase("TC_BufferPool02") {;};
+    void run();
+};
+
+void
+TC_BufferPool02::run()
+{
+    char path[] = "/tmp/dback_utests_bp.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_TRUE(fd >= 0);
+    close(fd);
+
+    R2BTreeParams params;
+    params.keySize = 4;
+    params.valSize = 4;
+    params.pageSize = 72;
+
+    R2IntKey k;
+    R2IndexHeader ih;
+    R2BTree::initIndexHeader(&ih, &params);
+
+    ErrorInfo err;
+    bool ok;
+    size_t count;
+    uint32_t key, val;
+    const uint32_t n = 2000;
+
+    {
+	BufferPool bp(params.pageSize, 8 * params.pageSize);
+	err.clear();
+	ok = bp.open(path, &err);
+	ASSERT_TRUE(ok == true);
+
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &bp;
+
+	err.clear();
+	ok = b.initTree(&err);
+	ASSERT_TRUE(ok == true);
+
+	for (uint32_t i = 0; i < n; i++) {
+	    key = (i * 7919) % n;
+	    val = key + 1;
+	    err.clear();
+	    ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+			  reinterpret_cast<uint8_t *>(&val), &err);
+	    ASSERT_TRUE(ok == true);
+	}
+
+	for (key = 0; key < n; key += 3) {
+	    err.clear();
+	    ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+	    ASSERT_TRUE(ok == true);
+	}
+
+	ok = r2_check_tree(&b, &count);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == n - (n + 2) / 3);
+	ASSERT_TRUE(bp.getNumEvictions() > 0);
+	ASSERT_TRUE(bp.getHitRatio() > 0.0);
+
+	err.clear();
+	ok = bp.close(&err);
+	ASSERT_TRUE(ok == true);
+    }
+
+    {
+	BufferPool bp(params.pageSize, 8 * params.pageSize);
+	err.clear();
+	ok = bp.open(path, &err);
+	ASSERT_TRUE(ok == true);
+
+	R2BTree b;
+	b.header = &ih;
+	b.ki = &k;
+	b.ps = &bp;
+
+	for (key = 0; key < n; key++) {
+	    err.clear();
+	    val = 0;
+	    ok = b.find(reinterpret_cast<uint8_t *>(&key),
+			reinterpret_cast<uint8_t *>(&val), &err);
+	    ASSERT_TRUE(ok == (key % 3 != 0));
+	    if (ok)
+		ASSERT_TRUE(val == key + 1);
+	}
+    }
+
+    unlink(path);
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+struct TC_MMapPageStore01 : public TestCase {
+    TC_MMapPageStore01() : TestCase("TC_MMapPageStore01") {;};
+    void run();
+};
+
+void
+TC_MMapPageStore01::run()
+{
+    char path[] = "/tmp/dback_utests_mm.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_TRUE(fd >= 0);
+    close(fd);
+
+    ErrorInfo err;
+    bool ok;
+    size_t count;
+    uint32_t key, val;
+    const uint32_t n = 3000;
+    R2IntKey k;
+
+    R2BTreeParams params;
+    params.keySize = 4;
+    params.valSize = 4;
+    params.pageSize = 128;
+
+    {
+	MMapPageStore ms(1024 * 1024);
+
+	// empty file is not an index
+	err.clear();
+	ok = ms.open(path, &err);
+	ASSERT_TRUE(ok == false);
+
+	err.clear();
+	ok = ms.create(path, params.pageSize, &err);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(ms.getPageSize() == params.pageSize);
+	ASSERT_TRUE(ms.getIndexHeaderSize() >= sizeof(R2IndexHeader));
+
+	R2IndexHeader *ih = reinterpret_cast<R2IndexHeader *>(ms.getIndexHeader());
+	R2BTree::initIndexHeader(ih, &params);
+
+	R2BTree b;
+	b.header = ih;
+	b.ki = &k;
+	b.ps = &ms;
+
+	err.clear();
+	ok = b.initTree(&err);
+	ASSERT_TRUE(ok == true);
+
+	ok = ms.setAccessHint(MMapPageStore::AccessSequential, &err);
+	ASSERT_TRUE(ok == true);
+
+	for (key = 0; key < n; key++) {
+	    val = key * 2;
+	    err.clear();
+	    ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+			  reinterpret_cast<uint8_t *>(&val), &err);
+	    ASSERT_TRUE(ok == true);
+	}
+
+	ok = ms.flush(false, &err);
+	ASSERT_TRUE(ok == true);
+
+	size_t before = ms.numPages();
+	for (key = 0; key < n; key += 2) {
+	    err.clear();
+	    ok = b.erase(reinterpret_cast<uint8_t *>(&key), &err);
+	    ASSERT_TRUE(ok == true);
+	}
+	ASSERT_TRUE(ms.numPages() < before);
+
+	ok = r2_check_tree(&b, &count);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == n / 2);
+
+	err.clear();
+	ok = ms.close(&err);
+	ASSERT_TRUE(ok == true);
+    }
+
+    {
+	MMapPageStore ms(1024 * 1024);
+
+	err.clear();
+	ok = ms.open(path, &err);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(ms.getPageSize() == params.pageSize);
+
+	ok = ms.setAccessHint(MMapPageStore::AccessRandom, &err);
+	ASSERT_TRUE(ok == true);
+
+	R2BTree b;
+	b.header = reinterpret_cast<R2IndexHeader *>(ms.getIndexHeader());
+	b.ki = &k;
+	b.ps = &ms;
+
+	for (key = 0; key < n; key++) {
+	    val = 0;
+	    err.clear();
+	    ok = b.find(reinterpret_cast<uint8_t *>(&key),
+			reinterpret_cast<uint8_t *>(&val), &err);
+	    ASSERT_TRUE(ok == ((key & 1) == 1));
+	    if (ok)
+		ASSERT_TRUE(val == key * 2);
+	}
+
+	// put the erased keys back
+	size_t used = ms.numPages();
+	for (key = 0; key < n; key += 2) {
+	    val = key * 2;
+	    err.clear();
+	    ok = b.insert(reinterpret_cast<uint8_t *>(&key),
+			  reinterpret_cast<uint8_t *>(&val), &err);
+	    ASSERT_TRUE(ok == true);
+	}
+	ASSERT_TRUE(ms.numPages() >= used);
+
+	ok = r2_check_tree(&b, &count);
+	ASSERT_TRUE(ok == true);
+	ASSERT_TRUE(count == n);
+    }
+
+    unlink(path);
+
+    this->setStatus(true);
+}
+
+}
+
+/************/
+
+namespace dback {
+
+struct TC_MMapPageStore02 : public TestCase {
+    TC_MMapPageStore02() : TestCase("TC_MMapPageStore02") {;};
+    void run();
+};
+
+void
+TC_MMapPageStore02::run()
+{
+    char path[] = "/tmp/dback_utests_mm.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_TRUE(fd >= 0);
+    close(fd);
+
+    ErrorInfo err;
+    bool ok;
+    uint8_t key;
+    uint64_t val;
+    uint32_t pn;
+    ShortKey k;
+    boost::shared_mutex l;
+    const uint32_t psize = 256;
+
+    {
+	MMapPageStore ms(1024 * 1024);
+
+	err.clear();
+	ok = ms.create(path, psize, &err);
+	ASSERT_TRUE(ok == true);
+
+	IndexHeader *ih = reinterpret_cast<IndexHeader *>(ms.getIndexHeader());
+	k.initIndexHeader(ih, psize);
+
+	BTree b;
+	b.header = ih;
+	b.root = NULL;
+	b.ki = &k;
+
+	err.clear();
+	uint8_t *buf = ms.allocPage(&pn, &err);
+	ASSERT_TRUE(buf != NULL);
+	ASSERT_TRUE(pn == 1);
+	b.initLeafPage(buf);
+
+	PageAccess pa;
+	b.initPageAccess(&pa, buf);
+	for (key = 0; key < 20; key++) {
+	    err.clear();
+	    ok = b.blockInsertInLeaf(&l, &pa, &key, key + 1000, &err);
+	    ASSERT_TRUE(ok == true);
+	}
+	ms.releasePage(pn, true);
+
+	err.clear();
+	ok = ms.close(&err);
+	ASSERT_TRUE(ok == true);
+    }
+
+    {
+	MMapPageStore ms(1024 * 1024);
+
+	err.clear();
+	ok = ms.open(path, &err);
+	ASSERT_TRUE(ok == true);
+
+	BTree b;
+	b.header = reinterpret_cast<IndexHeader *>(ms.getIndexHeader());
+	b.root = NULL;
+	b.ki = &k;
+	ASSERT_TRUE(b.header->pageSizeInBytes == psize);
+
+	err.clear();
+	uint8_t *buf = ms.getPage(1, &err);
+	ASSERT_TRUE(buf != NULL);
+
+	PageAccess pa;
+	b.initPageAccess(&pa, buf);
+	ASSERT_TRUE(pa.header->numKeys == 20);
+	for (key = 0; key < 20; key++) {
+	    err.clear();
+	    ok = b.blockFindInLeaf(&l, &pa, &key, &val, &err);
+	    ASSERT_TRUE(ok == true);
+	    ASSERT_TRUE(val == key + 1000U);
+	}
+	ms.releasePage(1, false);
+
+	err.clear();
+	buf = ms.getPage(2, &err);
+	ASSERT_TRUE(buf == NULL);
+	ASSERT_TRUE(err.errorNum == ErrorInfo::ERR_BAD_ARG);
+    }
+
+    unlink(path);
+
+    this->setStatus(true);
+}
+
+}
+
 /****************************************************/
 /* top level                                        */
 /****************************************************/
@@ -5075,6 +11977,43 @@ make_suite_all_tests()
     s->addTestCase(new dback::TC_R2BTree22());
     s->addTestCase(new dback::TC_R2BTree23());
     s->addTestCase(new dback::TC_R2BTree24());
+    s->addTestCase(new dback::TC_R2BTree25());
+    s->addTestCase(new dback::TC_R2BTree26());
+    s->addTestCase(new dback::TC_R2BTree27());
+    s->addTestCase(new dback::TC_R2BTree28());
+    s->addTestCase(new dback::TC_R2BTree29());
+    s->addTestCase(new dback::TC_KeySearch01());
+    s->addTestCase(new dback::TC_KeySearch02());
+    s->addTestCase(new dback::TC_R2BTree30());
+    s->addTestCase(new dback::TC_R2BTree31());
+    s->addTestCase(new dback::TC_R2BTree32());
+    s->addTestCase(new dback::TC_R2BTree33());
+    s->addTestCase(new dback::TC_R2BTree34());
+    s->addTestCase(new dback::TC_R2BTree35());
+    s->addTestCase(new dback::TC_R2BTree36());
+    s->addTestCase(new dback::TC_R2BTree37());
+    s->addTestCase(new dback::TC_R2BTree38());
+    s->addTestCase(new dback::TC_R2BTree39());
+    s->addTestCase(new dback::TC_R2BTree40());
+    s->addTestCase(new dback::TC_R2BTree41());
+    s->addTestCase(new dback::TC_R2BTree42());
+    s->addTestCase(new dback::TC_R2BTree43());
+    s->addTestCase(new dback::TC_R2BTree44());
+    s->addTestCase(new dback::TC_R2BTree45());
+    s->addTestCase(new dback::TC_R2BTree46());
+    s->addTestCase(new dback::TC_R2BTree47());
+    s->addTestCase(new dback::TC_R2BTree48());
+    s->addTestCase(new dback::TC_HashIndex01());
+    s->addTestCase(new dback::TC_R2BTree49());
+    s->addTestCase(new dback::TC_BloomFilter01());
+    s->addTestCase(new dback::TC_R2BTree50());
+    s->addTestCase(new dback::TC_R2BTree51());
+    s->addTestCase(new dback::TC_R2BTree52());
+
+    s->addTestCase(new dback::TC_BufferPool01());
+    s->addTestCase(new dback::TC_BufferPool02());
+    s->addTestCase(new dback::TC_MMapPageStore01());
+    s->addTestCase(new dback::TC_MMapPageStore02());
 
     return s;
 }
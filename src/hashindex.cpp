@@ -0,0 +1,212 @@
+#include <inttypes.h>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include "hashindex.h"
+
+namespace dback {
+
+/****************************************************/
+/****************************************************/
+/* hash index                                       */
+/****************************************************/
+/****************************************************/
+
+/**
+ * Mix the bits of a word, the finalizer of MurmurHash3.
+ *
+ * Keys are not always random, sequential ids only differ in their low
+ * bytes, so the words of a key are mixed before the slot is taken.
+ */
+static inline uint64_t
+mix64(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+HashIndex::HashIndex(uint32_t keySize, uint32_t valSize)
+    : keySize(keySize), valSize(valSize), slotSize(1 + keySize + valSize),
+      mask(0), count(0), carry(1 + keySize + valSize)
+{
+    this->resize(MIN_SLOTS);
+}
+
+size_t
+HashIndex::home(const uint8_t *key)
+{
+    uint64_t h = 0;
+    uint64_t w;
+    uint32_t i;
+
+    for (i = 0; i + sizeof(w) <= this->keySize; i += sizeof(w)) {
+	memcpy(&w, key + i, sizeof(w));
+	h = mix64(h ^ w);
+    }
+    if (i < this->keySize) {
+	w = 0;
+	memcpy(&w, key + i, this->keySize - i);
+	h = mix64(h ^ w);
+    }
+
+    return h & this->mask;
+}
+
+bool
+HashIndex::find(const uint8_t *key, uint8_t *val)
+{
+    size_t i = this->home(key);
+    uint8_t *slot = &this->slots[i * this->slotSize];
+
+    // an entry closer to its home than key would be ends the search
+    for (uint32_t d = 1; slot[0] >= d; d++) {
+	if (slot[0] == d && memcmp(slot + 1, key, this->keySize) == 0) {
+	    if (val != NULL)
+		memcpy(val, slot + 1 + this->keySize, this->valSize);
+	    return true;
+	}
+	i = (i + 1) & this->mask;
+	slot = &this->slots[i * this->slotSize];
+    }
+
+    return false;
+}
+
+bool
+HashIndex::insert(const uint8_t *key, const uint8_t *val)
+{
+    size_t ss = this->slotSize;
+
+    if ((this->count + 1) * 4 > (this->mask + 1) * 3)
+	this->resize((this->mask + 1) * 2);
+
+    uint8_t *c = &this->carry[0];
+    c[0] = 1;
+    memcpy(c + 1, key, this->keySize);
+    memcpy(c + 1 + this->keySize, val, this->valSize);
+
+    size_t i = this->home(key);
+    uint8_t *slot = &this->slots[i * ss];
+    bool moved = false;
+
+    while (slot[0] != 0) {
+	// once an entry has been moved key is known not to be here
+	if ( ! moved && slot[0] == c[0]
+	     && memcmp(slot + 1, key, this->keySize) == 0) {
+	    memcpy(slot + 1 + this->keySize, val, this->valSize);
+	    return false;
+	}
+
+	if (slot[0] < c[0]) {
+	    std::swap_ranges(c, c + ss, slot);
+	    moved = true;
+	}
+
+	if (c[0] == MAX_DIST) {
+	    // the entry being moved is not in the table, put it back
+	    // after the table has grown
+	    std::vector<uint8_t> entry(this->carry);
+	    this->resize((this->mask + 1) * 2);
+	    this->insert(&entry[1], &entry[1 + this->keySize]);
+	    return true;
+	}
+	c[0]++;
+	i = (i + 1) & this->mask;
+	slot = &this->slots[i * ss];
+    }
+
+    memcpy(slot, c, ss);
+    this->count++;
+
+    return true;
+}
+
+bool
+HashIndex::remove(const uint8_t *key)
+{
+    size_t ss = this->slotSize;
+    size_t i = this->home(key);
+    uint8_t *slot = &this->slots[i * ss];
+    uint32_t d;
+
+    for (d = 1; slot[0] >= d; d++) {
+	if (slot[0] == d && memcmp(slot + 1, key, this->keySize) == 0)
+	    break;
+	i = (i + 1) & this->mask;
+	slot = &this->slots[i * ss];
+    }
+    if (slot[0] < d)
+	return false;
+
+    // shift back the entries after it that are not in their home slot
+    i = (i + 1) & this->mask;
+    uint8_t *next = &this->slots[i * ss];
+    while (next[0] > 1) {
+	memcpy(slot, next, ss);
+	slot[0]--;
+	slot = next;
+	i = (i + 1) & this->mask;
+	next = &this->slots[i * ss];
+    }
+    slot[0] = 0;
+    this->count--;
+
+    return true;
+}
+
+void
+HashIndex::clear()
+{
+    this->slots.clear();
+    this->resize(MIN_SLOTS);
+}
+
+void
+HashIndex::swap(HashIndex *other)
+{
+    this->slots.swap(other->slots);
+    std::swap(this->mask, other->mask);
+    std::swap(this->count, other->count);
+}
+
+void
+HashIndex::reserve(size_t n)
+{
+    size_t n_slots = this->mask + 1;
+    while (n * 4 > n_slots * 3)
+	n_slots *= 2;
+    if (n_slots > this->mask + 1)
+	this->resize(n_slots);
+}
+
+void
+HashIndex::resize(size_t nSlots)
+{
+    size_t ss = this->slotSize;
+    std::vector<uint8_t> old;
+    old.swap(this->slots);
+
+    this->slots.assign(nSlots * ss, 0);
+    this->mask = nSlots - 1;
+    this->count = 0;
+
+    for (size_t i = 0; i < old.size(); i += ss) {
+	if (old[i] != 0)
+	    this->insert(&old[i + 1], &old[i + 1 + this->keySize]);
+    }
+}
+
+}
+
+/*
+  Local Variables:
+  mode: c++
+  c-basic-offset: 4
+  End:
+*/
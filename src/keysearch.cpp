@@ -0,0 +1,167 @@
+#include <inttypes.h>
+#include <cstddef>
+#include <cstring>
+
+#include <endian.h>
+
+#include "keysearch.h"
+
+namespace dback {
+
+/****************************************************/
+/****************************************************/
+/* UUID search                                      */
+/****************************************************/
+/****************************************************/
+
+/**
+ * Load 8 bytes as a big endian word.
+ *
+ * Comparing the words gives the same order as memcmp on the bytes.
+ */
+static inline uint64_t
+load_be64(const uint8_t *p)
+{
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    return be64toh(w);
+}
+
+/**
+ * true if the key at p is smaller than the key k_hi, k_lo.
+ */
+static inline bool
+uuid_less(const uint8_t *p, uint64_t k_hi, uint64_t k_lo)
+{
+    uint64_t p_hi = load_be64(p);
+    return p_hi < k_hi || (p_hi == k_hi && load_be64(p + 8) < k_lo);
+}
+
+/**
+ * First position in [lo, hi) whose key is >= k_hi, k_lo, counting
+ * the keys compared in *probes.
+ */
+static uint32_t
+uuid_lower_bound(const uint8_t *keys, uint32_t lo, uint32_t hi,
+		 uint64_t k_hi, uint64_t k_lo, uint32_t *probes)
+{
+    while (lo < hi) {
+	uint32_t m = lo + (hi - lo) / 2;
+	(*probes)++;
+	if (uuid_less(keys + m * 16, k_hi, k_lo))
+	    lo = m + 1;
+	else
+	    hi = m;
+    }
+    return lo;
+}
+
+bool
+KeySearch::findUUIDPosition(const uint8_t *keys, uint32_t n,
+			    const uint8_t *key, uint32_t *idx)
+{
+    uint64_t k_hi = load_be64(key);
+    uint64_t k_lo = load_be64(key + 8);
+    uint32_t lo = 0;
+    uint32_t hi = n;
+
+    // find the first key >= key, stop when only a few are left
+    while (hi - lo > LINEAR_SCAN_KEYS) {
+	uint32_t m = lo + (hi - lo) / 2;
+	const uint8_t *p = keys + m * 16;
+	uint64_t p_hi = load_be64(p);
+	uint64_t p_lo = load_be64(p + 8);
+	bool less = p_hi < k_hi || (p_hi == k_hi && p_lo < k_lo);
+	lo = less ? m + 1 : lo;
+	hi = less ? hi : m;
+    }
+
+    // count the remaining keys that are smaller, without branches
+    uint32_t pos = lo;
+    for (uint32_t i = lo; i < hi; i++) {
+	const uint8_t *p = keys + i * 16;
+	uint64_t p_hi = load_be64(p);
+	uint64_t p_lo = load_be64(p + 8);
+	pos += (p_hi < k_hi) | ((p_hi == k_hi) & (p_lo < k_lo));
+    }
+
+    *idx = pos;
+    if (pos == n)
+	return false;
+
+    const uint8_t *p = keys + pos * 16;
+    return load_be64(p) == k_hi && load_be64(p + 8) == k_lo;
+}
+
+bool
+KeySearch::interpolateUUIDPosition(const uint8_t *keys, uint32_t n,
+				   const uint8_t *key, uint32_t *idx,
+				   uint32_t *probes, bool *fellBack)
+{
+    uint64_t k_hi = load_be64(key);
+    uint64_t k_lo = load_be64(key + 8);
+    uint32_t pos;
+
+    *probes = 0;
+    *fellBack = false;
+
+    if (n <= INTERPOLATION_WINDOW) {
+	pos = uuid_lower_bound(keys, 0, n, k_hi, k_lo, probes);
+    }
+    else {
+	// guess from the first 8 bytes, assuming the keys are spread
+	// evenly between the first and the last
+	uint64_t first = load_be64(keys);
+	uint64_t last = load_be64(keys + (n - 1) * 16);
+	uint32_t g;
+	if (k_hi <= first)
+	    g = 0;
+	else if (k_hi >= last)
+	    g = n - 1;
+	else
+	    g = (uint32_t)((double)(k_hi - first) / (double)(last - first)
+			   * (n - 1));
+
+	(*probes)++;
+	if (uuid_less(keys + g * 16, k_hi, k_lo)) {
+	    // scan up for the first key >= key
+	    uint32_t end = g + 1 + INTERPOLATION_WINDOW;
+	    end = end < n ? end : n;
+	    pos = g + 1;
+	    while (pos < end) {
+		(*probes)++;
+		if ( ! uuid_less(keys + pos * 16, k_hi, k_lo))
+		    break;
+		pos++;
+	    }
+	    if (pos == end && end < n) {
+		*fellBack = true;
+		pos = uuid_lower_bound(keys, end, n, k_hi, k_lo, probes);
+	    }
+	}
+	else {
+	    // key g is >= key, scan down while the one before is too
+	    uint32_t end = g > INTERPOLATION_WINDOW ? g - INTERPOLATION_WINDOW : 0;
+	    pos = g;
+	    while (pos > end) {
+		(*probes)++;
+		if (uuid_less(keys + (pos - 1) * 16, k_hi, k_lo))
+		    break;
+		pos--;
+	    }
+	    if (pos == end && end > 0) {
+		*fellBack = true;
+		pos = uuid_lower_bound(keys, 0, end, k_hi, k_lo, probes);
+	    }
+	}
+    }
+
+    *idx = pos;
+    if (pos == n)
+	return false;
+
+    const uint8_t *p = keys + pos * 16;
+    return load_be64(p) == k_hi && load_be64(p + 8) == k_lo;
+}
+
+}
@@ -0,0 +1,907 @@
+#include <inttypes.h>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <new>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/thread.hpp>
+
+#include "dback.h"
+#include "wal.h"
+#include "pagestore.h"
+
+namespace dback {
+
+/****************************************************/
+/****************************************************/
+/* page pins                                        */
+/****************************************************/
+/****************************************************/
+uint8_t *
+PagePin::pin(PageStore *s, uint32_t pn, ErrorInfo *err)
+{
+    this->release();
+
+    uint8_t *b = s->getPage(pn, err);
+    if (b == NULL)
+	return NULL;
+
+    this->ps = s;
+    this->pageNum = pn;
+    this->buf = b;
+    this->dirty = false;
+
+    return b;
+}
+
+uint8_t *
+PagePin::alloc(PageStore *s, uint32_t *pn, ErrorInfo *err)
+{
+    this->release();
+
+    uint8_t *b = s->allocPage(pn, err);
+    if (b == NULL)
+	return NULL;
+
+    this->ps = s;
+    this->pageNum = *pn;
+    this->buf = b;
+    this->dirty = true;
+
+    return b;
+}
+
+void
+PagePin::release()
+{
+    if (this->buf == NULL)
+	return;
+
+    this->ps->releasePage(this->pageNum, this->dirty);
+    this->ps = NULL;
+    this->pageNum = 0;
+    this->buf = NULL;
+    this->dirty = false;
+}
+
+void
+PagePin::moveFrom(PagePin *other)
+{
+    this->release();
+
+    this->ps = other->ps;
+    this->pageNum = other->pageNum;
+    this->buf = other->buf;
+    this->dirty = other->dirty;
+
+    other->ps = NULL;
+    other->pageNum = 0;
+    other->buf = NULL;
+    other->dirty = false;
+}
+
+/****************************************************/
+/****************************************************/
+/* in memory page store                             */
+/****************************************************/
+/****************************************************/
+MemPageStore::MemPageStore(uint32_t sz)
+    : pageSize(sz)
+{
+    // page 0 is reserved
+    this->pages.push_back(NULL);
+}
+
+MemPageStore::~MemPageStore()
+{
+    std::vector<uint8_t *>::iterator iter = this->pages.begin();
+    while (iter != this->pages.end()) {
+	delete [] *iter;
+	iter++;
+    }
+}
+
+uint8_t *
+MemPageStore::getPage(uint32_t pageNum, ErrorInfo *err)
+{
+    if (pageNum >= this->pages.size() || this->pages[pageNum] == NULL) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("invalid page number");
+	return NULL;
+    }
+    return this->pages[pageNum];
+}
+
+void
+MemPageStore::releasePage(uint32_t /* pageNum */, bool /* dirty */)
+{
+    return;
+}
+
+uint8_t *
+MemPageStore::allocPage(uint32_t *pageNum, ErrorInfo *err)
+{
+    uint8_t *buf = new (std::nothrow) uint8_t[ this->pageSize ];
+    if (buf == NULL) {
+	err->setErrNum(ErrorInfo::ERR_NO_SPACE);
+	err->message.assign("out of memory");
+	return NULL;
+    }
+
+    if ( ! this->freeList.empty()) {
+	*pageNum = this->freeList.back();
+	this->freeList.pop_back();
+	this->pages[*pageNum] = buf;
+    }
+    else {
+	*pageNum = this->pages.size();
+	this->pages.push_back(buf);
+    }
+
+    return buf;
+}
+
+void
+MemPageStore::freePage(uint32_t pageNum)
+{
+    if (pageNum == 0
+	|| pageNum >= this->pages.size()
+	|| this->pages[pageNum] == NULL)
+	return;
+
+    delete [] this->pages[pageNum];
+    this->pages[pageNum] = NULL;
+    this->freeList.push_back(pageNum);
+}
+
+size_t
+MemPageStore::numPages()
+{
+    return this->pages.size() - 1 - this->freeList.size();
+}
+
+/****************************************************/
+/****************************************************/
+/* buffer pool                                      */
+/****************************************************/
+/****************************************************/
+BufferPool::BufferPool(uint32_t sz, size_t maxBytes)
+    : pageSize(sz),
+      numFrames(maxBytes / sz),
+      mem(NULL),
+      clockHand(0),
+      fd(-1),
+      numFilePages(1),
+      wal(NULL),
+      lsnOffset(0),
+      nHits(0),
+      nMisses(0),
+      nEvictions(0),
+      nWrites(0)
+{
+    if (this->numFrames < 8)
+	this->numFrames = 8;
+
+    this->mem = new uint8_t[ this->numFrames * this->pageSize ];
+
+    Frame f;
+    f.pageNum = 0;
+    f.pinCount = 0;
+    f.dirty = false;
+    f.ref = false;
+    this->frames.assign(this->numFrames, f);
+}
+
+BufferPool::~BufferPool()
+{
+    ErrorInfo err;
+    if (this->fd >= 0) {
+	this->writeAll(&err);
+	::close(this->fd);
+    }
+    delete [] this->mem;
+}
+
+bool
+BufferPool::open(const char *path, ErrorInfo *err)
+{
+    boost::mutex::scoped_lock guard(this->lock);
+
+    if (this->fd >= 0) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("already open");
+	return false;
+    }
+
+    int f = ::open(path, O_RDWR | O_CREAT, 0644);
+    if (f < 0) {
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("unable to open index file");
+	return false;
+    }
+
+    struct stat st;
+    if (fstat(f, &st) != 0) {
+	::close(f);
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("unable to stat index file");
+	return false;
+    }
+
+    this->fd = f;
+    this->numFilePages = st.st_size / this->pageSize;
+    if (this->numFilePages == 0)
+	this->numFilePages = 1;
+
+    return true;
+}
+
+bool
+BufferPool::flush(ErrorInfo *err)
+{
+    boost::mutex::scoped_lock guard(this->lock);
+
+    if ( ! this->writeAll(err))
+	return false;
+
+    if (fsync(this->fd) != 0) {
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("fsync failed");
+	return false;
+    }
+
+    return true;
+}
+
+bool
+BufferPool::close(ErrorInfo *err)
+{
+    boost::mutex::scoped_lock guard(this->lock);
+
+    for (size_t i = 0; i < this->numFrames; i++) {
+	if (this->frames[i].pinCount > 0) {
+	    err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	    err->message.assign("page still pinned");
+	    return false;
+	}
+    }
+
+    if ( ! this->writeAll(err))
+	return false;
+
+    if (fsync(this->fd) != 0 || ::close(this->fd) != 0) {
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("close failed");
+	return false;
+    }
+
+    this->fd = -1;
+    this->pageTable.clear();
+    this->freeList.clear();
+    for (size_t i = 0; i < this->numFrames; i++) {
+	this->frames[i].pageNum = 0;
+	this->frames[i].dirty = false;
+	this->frames[i].ref = false;
+    }
+
+    return true;
+}
+
+uint8_t *
+BufferPool::getPage(uint32_t pageNum, ErrorInfo *err)
+{
+    boost::mutex::scoped_lock guard(this->lock);
+
+    if (pageNum == 0 || pageNum >= this->numFilePages) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("invalid page number");
+	return NULL;
+    }
+
+    std::unordered_map<uint32_t, size_t>::iterator iter;
+    iter = this->pageTable.find(pageNum);
+    if (iter != this->pageTable.end()) {
+	Frame &f = this->frames[iter->second];
+	f.pinCount++;
+	f.ref = true;
+	this->nHits++;
+	return this->mem + iter->second * this->pageSize;
+    }
+
+    this->nMisses++;
+
+    size_t idx;
+    if ( ! this->findVictim(&idx, err))
+	return NULL;
+
+    uint8_t *buf = this->mem + idx * this->pageSize;
+    off_t off = (off_t)pageNum * this->pageSize;
+    ssize_t n = pread(this->fd, buf, this->pageSize, off);
+    if (n != (ssize_t)this->pageSize) {
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("page read failed");
+	return NULL;
+    }
+
+    Frame &f = this->frames[idx];
+    f.pageNum = pageNum;
+    f.pinCount = 1;
+    f.dirty = false;
+    f.ref = true;
+    this->pageTable[pageNum] = idx;
+
+    return buf;
+}
+
+void
+BufferPool::releasePage(uint32_t pageNum, bool dirty)
+{
+    boost::mutex::scoped_lock guard(this->lock);
+
+    std::unordered_map<uint32_t, size_t>::iterator iter;
+    iter = this->pageTable.find(pageNum);
+    if (iter == this->pageTable.end())
+	return;
+
+    Frame &f = this->frames[iter->second];
+    if (f.pinCount > 0)
+	f.pinCount--;
+    if (dirty)
+	f.dirty = true;
+}
+
+uint8_t *
+BufferPool::allocPage(uint32_t *pageNum, ErrorInfo *err)
+{
+    boost::mutex::scoped_lock guard(this->lock);
+
+    if (this->fd < 0) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("index file not open");
+	return NULL;
+    }
+
+    size_t idx;
+    if ( ! this->findVictim(&idx, err))
+	return NULL;
+
+    uint32_t pn;
+    if ( ! this->freeList.empty()) {
+	pn = this->freeList.back();
+	this->freeList.pop_back();
+    }
+    else {
+	pn = this->numFilePages++;
+    }
+
+    uint8_t *buf = this->mem + idx * this->pageSize;
+    memset(buf, 0, this->pageSize);
+
+    Frame &f = this->frames[idx];
+    f.pageNum = pn;
+    f.pinCount = 1;
+    f.dirty = true;
+    f.ref = true;
+    this->pageTable[pn] = idx;
+
+    *pageNum = pn;
+    return buf;
+}
+
+void
+BufferPool::freePage(uint32_t pageNum)
+{
+    boost::mutex::scoped_lock guard(this->lock);
+
+    if (pageNum == 0 || pageNum >= this->numFilePages)
+	return;
+
+    std::unordered_map<uint32_t, size_t>::iterator iter;
+    iter = this->pageTable.find(pageNum);
+    if (iter != this->pageTable.end()) {
+	Frame &f = this->frames[iter->second];
+	f.pageNum = 0;
+	f.pinCount = 0;
+	f.dirty = false;
+	f.ref = false;
+	this->pageTable.erase(iter);
+    }
+
+    this->freeList.push_back(pageNum);
+}
+
+void
+BufferPool::setLog(WriteAheadLog *log, uint32_t off)
+{
+    boost::mutex::scoped_lock guard(this->lock);
+
+    this->wal = log;
+    this->lsnOffset = off;
+}
+
+uint64_t
+BufferPool::getNumHits()
+{
+    boost::mutex::scoped_lock guard(this->lock);
+    return this->nHits;
+}
+
+uint64_t
+BufferPool::getNumMisses()
+{
+    boost::mutex::scoped_lock guard(this->lock);
+    return this->nMisses;
+}
+
+uint64_t
+BufferPool::getNumEvictions()
+{
+    boost::mutex::scoped_lock guard(this->lock);
+    return this->nEvictions;
+}
+
+uint64_t
+BufferPool::getNumWrites()
+{
+    boost::mutex::scoped_lock guard(this->lock);
+    return this->nWrites;
+}
+
+double
+BufferPool::getHitRatio()
+{
+    boost::mutex::scoped_lock guard(this->lock);
+
+    uint64_t total = this->nHits + this->nMisses;
+    if (total == 0)
+	return 0.0;
+    return (double)this->nHits / (double)total;
+}
+
+void
+BufferPool::resetStats()
+{
+    boost::mutex::scoped_lock guard(this->lock);
+
+    this->nHits = 0;
+    this->nMisses = 0;
+    this->nEvictions = 0;
+    this->nWrites = 0;
+}
+
+bool
+BufferPool::findVictim(size_t *idx, ErrorInfo *err)
+{
+    // two sweeps: the first may only clear reference bits
+    for (size_t n = 0; n < 2 * this->numFrames; n++) {
+	size_t i = this->clockHand;
+	Frame &f = this->frames[i];
+
+	this->clockHand = (this->clockHand + 1) % this->numFrames;
+
+	if (f.pageNum == 0) {
+	    *idx = i;
+	    return true;
+	}
+	if (f.pinCount > 0)
+	    continue;
+	if (f.ref) {
+	    f.ref = false;
+	    continue;
+	}
+	if (f.dirty && ! this->canWrite(i))
+	    continue;
+
+	if (f.dirty && ! this->writeFrame(i, err))
+	    return false;
+
+	this->pageTable.erase(f.pageNum);
+	f.pageNum = 0;
+	this->nEvictions++;
+
+	*idx = i;
+	return true;
+    }
+
+    err->setErrNum(ErrorInfo::ERR_NO_SPACE);
+    err->message.assign("all buffer frames pinned");
+    return false;
+}
+
+bool
+BufferPool::writeFrame(size_t idx, ErrorInfo *err)
+{
+    Frame &f = this->frames[idx];
+    uint8_t *buf = this->mem + idx * this->pageSize;
+    off_t off = (off_t)f.pageNum * this->pageSize;
+
+    // the log records for the page must reach the disk first
+    if (this->wal != NULL) {
+	uint64_t lsn;
+	memcpy(&lsn, buf + this->lsnOffset, sizeof(lsn));
+	if (lsn > this->wal->getDurableLsn() && ! this->wal->commit(lsn, err))
+	    return false;
+    }
+
+    ssize_t n = pwrite(this->fd, buf, this->pageSize, off);
+    if (n != (ssize_t)this->pageSize) {
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("page write failed");
+	return false;
+    }
+
+    f.dirty = false;
+    this->nWrites++;
+
+    return true;
+}
+
+bool
+BufferPool::writeAll(ErrorInfo *err)
+{
+    for (size_t i = 0; i < this->numFrames; i++) {
+	if (this->frames[i].pageNum != 0 && this->frames[i].dirty
+	    && this->canWrite(i)) {
+	    if ( ! this->writeFrame(i, err))
+		return false;
+	}
+    }
+
+    return true;
+}
+
+bool
+BufferPool::canWrite(size_t idx)
+{
+    if (this->wal == NULL)
+	return true;
+
+    uint64_t lsn;
+    memcpy(&lsn, this->mem + idx * this->pageSize + this->lsnOffset,
+	   sizeof(lsn));
+    return lsn != WAL_LSN_PENDING;
+}
+
+/****************************************************/
+/****************************************************/
+/* memory mapped file                               */
+/****************************************************/
+/****************************************************/
+MMapPageStore::MMapPageStore(size_t mx)
+    : maxBytes(mx),
+      base(NULL),
+      mappedBytes(0),
+      fd(-1),
+      fileHeader(NULL)
+{
+    ;
+}
+
+MMapPageStore::~MMapPageStore()
+{
+    this->unmap();
+}
+
+bool
+MMapPageStore::create(const char *path, uint32_t pageSize, ErrorInfo *err)
+{
+    if (this->fd >= 0) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("already open");
+	return false;
+    }
+
+    if (pageSize < sizeof(MMapFileHeader) + sizeof(uint32_t)
+	|| pageSize > this->maxBytes) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("invalid page size");
+	return false;
+    }
+
+    this->fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (this->fd < 0) {
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("unable to create index file");
+	return false;
+    }
+
+    this->mappedBytes = 0;
+    if ( ! this->mapFile(err))
+	return false;
+
+    if ( ! this->grow(pageSize, err)) {
+	this->unmap();
+	return false;
+    }
+
+    memset(this->base, 0, pageSize);
+    this->fileHeader = reinterpret_cast<MMapFileHeader *>(this->base);
+    this->fileHeader->magic = MAGIC;
+    this->fileHeader->version = 1;
+    this->fileHeader->pageSize = pageSize;
+    this->fileHeader->numPages = 1;
+    this->fileHeader->freeListHead = 0;
+    this->fileHeader->numFree = 0;
+
+    return true;
+}
+
+bool
+MMapPageStore::open(const char *path, ErrorInfo *err)
+{
+    if (this->fd >= 0) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("already open");
+	return false;
+    }
+
+    this->fd = ::open(path, O_RDWR);
+    if (this->fd < 0) {
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("unable to open index file");
+	return false;
+    }
+
+    MMapFileHeader h;
+    struct stat st;
+    if (pread(this->fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h)
+	|| fstat(this->fd, &st) != 0) {
+	this->unmap();
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("unable to read index file header");
+	return false;
+    }
+
+    if (h.magic != MAGIC
+	|| h.version != 1
+	|| (size_t)h.numPages * h.pageSize > (size_t)st.st_size
+	|| (size_t)st.st_size > this->maxBytes) {
+	this->unmap();
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("not a valid index file");
+	return false;
+    }
+
+    this->mappedBytes = st.st_size;
+    if ( ! this->mapFile(err))
+	return false;
+    this->fileHeader = reinterpret_cast<MMapFileHeader *>(this->base);
+
+    return true;
+}
+
+bool
+MMapPageStore::flush(bool wait, ErrorInfo *err)
+{
+    if (this->base == NULL) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("index file not open");
+	return false;
+    }
+
+    size_t len = (size_t)this->fileHeader->numPages * this->fileHeader->pageSize;
+    if (msync(this->base, len, wait ? MS_SYNC : MS_ASYNC) != 0) {
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("msync failed");
+	return false;
+    }
+
+    return true;
+}
+
+bool
+MMapPageStore::close(ErrorInfo *err)
+{
+    if ( ! this->flush(true, err))
+	return false;
+
+    this->unmap();
+    return true;
+}
+
+bool
+MMapPageStore::setAccessHint(AccessHint h, ErrorInfo *err)
+{
+    int advice;
+
+    switch (h) {
+    case AccessRandom:
+	advice = MADV_RANDOM;
+	break;
+    case AccessSequential:
+	advice = MADV_SEQUENTIAL;
+	break;
+    case AccessWillNeed:
+	advice = MADV_WILLNEED;
+	break;
+    default:
+	advice = MADV_NORMAL;
+	break;
+    }
+
+    if (this->base == NULL || madvise(this->base, this->mappedBytes, advice) != 0) {
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("madvise failed");
+	return false;
+    }
+
+    return true;
+}
+
+uint8_t *
+MMapPageStore::getIndexHeader()
+{
+    return this->base + sizeof(MMapFileHeader);
+}
+
+size_t
+MMapPageStore::getIndexHeaderSize()
+{
+    return this->fileHeader->pageSize - sizeof(MMapFileHeader);
+}
+
+uint32_t
+MMapPageStore::getPageSize()
+{
+    return this->fileHeader->pageSize;
+}
+
+uint8_t *
+MMapPageStore::getPage(uint32_t pageNum, ErrorInfo *err)
+{
+    if (pageNum == 0 || pageNum >= this->fileHeader->numPages) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("invalid page number");
+	return NULL;
+    }
+
+    return this->base + (size_t)pageNum * this->fileHeader->pageSize;
+}
+
+void
+MMapPageStore::releasePage(uint32_t /* pageNum */, bool /* dirty */)
+{
+    return;
+}
+
+uint8_t *
+MMapPageStore::allocPage(uint32_t *pageNum, ErrorInfo *err)
+{
+    MMapFileHeader *h = this->fileHeader;
+    uint32_t pn;
+
+    if (h->freeListHead != 0) {
+	pn = h->freeListHead;
+	memcpy(&h->freeListHead, this->base + (size_t)pn * h->pageSize,
+	       sizeof(uint32_t));
+	h->numFree--;
+    }
+    else {
+	if ( ! this->grow((size_t)(h->numPages + 1) * h->pageSize, err))
+	    return NULL;
+	pn = h->numPages++;
+    }
+
+    *pageNum = pn;
+    return this->base + (size_t)pn * h->pageSize;
+}
+
+void
+MMapPageStore::freePage(uint32_t pageNum)
+{
+    MMapFileHeader *h = this->fileHeader;
+
+    if (pageNum == 0 || pageNum >= h->numPages)
+	return;
+
+    memcpy(this->base + (size_t)pageNum * h->pageSize, &h->freeListHead,
+	   sizeof(uint32_t));
+    h->freeListHead = pageNum;
+    h->numFree++;
+}
+
+size_t
+MMapPageStore::numPages()
+{
+    return this->fileHeader->numPages - 1 - this->fileHeader->numFree;
+}
+
+bool
+MMapPageStore::mapFile(ErrorInfo *err)
+{
+    void *r = mmap(NULL, this->maxBytes, PROT_NONE,
+		   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (r == MAP_FAILED) {
+	this->unmap();
+	err->setErrNum(ErrorInfo::ERR_NO_SPACE);
+	err->message.assign("unable to reserve address space");
+	return false;
+    }
+    this->base = reinterpret_cast<uint8_t *>(r);
+
+    if (this->mappedBytes == 0)
+	return true;
+
+    r = mmap(this->base, this->mappedBytes, PROT_READ | PROT_WRITE,
+	     MAP_SHARED | MAP_FIXED, this->fd, 0);
+    if (r == MAP_FAILED) {
+	this->unmap();
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("mmap failed");
+	return false;
+    }
+
+    return true;
+}
+
+bool
+MMapPageStore::grow(size_t need, ErrorInfo *err)
+{
+    if (need <= this->mappedBytes)
+	return true;
+
+    // grow by doubling, in whole OS pages
+    size_t osPage = sysconf(_SC_PAGESIZE);
+    size_t newSize = this->mappedBytes * 2;
+    if (newSize < need)
+	newSize = need;
+    if (newSize < 16 * osPage)
+	newSize = 16 * osPage;
+    newSize = (newSize + osPage - 1) & ~(osPage - 1);
+    if (newSize > this->maxBytes)
+	newSize = this->maxBytes & ~(osPage - 1);
+    if (newSize < need) {
+	err->setErrNum(ErrorInfo::ERR_NO_SPACE);
+	err->message.assign("index file at max size");
+	return false;
+    }
+
+    if (ftruncate(this->fd, newSize) != 0) {
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("unable to grow index file");
+	return false;
+    }
+
+    void *r = mmap(this->base + this->mappedBytes, newSize - this->mappedBytes,
+		   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, this->fd,
+		   this->mappedBytes);
+    if (r == MAP_FAILED) {
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("mmap failed");
+	return false;
+    }
+
+    this->mappedBytes = newSize;
+    return true;
+}
+
+void
+MMapPageStore::unmap()
+{
+    if (this->base != NULL)
+	munmap(this->base, this->maxBytes);
+    if (this->fd >= 0)
+	::close(this->fd);
+
+    this->base = NULL;
+    this->fd = -1;
+    this->mappedBytes = 0;
+    this->fileHeader = NULL;
+}
+
+}
+
+/*
+Local Variables:
+mode: c++
+c-basic-offset: 4
+End:
+*/
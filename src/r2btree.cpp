@@ -1,16 +1,180 @@
 #include <inttypes.h>
 #include <cstddef>
 #include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <queue>
+#include <cstring>
 
 #include <boost/thread.hpp>
 
 #include <arpa/inet.h>
+#include <endian.h>
 
 #include "dback.h"
+#include "wal.h"
+#include "pagestore.h"
+#include "keysearch.h"
+#include "hashindex.h"
+#include "bloomfilter.h"
 #include "r2btree.h"
 
 namespace dback {
 
+/// Most search index levels a page can need, R2_MAX_KEYS_PER_PAGE < 2^16.
+static const uint32_t R2_INDEX_LEVELS = 16;
+
+/// Position mergeRun gives a key already in the leaf.
+static const uint32_t R2_NO_POS = UINT32_MAX;
+
+static uint32_t
+r2_align_line(uint32_t off)
+{
+    return (off + R2_CACHE_LINE - 1) & ~(R2_CACHE_LINE - 1);
+}
+
+/*
+ * Bytes of a non-leaf value: the child page number, then the subtree
+ * maximum, count and sum the tree keeps.
+ */
+static uint32_t
+r2_non_leaf_val_size(uint32_t subtreeMax, uint32_t subtreeCounts,
+		     uint32_t subtreeSums)
+{
+    return sizeof(uint32_t) + (subtreeMax ? sizeof(uint64_t) : 0)
+	+ (subtreeCounts ? sizeof(uint64_t) : 0)
+	+ (subtreeSums ? sizeof(uint64_t) : 0);
+}
+
+/*
+ * Keys per block of the R2LayoutIndexed search index.
+ */
+static uint32_t
+r2_index_block(uint32_t keySize)
+{
+    uint32_t b = R2_CACHE_LINE / keySize;
+    return b < 2 ? 2 : b;
+}
+
+/*
+ * Offset of the key array of a R2LayoutIndexed non-leaf page that can
+ * hold n keys of values of valSize bytes. Room is left for the extra
+ * value, as for R2LayoutSorted.
+ */
+static uint32_t
+r2_index_keys_offset(uint32_t valSize, uint32_t n)
+{
+    return r2_align_line(sizeof(R2PageHeader) + (n + 1) * valSize);
+}
+
+/*
+ * Work out where the search index levels of a non-leaf page go.
+ *
+ * n is the most keys the page can hold, each with a value of valSize
+ * bytes. off[l] and cap[l] are set to the offset and the most keys of
+ * the level above level l, level 0 being the key array. *end is set to the offset just past the index.
+ *
+ * Returns the number of index levels.
+ */
+static uint32_t
+r2_index_levels(uint32_t keySize, uint32_t valSize, uint32_t n, uint32_t *off,
+		uint32_t *cap, uint32_t *end)
+{
+    uint32_t b = r2_index_block(keySize);
+    uint32_t pos = r2_align_line(r2_index_keys_offset(valSize, n)
+				 + n * keySize);
+    uint32_t levels = 0;
+
+    while (n > b && levels < R2_INDEX_LEVELS) {
+	n = (n - 1) / b;
+	off[levels] = pos;
+	cap[levels] = n;
+	pos = r2_align_line(pos + (n + b - 1) / b * b * keySize);
+	levels++;
+    }
+
+    *end = pos;
+    return levels;
+}
+
+/****************************************************/
+/****************************************************/
+/* latches                                          */
+/****************************************************/
+/****************************************************/
+
+uint32_t
+R2Latch::readLock(R2PageHeader *h)
+{
+    uint32_t v = __atomic_load_n(&h->version, __ATOMIC_ACQUIRE);
+    while (v & 0x01) {
+	boost::this_thread::yield();
+	v = __atomic_load_n(&h->version, __ATOMIC_ACQUIRE);
+    }
+    return v;
+}
+
+bool
+R2Latch::validate(R2PageHeader *h, uint32_t v)
+{
+    // keep the page reads before the version read
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&h->version, __ATOMIC_RELAXED) == v;
+}
+
+void
+R2Latch::lock(R2PageHeader *h)
+{
+    for (;;) {
+	uint32_t v = __atomic_load_n(&h->version, __ATOMIC_RELAXED);
+	if ((v & 0x01) == 0
+	    && __atomic_compare_exchange_n(&h->version, &v, v + 1, false,
+					   __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+	    return;
+	boost::this_thread::yield();
+    }
+}
+
+void
+R2Latch::unlock(R2PageHeader *h, bool changed)
+{
+    uint32_t v = h->version;
+    __atomic_store_n(&h->version, changed ? v + 1 : v - 1, __ATOMIC_RELEASE);
+}
+
+void
+R2WriteLatch::lock(R2PageHeader *h)
+{
+    this->release();
+    R2Latch::lock(h);
+    this->header = h;
+    this->changed = false;
+}
+
+void
+R2WriteLatch::release()
+{
+    if (this->header == NULL)
+	return;
+
+    R2Latch::unlock(this->header, this->changed);
+    this->header = NULL;
+    this->changed = false;
+}
+
+void
+R2WriteLatch::moveFrom(R2WriteLatch *other)
+{
+    this->release();
+
+    this->header = other->header;
+    this->changed = other->changed;
+
+    other->header = NULL;
+    other->changed = false;
+}
+
 /****************************************************/
 /****************************************************/
 /* btree funcs                                      */
@@ -26,17 +190,13 @@ R2BTree::blockInsert(boost::shared_mutex *l,
 		     uint8_t *val,
 		     ErrorInfo *err)
 {
-    uint32_t n_to_move, idx;
-    size_t bytes_to_move;
-    uint8_t *dst, *src, pt;
+    uint32_t idx;
     bool found, result;
 
     result = false;
     l->lock();
 
-    pt = ac->header->pageType;
-
-    if (ac->header->numKeys + 1 > this->header->maxNumKeys[ pt ]) {
+    if (ac->header->numKeys + 1 > this->maxKeys(ac)) {
 	err->setErrNum(ErrorInfo::ERR_NODE_FULL);
 	err->message.assign("page full");
 	goto out;
@@ -50,26 +210,7 @@ R2BTree::blockInsert(boost::shared_mutex *l,
 	goto out;
     }
 
-
-    if (idx > 0 || ac->header->numKeys > 0) {
-	n_to_move = ac->header->numKeys - idx;
-	bytes_to_move = n_to_move * this->header->keySize;
-	dst = ac->keys + ((idx + 1) * this->header->keySize);
-	src = ac->keys + idx * this->header->keySize;
-	memmove(dst, src, bytes_to_move);
-
-	bytes_to_move = n_to_move * this->header->valSize[pt];
-	dst = ac->vals + ((idx + 1) * this->header->valSize[pt]);
-	src = ac->vals + (idx * this->header->valSize[pt]);
-	memmove(dst, src, bytes_to_move);
-    }
-
-    dst = ac->keys + idx * this->header->keySize;
-    memcpy(dst, key, this->header->keySize);
-    dst = ac->vals + idx * this->header->valSize[pt];
-    memcpy(dst, val, this->header->valSize[pt]);
-
-    ac->header->numKeys++;
+    this->insertAt(ac, idx, key, val);
 
     result = true;
 
@@ -85,10 +226,8 @@ R2BTree::blockDelete(boost::shared_mutex *l,
 		     ErrorInfo *err)
 {
     bool result, found;
-    uint32_t idx, n_to_move;
-    size_t bytes_to_move;
-    uint8_t *dst, *src, ptype;
-
+    uint32_t idx;
+    uint8_t ptype;
 
     result = false;
     l->lock();
@@ -107,19 +246,7 @@ R2BTree::blockDelete(boost::shared_mutex *l,
 	goto out;
     }
 
-    n_to_move = ac->header->numKeys - idx;
-    bytes_to_move = n_to_move * this->header->keySize;
-    dst = ac->keys + idx * this->header->keySize;
-    src = ac->keys + (idx + 1) * this->header->keySize;
-    memmove(dst, src, bytes_to_move);
-
-    bytes_to_move = n_to_move * sizeof(uint32_t);
-
-    dst = ac->vals + idx * this->header->valSize[ ac->header->pageType ];
-    src = ac->vals + (idx + 1) * this->header->valSize[ ac->header->pageType ];
-    memmove(dst, src, bytes_to_move);
-
-    ac->header->numKeys--;
+    this->removeAt(ac, idx);
     result = true;
 
 out:
@@ -161,276 +288,3490 @@ out:
     return result;
 }
 
-
-
-/********************************************************/
-
 bool
-R2BTree::splitNode(R2PageAccess *full, R2PageAccess *empty, uint8_t *key,
-		   ErrorInfo *err)
+R2BTree::latchInsert(R2PageAccess *ac,
+		     uint8_t *key,
+		     uint8_t *val,
+		     ErrorInfo *err)
 {
-    if (full == NULL) {
-	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
-	err->message.assign("invalid input");
+    uint32_t idx;
+    R2WriteLatch latch;
+
+    latch.lock(ac->header);
+
+    if ((uint32_t)ac->header->numKeys + 1 > this->maxKeys(ac)) {
+	err->setErrNum(ErrorInfo::ERR_NODE_FULL);
+	err->message.assign("page full");
 	return false;
     }
 
-    if (empty == NULL
-	|| empty->header->numKeys != 0) {
-	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
-	err->message.assign("invalid input");
+    if (this->findKeyPosition(ac, key, &idx)) {
+	err->setErrNum(ErrorInfo::ERR_DUPLICATE_INSERT);
+	err->message.assign("attempt to insert duplicate key");
 	return false;
     }
 
-    int ft = full->header->pageType;
-    int et = empty->header->pageType;
+    this->insertAt(ac, idx, key, val);
+    latch.setChanged();
 
-    if (ft != et || full->header->numKeys != this->header->maxNumKeys[ft]) {
-	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
-	err->message.assign("invalid input");
+    return true;
+}
+
+bool
+R2BTree::latchDelete(R2PageAccess *ac,
+		     uint8_t *key,
+		     ErrorInfo *err)
+{
+    uint32_t idx;
+    uint8_t ptype;
+    R2WriteLatch latch;
+
+    latch.lock(ac->header);
+
+    if ( ! this->findKeyPosition(ac, key, &idx)) {
+	err->setErrNum(ErrorInfo::ERR_KEY_NOT_FOUND);
+	err->message.assign("key not found");
 	return false;
-    }	
+    }
 
-    if (key == NULL) {
-	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
-	err->message.assign("invalid input");
+    ptype = ac->header->pageType;
+    if (ac->header->numKeys <= this->header->minNumKeys[ptype]) {
+	err->setErrNum(ErrorInfo::ERR_UNDERFLOW);
+	err->message.assign("node would underflow");
 	return false;
     }
 
-    size_t bytes;
-    uint8_t *src;
-    uint32_t move_start_idx = full->header->numKeys / 2;
-    uint32_t n_to_move = full->header->numKeys - move_start_idx;
+    this->removeAt(ac, idx);
+    latch.setChanged();
 
-    bytes = n_to_move * this->header->keySize;
-    src = full->keys + move_start_idx * this->header->keySize;
-    memmove(empty->keys, src, bytes);
+    return true;
+}
 
-    src = full->keys + move_start_idx * this->header->keySize;
-    memmove(key, src, this->header->keySize);
+bool
+R2BTree::latchFind(R2PageAccess *ac,
+		   uint8_t *key,
+		   uint8_t *val,
+		   ErrorInfo *err)
+{
+    bool found;
+    uint32_t idx, v;
 
-    bytes = n_to_move * this->header->valSize[ft];
-    src = full->vals + move_start_idx * this->header->valSize[ft];
-    memmove(empty->vals, src, bytes);
+    do {
+	v = R2Latch::readLock(ac->header);
+	found = this->findKeyPosition(ac, key, &idx);
+	if (found && val != NULL)
+	    this->getData(val, ac, idx);
+    } while ( ! R2Latch::validate(ac->header, v));
 
-    empty->header->numKeys = n_to_move;
-    full->header->numKeys = move_start_idx;
+    if (found == false) {
+	err->setErrNum(ErrorInfo::ERR_KEY_NOT_FOUND);
+	err->message.assign("key not found");
+	return false;
+    }
 
     return true;
 }
 
+
+
+/****************************************************/
+/****************************************************/
+/* tree level funcs                                 */
+/****************************************************/
+/****************************************************/
+
 bool
-R2BTree::concatNodes(R2PageAccess *dst, R2PageAccess *src, bool dstIsFirst,
-		     ErrorInfo *err)
+R2BTree::initTree(ErrorInfo *err)
 {
-    if (dst == NULL || src == NULL) {
-	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
-	err->message.assign("invalid input");
+    if ( ! this->checkHeader(err))
 	return false;
-    }
 
-    int dt = dst->header->pageType;
-    int st = src->header->pageType;
+    boost::mutex::scoped_lock guard(this->snapLock, boost::defer_lock);
+    if (this->copyOnWrite)
+	guard.lock();
 
-    if (dt != st) {
-	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
-	err->message.assign("invalid input");
-	return false;
-    }
+    this->logBegin();
 
-    if (dst->header->numKeys + src->header->numKeys
-	!= this->header->maxNumKeys[st]) {
-	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
-	err->message.assign("invalid input");
+    PagePin pin;
+    R2PageAccess ac;
+    uint32_t pn;
+    uint8_t *buf = this->allocPage(&pin, &pn, err);
+    if (buf == NULL)
 	return false;
-    }
 
-    size_t dst_idx, bytes_to_move;
-    size_t vsize = this->header->valSize[dt];
+    this->initLeafPage(buf);
+    this->initPageAccess(&ac, buf);
+    this->setDirty(&pin, &ac);
+    this->setRoot(pn);
+    this->appendPageNum = 0;
+    if (this->hashIndex != NULL)
+	this->hashIndex->clear();
+    if (this->bloomFilter != NULL)
+	this->bloomFilter->clear();
+    pin.release();
 
-    if ( ! dstIsFirst) {
-	size_t slots_needed = src->header->numKeys;
-	uint8_t *val_dst = dst->vals + slots_needed * vsize;
-	bytes_to_move = dst->header->numKeys * vsize;
-	memmove(val_dst, dst->vals, bytes_to_move);
+    return this->logEnd(err);
+}
 
-	uint8_t *key_dst = dst->keys + slots_needed * this->header->keySize;
-	bytes_to_move = dst->header->numKeys * this->header->keySize;
-	memmove(key_dst, dst->keys, bytes_to_move);
+bool
+R2BTree::insert(uint8_t *key, uint8_t *val, ErrorInfo *err)
+{
+    ErrorInfo log_err;
+    boost::mutex::scoped_lock guard(this->snapLock, boost::defer_lock);
+    if (this->copyOnWrite)
+	guard.lock();
 
-	dst_idx = 0;
+    this->logBegin();
+    bool ok = this->insertPages(key, val, err);
+    if (this->copyOnWrite)
+	this->freeRetired();
+    if ( ! this->logEnd(ok ? err : &log_err))
+	return false;
+
+    return ok;
+}
+
+bool
+R2BTree::insertPages(uint8_t *key, uint8_t *val, ErrorInfo *err)
+{
+    std::vector<uint32_t> path_pn;
+    std::vector<uint32_t> path_idx;
+    PagePin cur_pin;
+    R2PageAccess ac;
+    uint32_t idx;
+
+    if (this->appendLeaf(key, val)) {
+	this->indexKey(key, val);
+	return true;
     }
-    else {
-	dst_idx = dst->header->numKeys;
+
+    if ( ! this->descendInsert(key, &cur_pin, &ac, NULL, NULL, &path_pn,
+			       &path_idx, err))
+	return false;
+
+    if ( ! this->copyOnWrite && ac.header->nextPageNum == 0) {
+	this->appendPageNum = cur_pin.getPageNum();
+	this->appendHeader = this->header;
     }
 
-    uint8_t *key_dst = dst->keys + dst_idx * this->header->keySize;
-    bytes_to_move = src->header->numKeys * this->header->keySize;
-    memmove(key_dst, src->keys, bytes_to_move);
+    if (this->findKeyPosition(&ac, key, &idx)) {
+	err->setErrNum(ErrorInfo::ERR_DUPLICATE_INSERT);
+	err->message.assign("attempt to insert duplicate key");
+	return false;
+    }
 
-    uint8_t *val_dst = dst->vals + dst_idx * vsize;
-    bytes_to_move = src->header->numKeys * vsize;
-    memmove(val_dst, src->vals, bytes_to_move);
+    this->insertAt(&ac, idx, key, val);
+    this->setDirtyLeaf(&cur_pin, &ac, R2LogInsert, idx, key, val);
+    this->indexKey(key, val);
 
-    dst->header->numKeys += src->header->numKeys;
-    src->header->numKeys = 0;
+    if (this->header->subtreeMax || this->header->subtreeCounts) {
+	uint64_t m = this->header->subtreeMax ? this->valueField(val) : 0;
+	uint64_t sum = this->header->subtreeSums ? this->sumField(val) : 0;
+	cur_pin.release();
+	return this->raiseStats(&path_pn, &path_idx, m, 1, sum, err);
+    }
 
     return true;
 }
 
 bool
-R2BTree::redistributeNodes(R2PageAccess *n1, R2PageAccess *n2, ErrorInfo *err)
+R2BTree::appendLeaf(uint8_t *key, uint8_t *val)
 {
-    if (n1 == NULL
-	|| n2 == NULL
-	|| n1->header->pageType != n2->header->pageType) {
-	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
-	err->message.assign("invalid input");
+    if (this->appendPageNum == 0 || this->appendHeader != this->header
+	|| this->copyOnWrite || this->header->subtreeMax
+	|| this->header->subtreeCounts)
 	return false;
-    }
 
-    int pt = n1->header->pageType;
-    size_t minNumKeys = this->header->minNumKeys[pt];
-    if (n1->header->numKeys + n2->header->numKeys < 2 * minNumKeys) {
-	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
-	err->message.assign("invalid input");
+    PagePin pin;
+    R2PageAccess ac;
+    ErrorInfo pin_err;
+    if ( ! this->pinPage(&pin, &ac, this->appendPageNum, &pin_err))
 	return false;
-    }
-    
-    if (n1->header->numKeys >= minNumKeys
-	&& n2->header->numKeys >= minNumKeys) {
-	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
-	err->message.assign("invalid input");
+
+    uint32_t n = ac.header->numKeys;
+    if (ac.header->pageType != PageTypeLeaf
+	|| ac.header->nextPageNum != 0
+	|| ac.header->prefixLen != 0
+	|| n == 0 || n == this->maxKeys(&ac)
+	|| this->compareAt(&ac, n - 1, key) >= 0)
 	return false;
-    }
 
-    uint8_t *src, *dst;
-    size_t src_idx, nbytes;
+    this->insertAt(&ac, n, key, val);
+    this->setDirtyLeaf(&pin, &ac, R2LogInsert, n, key, val);
+    this->nAppends++;
 
-    if (n1->header->numKeys >= n2->header->numKeys) {
-	size_t n2_needs = minNumKeys - n2->header->numKeys;
+    return true;
+}
 
-	nbytes = n2->header->numKeys * this->header->keySize;
-	dst = n2->keys + n2_needs * this->header->keySize;
-	memmove(dst, n2->keys, nbytes);
-	
-	src_idx = n1->header->numKeys - n2_needs;
+uint8_t *
+R2BTree::appendSplitKey(R2PageAccess *ac, uint8_t *key, bool edge)
+{
+    if ( ! this->appendSplit || ! edge
+	|| this->compareAt(ac, ac->header->numKeys - 1, key) >= 0)
+	return NULL;
 
-	nbytes = n2_needs * this->header->keySize;
-	src = n1->keys + src_idx * this->header->keySize;
-	memmove(n2->keys, src, nbytes);
+    return key;
+}
 
-	nbytes = n2->header->numKeys * this->header->valSize[pt];
-	dst = n2->vals + n2_needs * this->header->valSize[pt];
-	memmove(dst, n2->vals, nbytes);
+bool
+R2BTree::raiseStats(std::vector<uint32_t> *pathPn,
+		    std::vector<uint32_t> *pathIdx, uint64_t m, uint64_t n,
+		    uint64_t sum, ErrorInfo *err)
+{
+    for (size_t i = pathPn->size(); i > 0; i--) {
+	PagePin pin;
+	R2PageAccess ac;
+	if ( ! this->pinPage(&pin, &ac, (*pathPn)[i - 1], err))
+	    return false;
 
-	nbytes = n2_needs * this->header->valSize[pt];
-	src = n1->vals + src_idx * this->header->valSize[pt];
+	uint32_t idx = (*pathIdx)[i - 1];
+	bool raise = this->header->subtreeMax
+	    && this->getChildMax(&ac, idx) < m;
+	if ( ! raise && ! this->header->subtreeCounts)
+	    break;
+
+	if (raise) {
+	    this->setChildMax(&ac, idx, m);
+	    this->setDirty(&pin, &ac);
+	}
+	if (this->header->subtreeCounts) {
+	    this->setChildCount(&ac, idx, this->getChildCount(&ac, idx) + n);
+	    if (this->header->subtreeSums)
+		this->setChildSum(&ac, idx, this->getChildSum(&ac, idx) + sum);
+	    this->setDirtyCount(&pin, &ac, idx, n, sum);
+	}
+    }
+
+    return true;
+}
+
+bool
+R2BTree::descendInsert(uint8_t *key, PagePin *pin, R2PageAccess *leaf,
+		       uint8_t *hi, bool *hasHi, std::vector<uint32_t> *pathPn,
+		       std::vector<uint32_t> *pathIdx, ErrorInfo *err)
+{
+    PagePin cur_pin, child_pin;
+    R2PageAccess ac, child;
+    uint32_t idx, pn;
+    size_t ks = this->header->keySize;
+
+    if (hasHi != NULL)
+	*hasHi = false;
+
+    if ( ! this->pinPage(&cur_pin, &ac, this->header->rootPageNum, err))
+	return false;
+    if ( ! this->copyPage(&cur_pin, &ac, NULL, NULL, 0, err))
+	return false;
+    pn = cur_pin.getPageNum();
+
+    // true while the pages passed are the last of their level
+    bool edge = true;
+
+    if (ac.header->numKeys == this->maxKeys(&ac)) {
+	PagePin root_pin;
+	uint32_t new_pn;
+	uint8_t *buf = this->allocPage(&root_pin, &new_pn, err);
+	if (buf == NULL)
+	    return false;
+
+	R2PageAccess new_root;
+	std::vector<uint8_t> first(this->header->keySize), entry;
+	this->copyKey(&ac, 0, &first[0]);
+	this->childEntry(pn, &entry);
+	this->initNonLeafPage(buf);
+	this->initPageAccess(&new_root, buf);
+	new_root.header->level = ac.header->level + 1;
+	this->insertAt(&new_root, 0, &first[0], &entry[0]);
+	this->setDirty(&root_pin, &new_root);
+	this->setRoot(new_pn);
+
+	this->setDirty(&cur_pin, &ac);
+	if ( ! this->splitChild(&new_root, 0, &ac,
+				this->appendSplitKey(&ac, key, edge), err))
+	    return false;
+
+	cur_pin.moveFrom(&root_pin);
+	ac = new_root;
+    }
+
+    while (ac.header->pageType == PageTypeNonLeaf) {
+	idx = this->findChildIndex(&ac, key);
+
+	// key 0 must stay <= every key under child 0 so the keys
+	// of the node stay sorted
+	if (idx == 0 && this->ki->compare(key, ac.keys) < 0) {
+	    memcpy(ac.keys, key, this->header->keySize);
+	    this->setDirty(&cur_pin, &ac);
+	}
+
+	pn = this->getChildPageNum(&ac, idx);
+	if ( ! this->pinPage(&child_pin, &child, pn, err))
+	    return false;
+	if ( ! this->copyPage(&child_pin, &child, &cur_pin, &ac, idx, err))
+	    return false;
+
+	edge = edge && idx + 1 == ac.header->numKeys;
+
+	if (child.header->numKeys == this->maxKeys(&child)) {
+	    this->setDirty(&cur_pin, &ac);
+	    this->setDirty(&child_pin, &child);
+	    if ( ! this->splitChild(&ac, idx, &child,
+				    this->appendSplitKey(&child, key, edge), err))
+		return false;
+
+	    uint8_t *sep = ac.keys + (idx + 1) * ks;
+	    if (this->ki->compare(key, sep) >= 0) {
+		idx++;
+		pn = this->getChildPageNum(&ac, idx);
+		if ( ! this->pinPage(&child_pin, &child, pn, err))
+		    return false;
+	    }
+	    edge = edge && idx + 1 == ac.header->numKeys;
+	}
+
+	// the fences of a node lie inside those of its parent
+	if (hi != NULL && idx + 1 < ac.header->numKeys) {
+	    memcpy(hi, ac.keys + (idx + 1) * ks, ks);
+	    *hasHi = true;
+	}
+
+	if (pathPn != NULL) {
+	    pathPn->push_back(cur_pin.getPageNum());
+	    pathIdx->push_back(idx);
+	}
+
+	cur_pin.moveFrom(&child_pin);
+	ac = child;
+    }
+
+    pin->moveFrom(&cur_pin);
+    *leaf = ac;
+
+    return true;
+}
+
+/*
+ * Orders positions in a batch by their keys.
+ */
+class R2BatchLess {
+public:
+    R2KeyInterface *ki;
+    const uint8_t *keys;
+    size_t keySize;
+
+    R2BatchLess(R2KeyInterface *k, const uint8_t *b, size_t s)
+	: ki(k), keys(b), keySize(s) {;};
+
+    bool operator()(uint32_t a, uint32_t b) const {
+	return this->ki->compare(this->keys + a * this->keySize,
+				 this->keys + b * this->keySize) < 0;
+    };
+};
+
+bool
+R2BTree::insertBatch(uint8_t *keys, uint8_t *vals, uint32_t n,
+		     uint32_t *nInserted, ErrorInfo *err)
+{
+    ErrorInfo log_err;
+    boost::mutex::scoped_lock guard(this->snapLock, boost::defer_lock);
+    if (this->copyOnWrite)
+	guard.lock();
+
+    this->logBegin();
+    bool ok = this->insertBatchPages(keys, vals, n, nInserted, err);
+    if (this->copyOnWrite)
+	this->freeRetired();
+    if ( ! this->logEnd(ok ? err : &log_err))
+	return false;
+
+    return ok;
+}
+
+bool
+R2BTree::insertBatchPages(uint8_t *keys, uint8_t *vals, uint32_t n,
+			  uint32_t *nInserted, ErrorInfo *err)
+{
+    size_t ks = this->header->keySize;
+    size_t vs = this->header->valSize[PageTypeLeaf];
+    uint32_t i, j, m, inserted = 0;
+
+    if (nInserted != NULL)
+	*nInserted = 0;
+
+    // sort, keeping the first of any repeated key
+    std::vector<uint32_t> order(n);
+    for (i = 0; i < n; i++)
+	order[i] = i;
+    std::stable_sort(order.begin(), order.end(),
+		     R2BatchLess(this->ki, keys, ks));
+
+    std::vector<uint8_t> run_keys(n * ks), run_vals(n * vs);
+    for (i = 0, m = 0; i < n; i++) {
+	const uint8_t *k = keys + order[i] * ks;
+	if (m > 0 && this->ki->compare(&run_keys[(m - 1) * ks], k) == 0)
+	    continue;
+	memcpy(&run_keys[m * ks], k, ks);
+	memcpy(&run_vals[m * vs], vals + order[i] * vs, vs);
+	m++;
+    }
+
+    std::vector<uint8_t> hi(ks);
+    std::vector<uint32_t> pos(m);
+    std::vector<uint32_t> path_pn;
+    std::vector<uint32_t> path_idx;
+    for (i = 0; i < m; i = j) {
+	PagePin pin;
+	R2PageAccess ac;
+	bool has_hi;
+
+	path_pn.clear();
+	path_idx.clear();
+	if ( ! this->descendInsert(&run_keys[i * ks], &pin, &ac, &hi[0],
+				   &has_hi, &path_pn, &path_idx, err)) {
+	    if (nInserted != NULL)
+		*nInserted = inserted;
+	    return false;
+	}
+
+	// the keys below the next separator, as many as there is room for
+	uint32_t room = this->maxKeys(&ac) - ac.header->numKeys;
+	for (j = i + 1; j < m && j - i < room; j++) {
+	    if (has_hi && this->ki->compare(&run_keys[j * ks], &hi[0]) >= 0)
+		break;
+	}
+
+	inserted += this->mergeRun(&ac, &run_keys[i * ks], &run_vals[i * vs],
+				   j - i, &pos[0]);
+	this->setDirty(&pin, &ac);
+
+	for (uint32_t b = 0; b < j - i; b++) {
+	    if (pos[b] != R2_NO_POS)
+		this->indexKey(&run_keys[(i + b) * ks], &run_vals[(i + b) * vs]);
+	}
+
+	if (this->header->subtreeMax || this->header->subtreeCounts) {
+	    uint64_t mx = 0, cnt = 0, sum = 0;
+	    for (uint32_t b = 0; b < j - i; b++) {
+		if (pos[b] == R2_NO_POS)
+		    continue;
+		uint8_t *v = &run_vals[(i + b) * vs];
+		if (this->header->subtreeMax)
+		    mx = std::max(mx, this->valueField(v));
+		if (this->header->subtreeSums)
+		    sum += this->sumField(v);
+		cnt++;
+	    }
+	    pin.release();
+	    if ( ! this->raiseStats(&path_pn, &path_idx, mx, cnt, sum, err)) {
+		if (nInserted != NULL)
+		    *nInserted = inserted;
+		return false;
+	    }
+	}
+    }
+
+    if (nInserted != NULL)
+	*nInserted = inserted;
+
+    if (inserted != n) {
+	err->setErrNum(ErrorInfo::ERR_DUPLICATE_INSERT);
+	err->message.assign("batch held keys already inserted");
+	return false;
+    }
+
+    return true;
+}
+
+int
+R2BTree::compareAt(R2PageAccess *ac, uint32_t idx, const uint8_t *key)
+{
+    size_t p = ac->header->prefixLen;
+
+    // keys with a prefix are ordered as by memcmp
+    if (p != 0) {
+	size_t kl = this->header->keySize - p;
+	return memcmp(ac->keys + idx * kl, key + p, kl);
+    }
+
+    return this->ki->compare(ac->keys + idx * this->header->keySize, key);
+}
+
+uint32_t
+R2BTree::mergeRun(R2PageAccess *ac, const uint8_t *keys, const uint8_t *vals,
+		  uint32_t n, uint32_t *pos)
+{
+    size_t p = ac->header->prefixLen;
+    size_t ks = this->header->keySize;
+    size_t kl = ks - p;
+    size_t vs = this->header->valSize[PageTypeLeaf];
+    uint32_t n_page = ac->header->numKeys;
+    uint32_t a, b, dups = 0;
+
+    // find where each key goes, searching only past the previous one
+    for (a = 0, b = 0; b < n; b++) {
+	uint32_t lo = a, hi = n_page;
+	while (lo < hi) {
+	    uint32_t mid = lo + (hi - lo) / 2;
+	    if (this->compareAt(ac, mid, keys + b * ks) < 0)
+		lo = mid + 1;
+	    else
+		hi = mid;
+	}
+	a = lo;
+	if (lo < n_page && this->compareAt(ac, lo, keys + b * ks) == 0) {
+	    pos[b] = R2_NO_POS;
+	    dups++;
+	}
+	else {
+	    pos[b] = lo;
+	}
+    }
+
+    // a slotted leaf needs a free cell for each new value
+    if (ac->slots != NULL
+	&& ac->header->numCells + n - dups > this->maxKeys(ac))
+	this->compactLeaf(ac);
+
+    // merge from the end, each block of page keys moves once
+    uint32_t w = n_page + n - dups;
+    a = n_page;
+    for (b = n; b > 0; b--) {
+	if (pos[b - 1] == R2_NO_POS)
+	    continue;
+	uint32_t len = a - pos[b - 1];
+	w -= len;
+	a -= len;
+	memmove(ac->keys + w * kl, ac->keys + a * kl, len * kl);
+	w--;
+	memcpy(ac->keys + w * kl, keys + (b - 1) * ks + p, kl);
+
+	if (ac->slots != NULL) {
+	    uint16_t cell = ac->header->numCells++;
+	    memmove(ac->slots + w + 1, ac->slots + a, len * sizeof(uint16_t));
+	    ac->slots[w] = cell;
+	    memcpy(ac->vals + cell * vs, vals + (b - 1) * vs, vs);
+	}
+	else {
+	    memmove(ac->vals + (w + 1) * vs, ac->vals + a * vs, len * vs);
+	    memcpy(ac->vals + w * vs, vals + (b - 1) * vs, vs);
+	}
+    }
+
+    ac->header->numKeys = n_page + n - dups;
+
+    return n - dups;
+}
+
+bool
+R2BTree::find(uint8_t *key, uint8_t *val, ErrorInfo *err)
+{
+    // the filter answers most misses from a single block
+    if (this->bloomFilter != NULL && ! this->bloomFilter->mayContain(key)) {
+	err->setErrNum(ErrorInfo::ERR_KEY_NOT_FOUND);
+	err->message.assign("key not found");
+	return false;
+    }
+
+    if (this->hashIndex == NULL)
+	return this->findFrom(this->header->rootPageNum, key, val, err);
+
+    // the hash index holds every key, a miss needs no descent
+    if ( ! this->hashIndex->find(key, val)) {
+	err->setErrNum(ErrorInfo::ERR_KEY_NOT_FOUND);
+	err->message.assign("key not found");
+	return false;
+    }
+
+    return true;
+}
+
+bool
+R2BTree::findFrom(uint32_t rootPageNum, uint8_t *key, uint8_t *val,
+		  ErrorInfo *err)
+{
+    PagePin pin;
+    R2PageAccess ac;
+    uint32_t idx, pn;
+
+    if ( ! this->pinPage(&pin, &ac, rootPageNum, err))
+	return false;
+
+    while (ac.header->pageType == PageTypeNonLeaf) {
+	idx = this->findChildIndex(&ac, key);
+	pn = this->getChildPageNum(&ac, idx);
+	if ( ! this->pinPage(&pin, &ac, pn, err))
+	    return false;
+    }
+
+    if ( ! this->findKeyPosition(&ac, key, &idx)) {
+	err->setErrNum(ErrorInfo::ERR_KEY_NOT_FOUND);
+	err->message.assign("key not found");
+	return false;
+    }
+
+    if (val != NULL)
+	return this->getData(val, &ac, idx);
+
+    return true;
+}
+
+bool
+R2BTree::findBatch(uint8_t *keys, uint8_t *vals, bool *found, uint32_t n,
+		   ErrorInfo *err)
+{
+    PagePin pins[R2_FIND_GROUP];
+    R2PageAccess acs[R2_FIND_GROUP];
+    size_t ks = this->header->keySize;
+    size_t vs = this->header->valSize[PageTypeLeaf];
+    uint32_t at[R2_FIND_GROUP];
+    uint32_t i, g, m, idx, pn;
+
+    if (this->hashIndex != NULL) {
+	for (i = 0; i < n; i++)
+	    found[i] = (this->bloomFilter == NULL
+			|| this->bloomFilter->mayContain(keys + i * ks))
+		&& this->hashIndex->find(keys + i * ks,
+					 vals != NULL ? vals + i * vs : NULL);
+	return true;
+    }
+
+    for (i = 0; i < n; ) {
+	// group the next keys the filter does not rule out
+	for (m = 0; i < n && m < R2_FIND_GROUP; i++) {
+	    if (this->bloomFilter != NULL
+		&& ! this->bloomFilter->mayContain(keys + i * ks))
+		found[i] = false;
+	    else
+		at[m++] = i;
+	}
+	if (m == 0)
+	    break;
+
+	for (g = 0; g < m; g++)
+	    if ( ! this->pinPage(&pins[g], &acs[g], this->header->rootPageNum,
+				 err))
+		return false;
+
+	// every leaf is at level 0, so the group moves down together
+	while (acs[0].header->pageType == PageTypeNonLeaf) {
+	    uint32_t type = acs[0].header->level == 1
+		? PageTypeLeaf : PageTypeNonLeaf;
+
+	    // search each page and ask for the child, but do not read it
+	    for (g = 0; g < m; g++) {
+		idx = this->findChildIndex(&acs[g], keys + at[g] * ks);
+		pn = this->getChildPageNum(&acs[g], idx);
+		uint8_t *buf = pins[g].pin(this->ps, pn, err);
+		if (buf == NULL)
+		    return false;
+		this->prefetchPage(buf, type);
+	    }
+
+	    for (g = 0; g < m; g++)
+		this->initPageAccess(&acs[g], pins[g].getBuf());
+	}
+
+	for (g = 0; g < m; g++) {
+	    found[at[g]] = this->findKeyPosition(&acs[g], keys + at[g] * ks,
+						 &idx);
+	    if (found[at[g]] && vals != NULL)
+		this->getData(vals + at[g] * vs, &acs[g], idx);
+	    pins[g].release();
+	}
+    }
+
+    return true;
+}
+
+void
+R2BTree::prefetchPage(uint8_t *buf, uint32_t pageType)
+{
+    uint32_t n = this->header->maxNumKeys[pageType];
+    size_t ks = this->header->keySize;
+
+    __builtin_prefetch(buf);
+
+    if (pageType == PageTypeNonLeaf
+	&& this->header->nonLeafLayout == R2LayoutIndexed) {
+	uint32_t off[R2_INDEX_LEVELS], cap[R2_INDEX_LEVELS], end;
+	uint32_t levels = r2_index_levels(ks, this->header->valSize[pageType],
+					  n, off, cap, &end);
+	for (uint32_t l = 0; l < levels; l++)
+	    __builtin_prefetch(buf + off[l]);
+	return;
+    }
+
+    // pages are kept at least half full, so guess 3/4 full
+    uint8_t *keys = buf + sizeof(R2PageHeader)
+	+ n * this->header->valSize[pageType];
+    if (pageType == PageTypeLeaf && this->header->leafLayout == R2LeafSlotted)
+	keys += n * sizeof(uint16_t);
+    uint32_t mid = n * 3 / 8;
+    __builtin_prefetch(keys + mid * ks);
+    __builtin_prefetch(keys + mid / 2 * ks);
+    __builtin_prefetch(keys + (mid + mid / 2) * ks);
+}
+
+bool
+R2BTree::findConcurrent(uint8_t *key, uint8_t *val, ErrorInfo *err)
+{
+    PagePin pin;
+    R2PageAccess ac;
+    uint32_t idx, v, next_pn, child_pn = 0;
+    bool found = false, beyond, right;
+
+    if (this->copyOnWrite) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("findConcurrent needs sibling links");
+	return false;
+    }
+
+    if (this->prefixKeys) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("findConcurrent does not support key prefixes");
+	return false;
+    }
+
+    if ( ! this->pinPage(&pin, &ac,
+			 __atomic_load_n(&this->header->rootPageNum,
+					 __ATOMIC_ACQUIRE), err))
+	return false;
+
+    for (;;) {
+	v = R2Latch::readLock(ac.header);
+	next_pn = ac.header->nextPageNum;
+	beyond = next_pn != 0
+	    && (ac.header->numKeys == 0
+		|| this->ki->compare(key, ac.keys + (ac.header->numKeys - 1)
+				     * this->header->keySize) > 0);
+	if (ac.header->pageType == PageTypeNonLeaf) {
+	    idx = this->findChildIndex(&ac, key);
+	    child_pn = this->getChildPageNum(&ac, idx);
+	}
+	else {
+	    found = this->findKeyPosition(&ac, key, &idx);
+	    if (found && val != NULL)
+		this->getData(val, &ac, idx);
+	}
+	if ( ! R2Latch::validate(ac.header, v))
+	    continue;
+
+	// the page may have been split since its parent was read
+	if (beyond) {
+	    if ( ! this->keyInNext(next_pn, key, &right, err))
+		return false;
+	    if (right) {
+		if ( ! this->pinPage(&pin, &ac, next_pn, err))
+		    return false;
+		continue;
+	    }
+	    if ( ! R2Latch::validate(ac.header, v))
+		continue;
+	}
+
+	if (ac.header->pageType == PageTypeLeaf)
+	    break;
+
+	if ( ! this->pinPage(&pin, &ac, child_pn, err))
+	    return false;
+    }
+
+    if ( ! found) {
+	err->setErrNum(ErrorInfo::ERR_KEY_NOT_FOUND);
+	err->message.assign("key not found");
+	return false;
+    }
+
+    return true;
+}
+
+bool
+R2BTree::insertConcurrent(uint8_t *key, uint8_t *val, ErrorInfo *err)
+{
+    size_t ks = this->header->keySize;
+    std::vector<uint8_t> ins_key(key, key + ks);
+    std::vector<uint8_t> ins_val(val, val + this->header->valSize[PageTypeLeaf]);
+    std::vector<uint8_t> sep(ks);
+    // the latch is declared after the pin so it is let go first
+    PagePin pin;
+    R2WriteLatch latch;
+    R2PageAccess ac;
+    uint32_t idx, new_pn;
+    uint8_t level = 0;
+
+    if (this->wal != NULL) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("insertConcurrent is not logged");
+	return false;
+    }
+
+    if (this->header->subtreeMax) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("insertConcurrent does not keep subtree maxima");
+	return false;
+    }
+
+    if (this->header->subtreeCounts) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("insertConcurrent does not keep subtree counts");
+	return false;
+    }
+
+    if (this->copyOnWrite) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("insertConcurrent needs sibling links");
+	return false;
+    }
+
+    if (this->hashIndex != NULL) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("insertConcurrent does not keep the hash index");
+	return false;
+    }
+
+    if (this->bloomFilter != NULL) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("insertConcurrent does not keep the bloom filter");
+	return false;
+    }
+
+    if (this->prefixKeys) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("insertConcurrent does not support key prefixes");
+	return false;
+    }
+
+    if ( ! this->latchCovering(key, level, &pin, &latch, &ac, err))
+	return false;
+
+    if (this->findKeyPosition(&ac, key, &idx)) {
+	err->setErrNum(ErrorInfo::ERR_DUPLICATE_INSERT);
+	err->message.assign("attempt to insert duplicate key");
+	return false;
+    }
+
+    for (;;) {
+	pin.setDirty();
+	latch.setChanged();
+
+	if (ac.header->numKeys < this->header->maxNumKeys[ac.header->pageType]) {
+	    this->findKeyPosition(&ac, &ins_key[0], &idx);
+	    this->insertAt(&ac, idx, &ins_key[0], &ins_val[0]);
+	    return true;
+	}
+
+	if ( ! this->splitRight(&pin, &ac, &ins_key[0], &ins_val[0], &sep[0],
+				&new_pn, err))
+	    return false;
+	if (new_pn == 0)
+	    return true;
+
+	// add the new page one level up, only one latch is held at a time
+	latch.release();
+	pin.release();
+
+	level++;
+	ins_key = sep;
+	ins_val.assign(reinterpret_cast<uint8_t *>(&new_pn),
+		       reinterpret_cast<uint8_t *>(&new_pn) + sizeof(uint32_t));
+	if ( ! this->latchCovering(&ins_key[0], level, &pin, &latch, &ac, err))
+	    return false;
+    }
+}
+
+bool
+R2BTree::erase(uint8_t *key, ErrorInfo *err)
+{
+    ErrorInfo log_err;
+    boost::mutex::scoped_lock guard(this->snapLock, boost::defer_lock);
+    if (this->copyOnWrite)
+	guard.lock();
+
+    this->logBegin();
+    bool ok = this->erasePages(key, err);
+    if (this->copyOnWrite)
+	this->freeRetired();
+    if ( ! this->logEnd(ok ? err : &log_err))
+	return false;
+
+    return ok;
+}
+
+bool
+R2BTree::insertVar(uint8_t *key, const uint8_t *val, uint32_t len,
+		   ErrorInfo *err)
+{
+    if ( ! this->header->varValues) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("values are not variable length");
+	return false;
+    }
+
+    ErrorInfo log_err;
+    boost::mutex::scoped_lock guard(this->snapLock, boost::defer_lock);
+    if (this->copyOnWrite)
+	guard.lock();
+
+    size_t vs = this->header->valSize[PageTypeLeaf];
+    std::vector<uint8_t> slot(vs, 0);
+    uint32_t first = 0;
+    memcpy(&slot[0], &len, sizeof(len));
+
+    this->logBegin();
+    bool ok = true;
+    if (len <= vs - sizeof(len)) {
+	if (len > 0)
+	    memcpy(&slot[sizeof(len)], val, len);
+    }
+    else {
+	ok = this->writeOverflow(val, len, &first, err);
+	memcpy(&slot[sizeof(len)], &first, sizeof(first));
+    }
+
+    if (ok) {
+	ok = this->insertPages(key, &slot[0], err);
+	if ( ! ok && first != 0)
+	    this->freeOverflow(&slot[0]);
+    }
+    if (this->copyOnWrite)
+	this->freeRetired();
+    if ( ! this->logEnd(ok ? err : &log_err))
+	return false;
+
+    return ok;
+}
+
+bool
+R2BTree::findVar(uint8_t *key, std::vector<uint8_t> *val, ErrorInfo *err)
+{
+    if ( ! this->header->varValues) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("values are not variable length");
+	return false;
+    }
+
+    std::vector<uint8_t> slot(this->header->valSize[PageTypeLeaf]);
+    if ( ! this->find(key, &slot[0], err))
+	return false;
+
+    if (val == NULL)
+	return true;
+
+    return this->readValue(&slot[0], val, err);
+}
+
+bool
+R2BTree::readValue(const uint8_t *slot, std::vector<uint8_t> *val,
+		   ErrorInfo *err)
+{
+    uint32_t len, pn;
+    size_t vs = this->header->valSize[PageTypeLeaf];
+    size_t room = this->header->pageSize - sizeof(R2PageHeader);
+
+    memcpy(&len, slot, sizeof(len));
+    if (len <= vs - sizeof(len)) {
+	val->assign(slot + sizeof(len), slot + sizeof(len) + len);
+	return true;
+    }
+
+    memcpy(&pn, slot + sizeof(len), sizeof(pn));
+    val->resize(len);
+
+    PagePin pin;
+    R2PageAccess ac;
+    for (size_t off = 0; off < len; off += room) {
+	if (pn == 0 || ! this->pinPage(&pin, &ac, pn, err))
+	    return false;
+	if (ac.header->pageType != PageTypeOverflow) {
+	    err->setErrNum(ErrorInfo::ERR_IO);
+	    err->message.assign("bad overflow page");
+	    return false;
+	}
+	memcpy(&(*val)[off], ac.vals, std::min(room, len - off));
+	pn = ac.header->nextPageNum;
+    }
+
+    return true;
+}
+
+/*
+ * A page not yet opened, or an entry of an opened leaf, in the best
+ * first walk of findLargest.
+ */
+class R2MaxItem {
+public:
+    /// Largest field under the page, or the field of the entry.
+    uint64_t max;
+
+    /// true for a page.
+    bool isPage;
+
+    /// Page number, or position of the entry in the entries copied.
+    uint32_t num;
+
+    R2MaxItem(uint64_t m, bool p, uint32_t n) : max(m), isPage(p), num(n) {;};
+
+    // an entry goes before a page with the same maximum, which can
+    // hold nothing larger
+    bool operator<(const R2MaxItem &o) const {
+	if (this->max != o.max)
+	    return this->max < o.max;
+	return this->isPage && ! o.isPage;
+    };
+};
+
+bool
+R2BTree::findLargest(uint32_t k, std::vector<uint8_t> *keys,
+		     std::vector<uint8_t> *vals, ErrorInfo *err)
+{
+    keys->clear();
+    vals->clear();
+
+    if ( ! this->header->subtreeMax) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("tree keeps no subtree maxima");
+	return false;
+    }
+
+    size_t ks = this->header->keySize;
+    size_t vs = this->header->valSize[PageTypeLeaf];
+    std::vector<uint8_t> ent_keys, ent_vals;
+    std::priority_queue<R2MaxItem> q;
+    uint32_t n = 0;
+
+    q.push(R2MaxItem(UINT64_MAX, true, this->header->rootPageNum));
+    while (n < k && ! q.empty()) {
+	R2MaxItem it = q.top();
+	q.pop();
+
+	if ( ! it.isPage) {
+	    keys->insert(keys->end(), &ent_keys[it.num * ks],
+			 &ent_keys[it.num * ks] + ks);
+	    vals->insert(vals->end(), &ent_vals[it.num * vs],
+			 &ent_vals[it.num * vs] + vs);
+	    n++;
+	    continue;
+	}
+
+	PagePin pin;
+	R2PageAccess ac;
+	if ( ! this->pinPage(&pin, &ac, it.num, err))
+	    return false;
+
+	if (ac.header->pageType == PageTypeNonLeaf) {
+	    for (uint32_t i = 0; i < ac.header->numKeys; i++)
+		q.push(R2MaxItem(this->getChildMax(&ac, i), true,
+				 this->getChildPageNum(&ac, i)));
+	    continue;
+	}
+
+	for (uint32_t i = 0; i < ac.header->numKeys; i++) {
+	    uint32_t e = ent_vals.size() / vs;
+	    const uint8_t *v = this->valAt(&ac, i);
+	    ent_keys.resize(ent_keys.size() + ks);
+	    this->copyKey(&ac, i, &ent_keys[e * ks]);
+	    ent_vals.insert(ent_vals.end(), v, v + vs);
+	    q.push(R2MaxItem(this->valueField(v), false, e));
+	}
+    }
+
+    return true;
+}
+
+bool
+R2BTree::rank(uint8_t *key, uint64_t *n, uint64_t *sum, ErrorInfo *err)
+{
+    if ( ! this->header->subtreeCounts
+	|| (sum != NULL && ! this->header->subtreeSums)) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("tree keeps no subtree counts");
+	return false;
+    }
+
+    PagePin pin;
+    R2PageAccess ac;
+    uint32_t idx, i;
+    uint64_t below = 0, below_sum = 0;
+
+    if ( ! this->pinPage(&pin, &ac, this->header->rootPageNum, err))
+	return false;
+
+    // the subtrees left of the path hold only smaller keys
+    while (ac.header->pageType == PageTypeNonLeaf) {
+	idx = this->findChildIndex(&ac, key);
+	for (i = 0; i < idx; i++) {
+	    below += this->getChildCount(&ac, i);
+	    if (sum != NULL)
+		below_sum += this->getChildSum(&ac, i);
+	}
+	if ( ! this->pinPage(&pin, &ac, this->getChildPageNum(&ac, idx),
+			     err))
+	    return false;
+    }
+
+    this->findKeyPosition(&ac, key, &idx);
+    below += idx;
+    if (sum != NULL) {
+	for (i = 0; i < idx; i++)
+	    below_sum += this->sumField(this->valAt(&ac, i));
+	*sum = below_sum;
+    }
+    *n = below;
+
+    return true;
+}
+
+bool
+R2BTree::select(uint64_t i, uint8_t *key, uint8_t *val, ErrorInfo *err)
+{
+    if ( ! this->header->subtreeCounts) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("tree keeps no subtree counts");
+	return false;
+    }
+
+    PagePin pin;
+    R2PageAccess ac;
+
+    if ( ! this->pinPage(&pin, &ac, this->header->rootPageNum, err))
+	return false;
+
+    while (ac.header->pageType == PageTypeNonLeaf) {
+	uint32_t c;
+	for (c = 0; c < ac.header->numKeys; c++) {
+	    uint64_t n = this->getChildCount(&ac, c);
+	    if (i < n)
+		break;
+	    i -= n;
+	}
+	if (c == ac.header->numKeys)
+	    break;
+	if ( ! this->pinPage(&pin, &ac, this->getChildPageNum(&ac, c), err))
+	    return false;
+    }
+
+    if (ac.header->pageType == PageTypeNonLeaf || i >= ac.header->numKeys) {
+	err->setErrNum(ErrorInfo::ERR_KEY_NOT_FOUND);
+	err->message.assign("position past the last key");
+	return false;
+    }
+
+    this->copyKey(&ac, i, key);
+    if (val != NULL)
+	return this->getData(val, &ac, i);
+
+    return true;
+}
+
+bool
+R2BTree::count(uint8_t *lo, uint8_t *hi, uint64_t *n, uint64_t *sum,
+	       ErrorInfo *err)
+{
+    uint64_t lo_n = 0, lo_sum = 0, hi_n, hi_sum;
+
+    if ( ! this->header->subtreeCounts
+	|| (sum != NULL && ! this->header->subtreeSums)) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("tree keeps no subtree counts");
+	return false;
+    }
+
+    if (lo != NULL
+	&& ! this->rank(lo, &lo_n, sum != NULL ? &lo_sum : NULL, err))
+	return false;
+
+    if (hi != NULL) {
+	hi_sum = 0;
+	if ( ! this->rank(hi, &hi_n, sum != NULL ? &hi_sum : NULL, err))
+	    return false;
+    }
+    else {
+	PagePin pin;
+	R2PageAccess ac;
+	if ( ! this->pinPage(&pin, &ac, this->header->rootPageNum, err))
+	    return false;
+	hi_n = this->pageCount(&ac, &hi_sum);
+    }
+
+    if (hi_n <= lo_n) {
+	hi_n = lo_n;
+	hi_sum = lo_sum;
+    }
+
+    *n = hi_n - lo_n;
+    if (sum != NULL)
+	*sum = hi_sum - lo_sum;
+
+    return true;
+}
+
+bool
+R2BTree::writeOverflow(const uint8_t *val, uint32_t len, uint32_t *firstPage,
+		       ErrorInfo *err)
+{
+    size_t room = this->header->pageSize - sizeof(R2PageHeader);
+    uint32_t n_pages = (len + room - 1) / room;
+    uint32_t next = 0;
+
+    // from the last page back, so each page knows the next
+    for (uint32_t i = n_pages; i > 0; i--) {
+	PagePin pin;
+	R2PageAccess ac;
+	uint32_t pn;
+	uint8_t *buf = this->allocPage(&pin, &pn, err);
+	if (buf == NULL) {
+	    ErrorInfo free_err;
+	    while (next != 0 && this->pinPage(&pin, &ac, next, &free_err)) {
+		pn = next;
+		next = ac.header->nextPageNum;
+		pin.release();
+		this->freePage(pn);
+	    }
+	    return false;
+	}
+
+	memset(buf, 0, this->header->pageSize);
+	R2PageHeader *h = reinterpret_cast<R2PageHeader *>(buf);
+	h->pageType = PageTypeOverflow;
+	h->generation = this->generation;
+	h->nextPageNum = next;
+	this->initPageAccess(&ac, buf);
+
+	size_t off = (i - 1) * room;
+	memcpy(ac.vals, val + off, std::min(room, len - off));
+	this->setDirty(&pin, &ac);
+	next = pn;
+    }
+
+    *firstPage = next;
+    return true;
+}
+
+void
+R2BTree::freeOverflow(const uint8_t *slot)
+{
+    uint32_t len, pn;
+    size_t vs = this->header->valSize[PageTypeLeaf];
+
+    memcpy(&len, slot, sizeof(len));
+    if (len <= vs - sizeof(len))
+	return;
+    memcpy(&pn, slot + sizeof(len), sizeof(pn));
+
+    PagePin pin;
+    R2PageAccess ac;
+    ErrorInfo err;
+    while (pn != 0 && this->pinPage(&pin, &ac, pn, &err)) {
+	uint32_t next = ac.header->nextPageNum;
+	bool held = this->copyOnWrite && ! this->snapshots.empty()
+	    && ac.header->generation <= this->snapshots.back();
+	pin.release();
+
+	// a snapshot may still read the value
+	if (held) {
+	    R2RetiredPage r;
+	    r.pageNum = pn;
+	    r.generation = this->generation;
+	    this->retired.push_back(r);
+	}
+	else {
+	    this->freePage(pn);
+	}
+	pn = next;
+    }
+}
+
+/**
+ * Passes the records read back from the log to R2BTree::redo.
+ */
+class R2Redo : public WALReplayer {
+private:
+    R2BTree *tree;
+
+public:
+    R2Redo(R2BTree *t) : tree(t) {;};
+
+    bool redo(uint64_t lsn, uint32_t type, uint32_t pageNum,
+	      const uint8_t *data, uint32_t len, ErrorInfo *err) {
+	return this->tree->redo(lsn, type, pageNum, data, len, err);
+    };
+};
+
+bool
+R2BTree::recover(ErrorInfo *err)
+{
+    if (this->wal == NULL) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("no log to recover from");
+	return false;
+    }
+
+    if ( ! this->checkHeader(err))
+	return false;
+
+    R2Redo r(this);
+    this->appendPageNum = 0;
+    if ( ! this->wal->replay(&r, err))
+	return false;
+
+    if (this->hashIndex == NULL && this->bloomFilter == NULL)
+	return true;
+
+    // neither is logged, both are filled from the tree
+    if (this->hashIndex != NULL)
+	this->hashIndex->clear();
+    if (this->bloomFilter != NULL)
+	this->bloomFilter->clear();
+
+    return this->indexSubtree(this->header->rootPageNum, this->hashIndex,
+			      this->bloomFilter, err);
+}
+
+bool
+R2BTree::loadHashIndex(ErrorInfo *err)
+{
+    if (this->hashIndex == NULL) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("no hash index");
+	return false;
+    }
+
+    if ( ! this->checkHeader(err))
+	return false;
+
+    this->hashIndex->clear();
+    return this->indexSubtree(this->header->rootPageNum, this->hashIndex, NULL,
+			      err);
+}
+
+bool
+R2BTree::loadBloomFilter(ErrorInfo *err)
+{
+    if (this->bloomFilter == NULL) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("no bloom filter");
+	return false;
+    }
+
+    if ( ! this->checkHeader(err))
+	return false;
+
+    this->bloomFilter->clear();
+    return this->indexSubtree(this->header->rootPageNum, NULL,
+			      this->bloomFilter, err);
+}
+
+bool
+R2BTree::takeSnapshot(R2Snapshot *snap, ErrorInfo *err)
+{
+    if ( ! this->copyOnWrite) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("snapshots need copyOnWrite");
+	return false;
+    }
+
+    boost::mutex::scoped_lock guard(this->snapLock);
+    snap->rootPageNum = this->header->rootPageNum;
+    snap->generation = this->generation;
+    // generations only grow, so this keeps snapshots sorted
+    this->snapshots.push_back(this->generation);
+    this->generation++;
+
+    return true;
+}
+
+void
+R2BTree::releaseSnapshot(R2Snapshot *snap)
+{
+    boost::mutex::scoped_lock guard(this->snapLock);
+    std::vector<uint32_t>::iterator iter;
+    iter = std::find(this->snapshots.begin(), this->snapshots.end(),
+		     snap->generation);
+    if (snap->rootPageNum != 0 && iter != this->snapshots.end())
+	this->snapshots.erase(iter);
+    snap->rootPageNum = 0;
+
+    this->freeRetired();
+}
+
+bool
+R2BTree::findSnapshot(R2Snapshot *snap, uint8_t *key, uint8_t *val,
+		      ErrorInfo *err)
+{
+    if (snap->rootPageNum == 0) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("snapshot not taken");
+	return false;
+    }
+
+    return this->findFrom(snap->rootPageNum, key, val, err);
+}
+
+bool
+R2BTree::copyPage(PagePin *pin, R2PageAccess *ac, PagePin *parentPin,
+		  R2PageAccess *parent, uint32_t idx, ErrorInfo *err)
+{
+    // a page can only be reached from snapshots taken after it was
+    // written
+    if ( ! this->copyOnWrite
+	 || this->snapshots.empty()
+	 || ac->header->generation > this->snapshots.back())
+	return true;
+
+    PagePin new_pin;
+    R2PageAccess copy;
+    uint32_t new_pn;
+    uint8_t *buf = this->allocPage(&new_pin, &new_pn, err);
+    if (buf == NULL)
+	return false;
+
+    memcpy(buf, pin->getBuf(), this->header->pageSize);
+    this->initPageAccess(&copy, buf);
+    copy.header->generation = this->generation;
+    copy.header->prevPageNum = 0;
+    copy.header->nextPageNum = 0;
+    this->setDirty(&new_pin, &copy);
+
+    R2RetiredPage r;
+    r.pageNum = pin->getPageNum();
+    r.generation = this->generation;
+    this->retired.push_back(r);
+    this->nCopies++;
+
+    if (parent == NULL)
+	this->setRoot(new_pn);
+    else {
+	memcpy(parent->vals + idx * this->header->valSize[PageTypeNonLeaf],
+	       &new_pn, sizeof(new_pn));
+	this->setDirty(parentPin, parent);
+    }
+
+    pin->moveFrom(&new_pin);
+    *ac = copy;
+
+    return true;
+}
+
+void
+R2BTree::freeRetired()
+{
+    // a page retired in generation g may be reached from any snapshot
+    // older than g
+    uint32_t oldest = this->snapshots.empty()
+	? UINT32_MAX : this->snapshots.front();
+    size_t n = 0;
+
+    while (n < this->retired.size() && this->retired[n].generation <= oldest) {
+	this->freePage(this->retired[n].pageNum);
+	n++;
+    }
+
+    this->retired.erase(this->retired.begin(), this->retired.begin() + n);
+}
+
+bool
+R2BTree::erasePages(uint8_t *key, ErrorInfo *err)
+{
+    std::vector<uint32_t> path_pn;
+    std::vector<uint32_t> path_idx;
+    PagePin cur_pin, child_pin;
+    R2PageAccess ac, child;
+    uint32_t idx, pn;
+
+    if ( ! this->pinPage(&cur_pin, &ac, this->header->rootPageNum, err))
+	return false;
+    if ( ! this->copyPage(&cur_pin, &ac, NULL, NULL, 0, err))
+	return false;
+    pn = cur_pin.getPageNum();
+
+    while (ac.header->pageType == PageTypeNonLeaf) {
+	idx = this->findChildIndex(&ac, key);
+	path_pn.push_back(pn);
+	path_idx.push_back(idx);
+	pn = this->getChildPageNum(&ac, idx);
+	if ( ! this->pinPage(&child_pin, &child, pn, err))
+	    return false;
+	if ( ! this->copyPage(&child_pin, &child, &cur_pin, &ac, idx, err))
+	    return false;
+	pn = child_pin.getPageNum();
+	cur_pin.moveFrom(&child_pin);
+	ac = child;
+    }
+
+    if ( ! this->findKeyPosition(&ac, key, &idx)) {
+	err->setErrNum(ErrorInfo::ERR_KEY_NOT_FOUND);
+	err->message.assign("key not found");
+	return false;
+    }
+
+    if (this->header->varValues)
+	this->freeOverflow(this->valAt(&ac, idx));
+
+    uint64_t gone = this->header->subtreeSums
+	? this->sumField(this->valAt(&ac, idx)) : 0;
+    bool stats = this->header->subtreeMax || this->header->subtreeCounts;
+
+    this->removeAt(&ac, idx);
+    this->setDirtyLeaf(&cur_pin, &ac, R2LogRemove, idx, NULL, NULL);
+    if (this->hashIndex != NULL)
+	this->hashIndex->remove(key);
+
+    // walk back up fixing underflow, and the subtree maxima and counts
+    while ( ! path_pn.empty()) {
+	PagePin parent_pin, left_pin, right_pin;
+	R2PageAccess parent, left, right;
+	uint32_t cidx, left_idx, right_pn;
+	bool under = ac.header->numKeys
+	    < this->header->minNumKeys[ac.header->pageType];
+
+	if ( ! under && ! stats)
+	    break;
+	uint64_t m = under || ! this->header->subtreeMax
+	    ? 0 : this->pageMax(&ac);
+
+	cur_pin.release();
+
+	if ( ! this->pinPage(&parent_pin, &parent, path_pn.back(), err))
+	    return false;
+	cidx = path_idx.back();
+	path_pn.pop_back();
+	path_idx.pop_back();
+
+	// without counts nothing above changes once a maximum stays the
+	// same
+	if ( ! under) {
+	    bool lower = this->header->subtreeMax
+		&& this->getChildMax(&parent, cidx) != m;
+	    if ( ! lower && ! this->header->subtreeCounts)
+		break;
+	    if (lower) {
+		this->setChildMax(&parent, cidx, m);
+		this->setDirty(&parent_pin, &parent);
+	    }
+	    if (this->header->subtreeCounts) {
+		this->setChildCount(&parent, cidx,
+				    this->getChildCount(&parent, cidx) - 1);
+		if (this->header->subtreeSums)
+		    this->setChildSum(&parent, cidx,
+				      this->getChildSum(&parent, cidx) - gone);
+		this->setDirtyCount(&parent_pin, &parent, cidx, -1,
+				    -(int64_t)gone);
+	    }
+	    cur_pin.moveFrom(&parent_pin);
+	    ac = parent;
+	    continue;
+	}
+
+	if (cidx + 1 < parent.header->numKeys)
+	    left_idx = cidx;
+	else
+	    left_idx = cidx - 1;
+
+	pn = this->getChildPageNum(&parent, left_idx);
+	if ( ! this->pinPage(&left_pin, &left, pn, err))
+	    return false;
+	right_pn = this->getChildPageNum(&parent, left_idx + 1);
+	if ( ! this->pinPage(&right_pin, &right, right_pn, err))
+	    return false;
+	if ( ! this->copyPage(&left_pin, &left, &parent_pin, &parent, left_idx,
+			      err)
+	    || ! this->copyPage(&right_pin, &right, &parent_pin, &parent,
+				left_idx + 1, err))
+	    return false;
+	pn = left_pin.getPageNum();
+	right_pn = right_pin.getPageNum();
+
+	this->setDirty(&parent_pin, &parent);
+	this->setDirty(&left_pin, &left);
+	this->setDirty(&right_pin, &right);
+
+	uint8_t pt = left.header->pageType;
+	size_t ks = this->header->keySize;
+	bool merged;
+	if (this->prefixKeys && pt == PageTypeLeaf) {
+	    this->mergeLeaves(&parent, left_idx, &left, &right, &merged);
+	}
+	else {
+	    // with key prefixes the leaves below must keep their ranges,
+	    // so the separator for right takes the place of its key 0
+	    if (this->prefixKeys)
+		memcpy(right.keys, parent.keys + (left_idx + 1) * ks, ks);
+
+	    merged = left.header->numKeys + right.header->numKeys
+		<= this->header->maxNumKeys[pt];
+	    if (merged) {
+		if ( ! this->concatNodes(&left, &right, true, err))
+		    return false;
+	    }
+	    else {
+		if ( ! this->redistributeNodes(&left, &right, err))
+		    return false;
+		this->copyKey(&right, 0, parent.keys + (left_idx + 1) * ks);
+	    }
+	}
+
+	if ( ! merged)
+	    this->indexNode(&parent);
+
+	this->setChildStats(&parent, left_idx, &left);
+	this->setChildStats(&parent, left_idx + 1, &right);
+
+	if (merged) {
+	    this->removeAt(&parent, left_idx + 1);
+	    right_pin.release();
+	    this->freePage(right_pn);
+
+	    uint32_t next_pn = left.header->nextPageNum;
+	    if (next_pn != 0 && ! this->copyOnWrite) {
+		R2PageAccess next;
+		if ( ! this->pinPage(&right_pin, &next, next_pn, err))
+		    return false;
+		next.header->prevPageNum = pn;
+		this->setDirty(&right_pin, &next);
+	    }
+	}
+
+	cur_pin.moveFrom(&parent_pin);
+	ac = parent;
+    }
+
+    cur_pin.release();
+
+    // a non-leaf root with a single child is replaced by the child
+    if ( ! this->pinPage(&cur_pin, &ac, this->header->rootPageNum, err))
+	return false;
+    while (ac.header->pageType == PageTypeNonLeaf && ac.header->numKeys == 1) {
+	uint32_t old_root = this->header->rootPageNum;
+	this->setRoot(this->getChildPageNum(&ac, 0));
+	cur_pin.release();
+	this->freePage(old_root);
+	if ( ! this->pinPage(&cur_pin, &ac, this->header->rootPageNum, err))
+	    return false;
+    }
+
+    return true;
+}
+
+bool
+R2BTree::bulkLoad(R2BulkSource *src, double fillFactor, ErrorInfo *err)
+{
+    if (src == NULL || ! (fillFactor > 0.0 && fillFactor <= 1.0)) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("invalid input");
+	return false;
+    }
+
+    if ( ! this->checkHeader(err))
+	return false;
+
+    if (this->wal != NULL) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("bulkLoad is not logged");
+	return false;
+    }
+
+    boost::mutex::scoped_lock guard(this->snapLock, boost::defer_lock);
+    if (this->copyOnWrite)
+	guard.lock();
+
+    uint32_t target[2];
+    for (int pt = PageTypeNonLeaf; pt <= PageTypeLeaf; pt++) {
+	target[pt] = (uint32_t)(this->header->maxNumKeys[pt] * fillFactor);
+	if (target[pt] < this->header->minNumKeys[pt])
+	    target[pt] = this->header->minNumKeys[pt];
+	if (target[pt] > this->header->maxNumKeys[pt])
+	    target[pt] = this->header->maxNumKeys[pt];
+    }
+
+    this->appendPageNum = 0;
+
+    std::vector<R2BulkLevel> levels;
+    std::vector<uint8_t> key(this->header->keySize);
+    std::vector<uint8_t> prev(this->header->keySize);
+    std::vector<uint8_t> val(this->header->valSize[PageTypeLeaf]);
+    bool have_prev = false;
+    size_t n_keys = 0;
+
+    while (src->next(&key[0], &val[0])) {
+	if (have_prev) {
+	    int c = this->ki->compare(&prev[0], &key[0]);
+	    if (c == 0) {
+		err->setErrNum(ErrorInfo::ERR_DUPLICATE_INSERT);
+		err->message.assign("attempt to insert duplicate key");
+		return false;
+	    }
+	    if (c > 0) {
+		err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+		err->message.assign("keys not sorted");
+		return false;
+	    }
+	}
+
+	if ( ! this->bulkAppend(&levels, 0, &key[0], &val[0], target, err))
+	    return false;
+	n_keys++;
+
+	prev.swap(key);
+	have_prev = true;
+    }
+
+    // empty input gives an empty tree
+    if (levels.empty()) {
+	PagePin pin;
+	R2BulkLevel lev;
+	uint8_t *buf = pin.alloc(this->ps, &lev.pageNum, err);
+	if (buf == NULL)
+	    return false;
+	this->initLeafPage(buf);
+	lev.prevPageNum = 0;
+	levels.push_back(lev);
+    }
+
+    uint32_t root_pn;
+    if ( ! this->bulkFinish(&levels, &root_pn, err))
+	return false;
+
+    // the maxima and counts of the pages above are only known once
+    // all are built, and must be before the tree is installed
+    uint64_t m, cnt, sum;
+    if ((this->header->subtreeMax || this->header->subtreeCounts)
+	&& ! this->computeStats(root_pn, &m, &cnt, &sum, err))
+	return false;
+
+    // the hash index and the filter are trusted on a miss, so they
+    // keep the keys of the old tree until the new one is in place
+    HashIndex hash(this->header->keySize,
+		   this->hashIndex != NULL ? this->hashIndex->getValSize() : 0);
+    BloomFilter *bloom = NULL;
+    if (this->hashIndex != NULL)
+	hash.reserve(n_keys);
+    if (this->bloomFilter != NULL)
+	bloom = new BloomFilter(this->bloomFilter);
+    bool ok = (this->hashIndex == NULL && bloom == NULL)
+	|| this->indexSubtree(root_pn, this->hashIndex != NULL ? &hash : NULL,
+			      bloom, err);
+
+    if (ok) {
+	this->header->rootPageNum = root_pn;
+	if (this->hashIndex != NULL)
+	    this->hashIndex->swap(&hash);
+	if (bloom != NULL)
+	    this->bloomFilter->swap(bloom);
+    }
+    delete bloom;
+
+    return ok;
+}
+
+/********************************************************/
+
+bool
+R2BTree::splitNode(R2PageAccess *full, R2PageAccess *empty, uint8_t *key,
+		   ErrorInfo *err)
+{
+    if (full == NULL) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("invalid input");
+	return false;
+    }
+
+    if (empty == NULL
+	|| empty->header->numKeys != 0) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("invalid input");
+	return false;
+    }
+
+    int ft = full->header->pageType;
+    int et = empty->header->pageType;
+
+    if (ft != et || full->header->numKeys != this->header->maxNumKeys[ft]) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("invalid input");
+	return false;
+    }	
+
+    if (key == NULL) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("invalid input");
+	return false;
+    }
+
+    size_t bytes;
+    uint8_t *src;
+    uint32_t move_start_idx = full->header->numKeys / 2;
+
+    this->compactLeaf(full);
+    uint32_t n_to_move = full->header->numKeys - move_start_idx;
+
+    bytes = n_to_move * this->header->keySize;
+    src = full->keys + move_start_idx * this->header->keySize;
+    memmove(empty->keys, src, bytes);
+
+    src = full->keys + move_start_idx * this->header->keySize;
+    memmove(key, src, this->header->keySize);
+
+    bytes = n_to_move * this->header->valSize[ft];
+    src = full->vals + move_start_idx * this->header->valSize[ft];
+    memmove(empty->vals, src, bytes);
+
+    empty->header->numKeys = n_to_move;
+    full->header->numKeys = move_start_idx;
+    this->resetSlots(full);
+    this->resetSlots(empty);
+
+    empty->header->nextPageNum = full->header->nextPageNum;
+
+    this->indexNode(full);
+    this->indexNode(empty);
+
+    return true;
+}
+
+bool
+R2BTree::concatNodes(R2PageAccess *dst, R2PageAccess *src, bool dstIsFirst,
+		     ErrorInfo *err)
+{
+    if (dst == NULL || src == NULL) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("invalid input");
+	return false;
+    }
+
+    int dt = dst->header->pageType;
+    int st = src->header->pageType;
+
+    if (dt != st) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("invalid input");
+	return false;
+    }
+
+    if (dst->header->numKeys + src->header->numKeys
+	> this->header->maxNumKeys[st]) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("invalid input");
+	return false;
+    }
+
+    size_t dst_idx, bytes_to_move;
+    size_t vsize = this->header->valSize[dt];
+
+    this->compactLeaf(dst);
+    this->compactLeaf(src);
+
+    if ( ! dstIsFirst) {
+	size_t slots_needed = src->header->numKeys;
+	uint8_t *val_dst = dst->vals + slots_needed * vsize;
+	bytes_to_move = dst->header->numKeys * vsize;
+	memmove(val_dst, dst->vals, bytes_to_move);
+
+	uint8_t *key_dst = dst->keys + slots_needed * this->header->keySize;
+	bytes_to_move = dst->header->numKeys * this->header->keySize;
+	memmove(key_dst, dst->keys, bytes_to_move);
+
+	dst_idx = 0;
+    }
+    else {
+	dst_idx = dst->header->numKeys;
+    }
+
+    uint8_t *key_dst = dst->keys + dst_idx * this->header->keySize;
+    bytes_to_move = src->header->numKeys * this->header->keySize;
+    memmove(key_dst, src->keys, bytes_to_move);
+
+    uint8_t *val_dst = dst->vals + dst_idx * vsize;
+    bytes_to_move = src->header->numKeys * vsize;
+    memmove(val_dst, src->vals, bytes_to_move);
+
+    dst->header->numKeys += src->header->numKeys;
+    src->header->numKeys = 0;
+    this->resetSlots(dst);
+    this->resetSlots(src);
+
+    if (dstIsFirst)
+	dst->header->nextPageNum = src->header->nextPageNum;
+    else
+	dst->header->prevPageNum = src->header->prevPageNum;
+
+    this->indexNode(dst);
+
+    return true;
+}
+
+bool
+R2BTree::redistributeNodes(R2PageAccess *n1, R2PageAccess *n2, ErrorInfo *err)
+{
+    if (n1 == NULL
+	|| n2 == NULL
+	|| n1->header->pageType != n2->header->pageType) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("invalid input");
+	return false;
+    }
+
+    int pt = n1->header->pageType;
+    size_t minNumKeys = this->header->minNumKeys[pt];
+    if (n1->header->numKeys + n2->header->numKeys < 2 * minNumKeys) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("invalid input");
+	return false;
+    }
+    
+    if (n1->header->numKeys >= minNumKeys
+	&& n2->header->numKeys >= minNumKeys) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("invalid input");
+	return false;
+    }
+
+    uint8_t *src, *dst;
+    size_t src_idx, nbytes;
+
+    this->compactLeaf(n1);
+    this->compactLeaf(n2);
+
+    if (n1->header->numKeys >= n2->header->numKeys) {
+	size_t n2_needs = minNumKeys - n2->header->numKeys;
+
+	nbytes = n2->header->numKeys * this->header->keySize;
+	dst = n2->keys + n2_needs * this->header->keySize;
+	memmove(dst, n2->keys, nbytes);
+	
+	src_idx = n1->header->numKeys - n2_needs;
+
+	nbytes = n2_needs * this->header->keySize;
+	src = n1->keys + src_idx * this->header->keySize;
+	memmove(n2->keys, src, nbytes);
+
+	nbytes = n2->header->numKeys * this->header->valSize[pt];
+	dst = n2->vals + n2_needs * this->header->valSize[pt];
+	memmove(dst, n2->vals, nbytes);
+
+	nbytes = n2_needs * this->header->valSize[pt];
+	src = n1->vals + src_idx * this->header->valSize[pt];
+	memmove(n2->vals, src, nbytes);
+
+	n1->header->numKeys -= n2_needs;
+	n2->header->numKeys += n2_needs;
+    }
+    else {
+	size_t n1_needs = minNumKeys - n1->header->numKeys;
+	
+	nbytes = n1_needs * this->header->keySize;
+	dst = n1->keys + n1->header->numKeys * this->header->keySize;
+	memmove(dst, n2->keys, nbytes);
+	
+	nbytes = (n2->header->numKeys - n1_needs) * this->header->keySize;
+	src = n2->keys + n1_needs * this->header->keySize;
+	memmove(n2->keys, src, nbytes);
+
+	nbytes = n1_needs * this->header->valSize[pt];
+	dst = n1->vals + n1->header->numKeys * this->header->valSize[pt];
+	memmove(dst, n2->vals, nbytes);
+
+	nbytes = (n2->header->numKeys - n1_needs) * this->header->valSize[pt];
+	src = n2->vals + n1_needs * this->header->valSize[pt];
 	memmove(n2->vals, src, nbytes);
 
-	n1->header->numKeys -= n2_needs;
-	n2->header->numKeys += n2_needs;
+	n1->header->numKeys += n1_needs;
+	n2->header->numKeys -= n1_needs;
+    }
+
+    this->resetSlots(n1);
+    this->resetSlots(n2);
+    this->indexNode(n1);
+    this->indexNode(n2);
+
+    return true;
+}
+
+/********************************************************/
+
+bool
+R2BTree::findKeyPosition(R2PageAccess *ac, uint8_t *key, uint32_t *idx)
+{
+    size_t n1, n2, n, ks;
+    uint32_t p = ac->header->prefixLen;
+
+    // only the part after the prefix is stored, and keys in such a
+    // page are ordered as by memcmp
+    if (p != 0) {
+	int c = memcmp(key, ac->keys - p, p);
+	if (c != 0) {
+	    *idx = c < 0 ? 0 : ac->header->numKeys;
+	    return false;
+	}
+
+	ks = this->header->keySize - p;
+	n1 = 0;
+	n2 = ac->header->numKeys;
+	while (n1 < n2) {
+	    n = n1 + (n2 - n1) / 2;
+	    if (memcmp(ac->keys + n * ks, key + p, ks) < 0)
+		n1 = n + 1;
+	    else
+		n2 = n;
+	}
+	*idx = n1;
+	return n1 < ac->header->numKeys
+	    && memcmp(ac->keys + n1 * ks, key + p, ks) == 0;
+    }
+
+    if (this->header->keySize == 16 && this->ki->isUUID()) {
+	if ( ! this->interpolationSearch)
+	    return KeySearch::findUUIDPosition(ac->keys, ac->header->numKeys,
+					       key, idx);
+
+	uint32_t probes;
+	bool fell_back;
+	bool found = KeySearch::interpolateUUIDPosition(ac->keys,
+							ac->header->numKeys,
+							key, idx, &probes,
+							&fell_back);
+	__atomic_add_fetch(&this->nSearches, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&this->nProbes, probes, __ATOMIC_RELAXED);
+	if (fell_back)
+	    __atomic_add_fetch(&this->nFallbacks, 1, __ATOMIC_RELAXED);
+	return found;
+    }
+
+    if (ac->header->numKeys == 0) {
+	*idx = 0;
+	return false;
+    }
+    else if (ac->header->numKeys == 1) {
+	int c = this->ki->compare(key, ac->keys);
+	if (c < 0) {
+	    *idx = 0;
+	    return false;
+	}
+	else if (c == 0) {
+	    *idx = 0;
+	    return true;
+	}
+	else {
+	    *idx = 1;
+	    return false;
+	}
+    }
+
+    ks = this->header->keySize;
+    n1 = 0;
+    n2 = ac->header->numKeys - 1;
+
+    while (n2 >= n1) {
+	n = n2 - n1;
+	if (n == 1) {
+	    int c1 = this->ki->compare(key, ac->keys + n1 * ks);
+
+	    if (c1 < 0) {
+		*idx = n1;
+		return false;
+	    }
+	    else if (c1 == 0) {
+		*idx = n1;
+		return true;
+	    }
+
+	    int c2 = this->ki->compare(key, ac->keys + n2 * ks);
+	    if (c2 < 0) {
+		*idx = n2;
+		return false;
+	    }
+	    else if (c2 == 0) {
+		*idx = n2;
+		return true;
+	    }
+	    else {
+		*idx = n2 + 1;
+		return false;
+	    }
+	}
+	else {
+	    size_t m = n1 + n/2;
+	    int c = this->ki->compare(key, ac->keys + m * ks);
+	    if (c < 0) {
+		n2 = m;
+	    }
+	    else if (c == 0) {
+		*idx = m;
+		return true;
+	    }
+	    else {
+		n1 = m;
+	    }
+	}
+    }
+}
+
+void
+R2BTree::resetSearchStats()
+{
+    __atomic_store_n(&this->nSearches, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&this->nProbes, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&this->nFallbacks, 0, __ATOMIC_RELAXED);
+}
+
+uint32_t
+R2BTree::findChildIndex(R2PageAccess *ac, uint8_t *key)
+{
+    uint32_t idx;
+
+    if (this->header->nonLeafLayout == R2LayoutIndexed)
+	return this->searchIndex(ac, key);
+
+    if (this->findKeyPosition(ac, key, &idx))
+	return idx;
+    if (idx == 0)
+	return 0;
+    return idx - 1;
+}
+
+uint32_t
+R2BTree::searchIndex(R2PageAccess *ac, uint8_t *key)
+{
+    uint32_t off[R2_INDEX_LEVELS], cap[R2_INDEX_LEVELS], end;
+    const uint8_t *lev[R2_INDEX_LEVELS + 1];
+    uint32_t m[R2_INDEX_LEVELS + 1];
+    size_t ks = this->header->keySize;
+    uint32_t b = r2_index_block(ks);
+    uint32_t levels = r2_index_levels(ks,
+				      this->header->valSize[PageTypeNonLeaf],
+				      this->header->maxNumKeys[PageTypeNonLeaf],
+				      off, cap, &end);
+    uint8_t *buf = reinterpret_cast<uint8_t *>(ac->header);
+    bool uuid = ks == 16 && this->ki->isUUID();
+
+    // the levels in use, read numKeys once as a concurrent writer may
+    // be changing the page
+    uint32_t top = 0;
+    lev[0] = ac->keys;
+    m[0] = ac->header->numKeys;
+    while (top < levels && m[top] > b) {
+	lev[top + 1] = buf + off[top];
+	m[top + 1] = (m[top] - 1) / b;
+	top++;
+    }
+
+    // c is the number of keys <= key on the level below, all of them
+    // before the block it picks
+    uint32_t c = 0;
+    for (int l = top; l >= 0; l--) {
+	uint32_t lo = c * b;
+	uint32_t hi = std::min(lo + b, m[l]);
+	if (uuid) {
+	    uint32_t pos;
+	    bool found = KeySearch::findUUIDPosition(lev[l] + lo * ks, hi - lo,
+						     key, &pos);
+	    c = lo + pos + (found ? 1 : 0);
+	    continue;
+	}
+	while (lo < hi) {
+	    uint32_t mid = lo + (hi - lo) / 2;
+	    if (this->ki->compare(lev[l] + mid * ks, key) <= 0)
+		lo = mid + 1;
+	    else
+		hi = mid;
+	}
+	c = lo;
+    }
+
+    return c > 0 ? c - 1 : 0;
+}
+
+void
+R2BTree::indexNode(R2PageAccess *ac)
+{
+    if (ac->header->pageType != PageTypeNonLeaf
+	|| this->header->nonLeafLayout != R2LayoutIndexed)
+	return;
+
+    uint32_t off[R2_INDEX_LEVELS], cap[R2_INDEX_LEVELS], end;
+    size_t ks = this->header->keySize;
+    uint32_t b = r2_index_block(ks);
+    uint32_t levels = r2_index_levels(ks,
+				      this->header->valSize[PageTypeNonLeaf],
+				      this->header->maxNumKeys[PageTypeNonLeaf],
+				      off, cap, &end);
+    uint8_t *buf = reinterpret_cast<uint8_t *>(ac->header);
+    const uint8_t *src = ac->keys;
+    uint32_t m = ac->header->numKeys;
+
+    // the first key of every block but the first goes up a level
+    for (uint32_t l = 0; l < levels && m > b; l++) {
+	uint8_t *dst = buf + off[l];
+	m = (m - 1) / b;
+	for (uint32_t j = 0; j < m; j++)
+	    memcpy(dst + j * ks, src + (j + 1) * b * ks, ks);
+	src = dst;
+    }
+}
+
+uint32_t
+R2BTree::getChildPageNum(R2PageAccess *ac, uint32_t idx)
+{
+    uint32_t pn;
+    memcpy(&pn, ac->vals + idx * this->header->valSize[PageTypeNonLeaf],
+	   sizeof(uint32_t));
+    return pn;
+}
+
+uint64_t
+R2BTree::getChildMax(R2PageAccess *ac, uint32_t idx)
+{
+    uint64_t m;
+    memcpy(&m, ac->vals + idx * this->header->valSize[PageTypeNonLeaf]
+	   + sizeof(uint32_t), sizeof(m));
+    return m;
+}
+
+void
+R2BTree::setChildMax(R2PageAccess *ac, uint32_t idx, uint64_t m)
+{
+    memcpy(ac->vals + idx * this->header->valSize[PageTypeNonLeaf]
+	   + sizeof(uint32_t), &m, sizeof(m));
+}
+
+uint64_t
+R2BTree::pageMax(R2PageAccess *ac)
+{
+    uint64_t m = 0;
+    uint32_t n = ac->header->numKeys;
+
+    if (ac->header->pageType == PageTypeNonLeaf) {
+	for (uint32_t i = 0; i < n; i++)
+	    m = std::max(m, this->getChildMax(ac, i));
+    }
+    else {
+	for (uint32_t i = 0; i < n; i++)
+	    m = std::max(m, this->valueField(this->valAt(ac, i)));
+    }
+
+    return m;
+}
+
+uint64_t
+R2BTree::valueField(const uint8_t *val)
+{
+    uint64_t f;
+    memcpy(&f, val + this->header->maxOffset, sizeof(f));
+    return f;
+}
+
+/*
+ * Offset in a non-leaf value of the subtree count, after the page
+ * number and the maximum if any. The sum follows the count.
+ */
+static inline uint32_t
+r2_count_offset(R2IndexHeader *h)
+{
+    return sizeof(uint32_t) + (h->subtreeMax ? sizeof(uint64_t) : 0);
+}
+
+uint64_t
+R2BTree::getChildCount(R2PageAccess *ac, uint32_t idx)
+{
+    uint64_t n;
+    memcpy(&n, ac->vals + idx * this->header->valSize[PageTypeNonLeaf]
+	   + r2_count_offset(this->header), sizeof(n));
+    return n;
+}
+
+void
+R2BTree::setChildCount(R2PageAccess *ac, uint32_t idx, uint64_t n)
+{
+    memcpy(ac->vals + idx * this->header->valSize[PageTypeNonLeaf]
+	   + r2_count_offset(this->header), &n, sizeof(n));
+}
+
+uint64_t
+R2BTree::getChildSum(R2PageAccess *ac, uint32_t idx)
+{
+    uint64_t sum;
+    memcpy(&sum, ac->vals + idx * this->header->valSize[PageTypeNonLeaf]
+	   + r2_count_offset(this->header) + sizeof(uint64_t), sizeof(sum));
+    return sum;
+}
+
+void
+R2BTree::setChildSum(R2PageAccess *ac, uint32_t idx, uint64_t sum)
+{
+    memcpy(ac->vals + idx * this->header->valSize[PageTypeNonLeaf]
+	   + r2_count_offset(this->header) + sizeof(uint64_t), &sum,
+	   sizeof(sum));
+}
+
+uint64_t
+R2BTree::sumField(const uint8_t *val)
+{
+    uint64_t f;
+    memcpy(&f, val + this->header->sumOffset, sizeof(f));
+    return f;
+}
+
+uint64_t
+R2BTree::pageCount(R2PageAccess *ac, uint64_t *sum)
+{
+    uint32_t n = ac->header->numKeys;
+
+    *sum = 0;
+    if (ac->header->pageType == PageTypeLeaf) {
+	if (this->header->subtreeSums) {
+	    for (uint32_t i = 0; i < n; i++)
+		*sum += this->sumField(this->valAt(ac, i));
+	}
+	return n;
+    }
+
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < n; i++) {
+	total += this->getChildCount(ac, i);
+	if (this->header->subtreeSums)
+	    *sum += this->getChildSum(ac, i);
+    }
+
+    return total;
+}
+
+void
+R2BTree::setChildStats(R2PageAccess *parent, uint32_t idx,
+		       R2PageAccess *child)
+{
+    if (this->header->subtreeMax)
+	this->setChildMax(parent, idx, this->pageMax(child));
+
+    if (this->header->subtreeCounts) {
+	uint64_t sum;
+	this->setChildCount(parent, idx, this->pageCount(child, &sum));
+	if (this->header->subtreeSums)
+	    this->setChildSum(parent, idx, sum);
+    }
+}
+
+void
+R2BTree::childEntry(uint32_t pageNum, std::vector<uint8_t> *entry)
+{
+    entry->assign(this->header->valSize[PageTypeNonLeaf], 0);
+    memcpy(&(*entry)[0], &pageNum, sizeof(pageNum));
+}
+
+void
+R2BTree::insertAt(R2PageAccess *ac, uint32_t idx, uint8_t *key, uint8_t *val)
+{
+    size_t p = ac->header->prefixLen;
+    size_t ks = this->header->keySize - p;
+    size_t vs = this->header->valSize[ ac->header->pageType ];
+    uint32_t n_to_move = ac->header->numKeys - idx;
+
+    if (n_to_move > 0)
+	memmove(ac->keys + (idx + 1) * ks, ac->keys + idx * ks, n_to_move * ks);
+    memcpy(ac->keys + idx * ks, key + p, ks);
+
+    if (ac->slots != NULL) {
+	// the value goes in the next cell, only its number is shifted
+	if (ac->header->numCells == this->maxKeys(ac))
+	    this->compactLeaf(ac);
+	uint16_t cell = ac->header->numCells++;
+	memmove(ac->slots + idx + 1, ac->slots + idx,
+		n_to_move * sizeof(uint16_t));
+	ac->slots[idx] = cell;
+	memcpy(ac->vals + cell * vs, val, vs);
+    }
+    else {
+	if (n_to_move > 0)
+	    memmove(ac->vals + (idx + 1) * vs, ac->vals + idx * vs,
+		    n_to_move * vs);
+	memcpy(ac->vals + idx * vs, val, vs);
+    }
+
+    ac->header->numKeys++;
+    this->indexNode(ac);
+}
+
+void
+R2BTree::removeAt(R2PageAccess *ac, uint32_t idx)
+{
+    size_t ks = this->header->keySize - ac->header->prefixLen;
+    size_t vs = this->header->valSize[ ac->header->pageType ];
+    uint32_t n_to_move = ac->header->numKeys - idx - 1;
+
+    if (n_to_move > 0)
+	memmove(ac->keys + idx * ks, ac->keys + (idx + 1) * ks, n_to_move * ks);
+
+    if (ac->slots != NULL) {
+	// the cell is left behind, unless it is the last one used
+	if (ac->slots[idx] + 1 == ac->header->numCells)
+	    ac->header->numCells--;
+	memmove(ac->slots + idx, ac->slots + idx + 1,
+		n_to_move * sizeof(uint16_t));
+    }
+    else if (n_to_move > 0) {
+	memmove(ac->vals + idx * vs, ac->vals + (idx + 1) * vs, n_to_move * vs);
+    }
+
+    ac->header->numKeys--;
+    this->indexNode(ac);
+}
+
+uint8_t *
+R2BTree::valAt(R2PageAccess *ac, uint32_t idx)
+{
+    size_t vs = this->header->valSize[ ac->header->pageType ];
+
+    if (ac->slots != NULL)
+	return ac->vals + ac->slots[idx] * vs;
+
+    return ac->vals + idx * vs;
+}
+
+void
+R2BTree::compactLeaf(R2PageAccess *ac)
+{
+    if (ac->slots == NULL)
+	return;
+
+    size_t vs = this->header->valSize[PageTypeLeaf];
+    uint32_t n = ac->header->numKeys;
+    std::vector<uint8_t> vals(n * vs);
+
+    for (uint32_t i = 0; i < n; i++)
+	memcpy(&vals[i * vs], ac->vals + ac->slots[i] * vs, vs);
+    if (n > 0)
+	memcpy(ac->vals, &vals[0], n * vs);
+
+    this->resetSlots(ac);
+}
+
+void
+R2BTree::resetSlots(R2PageAccess *ac)
+{
+    if (ac->slots == NULL)
+	return;
+
+    for (uint32_t i = 0; i < ac->header->numKeys; i++)
+	ac->slots[i] = i;
+    ac->header->numCells = ac->header->numKeys;
+}
+
+void
+R2BTree::copyKey(R2PageAccess *ac, uint32_t idx, uint8_t *key)
+{
+    size_t p = ac->header->prefixLen;
+    size_t ks = this->header->keySize - p;
+
+    memcpy(key, ac->keys - p, p);
+    memcpy(key + p, ac->keys + idx * ks, ks);
+}
+
+uint32_t
+R2BTree::maxKeys(R2PageAccess *ac)
+{
+    if (ac->header->prefixLen == 0)
+	return this->header->maxNumKeys[ac->header->pageType];
+
+    return this->leafCapacity(ac->header->prefixLen);
+}
+
+uint32_t
+R2BTree::leafCapacity(uint32_t prefixLen)
+{
+    // same as initIndexHeader, with prefixLen bytes of each key
+    // stored once
+    uint32_t slot_sz = this->header->leafLayout == R2LeafSlotted
+	? sizeof(uint16_t) : 0;
+    uint32_t n = (this->header->pageSize - sizeof(R2PageHeader) - prefixLen)
+	/ (this->header->keySize - prefixLen
+	   + this->header->valSize[PageTypeLeaf] + slot_sz);
+
+    if (n > R2_MAX_KEYS_PER_PAGE)
+	n = R2_MAX_KEYS_PER_PAGE;
+
+    return n & ~(uint32_t)0x01;
+}
+
+uint32_t
+R2BTree::commonPrefix(const uint8_t *a, const uint8_t *b)
+{
+    uint32_t n = 0;
+
+    if (a == NULL || b == NULL)
+	return 0;
+
+    while (n + 1 < this->header->keySize && a[n] == b[n])
+	n++;
+
+    return n;
+}
+
+void
+R2BTree::shortSeparator(const uint8_t *lo, const uint8_t *hi, uint8_t *sep)
+{
+    size_t ks = this->header->keySize;
+    size_t n = this->commonPrefix(lo, hi) + 1;
+
+    memcpy(sep, hi, n);
+    memset(sep + n, 0, ks - n);
+}
+
+void
+R2BTree::getEntries(R2PageAccess *ac, std::vector<uint8_t> *keys,
+		    std::vector<uint8_t> *vals)
+{
+    size_t ks = this->header->keySize;
+    size_t vs = this->header->valSize[PageTypeLeaf];
+    size_t k0 = keys->size();
+    uint32_t n = ac->header->numKeys;
+
+    keys->resize(k0 + n * ks);
+    for (uint32_t i = 0; i < n; i++)
+	this->copyKey(ac, i, &(*keys)[k0 + i * ks]);
+
+    size_t v0 = vals->size();
+    vals->resize(v0 + n * vs);
+    for (uint32_t i = 0; i < n; i++)
+	memcpy(&(*vals)[v0 + i * vs], this->valAt(ac, i), vs);
+}
+
+void
+R2BTree::fillLeaf(R2PageAccess *ac, const uint8_t *keys, const uint8_t *vals,
+		  uint32_t n, uint32_t prefixLen)
+{
+    size_t ks = this->header->keySize;
+    size_t vs = this->header->valSize[PageTypeLeaf];
+    size_t kl = ks - prefixLen;
+
+    ac->header->prefixLen = prefixLen;
+    ac->header->numKeys = n;
+    this->initPageAccess(ac, reinterpret_cast<uint8_t *>(ac->header));
+
+    memcpy(ac->keys - prefixLen, keys, prefixLen);
+    for (uint32_t i = 0; i < n; i++)
+	memcpy(ac->keys + i * kl, keys + i * ks + prefixLen, kl);
+    memcpy(ac->vals, vals, n * vs);
+    this->resetSlots(ac);
+}
+
+bool
+R2BTree::splitLeaf(R2PageAccess *parent, uint32_t idx, R2PageAccess *full,
+		   R2PageAccess *empty, uint8_t *key, ErrorInfo *err)
+{
+    if (full->header->numKeys < 2
+	|| empty->header->numKeys != 0
+	|| empty->header->pageType != PageTypeLeaf) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("invalid input");
+	return false;
+    }
+
+    std::vector<uint8_t> keys, vals;
+    size_t ks = this->header->keySize;
+    size_t vs = this->header->valSize[PageTypeLeaf];
+    uint32_t n = full->header->numKeys;
+    uint32_t half = n / 2;
+
+    this->getEntries(full, &keys, &vals);
+    this->shortSeparator(&keys[(half - 1) * ks], &keys[half * ks], key);
+
+    // both halves lie inside the range of full, so they keep at least
+    // its prefix
+    uint8_t *lo = idx > 0 ? parent->keys + idx * ks : NULL;
+    uint8_t *hi = idx + 1 < parent->header->numKeys
+	? parent->keys + (idx + 1) * ks : NULL;
+    uint32_t p_left = std::max<uint32_t>(full->header->prefixLen,
+					 this->commonPrefix(lo, key));
+    uint32_t p_right = std::max<uint32_t>(full->header->prefixLen,
+					  this->commonPrefix(key, hi));
+
+    empty->header->nextPageNum = full->header->nextPageNum;
+    this->fillLeaf(full, &keys[0], &vals[0], half, p_left);
+    this->fillLeaf(empty, &keys[half * ks], &vals[half * vs], n - half,
+		   p_right);
+
+    return true;
+}
+
+void
+R2BTree::mergeLeaves(R2PageAccess *parent, uint32_t leftIdx,
+		     R2PageAccess *left, R2PageAccess *right, bool *merged)
+{
+    std::vector<uint8_t> keys, vals;
+    size_t ks = this->header->keySize;
+    size_t vs = this->header->valSize[PageTypeLeaf];
+    uint32_t n_left = left->header->numKeys;
+
+    this->getEntries(left, &keys, &vals);
+    this->getEntries(right, &keys, &vals);
+    uint32_t n = keys.size() / ks;
+
+    uint8_t *lo = leftIdx > 0 ? parent->keys + leftIdx * ks : NULL;
+    uint8_t *hi = leftIdx + 2 < parent->header->numKeys
+	? parent->keys + (leftIdx + 2) * ks : NULL;
+
+    uint32_t p = this->commonPrefix(lo, hi);
+    if (n <= this->leafCapacity(p)) {
+	this->fillLeaf(left, &keys[0], &vals[0], n, p);
+	left->header->nextPageNum = right->header->nextPageNum;
+	*merged = true;
+	return;
+    }
+
+    // the other leaf may hold far more than half of both, so evening
+    // them out could overflow a leaf whose prefix gets shorter
+    uint32_t min = this->header->minNumKeys[PageTypeLeaf];
+    uint32_t split = n_left < min ? min : n - min;
+    uint8_t *sep = parent->keys + (leftIdx + 1) * ks;
+    this->shortSeparator(&keys[(split - 1) * ks], &keys[split * ks], sep);
+
+    // the leaf that gave keys only lost range, and keeps its prefix
+    uint32_t p_left = this->commonPrefix(lo, sep);
+    uint32_t p_right = this->commonPrefix(sep, hi);
+    if (split < n_left)
+	p_left = std::max<uint32_t>(p_left, left->header->prefixLen);
+    else
+	p_right = std::max<uint32_t>(p_right, right->header->prefixLen);
+
+    this->fillLeaf(left, &keys[0], &vals[0], split, p_left);
+    this->fillLeaf(right, &keys[split * ks], &vals[split * vs], n - split,
+		   p_right);
+    *merged = false;
+}
+
+bool
+R2BTree::splitChild(R2PageAccess *parent, uint32_t idx, R2PageAccess *child,
+		    uint8_t *appendKey, ErrorInfo *err)
+{
+    PagePin pin;
+    uint32_t new_pn;
+    uint8_t *buf = this->allocPage(&pin, &new_pn, err);
+    if (buf == NULL)
+	return false;
+
+    if (child->header->pageType == PageTypeLeaf)
+	this->initLeafPage(buf);
+    else
+	this->initNonLeafPage(buf);
+
+    R2PageAccess empty;
+    this->initPageAccess(&empty, buf);
+    empty.header->level = child->header->level;
+    this->setDirty(&pin, &empty);
+
+    std::vector<uint8_t> sep(this->header->keySize);
+    bool ok = true;
+    if (appendKey != NULL && child->header->pageType == PageTypeLeaf) {
+	memcpy(&sep[0], appendKey, this->header->keySize);
+	empty.header->nextPageNum = child->header->nextPageNum;
+    }
+    else if (appendKey != NULL) {
+	// two, as erase merges an underflowing child with a sibling
+	std::vector<uint8_t> k(this->header->keySize);
+	uint32_t first = child->header->numKeys - 2;
+	for (uint32_t i = 0; i < 2; i++) {
+	    this->copyKey(child, first + i, &k[0]);
+	    this->insertAt(&empty, i, &k[0], this->valAt(child, first + i));
+	}
+	this->copyKey(child, first, &sep[0]);
+	this->removeAt(child, first + 1);
+	this->removeAt(child, first);
+	empty.header->nextPageNum = child->header->nextPageNum;
+    }
+    else if (this->prefixKeys && child->header->pageType == PageTypeLeaf)
+	ok = this->splitLeaf(parent, idx, child, &empty, &sep[0], err);
+    else
+	ok = this->splitNode(child, &empty, &sep[0], err);
+    if ( ! ok) {
+	pin.release();
+	this->freePage(new_pn);
+	return false;
+    }
+
+    std::vector<uint8_t> entry;
+    this->childEntry(new_pn, &entry);
+    this->insertAt(parent, idx + 1, &sep[0], &entry[0]);
+    this->setChildStats(parent, idx, child);
+    this->setChildStats(parent, idx + 1, &empty);
+
+    // copy-on-write trees keep no sibling links
+    if (this->copyOnWrite) {
+	empty.header->nextPageNum = 0;
+	return true;
+    }
+
+    uint32_t next_pn = empty.header->nextPageNum;
+    child->header->nextPageNum = new_pn;
+    empty.header->prevPageNum = this->getChildPageNum(parent, idx);
+
+    if (next_pn != 0) {
+	R2PageAccess next;
+	if ( ! this->pinPage(&pin, &next, next_pn, err))
+	    return false;
+	next.header->prevPageNum = new_pn;
+	this->setDirty(&pin, &next);
+    }
+
+    return true;
+}
+
+bool
+R2BTree::checkHeader(ErrorInfo *err)
+{
+    if (this->header->formatVersion != R2_FORMAT_VERSION) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("unsupported page format version");
+	return false;
+    }
+
+    if (this->header->maxNumKeys[PageTypeNonLeaf] < 4
+	|| this->header->maxNumKeys[PageTypeLeaf] < 2) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("page size too small");
+	return false;
+    }
+
+    if (this->header->maxNumKeys[PageTypeNonLeaf] > R2_MAX_KEYS_PER_PAGE
+	|| this->header->maxNumKeys[PageTypeLeaf] > R2_MAX_KEYS_PER_PAGE) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("page size too large");
+	return false;
+    }
+
+    if (this->header->nonLeafLayout > R2LayoutIndexed) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("unknown non-leaf page layout");
+	return false;
+    }
+
+    if (this->header->leafLayout > R2LeafSlotted) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("unknown leaf page layout");
+	return false;
+    }
+
+    if (this->header->varValues
+	&& this->header->valSize[PageTypeLeaf] < 2 * sizeof(uint32_t)) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("value slots too small");
+	return false;
+    }
+
+    if (this->header->subtreeMax
+	&& (this->header->varValues
+	    || (uint64_t)this->header->maxOffset + sizeof(uint64_t)
+	       > this->header->valSize[PageTypeLeaf])) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("bad subtree maximum field");
+	return false;
+    }
+
+    if (this->header->subtreeSums
+	&& ( ! this->header->subtreeCounts || this->header->varValues
+	    || (uint64_t)this->header->sumOffset + sizeof(uint64_t)
+	       > this->header->valSize[PageTypeLeaf])) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("bad subtree sum field");
+	return false;
+    }
+
+    if (this->header->valSize[PageTypeNonLeaf]
+	!= r2_non_leaf_val_size(this->header->subtreeMax,
+				this->header->subtreeCounts,
+				this->header->subtreeSums)) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("bad non-leaf value size");
+	return false;
+    }
+
+    if (this->prefixKeys && ! this->ki->isBytewise()) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("key prefixes need keys ordered as by memcmp");
+	return false;
+    }
+
+    if (this->hashIndex != NULL
+	&& (this->hashIndex->getKeySize() != this->header->keySize
+	    || this->hashIndex->getValSize()
+	       != this->header->valSize[PageTypeLeaf])) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("hash index does not match the leaves");
+	return false;
+    }
+
+    if (this->bloomFilter != NULL
+	&& this->bloomFilter->getKeySize() != this->header->keySize) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("bloom filter does not match the keys");
+	return false;
+    }
+
+    return true;
+}
+
+bool
+R2BTree::pinPage(PagePin *pin, R2PageAccess *ac, uint32_t pageNum,
+		 ErrorInfo *err)
+{
+    uint8_t *buf = pin->pin(this->ps, pageNum, err);
+    if (buf == NULL)
+	return false;
+
+    this->initPageAccess(ac, buf);
+    return true;
+}
+
+uint8_t *
+R2BTree::allocPage(PagePin *pin, uint32_t *pageNum, ErrorInfo *err)
+{
+    boost::mutex::scoped_lock guard(this->allocLock);
+    return pin->alloc(this->ps, pageNum, err);
+}
+
+void
+R2BTree::freePage(uint32_t pageNum)
+{
+    std::vector<uint32_t>::iterator iter;
+    iter = std::remove(this->logPages.begin(), this->logPages.end(), pageNum);
+    this->logPages.erase(iter, this->logPages.end());
+
+    if (pageNum == this->appendPageNum)
+	this->appendPageNum = 0;
+
+    boost::mutex::scoped_lock guard(this->allocLock);
+    this->ps->freePage(pageNum);
+}
+
+void
+R2BTree::markDirty(PagePin *pin, R2PageAccess *ac)
+{
+    pin->setDirty();
+
+    if (this->wal == NULL)
+	return;
+
+    // keeps the page store from writing the page back before logEnd
+    ac->header->lsn = WAL_LSN_PENDING;
+    this->logPages.push_back(pin->getPageNum());
+}
+
+void
+R2BTree::setDirty(PagePin *pin, R2PageAccess *ac)
+{
+    this->markDirty(pin, ac);
+    this->logImages = true;
+}
+
+void
+R2BTree::setDirtyCount(PagePin *pin, R2PageAccess *ac, uint32_t idx,
+		       int64_t n, int64_t sum)
+{
+    this->markDirty(pin, ac);
+
+    if (this->wal == NULL)
+	return;
+
+    uint8_t rec[sizeof(idx) + 2 * sizeof(int64_t)];
+    memcpy(rec, &idx, sizeof(idx));
+    memcpy(rec + sizeof(idx), &n, sizeof(n));
+    memcpy(rec + sizeof(idx) + sizeof(n), &sum, sizeof(sum));
+    this->logGroup.add(R2LogCount, pin->getPageNum(), rec, sizeof(rec));
+}
+
+void
+R2BTree::setDirtyLeaf(PagePin *pin, R2PageAccess *ac, uint32_t type,
+		      uint32_t idx, uint8_t *key, uint8_t *val)
+{
+    this->markDirty(pin, ac);
+
+    if (this->wal == NULL)
+	return;
+
+    std::vector<uint8_t> rec(sizeof(idx));
+    memcpy(&rec[0], &idx, sizeof(idx));
+    if (key != NULL) {
+	rec.insert(rec.end(), key, key + this->header->keySize);
+	rec.insert(rec.end(), val, val + this->header->valSize[PageTypeLeaf]);
+    }
+
+    this->logGroup.add(type, pin->getPageNum(), &rec[0], rec.size());
+}
+
+void
+R2BTree::setRoot(uint32_t pageNum)
+{
+    this->header->rootPageNum = pageNum;
+    this->logRoot = true;
+}
+
+void
+R2BTree::logBegin()
+{
+    this->logPages.clear();
+    this->logGroup.clear();
+    this->logRoot = false;
+    this->logImages = false;
+}
+
+bool
+R2BTree::logEnd(ErrorInfo *err)
+{
+    if (this->wal == NULL)
+	return true;
+
+    std::vector<uint32_t>::iterator iter;
+    std::sort(this->logPages.begin(), this->logPages.end());
+    iter = std::unique(this->logPages.begin(), this->logPages.end());
+    this->logPages.erase(iter, this->logPages.end());
+
+    PagePin pin;
+    R2PageAccess ac;
+
+    // records are only enough if each describes all the changes to
+    // a page of its own
+    if (this->logImages
+	|| this->logPages.size() != this->logGroup.getNumRecords()) {
+	this->logGroup.clear();
+	for (iter = this->logPages.begin(); iter != this->logPages.end(); iter++) {
+	    if ( ! this->pinPage(&pin, &ac, *iter, err))
+		return false;
+	    this->logGroup.add(R2LogPage, *iter, pin.getBuf(),
+			       this->header->pageSize);
+	}
+    }
+
+    if (this->logRoot)
+	this->logGroup.add(R2LogRoot, this->header->rootPageNum, NULL, 0);
+
+    uint64_t lsn;
+    if ( ! this->wal->append(&this->logGroup, &lsn, err))
+	return false;
+
+    for (iter = this->logPages.begin(); iter != this->logPages.end(); iter++) {
+	if ( ! this->pinPage(&pin, &ac, *iter, err))
+	    return false;
+	ac.header->lsn = lsn;
+	pin.setDirty();
+    }
+
+    this->logBegin();
+
+    return true;
+}
+
+bool
+R2BTree::redo(uint64_t lsn, uint32_t type, uint32_t pageNum,
+	      const uint8_t *data, uint32_t len, ErrorInfo *err)
+{
+    if (type == R2LogRoot) {
+	this->header->rootPageNum = pageNum;
+	return true;
+    }
+
+    PagePin pin;
+    R2PageAccess ac;
+    if ( ! this->redoPin(&pin, &ac, pageNum, err))
+	return false;
+
+    // the page was written back after this change
+    if (ac.header->lsn >= lsn)
+	return true;
+
+    size_t ks = this->header->keySize;
+    size_t vs = this->header->valSize[PageTypeLeaf];
+    uint32_t idx = 0;
+    if (len >= sizeof(idx))
+	memcpy(&idx, data, sizeof(idx));
+
+    bool ok = false;
+    if (type == R2LogPage) {
+	ok = len == this->header->pageSize;
+	if (ok) {
+	    memcpy(pin.getBuf(), data, len);
+	    this->initPageAccess(&ac, pin.getBuf());
+	}
+    }
+    else if (type == R2LogInsert) {
+	ok = len == sizeof(idx) + ks + vs
+	    && ac.header->pageType == PageTypeLeaf
+	    && idx <= ac.header->numKeys
+	    && ac.header->numKeys < this->maxKeys(&ac);
+	if (ok) {
+	    std::vector<uint8_t> kv(data + sizeof(idx), data + len);
+	    this->insertAt(&ac, idx, &kv[0], &kv[ks]);
+	}
+    }
+    else if (type == R2LogRemove) {
+	ok = len == sizeof(idx)
+	    && ac.header->pageType == PageTypeLeaf
+	    && idx < ac.header->numKeys;
+	if (ok)
+	    this->removeAt(&ac, idx);
+    }
+    else if (type == R2LogCount) {
+	int64_t n, sum;
+	ok = len == sizeof(idx) + sizeof(n) + sizeof(sum)
+	    && this->header->subtreeCounts
+	    && ac.header->pageType == PageTypeNonLeaf
+	    && idx < ac.header->numKeys;
+	if (ok) {
+	    memcpy(&n, data + sizeof(idx), sizeof(n));
+	    memcpy(&sum, data + sizeof(idx) + sizeof(n), sizeof(sum));
+	    this->setChildCount(&ac, idx, this->getChildCount(&ac, idx) + n);
+	    if (this->header->subtreeSums)
+		this->setChildSum(&ac, idx, this->getChildSum(&ac, idx) + sum);
+	}
+    }
+
+    if ( ! ok) {
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("bad log record");
+	return false;
+    }
+
+    ac.header->lsn = lsn;
+    pin.setDirty();
+
+    return true;
+}
+
+bool
+R2BTree::redoPin(PagePin *pin, R2PageAccess *ac, uint32_t pageNum,
+		 ErrorInfo *err)
+{
+    ErrorInfo pin_err;
+    uint8_t *buf = pin->pin(this->ps, pageNum, &pin_err);
+
+    // pages allocated after the last flush are not in ps yet
+    while (buf == NULL) {
+	uint32_t pn;
+	buf = this->allocPage(pin, &pn, err);
+	if (buf == NULL)
+	    return false;
+	memset(buf, 0, this->header->pageSize);
+
+	if (pn > pageNum) {
+	    err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	    err->message.assign("unable to allocate logged page");
+	    return false;
+	}
+	if (pn < pageNum)
+	    buf = NULL;
+    }
+
+    this->initPageAccess(ac, buf);
+    return true;
+}
+
+bool
+R2BTree::keyInNext(uint32_t nextPageNum, uint8_t *key, bool *right,
+		   ErrorInfo *err)
+{
+    PagePin pin;
+    R2PageAccess next;
+    uint32_t v;
+
+    if ( ! this->pinPage(&pin, &next, nextPageNum, err))
+	return false;
+
+    do {
+	v = R2Latch::readLock(next.header);
+	*right = next.header->numKeys > 0
+	    && this->ki->compare(key, next.keys) >= 0;
+    } while ( ! R2Latch::validate(next.header, v));
+
+    return true;
+}
+
+bool
+R2BTree::latchCovering(uint8_t *key, uint8_t level, PagePin *pin,
+		       R2WriteLatch *latch, R2PageAccess *ac, ErrorInfo *err)
+{
+    uint32_t idx, v, next_pn, child_pn = 0;
+    uint8_t page_level;
+    bool beyond, lower = false, right;
+
+    if ( ! this->pinPage(pin, ac,
+			 __atomic_load_n(&this->header->rootPageNum,
+					 __ATOMIC_ACQUIRE), err))
+	return false;
+
+    for (;;) {
+	v = R2Latch::readLock(ac->header);
+	page_level = ac->header->level;
+	next_pn = ac->header->nextPageNum;
+	beyond = next_pn != 0
+	    && (ac->header->numKeys == 0
+		|| this->ki->compare(key, ac->keys + (ac->header->numKeys - 1)
+				     * this->header->keySize) > 0);
+	if (page_level > level) {
+	    idx = this->findChildIndex(ac, key);
+	    lower = idx == 0 && this->ki->compare(key, ac->keys) < 0;
+	    child_pn = this->getChildPageNum(ac, idx);
+	}
+	if ( ! R2Latch::validate(ac->header, v))
+	    continue;
+
+	if (page_level < level) {
+	    err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	    err->message.assign("tree is not as high as expected");
+	    return false;
+	}
+
+	if (beyond) {
+	    if ( ! this->keyInNext(next_pn, key, &right, err))
+		return false;
+	    if (right) {
+		if ( ! this->pinPage(pin, ac, next_pn, err))
+		    return false;
+		continue;
+	    }
+	    if ( ! R2Latch::validate(ac->header, v))
+		continue;
+	}
+
+	if (page_level == level)
+	    break;
+
+	// key 0 must stay <= every key under child 0 so the keys
+	// of the node stay sorted
+	if (lower) {
+	    latch->lock(ac->header);
+	    if (this->ki->compare(key, ac->keys) < 0
+		&& this->findChildIndex(ac, key) == 0) {
+		memcpy(ac->keys, key, this->header->keySize);
+		pin->setDirty();
+		latch->setChanged();
+	    }
+	    latch->release();
+	    continue;
+	}
+
+	if ( ! this->pinPage(pin, ac, child_pn, err))
+	    return false;
+    }
+
+    // the page may be split before the latch is taken, move right
+    latch->lock(ac->header);
+    for (;;) {
+	next_pn = ac->header->nextPageNum;
+	if (next_pn == 0
+	    || (ac->header->numKeys > 0
+		&& this->ki->compare(key, ac->keys + (ac->header->numKeys - 1)
+				     * this->header->keySize) <= 0))
+	    break;
+	if ( ! this->keyInNext(next_pn, key, &right, err))
+	    return false;
+	if ( ! right)
+	    break;
+	latch->release();
+	if ( ! this->pinPage(pin, ac, next_pn, err))
+	    return false;
+	latch->lock(ac->header);
+    }
+
+    return true;
+}
+
+bool
+R2BTree::splitRight(PagePin *pin, R2PageAccess *ac, uint8_t *key,
+		    uint8_t *val, uint8_t *sep, uint32_t *newPageNum,
+		    ErrorInfo *err)
+{
+    PagePin new_pin;
+    R2PageAccess right;
+    uint32_t pn = pin->getPageNum();
+    uint32_t right_pn, next_pn, idx;
+
+    uint8_t *buf = this->allocPage(&new_pin, &right_pn, err);
+    if (buf == NULL)
+	return false;
+
+    if (ac->header->pageType == PageTypeLeaf)
+	this->initLeafPage(buf);
+    else
+	this->initNonLeafPage(buf);
+    this->initPageAccess(&right, buf);
+    right.header->level = ac->header->level;
+
+    if ( ! this->splitNode(ac, &right, sep, err)) {
+	new_pin.release();
+	boost::mutex::scoped_lock guard(this->allocLock);
+	this->ps->freePage(right_pn);
+	return false;
+    }
+
+    if (this->ki->compare(key, sep) < 0) {
+	this->findKeyPosition(ac, key, &idx);
+	this->insertAt(ac, idx, key, val);
     }
     else {
-	size_t n1_needs = minNumKeys - n1->header->numKeys;
-	
-	nbytes = n1_needs * this->header->keySize;
-	dst = n1->keys + n1->header->numKeys * this->header->keySize;
-	memmove(dst, n2->keys, nbytes);
-	
-	nbytes = (n2->header->numKeys - n1_needs) * this->header->keySize;
-	src = n2->keys + n1_needs * this->header->keySize;
-	memmove(n2->keys, src, nbytes);
+	this->findKeyPosition(&right, key, &idx);
+	this->insertAt(&right, idx, key, val);
+    }
+
+    // readers can reach the new page once the latch on ac is let go
+    next_pn = right.header->nextPageNum;
+    right.header->prevPageNum = pn;
+    ac->header->nextPageNum = right_pn;
+
+    if (next_pn != 0) {
+	PagePin next_pin;
+	R2PageAccess next;
+	if ( ! this->pinPage(&next_pin, &next, next_pn, err))
+	    return false;
+	R2WriteLatch next_latch;
+	next_latch.lock(next.header);
+	next.header->prevPageNum = right_pn;
+	next_latch.setChanged();
+	next_pin.setDirty();
+    }
+
+    *newPageNum = right_pn;
+    if (pn != this->header->rootPageNum)
+	return true;
+
+    // ac is the root, it can only change while ac is latched
+    PagePin root_pin;
+    uint32_t root_pn;
+    R2PageAccess root;
+    buf = this->allocPage(&root_pin, &root_pn, err);
+    if (buf == NULL)
+	return false;
+    this->initNonLeafPage(buf);
+    this->initPageAccess(&root, buf);
+    root.header->level = ac->header->level + 1;
+    this->insertAt(&root, 0, ac->keys, reinterpret_cast<uint8_t *>(&pn));
+    this->insertAt(&root, 1, sep, reinterpret_cast<uint8_t *>(&right_pn));
+    __atomic_store_n(&this->header->rootPageNum, root_pn, __ATOMIC_RELEASE);
+
+    *newPageNum = 0;
+    return true;
+}
+
+bool
+R2BTree::bulkAppend(std::vector<R2BulkLevel> *levels, uint32_t level,
+		    uint8_t *key, uint8_t *val, uint32_t *target,
+		    ErrorInfo *err)
+{
+    PagePin pin;
+    R2PageAccess ac;
+    uint8_t *buf;
+
+    if (level == levels->size()) {
+	R2BulkLevel lev;
+	buf = pin.alloc(this->ps, &lev.pageNum, err);
+	if (buf == NULL)
+	    return false;
+	if (level == 0)
+	    this->initLeafPage(buf);
+	else
+	    this->initNonLeafPage(buf);
+	lev.prevPageNum = 0;
+	levels->push_back(lev);
+	this->initPageAccess(&ac, buf);
+	ac.header->level = level;
+    }
+    else {
+	if ( ! this->pinPage(&pin, &ac, (*levels)[level].pageNum, err))
+	    return false;
+    }
+
+    uint8_t pt = ac.header->pageType;
+    size_t ks = this->header->keySize;
+    size_t vs = this->header->valSize[pt];
+
+    if (ac.header->numKeys < target[pt]) {
+	memcpy(ac.keys + ac.header->numKeys * ks, key, ks);
+	memcpy(ac.vals + ac.header->numKeys * vs, val, vs);
+	if (ac.slots != NULL) {
+	    ac.slots[ac.header->numKeys] = ac.header->numKeys;
+	    ac.header->numCells++;
+	}
+	ac.header->numKeys++;
+	this->indexNode(&ac);
+	pin.setDirty();
+	return true;
+    }
+
+    // page is done, start a new one
+    uint32_t old_pn = (*levels)[level].pageNum;
+    std::vector<uint8_t> old_first(ac.keys, ac.keys + ks);
+
+    PagePin new_pin;
+    uint32_t new_pn;
+    buf = new_pin.alloc(this->ps, &new_pn, err);
+    if (buf == NULL)
+	return false;
+    if (pt == PageTypeLeaf)
+	this->initLeafPage(buf);
+    else
+	this->initNonLeafPage(buf);
+    ac.header->nextPageNum = new_pn;
+    pin.setDirty();
+    pin.moveFrom(&new_pin);
+    this->initPageAccess(&ac, buf);
+    ac.header->prevPageNum = old_pn;
+    ac.header->level = level;
+
+    memcpy(ac.keys, key, ks);
+    memcpy(ac.vals, val, vs);
+    ac.header->numKeys = 1;
+    this->resetSlots(&ac);
+    pin.release();
+
+    (*levels)[level].prevPageNum = old_pn;
+    (*levels)[level].pageNum = new_pn;
+
+    std::vector<uint8_t> entry;
+    if (level + 1 == levels->size()) {
+	this->childEntry(old_pn, &entry);
+	if ( ! this->bulkAppend(levels, level + 1, &old_first[0], &entry[0],
+				target, err))
+	    return false;
+    }
+
+    this->childEntry(new_pn, &entry);
+    return this->bulkAppend(levels, level + 1, key, &entry[0], target, err);
+}
+
+bool
+R2BTree::bulkFinish(std::vector<R2BulkLevel> *levels, uint32_t *rootPageNum,
+		    ErrorInfo *err)
+{
+    for (uint32_t level = 0; level < levels->size(); level++) {
+	R2BulkLevel *lev = &(*levels)[level];
+	if (lev->prevPageNum == 0)
+	    continue;
+
+	PagePin cur_pin, prev_pin, parent_pin;
+	R2PageAccess cur, prev, parent;
+
+	if ( ! this->pinPage(&cur_pin, &cur, lev->pageNum, err))
+	    return false;
+	uint8_t pt = cur.header->pageType;
+	if (cur.header->numKeys >= this->header->minNumKeys[pt])
+	    continue;
+
+	if ( ! this->pinPage(&prev_pin, &prev, lev->prevPageNum, err))
+	    return false;
+	if ( ! this->pinPage(&parent_pin, &parent, (*levels)[level + 1].pageNum,
+			     err))
+	    return false;
 
-	nbytes = n1_needs * this->header->valSize[pt];
-	dst = n1->vals + n1->header->numKeys * this->header->valSize[pt];
-	memmove(dst, n2->vals, nbytes);
+	cur_pin.setDirty();
+	prev_pin.setDirty();
+	parent_pin.setDirty();
 
-	nbytes = (n2->header->numKeys - n1_needs) * this->header->valSize[pt];
-	src = n2->vals + n1_needs * this->header->valSize[pt];
-	memmove(n2->vals, src, nbytes);
+	// cur is always the last child of the page being filled above
+	uint32_t last = parent.header->numKeys - 1;
+	if (prev.header->numKeys + cur.header->numKeys
+	    >= 2 * this->header->minNumKeys[pt]) {
+	    if ( ! this->redistributeNodes(&prev, &cur, err))
+		return false;
+	    memcpy(parent.keys + last * this->header->keySize,
+		   cur.keys, this->header->keySize);
+	    this->indexNode(&parent);
+	}
+	else {
+	    if ( ! this->concatNodes(&prev, &cur, true, err))
+		return false;
+	    this->removeAt(&parent, last);
+	    cur_pin.release();
+	    this->ps->freePage(lev->pageNum);
+	    lev->pageNum = lev->prevPageNum;
+	}
+    }
 
-	n1->header->numKeys += n1_needs;
-	n2->header->numKeys -= n1_needs;
+    PagePin pin;
+    R2PageAccess ac;
+    uint32_t root_pn = levels->back().pageNum;
+
+    // a non-leaf root with a single child is replaced by the child
+    if ( ! this->pinPage(&pin, &ac, root_pn, err))
+	return false;
+    while (ac.header->pageType == PageTypeNonLeaf && ac.header->numKeys == 1) {
+	uint32_t old_root = root_pn;
+	root_pn = this->getChildPageNum(&ac, 0);
+	pin.release();
+	this->ps->freePage(old_root);
+	if ( ! this->pinPage(&pin, &ac, root_pn, err))
+	    return false;
     }
 
+    *rootPageNum = root_pn;
+
     return true;
 }
 
-/********************************************************/
+void
+R2BTree::indexKey(const uint8_t *key, const uint8_t *val)
+{
+    if (this->hashIndex != NULL)
+	this->hashIndex->insert(key, val);
+    if (this->bloomFilter != NULL)
+	this->bloomFilter->add(key);
+}
 
 bool
-R2BTree::findKeyPosition(R2PageAccess *ac, uint8_t *key, uint32_t *idx)
+R2BTree::indexSubtree(uint32_t pageNum, HashIndex *hash, BloomFilter *bloom,
+		      ErrorInfo *err)
 {
-    size_t n1, n2, n, ks;
-
-    if (ac->header->numKeys == 0) {
-	*idx = 0;
+    PagePin pin;
+    R2PageAccess ac;
+    if ( ! this->pinPage(&pin, &ac, pageNum, err))
 	return false;
-    }
-    else if (ac->header->numKeys == 1) {
-	int c = this->ki->compare(key, ac->keys);
-	if (c < 0) {
-	    *idx = 0;
-	    return false;
-	}
-	else if (c == 0) {
-	    *idx = 0;
-	    return true;
-	}
-	else {
-	    *idx = 1;
-	    return false;
+
+    if (ac.header->pageType == PageTypeNonLeaf) {
+	for (uint32_t i = 0; i < ac.header->numKeys; i++) {
+	    if ( ! this->indexSubtree(this->getChildPageNum(&ac, i), hash,
+				      bloom, err))
+		return false;
 	}
+	return true;
     }
 
-    ks = this->header->keySize;
-    n1 = 0;
-    n2 = ac->header->numKeys - 1;
+    std::vector<uint8_t> key(this->header->keySize);
+    for (uint32_t i = 0; i < ac.header->numKeys; i++) {
+	this->copyKey(&ac, i, &key[0]);
+	if (hash != NULL)
+	    hash->insert(&key[0], this->valAt(&ac, i));
+	if (bloom != NULL)
+	    bloom->add(&key[0]);
+    }
 
-    while (n2 >= n1) {
-	n = n2 - n1;
-	if (n == 1) {
-	    int c1 = this->ki->compare(key, ac->keys + n1 * ks);
+    return true;
+}
 
-	    if (c1 < 0) {
-		*idx = n1;
-		return false;
-	    }
-	    else if (c1 == 0) {
-		*idx = n1;
-		return true;
-	    }
+bool
+R2BTree::computeStats(uint32_t pageNum, uint64_t *m, uint64_t *n,
+		      uint64_t *sum, ErrorInfo *err)
+{
+    PagePin pin;
+    R2PageAccess ac;
+    if ( ! this->pinPage(&pin, &ac, pageNum, err))
+	return false;
 
-	    int c2 = this->ki->compare(key, ac->keys + n2 * ks);
-	    if (c2 < 0) {
-		*idx = n2;
-		return false;
-	    }
-	    else if (c2 == 0) {
-		*idx = n2;
-		return true;
-	    }
-	    else {
-		*idx = n2 + 1;
+    if (ac.header->pageType == PageTypeNonLeaf) {
+	for (uint32_t i = 0; i < ac.header->numKeys; i++) {
+	    uint64_t child_max, child_n, child_sum;
+	    if ( ! this->computeStats(this->getChildPageNum(&ac, i),
+				      &child_max, &child_n, &child_sum, err))
 		return false;
-	    }
-	}
-	else {
-	    size_t m = n1 + n/2;
-	    int c = this->ki->compare(key, ac->keys + m * ks);
-	    if (c < 0) {
-		n2 = m;
-	    }
-	    else if (c == 0) {
-		*idx = m;
-		return true;
-	    }
-	    else {
-		n1 = m;
-	    }
+	    if (this->header->subtreeMax)
+		this->setChildMax(&ac, i, child_max);
+	    if (this->header->subtreeCounts)
+		this->setChildCount(&ac, i, child_n);
+	    if (this->header->subtreeSums)
+		this->setChildSum(&ac, i, child_sum);
 	}
+	pin.setDirty();
     }
+
+    *m = this->header->subtreeMax ? this->pageMax(&ac) : 0;
+    *n = 0;
+    *sum = 0;
+    if (this->header->subtreeCounts)
+	*n = this->pageCount(&ac, sum);
+    return true;
 }
 
 /********************************************************/
@@ -440,8 +3781,7 @@ R2BTree::getData(uint8_t *data_ptr, R2PageAccess *ac, uint32_t idx)
     if (idx >= ac->header->numKeys || data_ptr == NULL)
 	return false;
     size_t sz = this->header->valSize[ ac->header->pageType ];
-    uint8_t *src = ac->vals + idx * sz;
-    memcpy(data_ptr, src, sz);
+    memcpy(data_ptr, this->valAt(ac, idx), sz);
 
     return true;
 }
@@ -451,13 +3791,30 @@ R2BTree::initPageAccess(R2PageAccess *ac, uint8_t *buf)
 {
     ac->header = reinterpret_cast<R2PageHeader *>(buf);
 
+    // an overflow page is all value bytes
+    if (ac->header->pageType == PageTypeOverflow) {
+	ac->slots = NULL;
+	ac->vals = buf + sizeof(R2PageHeader);
+	ac->keys = NULL;
+	return;
+    }
+
     uint32_t n, s;
     
-    n = this->header->maxNumKeys[ ac->header->pageType ];
+    n = this->maxKeys(ac);
     s = this->header->valSize[ ac->header->pageType ];
 
+    ac->slots = NULL;
     ac->vals = buf + sizeof(R2PageHeader);
-    ac->keys = buf + sizeof(R2PageHeader) + n * s;
+    if (ac->header->pageType == PageTypeLeaf
+	&& this->header->leafLayout == R2LeafSlotted) {
+	ac->slots = reinterpret_cast<uint16_t *>(ac->vals);
+	ac->vals += n * sizeof(uint16_t);
+    }
+    ac->keys = ac->vals + n * s + ac->header->prefixLen;
+    if (ac->header->pageType == PageTypeNonLeaf
+	&& this->header->nonLeafLayout == R2LayoutIndexed)
+	ac->keys = buf + r2_index_keys_offset(s, n);
 
     return;
 }
@@ -469,6 +3826,7 @@ R2BTree::initLeafPage(uint8_t *buf)
     memset(buf, 0, this->header->pageSize);
     R2PageHeader *h = reinterpret_cast<R2PageHeader *>(buf);
     h->pageType = PageTypeLeaf;
+    h->generation = this->generation;
     return;
 }
 
@@ -478,16 +3836,55 @@ R2BTree::initNonLeafPage(uint8_t *buf)
     memset(buf, 0, this->header->pageSize);
     R2PageHeader *h = reinterpret_cast<R2PageHeader *>(buf);
     h->pageType = PageTypeNonLeaf;
+    h->generation = this->generation;
     return;
 }
 
 bool
 R2BTree::initIndexHeader(R2IndexHeader *h, R2BTreeParams *p)
 {
+    uint32_t slot_sz = p->leafLayout == R2LeafSlotted ? sizeof(uint16_t) : 0;
+    uint32_t nl_val_sz = r2_non_leaf_val_size(p->subtreeMax,
+					      p->subtreeCounts,
+					      p->subtreeSums);
+    uint32_t min_size = sizeof(R2PageHeader)
+	+ 2 * (p->keySize + p->valSize + slot_sz);
+    uint32_t min_nl_size = sizeof(R2PageHeader)
+	+ 2 * (p->keySize + nl_val_sz) + nl_val_sz;
+    if (min_nl_size > min_size)
+	min_size = min_nl_size;
+
+    h->formatVersion = R2_FORMAT_VERSION;
+    h->rootPageNum = 0;
     h->keySize = p->keySize;
     h->pageSize = p->pageSize;
-    h->valSize[PageTypeNonLeaf] = sizeof(uint32_t);
+    h->valSize[PageTypeNonLeaf] = nl_val_sz;
     h->valSize[PageTypeLeaf] = p->valSize;
+    h->nonLeafLayout = p->nonLeafLayout;
+    h->leafLayout = p->leafLayout;
+    h->varValues = p->varValues ? 1 : 0;
+    h->subtreeMax = p->subtreeMax ? 1 : 0;
+    h->maxOffset = p->maxOffset;
+    h->subtreeCounts = p->subtreeCounts ? 1 : 0;
+    h->subtreeSums = p->subtreeSums ? 1 : 0;
+    h->sumOffset = p->sumOffset;
+
+    if (p->keySize == 0 || p->pageSize < min_size
+	|| p->nonLeafLayout > R2LayoutIndexed
+	|| p->leafLayout > R2LeafSlotted
+	|| (p->varValues && p->valSize < 2 * sizeof(uint32_t))
+	|| (p->subtreeMax
+	    && (p->varValues
+		|| (uint64_t)p->maxOffset + sizeof(uint64_t) > p->valSize))
+	|| (p->subtreeSums
+	    && ( ! p->subtreeCounts || p->varValues
+		|| (uint64_t)p->sumOffset + sizeof(uint64_t) > p->valSize))) {
+	for (int pt = PageTypeNonLeaf; pt <= PageTypeLeaf; pt++) {
+	    h->maxNumKeys[pt] = 0;
+	    h->minNumKeys[pt] = 0;
+	}
+	return false;
+    }
 
     // non - leaf
     uint32_t val_sz = h->valSize[PageTypeNonLeaf];
@@ -497,13 +3894,32 @@ R2BTree::initIndexHeader(R2IndexHeader *h, R2BTreeParams *p)
     // ensure nk is even
     nk = nk & ~(uint32_t)0x01;
 
+    // the search index takes the room of some keys
+    if (h->nonLeafLayout == R2LayoutIndexed) {
+	uint32_t off[R2_INDEX_LEVELS], cap[R2_INDEX_LEVELS], end;
+	while (nk > 2) {
+	    r2_index_levels(h->keySize, val_sz, nk, off, cap, &end);
+	    if (end <= h->pageSize)
+		break;
+	    nk -= 2;
+	}
+	r2_index_levels(h->keySize, val_sz, nk, off, cap, &end);
+	if (end > h->pageSize) {
+	    for (int pt = PageTypeNonLeaf; pt <= PageTypeLeaf; pt++) {
+		h->maxNumKeys[pt] = 0;
+		h->minNumKeys[pt] = 0;
+	    }
+	    return false;
+	}
+    }
+
     h->maxNumKeys[PageTypeNonLeaf] = nk;
     h->minNumKeys[PageTypeNonLeaf] = nk / 2;
 
 
     // leaf
     uint32_t sz_user_data = h->valSize[PageTypeLeaf];
-    per_key = h->keySize + sz_user_data;
+    per_key = h->keySize + sz_user_data + slot_sz;
     uint32_t n_leaf_keys = (h->pageSize - sizeof(R2PageHeader)) / per_key;
 
     // must be even
@@ -512,6 +3928,270 @@ R2BTree::initIndexHeader(R2IndexHeader *h, R2BTreeParams *p)
     h->maxNumKeys[PageTypeLeaf] = n_leaf_keys;
     h->minNumKeys[PageTypeLeaf] = n_leaf_keys / 2;
 
+    if (nk > R2_MAX_KEYS_PER_PAGE || n_leaf_keys > R2_MAX_KEYS_PER_PAGE)
+	return false;
+
+    return true;
+}
+
+/****************************************************/
+/****************************************************/
+/* cursor                                           */
+/****************************************************/
+/****************************************************/
+
+bool
+R2Cursor::seek(uint8_t *key, ErrorInfo *err)
+{
+    uint32_t i, pn;
+
+    this->valid = false;
+    this->pathPages.clear();
+    this->pathIdx.clear();
+    pn = this->snap != NULL
+	? this->snap->rootPageNum : this->tree->header->rootPageNum;
+    if ( ! this->tree->pinPage(&this->pin, &this->ac, pn, err))
+	return false;
+
+    while (this->ac.header->pageType == PageTypeNonLeaf) {
+	i = this->tree->findChildIndex(&this->ac, key);
+	this->pathPages.push_back(pn);
+	this->pathIdx.push_back(i);
+	pn = this->tree->getChildPageNum(&this->ac, i);
+	if ( ! this->tree->pinPage(&this->pin, &this->ac, pn, err))
+	    return false;
+    }
+
+    this->tree->findKeyPosition(&this->ac, key, &this->idx);
+    if (this->idx < this->ac.header->numKeys) {
+	this->valid = true;
+	return true;
+    }
+
+    return this->nextLeaf(true, err);
+}
+
+bool
+R2Cursor::seekFirst(ErrorInfo *err)
+{
+    return this->descend(false, err);
+}
+
+bool
+R2Cursor::seekLast(ErrorInfo *err)
+{
+    return this->descend(true, err);
+}
+
+bool
+R2Cursor::next(ErrorInfo *err)
+{
+    if ( ! this->valid) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("cursor not positioned");
+	return false;
+    }
+
+    if (this->idx + 1 < this->ac.header->numKeys) {
+	this->idx++;
+	return true;
+    }
+
+    return this->nextLeaf(true, err);
+}
+
+bool
+R2Cursor::prev(ErrorInfo *err)
+{
+    if ( ! this->valid) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("cursor not positioned");
+	return false;
+    }
+
+    if (this->idx > 0) {
+	this->idx--;
+	return true;
+    }
+
+    return this->nextLeaf(false, err);
+}
+
+uint32_t
+R2Cursor::fetch(uint32_t n, uint8_t *keys, uint8_t *vals, ErrorInfo *err)
+{
+    size_t ks = this->tree->header->keySize;
+    size_t vs = this->tree->header->valSize[PageTypeLeaf];
+    uint32_t count = 0;
+
+    while (count < n && this->valid) {
+	uint32_t run = this->ac.header->numKeys - this->idx;
+	if (run > n - count)
+	    run = n - count;
+
+	if (keys != NULL && this->ac.header->prefixLen == 0)
+	    memcpy(keys + count * ks, this->ac.keys + this->idx * ks, run * ks);
+	else if (keys != NULL) {
+	    for (uint32_t i = 0; i < run; i++)
+		this->tree->copyKey(&this->ac, this->idx + i,
+				    keys + (count + i) * ks);
+	}
+	if (vals != NULL && this->ac.slots == NULL)
+	    memcpy(vals + count * vs, this->ac.vals + this->idx * vs, run * vs);
+	else if (vals != NULL) {
+	    for (uint32_t i = 0; i < run; i++)
+		this->tree->getData(vals + (count + i) * vs, &this->ac,
+				    this->idx + i);
+	}
+
+	count += run;
+	this->idx += run;
+	if (this->idx == this->ac.header->numKeys)
+	    this->nextLeaf(true, err);
+    }
+
+    return count;
+}
+
+bool
+R2Cursor::getKey(uint8_t *key)
+{
+    if ( ! this->valid || key == NULL)
+	return false;
+
+    this->tree->copyKey(&this->ac, this->idx, key);
+    return true;
+}
+
+bool
+R2Cursor::getVal(uint8_t *val)
+{
+    if ( ! this->valid)
+	return false;
+
+    return this->tree->getData(val, &this->ac, this->idx);
+}
+
+void
+R2Cursor::close()
+{
+    this->pin.release();
+    this->valid = false;
+}
+
+bool
+R2Cursor::descend(bool last, ErrorInfo *err)
+{
+    uint32_t pn;
+
+    this->valid = false;
+    this->pathPages.clear();
+    this->pathIdx.clear();
+    pn = this->snap != NULL
+	? this->snap->rootPageNum : this->tree->header->rootPageNum;
+    if ( ! this->edgeLeaf(pn, last, err))
+	return false;
+
+    if (this->ac.header->numKeys > 0) {
+	this->idx = last ? this->ac.header->numKeys - 1 : 0;
+	this->valid = true;
+	return true;
+    }
+
+    return this->nextLeaf( ! last, err);
+}
+
+bool
+R2Cursor::moveToLeaf(uint32_t pageNum, bool forward, ErrorInfo *err)
+{
+    while (pageNum != 0) {
+	if ( ! this->tree->pinPage(&this->pin, &this->ac, pageNum, err)) {
+	    this->valid = false;
+	    return false;
+	}
+
+	if (this->ac.header->numKeys > 0) {
+	    this->idx = forward ? 0 : this->ac.header->numKeys - 1;
+	    this->valid = true;
+	    return true;
+	}
+
+	if (forward)
+	    pageNum = this->ac.header->nextPageNum;
+	else
+	    pageNum = this->ac.header->prevPageNum;
+    }
+
+    this->pin.release();
+    this->valid = false;
+    err->setErrNum(ErrorInfo::ERR_KEY_NOT_FOUND);
+    err->message.assign("end of index");
+    return false;
+}
+
+bool
+R2Cursor::nextLeaf(bool forward, ErrorInfo *err)
+{
+    if ( ! this->tree->copyOnWrite) {
+	if (forward)
+	    return this->moveToLeaf(this->ac.header->nextPageNum, true, err);
+	return this->moveToLeaf(this->ac.header->prevPageNum, false, err);
+    }
+
+    while ( ! this->pathPages.empty()) {
+	uint32_t i = this->pathIdx.back();
+	if ( ! this->tree->pinPage(&this->pin, &this->ac,
+				   this->pathPages.back(), err)) {
+	    this->valid = false;
+	    return false;
+	}
+
+	if (forward ? i + 1 >= this->ac.header->numKeys : i == 0) {
+	    this->pathPages.pop_back();
+	    this->pathIdx.pop_back();
+	    continue;
+	}
+
+	i = forward ? i + 1 : i - 1;
+	this->pathIdx.back() = i;
+	if ( ! this->edgeLeaf(this->tree->getChildPageNum(&this->ac, i),
+			      ! forward, err)) {
+	    this->valid = false;
+	    return false;
+	}
+
+	// an empty leaf is passed over
+	if (this->ac.header->numKeys > 0) {
+	    this->idx = forward ? 0 : this->ac.header->numKeys - 1;
+	    this->valid = true;
+	    return true;
+	}
+    }
+
+    this->pin.release();
+    this->valid = false;
+    err->setErrNum(ErrorInfo::ERR_KEY_NOT_FOUND);
+    err->message.assign("end of index");
+    return false;
+}
+
+bool
+R2Cursor::edgeLeaf(uint32_t pageNum, bool last, ErrorInfo *err)
+{
+    uint32_t i;
+
+    if ( ! this->tree->pinPage(&this->pin, &this->ac, pageNum, err))
+	return false;
+
+    while (this->ac.header->pageType == PageTypeNonLeaf) {
+	i = last ? this->ac.header->numKeys - 1 : 0;
+	this->pathPages.push_back(pageNum);
+	this->pathIdx.push_back(i);
+	pageNum = this->tree->getChildPageNum(&this->ac, i);
+	if ( ! this->tree->pinPage(&this->pin, &this->ac, pageNum, err))
+	    return false;
+    }
+
     return true;
 }
 
@@ -523,7 +4203,58 @@ R2BTree::initIndexHeader(R2IndexHeader *h, R2BTreeParams *p)
 int
 R2UUIDKey::compare(const uint8_t *a, const uint8_t *b)
 {
-    return 0;
+    return memcmp(a, b, 16);
+}
+
+/****************************************************/
+/****************************************************/
+/* variable length key support                      */
+/****************************************************/
+/****************************************************/
+
+/*
+ * Load 8 bytes as a big endian word, words compare as memcmp does on
+ * the bytes.
+ */
+static inline uint64_t
+r2_load_be64(const uint8_t *p)
+{
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    return be64toh(w);
+}
+
+int
+R2VarKey::compare(const uint8_t *a, const uint8_t *b)
+{
+    uint64_t x = r2_load_be64(a);
+    uint64_t y = r2_load_be64(b);
+    if (x != y)
+	return x < y ? -1 : 1;
+
+    return memcmp(a + R2_NORMALIZED_KEY_SIZE, b + R2_NORMALIZED_KEY_SIZE,
+		  this->keySize - R2_NORMALIZED_KEY_SIZE);
+}
+
+bool
+R2VarKey::makeKey(const uint8_t *str, uint32_t len, uint8_t *key)
+{
+    if (len > this->getMaxLength())
+	return false;
+
+    if (len > 0)
+	memcpy(key, str, len);
+    memset(key + len, 0, this->keySize - len);
+    key[this->keySize - 2] = static_cast<uint8_t>(len >> 8);
+    key[this->keySize - 1] = static_cast<uint8_t>(len);
+
+    return true;
+}
+
+uint32_t
+R2VarKey::getLength(const uint8_t *key)
+{
+    return (key[this->keySize - 2] << 8) | key[this->keySize - 1];
 }
 
 
@@ -0,0 +1,622 @@
+#include <inttypes.h>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+
+#include <boost/thread.hpp>
+
+#include "dback.h"
+#include "wal.h"
+
+namespace dback {
+
+/****************************************************/
+/****************************************************/
+/* helpers                                          */
+/****************************************************/
+/****************************************************/
+
+/**
+ * Table for the reflected CRC-32 polynomial used by zlib.
+ */
+class CRCTable {
+public:
+    uint32_t t[256];
+
+    CRCTable() {
+	for (uint32_t i = 0; i < 256; i++) {
+	    uint32_t c = i;
+	    for (int k = 0; k < 8; k++)
+		c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+	    this->t[i] = c;
+	}
+    };
+};
+
+/**
+ * Continue a CRC-32 over n more bytes, start with crc 0.
+ */
+static uint32_t
+crc32_update(uint32_t crc, const uint8_t *p, size_t n)
+{
+    static const CRCTable table;
+
+    crc = ~crc;
+    while (n-- > 0)
+	crc = table.t[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+/**
+ * Checksum of a group, with the crc field of gh taken as 0.
+ */
+static uint32_t
+group_crc(const WALGroupHeader *gh, const uint8_t *records)
+{
+    WALGroupHeader h = *gh;
+    h.crc = 0;
+    uint32_t crc = crc32_update(0, reinterpret_cast<uint8_t *>(&h), sizeof(h));
+    return crc32_update(crc, records, h.length);
+}
+
+/**
+ * Write all of len bytes at off.
+ */
+static bool
+write_all(int fd, const uint8_t *buf, size_t len, off_t off)
+{
+    while (len > 0) {
+	ssize_t n = pwrite(fd, buf, len, off);
+	if (n <= 0)
+	    return false;
+	buf += n;
+	len -= n;
+	off += n;
+    }
+    return true;
+}
+
+/**
+ * Read the group at off, false if it is missing, short or torn.
+ */
+static bool
+read_group(int fd, off_t off, off_t fileSize, WALGroupHeader *gh,
+	   std::vector<uint8_t> *records)
+{
+    if (off + (off_t)sizeof(*gh) > fileSize)
+	return false;
+    if (pread(fd, gh, sizeof(*gh), off) != (ssize_t)sizeof(*gh))
+	return false;
+    if (gh->magic != WriteAheadLog::GROUP_MAGIC)
+	return false;
+    if (off + (off_t)sizeof(*gh) + gh->length > fileSize)
+	return false;
+
+    records->resize(gh->length);
+    if (gh->length > 0
+	&& pread(fd, &(*records)[0], gh->length, off + sizeof(*gh))
+	   != (ssize_t)gh->length)
+	return false;
+
+    const uint8_t *r = records->empty() ? NULL : &(*records)[0];
+    return group_crc(gh, r) == gh->crc;
+}
+
+/**
+ * Create path holding only a file header and sync it.
+ *
+ * @result The open file, or -1 on failure.
+ */
+static int
+create_log(const char *path, uint64_t baseLsn)
+{
+    int f = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (f < 0)
+	return -1;
+
+    WALFileHeader fh;
+    fh.magic = WriteAheadLog::MAGIC;
+    fh.version = 1;
+    fh.baseLsn = baseLsn;
+    if ( ! write_all(f, reinterpret_cast<uint8_t *>(&fh), sizeof(fh), 0)
+	|| fdatasync(f) != 0) {
+	::close(f);
+	return -1;
+    }
+
+    return f;
+}
+
+/**
+ * Sync the directory holding path, so a rename in it is durable.
+ */
+static bool
+sync_dir(const std::string &path)
+{
+    std::string dir(".");
+    size_t slash = path.rfind('/');
+    if (slash == 0)
+	dir.assign("/");
+    else if (slash != std::string::npos)
+	dir.assign(path, 0, slash);
+
+    int f = ::open(dir.c_str(), O_RDONLY);
+    if (f < 0)
+	return false;
+    bool ok = fsync(f) == 0;
+    ::close(f);
+    return ok;
+}
+
+/****************************************************/
+/****************************************************/
+/* log groups                                       */
+/****************************************************/
+/****************************************************/
+void
+WALGroup::add(uint32_t type, uint32_t pageNum, const uint8_t *data,
+	      uint32_t len)
+{
+    WALRecordHeader rh;
+    rh.type = type;
+    rh.pageNum = pageNum;
+    rh.length = len;
+
+    const uint8_t *p = reinterpret_cast<uint8_t *>(&rh);
+    this->buf.insert(this->buf.end(), p, p + sizeof(rh));
+    if (len > 0)
+	this->buf.insert(this->buf.end(), data, data + len);
+    this->numRecords++;
+}
+
+void
+WALGroup::clear()
+{
+    this->buf.clear();
+    this->numRecords = 0;
+}
+
+/****************************************************/
+/****************************************************/
+/* write-ahead log                                  */
+/****************************************************/
+/****************************************************/
+WriteAheadLog::WriteAheadLog()
+    : fd(-1),
+      baseLsn(0),
+      appendLsn(0),
+      durableLsn(0),
+      flushing(false),
+      failed(false),
+      flusher(NULL),
+      flusherRun(false),
+      flushInterval(0),
+      nCommits(0),
+      nSyncs(0),
+      nGroups(0)
+{
+    ;
+}
+
+WriteAheadLog::~WriteAheadLog()
+{
+    ErrorInfo err;
+    this->close(&err);
+}
+
+bool
+WriteAheadLog::open(const char *p, ErrorInfo *err)
+{
+    boost::mutex::scoped_lock guard(this->lock);
+
+    if (this->fd >= 0) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("already open");
+	return false;
+    }
+
+    int f = ::open(p, O_RDWR | O_CREAT, 0644);
+    if (f < 0) {
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("unable to open log file");
+	return false;
+    }
+
+    struct stat st;
+    if (fstat(f, &st) != 0) {
+	::close(f);
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("unable to stat log file");
+	return false;
+    }
+
+    if (st.st_size == 0) {
+	::close(f);
+	f = create_log(p, 0);
+	if (f < 0) {
+	    err->setErrNum(ErrorInfo::ERR_IO);
+	    err->message.assign("unable to create log file");
+	    return false;
+	}
+	st.st_size = sizeof(WALFileHeader);
+    }
+
+    WALFileHeader fh;
+    if (pread(f, &fh, sizeof(fh), 0) != (ssize_t)sizeof(fh)
+	|| fh.magic != MAGIC || fh.version != 1) {
+	::close(f);
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("not a log file");
+	return false;
+    }
+
+    // find the end of the last whole group
+    off_t off = sizeof(fh);
+    WALGroupHeader gh;
+    std::vector<uint8_t> records;
+    while (read_group(f, off, st.st_size, &gh, &records))
+	off += sizeof(gh) + gh.length;
+
+    if (off < st.st_size
+	&& (ftruncate(f, off) != 0 || fdatasync(f) != 0)) {
+	::close(f);
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("unable to truncate torn log");
+	return false;
+    }
+
+    this->path.assign(p);
+    this->fd = f;
+    this->baseLsn = fh.baseLsn;
+    this->appendLsn = fh.baseLsn + (off - sizeof(fh));
+    this->durableLsn = this->appendLsn;
+    this->pending.clear();
+    this->failed = false;
+
+    return true;
+}
+
+bool
+WriteAheadLog::close(ErrorInfo *err)
+{
+    this->stopFlusher();
+
+    boost::mutex::scoped_lock guard(this->lock);
+
+    if (this->fd < 0)
+	return true;
+
+    while (this->flushing)
+	this->flushDone.wait(guard);
+
+    bool ok = true;
+    if ( ! this->pending.empty())
+	ok = this->writePending(&guard, err);
+
+    while (this->flushing)
+	this->flushDone.wait(guard);
+
+    ::close(this->fd);
+    this->fd = -1;
+    this->pending.clear();
+
+    return ok;
+}
+
+bool
+WriteAheadLog::append(WALGroup *g, uint64_t *lsn, ErrorInfo *err)
+{
+    WALGroupHeader gh;
+    gh.magic = GROUP_MAGIC;
+    gh.length = g->getLength();
+    gh.numRecords = g->getNumRecords();
+    gh.crc = 0;
+
+    if (gh.length != g->getLength()) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("log group too large");
+	return false;
+    }
+
+    if (gh.numRecords > 0)
+	gh.crc = group_crc(&gh, g->getBuf());
+
+    boost::mutex::scoped_lock guard(this->lock);
+
+    if (this->fd < 0) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("log not open");
+	return false;
+    }
+
+    if (gh.numRecords > 0) {
+	const uint8_t *p = reinterpret_cast<uint8_t *>(&gh);
+	this->pending.insert(this->pending.end(), p, p + sizeof(gh));
+	this->pending.insert(this->pending.end(), g->getBuf(),
+			     g->getBuf() + gh.length);
+	this->appendLsn += sizeof(gh) + gh.length;
+	this->nGroups++;
+    }
+
+    *lsn = this->appendLsn;
+    return true;
+}
+
+bool
+WriteAheadLog::commit(uint64_t lsn, ErrorInfo *err)
+{
+    boost::mutex::scoped_lock guard(this->lock);
+
+    this->nCommits++;
+
+    if (lsn > this->appendLsn) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("lsn past end of log");
+	return false;
+    }
+
+    while (this->durableLsn < lsn) {
+	if (this->failed) {
+	    err->setErrNum(ErrorInfo::ERR_IO);
+	    err->message.assign("log write failed");
+	    return false;
+	}
+
+	// somebody else is writing, what they write may cover lsn
+	if (this->flushing) {
+	    this->flushDone.wait(guard);
+	    continue;
+	}
+
+	if ( ! this->writePending(&guard, err))
+	    return false;
+    }
+
+    return true;
+}
+
+bool
+WriteAheadLog::startFlusher(uint32_t intervalMs, ErrorInfo *err)
+{
+    boost::mutex::scoped_lock guard(this->lock);
+
+    if (this->fd < 0 || this->flusher != NULL || intervalMs == 0) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("unable to start flusher");
+	return false;
+    }
+
+    this->flushInterval = intervalMs;
+    this->flusherRun = true;
+    this->flusher = new boost::thread(&WriteAheadLog::flusherMain, this);
+
+    return true;
+}
+
+void
+WriteAheadLog::stopFlusher()
+{
+    boost::thread *t;
+    {
+	boost::mutex::scoped_lock guard(this->lock);
+	if (this->flusher == NULL)
+	    return;
+	t = this->flusher;
+	this->flusher = NULL;
+	this->flusherRun = false;
+	this->flusherWake.notify_all();
+    }
+
+    t->join();
+    delete t;
+}
+
+bool
+WriteAheadLog::replay(WALReplayer *r, ErrorInfo *err)
+{
+    boost::mutex::scoped_lock guard(this->lock);
+
+    if (this->fd < 0) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("log not open");
+	return false;
+    }
+
+    off_t end = sizeof(WALFileHeader) + (this->durableLsn - this->baseLsn);
+    off_t off = sizeof(WALFileHeader);
+    WALGroupHeader gh;
+    std::vector<uint8_t> records;
+
+    while (off < end) {
+	if ( ! read_group(this->fd, off, end, &gh, &records)) {
+	    err->setErrNum(ErrorInfo::ERR_IO);
+	    err->message.assign("unable to read log");
+	    return false;
+	}
+
+	uint64_t lsn = this->baseLsn + (off - sizeof(WALFileHeader))
+	    + sizeof(gh);
+	size_t pos = 0;
+	for (uint32_t i = 0; i < gh.numRecords; i++) {
+	    WALRecordHeader rh;
+	    if (pos + sizeof(rh) > records.size()) {
+		err->setErrNum(ErrorInfo::ERR_IO);
+		err->message.assign("corrupt log group");
+		return false;
+	    }
+	    memcpy(&rh, &records[pos], sizeof(rh));
+	    pos += sizeof(rh);
+	    if (pos + rh.length > records.size()) {
+		err->setErrNum(ErrorInfo::ERR_IO);
+		err->message.assign("corrupt log group");
+		return false;
+	    }
+
+	    const uint8_t *data = rh.length > 0 ? &records[pos] : NULL;
+	    pos += rh.length;
+	    if ( ! r->redo(lsn + pos, rh.type, rh.pageNum, data, rh.length,
+			   err))
+		return false;
+	}
+
+	off += sizeof(gh) + gh.length;
+    }
+
+    return true;
+}
+
+bool
+WriteAheadLog::checkpoint(ErrorInfo *err)
+{
+    boost::mutex::scoped_lock guard(this->lock);
+
+    if (this->fd < 0) {
+	err->setErrNum(ErrorInfo::ERR_BAD_ARG);
+	err->message.assign("log not open");
+	return false;
+    }
+
+    while (this->flushing)
+	this->flushDone.wait(guard);
+
+    if ( ! this->pending.empty() && ! this->writePending(&guard, err))
+	return false;
+
+    while (this->flushing)
+	this->flushDone.wait(guard);
+
+    // the new log is built aside and renamed over the old one, so a
+    // crash leaves one or the other and LSNs never go back
+    std::string tmp = this->path + ".tmp";
+    int f = create_log(tmp.c_str(), this->appendLsn);
+    if (f < 0) {
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("unable to create log file");
+	return false;
+    }
+
+    if (rename(tmp.c_str(), this->path.c_str()) != 0
+	|| ! sync_dir(this->path)) {
+	::close(f);
+	unlink(tmp.c_str());
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("unable to replace log file");
+	return false;
+    }
+
+    ::close(this->fd);
+    this->fd = f;
+    this->baseLsn = this->appendLsn;
+    this->durableLsn = this->appendLsn;
+
+    return true;
+}
+
+uint64_t
+WriteAheadLog::getAppendLsn()
+{
+    boost::mutex::scoped_lock guard(this->lock);
+    return this->appendLsn;
+}
+
+uint64_t
+WriteAheadLog::getDurableLsn()
+{
+    boost::mutex::scoped_lock guard(this->lock);
+    return this->durableLsn;
+}
+
+uint64_t
+WriteAheadLog::getNumCommits()
+{
+    boost::mutex::scoped_lock guard(this->lock);
+    return this->nCommits;
+}
+
+uint64_t
+WriteAheadLog::getNumSyncs()
+{
+    boost::mutex::scoped_lock guard(this->lock);
+    return this->nSyncs;
+}
+
+uint64_t
+WriteAheadLog::getNumGroups()
+{
+    boost::mutex::scoped_lock guard(this->lock);
+    return this->nGroups;
+}
+
+void
+WriteAheadLog::resetStats()
+{
+    boost::mutex::scoped_lock guard(this->lock);
+
+    this->nCommits = 0;
+    this->nSyncs = 0;
+    this->nGroups = 0;
+}
+
+bool
+WriteAheadLog::writePending(boost::mutex::scoped_lock *guard, ErrorInfo *err)
+{
+    std::vector<uint8_t> buf;
+    buf.swap(this->pending);
+    uint64_t end = this->appendLsn;
+    off_t off = sizeof(WALFileHeader) + (this->durableLsn - this->baseLsn);
+    int f = this->fd;
+    this->flushing = true;
+
+    guard->unlock();
+
+    bool ok = true;
+    if ( ! buf.empty())
+	ok = write_all(f, &buf[0], buf.size(), off);
+    if (ok)
+	ok = fdatasync(f) == 0;
+
+    guard->lock();
+
+    this->flushing = false;
+    if (ok) {
+	this->durableLsn = end;
+	this->nSyncs++;
+    }
+    else {
+	this->failed = true;
+    }
+    this->flushDone.notify_all();
+
+    if ( ! ok) {
+	err->setErrNum(ErrorInfo::ERR_IO);
+	err->message.assign("log write failed");
+	return false;
+    }
+
+    return true;
+}
+
+void
+WriteAheadLog::flusherMain()
+{
+    boost::mutex::scoped_lock guard(this->lock);
+
+    while (this->flusherRun) {
+	this->flusherWake.timed_wait(guard,
+	    boost::posix_time::milliseconds(this->flushInterval));
+
+	if ( ! this->flushing && ! this->failed && ! this->pending.empty()) {
+	    ErrorInfo err;
+	    this->writePending(&guard, &err);
+	}
+    }
+}
+
+}